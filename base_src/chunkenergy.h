@@ -109,6 +109,8 @@ struct Oxs_ComputeEnergyDataThreadedAux {
 // allow multiple threads to run concurrently, with each thread
 // claiming a separate cell range.
 class Oxs_ComputeEnergiesChunkThread; // Thread helper class; 
+class YY_2LatComputeEnergiesFusedThread; // Two-lattice helper class
+class YY_2LatChunkPostProcess;
 class Oxs_ChunkEnergy:public Oxs_Energy {
   friend void Oxs_ComputeEnergies(const Oxs_SimState&,
                                   Oxs_ComputeEnergyData&,
@@ -122,7 +124,9 @@ class Oxs_ChunkEnergy:public Oxs_Energy {
                                   Oxs_ComputeEnergyData&,
                                   Oxs_ComputeEnergyData&,
                                   const vector<Oxs_Energy*>&,
-                                  Oxs_ComputeEnergyExtraData& oceed);
+                                  Oxs_ComputeEnergyExtraData& oceed,
+                                  YY_2LatChunkPostProcess* postproc);
+  friend class YY_2LatComputeEnergiesFusedThread;
 
 private:
   // Expressly disable default constructor, copy constructor and
@@ -1177,6 +1177,8 @@ void Oxs_Driver::Run(vector<OxsRunEvent>& results,
           nstate.Tc = cstate.Tc;
           nstate.m_e = cstate.m_e;
           nstate.chi_l = cstate.chi_l;
+          nstate.T_update_count = cstate.T_update_count;
+          nstate.T_changed = cstate.T_changed;
         }
 #if REPORT_TIME
         driversteptime.Start();
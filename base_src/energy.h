@@ -126,6 +126,7 @@ public:
 
 
 ////////////////////////////////////////////////////////////////////////
+class YY_2LatChunkPostProcess; // Defined in yy_2lat_util.h
 class Oxs_Energy:public Oxs_Ext {
   friend void Oxs_ComputeEnergies(const Oxs_SimState&,
                                   Oxs_ComputeEnergyData&,
@@ -139,7 +140,8 @@ class Oxs_Energy:public Oxs_Ext {
                                   Oxs_ComputeEnergyData&,
                                   Oxs_ComputeEnergyData&,
                                   const vector<Oxs_Energy*>&,
-                                  Oxs_ComputeEnergyExtraData& oceed);
+                                  Oxs_ComputeEnergyExtraData& oceed,
+                                  YY_2LatChunkPostProcess* postproc);
 private:
   // Track count of number of times GetEnergy() has been
   // called in current problem run.
@@ -412,11 +414,13 @@ void Oxs_ComputeEnergies(const Oxs_SimState& state,
                          const vector<Oxs_Energy*>& energies,
                          Oxs_ComputeEnergyExtraData& oceed);
 
-// Added for 2-lattice simulation
+// Added for 2-lattice simulation.  See yy_2lat_util.h for details,
+// including the optional post-processing hook.
 void YY_2LatComputeEnergies(const Oxs_SimState&,
                             Oxs_ComputeEnergyData&,
                             Oxs_ComputeEnergyData&,
                             const vector<Oxs_Energy*>&,
-                            Oxs_ComputeEnergyExtraData& oceed);
+                            Oxs_ComputeEnergyExtraData& oceed,
+                            YY_2LatChunkPostProcess* postproc = 0);
 
 #endif // _OXS_ENERGY
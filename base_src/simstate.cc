@@ -24,6 +24,7 @@ Oxs_SimState::Oxs_SimState()
     mesh(NULL),Ms(NULL),Ms_inverse(NULL),
     Ms0(NULL),Ms0_inverse(NULL),
     T(NULL),Tc(NULL),m_e(NULL),chi_l(NULL),
+    T_update_count(NULL),T_changed(NULL),
     lattice_type(TOTAL), total_lattice(NULL),
     lattice1(NULL), lattice2(NULL),
     stage_done(UNKNOWN), run_done(UNKNOWN)
@@ -63,6 +64,8 @@ void Oxs_SimState::Reset()
   Tc=NULL;
   m_e=NULL;
   chi_l=NULL;
+  T_update_count=NULL;
+  T_changed=NULL;
   lattice_type=TOTAL;
   total_lattice=NULL;
   lattice1=NULL;
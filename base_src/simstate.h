@@ -96,6 +96,14 @@ public:
   mutable Oxs_MeshValue<OC_REAL8m> const* m_e;
   mutable Oxs_MeshValue<OC_REAL8m> const* chi_l;
 
+  // Optional log of temperature updates, kept by evolvers that change
+  // T within a stage.  *T_update_count increments at every update that
+  // changes T, and *T_changed lists the cells changed by the latest
+  // update, or is empty if that update rewrote all of T.  NULL if no
+  // log is kept.
+  mutable OC_UINT4m const* T_update_count;
+  mutable vector<OC_INDEX> const* T_changed;
+
   // For 2 lattice simulation, pointer to the other sublattice
   enum LatticeType { TOTAL, LATTICE1, LATTICE2 } lattice_type;
   // Default: TOTAL for standard simulations
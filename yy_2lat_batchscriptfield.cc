@@ -0,0 +1,228 @@
+/** FILE: yy_2lat_batchscriptfield.cc                 -*-Mode: c++-*-
+ *
+ * Tcl script scalar and vector fields that evaluate many cells per
+ * script call.
+ *
+ * Copyright (C) 2015 Yu Yahagi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string>
+#include <vector>
+
+#include "nb.h"
+#include "director.h"
+#include "mesh.h"
+#include "meshvalue.h"
+
+#include "yy_2lat_batchscriptfield.h"
+
+// Oxs_Ext registration support
+OXS_EXT_REGISTER(YY_2LatBatchScriptScalarField);
+OXS_EXT_REGISTER(YY_2LatBatchScriptVectorField);
+
+/* End includes */
+
+void YY_2LatBatchScript::Setup(Oxs_Ext* owner,int values_per_point_,
+                               const Oxs_Atlas* atlas)
+{
+  values_per_point = values_per_point_;
+
+  OC_INT4m bsize = owner->GetIntInitValue("batch_size",4096);
+  if(bsize<1) {
+    char buf[1024];
+    Oc_Snprintf(buf,sizeof(buf),
+                "Invalid batch_size value %ld; should be >=1.",
+                static_cast<long>(bsize));
+    throw Oxs_ExtError(owner,buf);
+  }
+  batch_size = bsize;
+
+  has_atlas = 0;
+  if(atlas != NULL) {
+    Oxs_Box bbox;
+    atlas->GetWorldExtents(bbox);
+    basept.Set(bbox.GetMinX(),bbox.GetMinY(),bbox.GetMinZ());
+    ThreeVector span(bbox.GetMaxX()-bbox.GetMinX(),
+                     bbox.GetMaxY()-bbox.GetMinY(),
+                     bbox.GetMaxZ()-bbox.GetMinZ());
+    scale.Set((span.x>0.0 ? 1.0/span.x : 1.0),
+              (span.y>0.0 ? 1.0/span.y : 1.0),
+              (span.z>0.0 ? 1.0/span.z : 1.0));
+    has_atlas = 1;
+  }
+
+  command_options.push_back(Nb_TclCommandLineOption("rawpt",3));
+  command_options.push_back(Nb_TclCommandLineOption("relpt",3));
+  String cmdoptreq = owner->GetStringInitValue("script_args","rawpt");
+  cmd.SetBaseCommand(owner->InstanceName(),
+                     owner->director->GetMifInterp(),
+                     owner->GetStringInitValue("script"),
+                     Nb_ParseTclCommandLineRequest(owner->InstanceName(),
+                                                   command_options,
+                                                   cmdoptreq));
+  if(command_options[1].position>=0 && !has_atlas) {
+    throw Oxs_ExtError(owner,"script_args relpt requires an atlas.");
+  }
+}
+
+static void YY_2LatBatchAppend(String& buf,OC_REAL8m val)
+{
+  char item[32];
+  Oc_Snprintf(item,sizeof(item),"%.17g ",static_cast<double>(val));
+  buf += item;
+}
+
+void YY_2LatBatchScript::Eval(const Oxs_Ext* owner,
+                              const vector<ThreeVector>& pts,
+                              vector<OC_REAL8m>& results) const
+{
+  const size_t count = pts.size();
+  for(int iopt=0;iopt<2;++iopt) {
+    const OC_INDEX index = command_options[iopt].position;
+    if(index<0) continue;
+    xbuf.erase(); ybuf.erase(); zbuf.erase();
+    xbuf.reserve(24*count); ybuf.reserve(24*count); zbuf.reserve(24*count);
+    for(size_t i=0;i<count;++i) {
+      ThreeVector pt = pts[i];
+      if(iopt==1) { // relpt
+        pt -= basept;
+        pt.x *= scale.x;  pt.y *= scale.y;  pt.z *= scale.z;
+      }
+      YY_2LatBatchAppend(xbuf,pt.x);
+      YY_2LatBatchAppend(ybuf,pt.y);
+      YY_2LatBatchAppend(zbuf,pt.z);
+    }
+    cmd.SetCommandArg(index,xbuf);
+    cmd.SetCommandArg(index+1,ybuf);
+    cmd.SetCommandArg(index+2,zbuf);
+  }
+
+  vector<String> strvals;
+  cmd.SaveInterpResult();
+  cmd.Eval();
+  cmd.GetResultList(strvals);
+  cmd.RestoreInterpResult();
+
+  const size_t expected = count*values_per_point;
+  if(strvals.size()!=expected) {
+    char buf[1024];
+    Oc_Snprintf(buf,sizeof(buf),
+                "Script returned %lu values for %lu points;"
+                " expected %lu.",
+                static_cast<unsigned long>(strvals.size()),
+                static_cast<unsigned long>(count),
+                static_cast<unsigned long>(expected));
+    throw Oxs_ExtError(owner,buf);
+  }
+  results.resize(expected);
+  for(size_t i=0;i<expected;++i) {
+    OC_BOOL err;
+    results[i] = Nb_Atof(strvals[i].c_str(),err);
+    if(err) {
+      char buf[1024];
+      Oc_Snprintf(buf,sizeof(buf),
+                  "Script return value %lu is not a number: %.500s",
+                  static_cast<unsigned long>(i),strvals[i].c_str());
+      throw Oxs_ExtError(owner,buf);
+    }
+  }
+}
+
+// Scalar field
+YY_2LatBatchScriptScalarField::YY_2LatBatchScriptScalarField(
+  const char* name,     // Child instance id
+  Oxs_Director* newdtr, // App director
+  const char* argstr)   // MIF input block parameters
+  : Oxs_ScalarField(name,newdtr,argstr)
+{
+  multiplier = GetRealInitValue("multiplier",1.0);
+  if(HasInitValue("atlas")) {
+    OXS_GET_INIT_EXT_OBJECT("atlas",Oxs_Atlas,atlas);
+  }
+  script.Setup(this,1,atlas.GetPtr());
+  VerifyAllInitArgsUsed();
+}
+
+OC_REAL8m
+YY_2LatBatchScriptScalarField::Value(const ThreeVector& pt) const
+{
+  pts.assign(1,pt);
+  script.Eval(this,pts,vals);
+  return multiplier*vals[0];
+}
+
+void
+YY_2LatBatchScriptScalarField::FillMeshValue
+(const Oxs_Mesh* mesh,
+ Oxs_MeshValue<OC_REAL8m>& array) const
+{
+  array.AdjustSize(mesh);
+  const OC_INDEX size = mesh->Size();
+  const OC_INDEX bsize = script.BatchSize();
+  for(OC_INDEX start=0;start<size;start+=bsize) {
+    const OC_INDEX stop = (size-start>bsize ? start+bsize : size);
+    pts.resize(stop-start);
+    for(OC_INDEX i=start;i<stop;++i) mesh->Center(i,pts[i-start]);
+    script.Eval(this,pts,vals);
+    for(OC_INDEX i=start;i<stop;++i) array[i] = multiplier*vals[i-start];
+  }
+}
+
+// Vector field
+YY_2LatBatchScriptVectorField::YY_2LatBatchScriptVectorField(
+  const char* name,     // Child instance id
+  Oxs_Director* newdtr, // App director
+  const char* argstr)   // MIF input block parameters
+  : Oxs_VectorField(name,newdtr,argstr)
+{
+  multiplier = GetRealInitValue("multiplier",1.0);
+  if(HasInitValue("atlas")) {
+    OXS_GET_INIT_EXT_OBJECT("atlas",Oxs_Atlas,atlas);
+  }
+  script.Setup(this,3,atlas.GetPtr());
+  VerifyAllInitArgsUsed();
+}
+
+void
+YY_2LatBatchScriptVectorField::Value
+(const ThreeVector& pt,
+ ThreeVector& value) const
+{
+  pts.assign(1,pt);
+  script.Eval(this,pts,vals);
+  value.Set(multiplier*vals[0],multiplier*vals[1],multiplier*vals[2]);
+}
+
+void
+YY_2LatBatchScriptVectorField::FillMeshValue
+(const Oxs_Mesh* mesh,
+ Oxs_MeshValue<ThreeVector>& array) const
+{
+  array.AdjustSize(mesh);
+  const OC_INDEX size = mesh->Size();
+  const OC_INDEX bsize = script.BatchSize();
+  for(OC_INDEX start=0;start<size;start+=bsize) {
+    const OC_INDEX stop = (size-start>bsize ? start+bsize : size);
+    pts.resize(stop-start);
+    for(OC_INDEX i=start;i<stop;++i) mesh->Center(i,pts[i-start]);
+    script.Eval(this,pts,vals);
+    for(OC_INDEX i=start;i<stop;++i) {
+      const OC_REAL8m* v = &(vals[3*(i-start)]);
+      array[i].Set(multiplier*v[0],multiplier*v[1],multiplier*v[2]);
+    }
+  }
+}
@@ -0,0 +1,113 @@
+/** FILE: yy_2lat_batchscriptfield.h                 -*-Mode: c++-*-
+ *
+ * Tcl script scalar and vector fields that evaluate many cells per
+ * script call.
+ *
+ * Copyright (C) 2015 Yu Yahagi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _YY_2LAT_BATCHSCRIPTFIELD
+#define _YY_2LAT_BATCHSCRIPTFIELD
+
+#include <vector>
+
+#include "nb.h"
+#include "atlas.h"
+#include "scalarfield.h"
+#include "vectorfield.h"
+#include "tclcommand.h"
+#include "threevector.h"
+
+OC_USE_STD_NAMESPACE;
+OC_USE_STRING;
+
+/* End includes */
+
+class YY_2LatBatchScript {
+  // Script call machinery shared by the batch script fields.  The
+  // script is called with one Tcl list per coordinate, e.g.
+  //   script {x0 x1 ...} {y0 y1 ...} {z0 z1 ...}
+  // for script_args rawpt, and must return values_per_point numbers per
+  // point, as one flat list.  With relpt the coordinates are scaled to
+  // [0,1] across the atlas world extents.  Not thread safe: as with any
+  // Tcl field, call only from the main thread.
+public:
+  YY_2LatBatchScript() : values_per_point(1), batch_size(4096),
+                         has_atlas(0) {}
+  void Setup(Oxs_Ext* owner,int values_per_point_,
+             const Oxs_Atlas* atlas);
+  /// Reads the script, script_args and batch_size init values of
+  /// owner.  atlas, if non-NULL, sets the relpt scaling; the owner
+  /// reads it from its atlas init value.
+  OC_INDEX BatchSize() const { return batch_size; }
+  void Eval(const Oxs_Ext* owner,
+            const vector<ThreeVector>& pts,
+            vector<OC_REAL8m>& results) const;
+  /// Fills results with values_per_point*pts.size() values.
+private:
+  int values_per_point;
+  OC_INDEX batch_size;
+  mutable Nb_TclCommand cmd;
+  vector<Nb_TclCommandLineOption> command_options;
+  OC_BOOL has_atlas;
+  ThreeVector basept, scale; // relpt = (rawpt - basept)*scale
+  mutable String xbuf, ybuf, zbuf;
+};
+
+class YY_2LatBatchScriptScalarField : public Oxs_ScalarField {
+private:
+  Oxs_OwnedPointer<Oxs_Atlas> atlas;
+  YY_2LatBatchScript script;
+  OC_REAL8m multiplier;
+  mutable vector<ThreeVector> pts;
+  mutable vector<OC_REAL8m> vals;
+public:
+  virtual const char* ClassName() const; // ClassName() is
+  /// automatically generated by the OXS_EXT_REGISTER macro.
+  YY_2LatBatchScriptScalarField(const char* name,     // Child instance id
+                                Oxs_Director* newdtr, // App director
+                                const char* argstr);  // MIF block
+  virtual ~YY_2LatBatchScriptScalarField() {}
+
+  virtual OC_REAL8m Value(const ThreeVector& pt) const;
+  virtual void FillMeshValue(const Oxs_Mesh* mesh,
+                             Oxs_MeshValue<OC_REAL8m>& array) const;
+  // One script call per batch_size cells.
+};
+
+class YY_2LatBatchScriptVectorField : public Oxs_VectorField {
+private:
+  Oxs_OwnedPointer<Oxs_Atlas> atlas;
+  YY_2LatBatchScript script;
+  OC_REAL8m multiplier;
+  mutable vector<ThreeVector> pts;
+  mutable vector<OC_REAL8m> vals;
+public:
+  virtual const char* ClassName() const; // ClassName() is
+  /// automatically generated by the OXS_EXT_REGISTER macro.
+  YY_2LatBatchScriptVectorField(const char* name,     // Child instance id
+                                Oxs_Director* newdtr, // App director
+                                const char* argstr);  // MIF block
+  virtual ~YY_2LatBatchScriptVectorField() {}
+
+  virtual void Value(const ThreeVector& pt,ThreeVector& value) const;
+  virtual void FillMeshValue(const Oxs_Mesh* mesh,
+                             Oxs_MeshValue<ThreeVector>& array) const;
+  // One script call per batch_size cells.
+};
+
+#endif // _YY_2LAT_BATCHSCRIPTFIELD
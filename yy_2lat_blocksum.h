@@ -0,0 +1,106 @@
+/** FILE: yy_2lat_blocksum.h                 -*-Mode: c++-*-
+ *
+ * Blocked, compensated accumulator for per-cell reductions.
+ *
+ * Copyright (C) 2015 Yu Yahagi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _YY_2LAT_BLOCKSUM
+#define _YY_2LAT_BLOCKSUM
+
+#include "oc.h"
+
+/* End includes */
+
+#define YY_2LAT_BLOCKSUM_LANES 4
+#define YY_2LAT_BLOCKSUM_SIZE  32  // Multiple of YY_2LAT_BLOCKSUM_LANES
+
+class YY_2LatBlockSum {
+  // Drop-in replacement for Nb_Xpfloat in loops that add one term per
+  // cell.  Add() only stores the term into a short buffer, so the cell
+  // loop carries no floating point dependency.  Each full buffer is
+  // folded into YY_2LAT_BLOCKSUM_LANES independent running sums, each
+  // with its own error term (Knuth's branch-free TwoSum).  The lanes
+  // are independent, so the fold vectorizes, and since every term is
+  // compensated the result is as accurate as per-term Nb_Xpfloat
+  // accumulation.
+  //   The compensation relies on strict IEEE evaluation order; it is
+  // lost (but the sum is otherwise unharmed) under -ffast-math style
+  // reassociation.
+public:
+  YY_2LatBlockSum() { Reset(); }
+
+  void Reset() {
+    fill = 0;
+    for(int l=0;l<YY_2LAT_BLOCKSUM_LANES;++l) { sum[l] = corr[l] = 0.0; }
+  }
+
+  void Add(OC_REAL8m x) {
+    buf[fill] = x;
+    if(++fill == YY_2LAT_BLOCKSUM_SIZE) Flush();
+  }
+  YY_2LatBlockSum& operator+=(OC_REAL8m x) { Add(x); return *this; }
+
+  OC_REAL8m GetValue() const {
+    // Folds the partial buffer and the lanes without disturbing *this.
+    OC_REAL8m s[YY_2LAT_BLOCKSUM_LANES], c[YY_2LAT_BLOCKSUM_LANES];
+    int l;
+    for(l=0;l<YY_2LAT_BLOCKSUM_LANES;++l) { s[l] = sum[l]; c[l] = corr[l]; }
+    for(int k=0;k<fill;++k) {
+      l = k % YY_2LAT_BLOCKSUM_LANES;
+      TwoSumAccum(s[l],c[l],buf[k]);
+    }
+    OC_REAL8m total = s[0], total_corr = c[0];
+    for(l=1;l<YY_2LAT_BLOCKSUM_LANES;++l) {
+      TwoSumAccum(total,total_corr,s[l]);
+      total_corr += c[l];
+    }
+    return total + total_corr;
+  }
+
+private:
+  OC_REAL8m buf[YY_2LAT_BLOCKSUM_SIZE];
+  OC_REAL8m sum[YY_2LAT_BLOCKSUM_LANES];
+  OC_REAL8m corr[YY_2LAT_BLOCKSUM_LANES];
+  int fill;
+
+  static void TwoSumAccum(OC_REAL8m& s,OC_REAL8m& c,OC_REAL8m x) {
+    // s + x == t + err exactly; err is collected into c.
+    const OC_REAL8m t = s + x;
+    const OC_REAL8m xp = t - s;
+    const OC_REAL8m sp = t - xp;
+    c += (s - sp) + (x - xp);
+    s = t;
+  }
+
+  void Flush() {
+    // Work on local copies so the compiler can keep the lanes in
+    // registers (the members could otherwise alias buf).
+    OC_REAL8m s[YY_2LAT_BLOCKSUM_LANES], c[YY_2LAT_BLOCKSUM_LANES];
+    int l;
+    for(l=0;l<YY_2LAT_BLOCKSUM_LANES;++l) { s[l] = sum[l]; c[l] = corr[l]; }
+    for(int k=0;k<YY_2LAT_BLOCKSUM_SIZE;k+=YY_2LAT_BLOCKSUM_LANES) {
+      for(l=0;l<YY_2LAT_BLOCKSUM_LANES;++l) {
+        TwoSumAccum(s[l],c[l],buf[k+l]);
+      }
+    }
+    for(l=0;l<YY_2LAT_BLOCKSUM_LANES;++l) { sum[l] = s[l]; corr[l] = c[l]; }
+    fill = 0;
+  }
+};
+
+#endif // _YY_2LAT_BLOCKSUM
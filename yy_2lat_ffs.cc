@@ -0,0 +1,343 @@
+/** FILE: yy_2lat_ffs.cc                 -*-Mode: c++-*-
+ *
+ * Forward flux sampling of rare switching events for the two lattice
+ * time driver.
+ *
+ * Copyright (C) 2015 Yu Yahagi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "nb.h"
+
+#include "yy_2lat_blocksum.h"
+#include "yy_2lat_ffs.h"
+
+/* End includes */
+
+OC_BOOL YY_2LatParseFFSSpec(const String& spec,
+                            YY_2LatFFSSpec& ffs,
+                            String& errmsg)
+{
+  Nb_SplitList params;
+  if(params.Split(spec.c_str())!=TCL_OK) {
+    errmsg = String("not a proper Tcl list");
+    return 0;
+  }
+  if(params.Count()%2!=0) {
+    errmsg = String("odd number of elements in key/value list");
+    return 0;
+  }
+
+  YY_2LatFFSSpec newffs;
+  OC_BOOL has_basin = 0;
+  for(int i=0;i<params.Count();i+=2) {
+    const String key = params[i];
+    const String value = params[i+1];
+    OC_BOOL ok = 1;
+    if(key.compare("order_parameter")==0) {
+      // [-]m{x,y,z}[1|2]
+      const char* cptr = value.c_str();
+      newffs.sign = 1.;
+      if(*cptr=='-') { newffs.sign = -1.; ++cptr; }
+      ok = (cptr[0]=='m' && cptr[1]>='x' && cptr[1]<='z');
+      if(ok) {
+        newffs.component = cptr[1]-'x';
+        if(cptr[2]=='\0') {
+          newffs.lattice = 0;
+        } else if((cptr[2]=='1' || cptr[2]=='2') && cptr[3]=='\0') {
+          newffs.lattice = cptr[2]-'0';
+        } else {
+          ok = 0;
+        }
+      }
+    } else if(key.compare("basin_A")==0) {
+      OC_BOOL err;
+      newffs.basin_A = Nb_Atof(value.c_str(),err);
+      ok = !err;
+      has_basin = 1;
+    } else if(key.compare("interfaces")==0) {
+      Nb_SplitList vals;
+      ok = (vals.Split(value.c_str())==TCL_OK && vals.Count()>=2);
+      for(int j=0;ok && j<vals.Count();++j) {
+        OC_BOOL err;
+        newffs.interfaces.push_back(Nb_Atof(vals[j],err));
+        ok = !err && (j==0 || newffs.interfaces[j]>newffs.interfaces[j-1]);
+      }
+    } else if(key.compare("crossings")==0
+              || key.compare("trials")==0
+              || key.compare("pool_size")==0) {
+      OC_BOOL err;
+      const long ival = Nb_Atol(value.c_str(),err);
+      ok = (!err && ival>=1);
+      if(key.compare("crossings")==0) {
+        newffs.crossings = static_cast<OC_INDEX>(ival);
+      } else if(key.compare("trials")==0) {
+        newffs.trials = static_cast<OC_INDEX>(ival);
+      } else {
+        newffs.pool_size = static_cast<OC_INDEX>(ival);
+      }
+    } else if(key.compare("verbose")==0) {
+      OC_BOOL err;
+      const long ival = Nb_Atol(value.c_str(),err);
+      ok = (!err && (ival==0 || ival==1));
+      newffs.verbose = (ival!=0);
+    } else {
+      errmsg = String("unrecognized key ") + key;
+      return 0;
+    }
+    if(!ok) {
+      errmsg = String("bad value for ") + key + String(": ") + value;
+      return 0;
+    }
+  }
+  if(newffs.interfaces.empty() || !has_basin) {
+    errmsg = String("basin_A and interfaces must be specified");
+    return 0;
+  }
+  if(newffs.basin_A>=newffs.interfaces[0]) {
+    errmsg = String("basin_A must lie below the first interface");
+    return 0;
+  }
+  ffs = newffs;
+  return 1;
+}
+
+YY_2LatFFSSampler::YY_2LatFFSSampler()
+  : phase(FLUX), started(0), in_A(0), interface_index(0),
+    crossing_count(0), flux_time(0.), trial_count(0), success_count(0),
+    restart(0), flux(0.), rate(0.), rate_error(0.), last_lambda(0.)
+{}
+
+YY_2LatFFSSampler::~YY_2LatFFSSampler()
+{
+  ReleasePool(pool);
+  ReleasePool(next_pool);
+}
+
+void YY_2LatFFSSampler::ReleasePool(vector<Config*>& pool_)
+{
+  for(size_t k=0;k<pool_.size();++k) delete pool_[k];
+  pool_.clear();
+}
+
+void YY_2LatFFSSampler::Setup(const YY_2LatFFSSpec& spec_)
+{
+  spec = spec_;
+  ReleasePool(pool);
+  ReleasePool(next_pool);
+  probability.clear();
+  phase = FLUX;
+  started = 0;
+  restart = 0;
+  rate = rate_error = flux = 0.;
+}
+
+OC_REAL8m
+YY_2LatFFSSampler::OrderParameter(const Oxs_SimState& state1,
+                                  const Oxs_SimState& state2) const
+{
+  const OC_INDEX size = state1.mesh->Size();
+  const Oxs_MeshValue<OC_REAL8m>& Ms1 = *(state1.Ms);
+  const Oxs_MeshValue<OC_REAL8m>& Ms2 = *(state2.Ms);
+  const int c = spec.component;
+  YY_2LatBlockSum msum, wsum;
+  for(OC_INDEX i=0;i<size;++i) {
+    const ThreeVector& m1 = state1.spin[i];
+    const ThreeVector& m2 = state2.spin[i];
+    const OC_REAL8m c1 = (c==0 ? m1.x : (c==1 ? m1.y : m1.z));
+    const OC_REAL8m c2 = (c==0 ? m2.x : (c==1 ? m2.y : m2.z));
+    if(spec.lattice!=2) { msum += Ms1[i]*c1; wsum += Ms1[i]; }
+    if(spec.lattice!=1) { msum += Ms2[i]*c2; wsum += Ms2[i]; }
+  }
+  const OC_REAL8m w = wsum.GetValue();
+  return (w>0. ? spec.sign*msum.GetValue()/w : 0.);
+}
+
+void YY_2LatFFSSampler::Save(const Oxs_SimState& state1,
+                             const Oxs_SimState& state2,
+                             Config& config) const
+{
+  config.spin1 = state1.spin;
+  config.spin2 = state2.spin;
+  config.Ms1 = *(state1.Ms);
+  config.Ms2 = *(state2.Ms);
+}
+
+void YY_2LatFFSSampler::Offer(const Oxs_SimState& state1,
+                              const Oxs_SimState& state2,
+                              OC_INDEX seen,
+                              vector<Config*>& pool_)
+{
+  if(static_cast<OC_INDEX>(pool_.size())<spec.pool_size) {
+    Config* config = new Config;
+    Save(state1,state2,*config);
+    pool_.push_back(config);
+    return;
+  }
+  OC_INDEX r = static_cast<OC_INDEX>(floor(Oc_UnifRand()*seen));
+  if(r<spec.pool_size) Save(state1,state2,*(pool_[r]));
+}
+
+void YY_2LatFFSSampler::PickStart()
+{
+  const OC_INDEX n = static_cast<OC_INDEX>(pool.size());
+  OC_INDEX r = static_cast<OC_INDEX>(floor(Oc_UnifRand()*n));
+  if(r>=n) r = n-1;
+  restart = pool[r];
+}
+
+void YY_2LatFFSSampler::Start(const Oxs_SimState& state1,
+                              const Oxs_SimState& state2)
+{
+  Save(state1,state2,initial);
+  last_lambda = OrderParameter(state1,state2);
+  in_A = (last_lambda<spec.basin_A);
+  phase = FLUX;
+  interface_index = 0;
+  crossing_count = 0;
+  flux_time = 0.;
+  trial_count = success_count = 0;
+  started = 1;
+  if(spec.verbose) {
+    fprintf(stderr,"FFS: flux run from lambda = %g, basin A below %g,"
+            " lambda_0 = %g\n",static_cast<double>(last_lambda),
+            static_cast<double>(spec.basin_A),
+            static_cast<double>(spec.interfaces[0]));
+  }
+}
+
+void YY_2LatFFSSampler::Finish()
+{
+  phase = DONE;
+  restart = 0;
+  ReleasePool(pool);
+  ReleasePool(next_pool);
+  OC_REAL8m pprod = 1.0;
+  OC_REAL8m relvar = 1.0/OC_REAL8m(crossing_count);
+  for(size_t k=0;k<probability.size();++k) {
+    const OC_REAL8m p = probability[k];
+    pprod *= p;
+    if(p>0.) relvar += (1.0-p)/(p*OC_REAL8m(spec.trials));
+  }
+  rate = flux*pprod;
+  rate_error = rate*sqrt(relvar);
+  if(spec.verbose) {
+    fprintf(stderr,"FFS: flux %g 1/s, P(B|lambda_0) %g,"
+            " rate %g +/- %g 1/s\n",static_cast<double>(flux),
+            static_cast<double>(pprod),static_cast<double>(rate),
+            static_cast<double>(rate_error));
+  }
+}
+
+OC_BOOL YY_2LatFFSSampler::Observe(const Oxs_SimState& state1,
+                                   const Oxs_SimState& state2,
+                                   OC_REAL8m timestep)
+{
+  restart = 0;
+  if(!started || phase==DONE) return 0;
+  const OC_REAL8m lambda = OrderParameter(state1,state2);
+  last_lambda = lambda;
+  const vector<OC_REAL8m>& lam = spec.interfaces;
+  const OC_INDEX last = static_cast<OC_INDEX>(lam.size())-1;
+
+  if(phase==FLUX) {
+    flux_time += timestep;
+    if(lambda>=lam[last]) {
+      // Reached B; start over from the initial state.
+      restart = &initial;
+      in_A = 1;
+      return 1;
+    }
+    if(lambda<spec.basin_A) {
+      in_A = 1;
+    } else if(in_A && lambda>=lam[0]) {
+      in_A = 0;
+      ++crossing_count;
+      Offer(state1,state2,crossing_count,pool);
+      if(crossing_count>=spec.crossings) {
+        flux = OC_REAL8m(crossing_count)/flux_time;
+        if(spec.verbose) {
+          fprintf(stderr,"FFS: %ld crossings of lambda_0 in %g s,"
+                  " flux %g 1/s\n",static_cast<long>(crossing_count),
+                  static_cast<double>(flux_time),static_cast<double>(flux));
+        }
+        phase = INTERFACE;
+        interface_index = 0;
+        trial_count = success_count = 0;
+        PickStart();
+        return 1;
+      }
+    }
+    return 0;
+  }
+
+  // Interface phase: the trial ends at the next interface or in A.
+  const OC_INDEX target = interface_index+1;
+  if(lambda>=lam[target]) {
+    ++success_count;
+    Offer(state1,state2,success_count,next_pool);
+  } else if(lambda>=spec.basin_A) {
+    return 0; // Trial still running
+  }
+  if(++trial_count<spec.trials) {
+    PickStart();
+    return 1;
+  }
+
+  const OC_REAL8m p = OC_REAL8m(success_count)/OC_REAL8m(trial_count);
+  probability.push_back(p);
+  if(spec.verbose) {
+    fprintf(stderr,"FFS: lambda %g -> %g: %ld of %ld trials, p = %g\n",
+            static_cast<double>(lam[interface_index]),
+            static_cast<double>(lam[target]),
+            static_cast<long>(success_count),static_cast<long>(trial_count),
+            static_cast<double>(p));
+  }
+  if(success_count==0 || target==last) {
+    Finish();
+    return 0;
+  }
+  ReleasePool(pool);
+  pool.swap(next_pool);
+  interface_index = target;
+  trial_count = success_count = 0;
+  PickStart();
+  return 1;
+}
+
+void YY_2LatFFSSampler::Restore(Oxs_SimState& state1,
+                                Oxs_SimState& state2) const
+{
+  if(restart==0) return;
+  state1.spin = restart->spin1;
+  state2.spin = restart->spin2;
+  Oxs_MeshValue<OC_REAL8m>& Ms1 = *(state1.Ms);
+  Oxs_MeshValue<OC_REAL8m>& Ms2 = *(state2.Ms);
+  Oxs_MeshValue<OC_REAL8m>& Ms1_inverse = *(state1.Ms_inverse);
+  Oxs_MeshValue<OC_REAL8m>& Ms2_inverse = *(state2.Ms_inverse);
+  const OC_INDEX size = state1.mesh->Size();
+  for(OC_INDEX i=0;i<size;++i) {
+    Ms1[i] = restart->Ms1[i];
+    Ms2[i] = restart->Ms2[i];
+    Ms1_inverse[i] = (Ms1[i]!=0.0 ? 1.0/Ms1[i] : 0.0);
+    Ms2_inverse[i] = (Ms2[i]!=0.0 ? 1.0/Ms2[i] : 0.0);
+  }
+}
@@ -0,0 +1,159 @@
+/** FILE: yy_2lat_ffs.h                 -*-Mode: c++-*-
+ *
+ * Forward flux sampling of rare switching events for the two lattice
+ * time driver.
+ *
+ * Copyright (C) 2015 Yu Yahagi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _YY_2LAT_FFS
+#define _YY_2LAT_FFS
+
+#include <string>
+#include <vector>
+
+#include "oc.h"
+#include "meshvalue.h"
+#include "simstate.h"
+#include "threevector.h"
+
+OC_USE_STD_NAMESPACE;
+OC_USE_STRING;
+
+/* End includes */
+
+struct YY_2LatFFSSpec {
+  // Parsed "ffs" driver option.  The order parameter is the Ms
+  // weighted average of one magnetization component, of sublattice 1,
+  // sublattice 2 or the total (lattice 0), optionally negated.
+  // Interfaces run from lambda_0 up to lambda_n, which bounds basin B;
+  // basin A is lambda < basin_A.
+  int lattice;              // 0, 1 or 2
+  int component;            // 0, 1, 2 for x, y, z
+  OC_REAL8m sign;           // +1 or -1
+  OC_REAL8m basin_A;
+  vector<OC_REAL8m> interfaces;
+  OC_INDEX crossings;       // lambda_0 crossings in the flux run
+  OC_INDEX trials;          // Trial runs per interface
+  OC_INDEX pool_size;       // Configurations kept per interface
+  OC_BOOL verbose;          // Phase summaries to stderr
+  YY_2LatFFSSpec()
+    : lattice(0), component(2), sign(1.), basin_A(0.),
+      crossings(50), trials(100), pool_size(50), verbose(0) {}
+  OC_BOOL Active() const { return !interfaces.empty(); }
+};
+
+OC_BOOL YY_2LatParseFFSSpec(const String& spec,
+                            YY_2LatFFSSpec& ffs,
+                            String& errmsg);
+// Fills ffs from a MIF key/value list, e.g.
+//   order_parameter -mz1 basin_A -0.9 interfaces {-0.8 -0.4 0 0.9}
+//   crossings 50 trials 200 pool_size 50 verbose 1
+// order_parameter is [-]m{x,y,z}[1|2]; basin_A and interfaces are
+// required, interfaces must be increasing and above basin_A.  Returns
+// 0 and sets errmsg on a malformed spec.
+
+class YY_2LatFFSSampler {
+  // Direct forward flux sampling on top of an ordinary trajectory.
+  // The driver reports each accepted step through Observe, which
+  // tells it when the current trajectory has to be abandoned and a
+  // new branch started from a stored configuration.
+  //
+  // Flux phase: the trajectory runs freely from the initial state.
+  // Each first crossing of lambda_0 after a visit to basin A is
+  // counted and its configuration stored, until `crossings` are
+  // collected.  The flux is crossings over the time spent in this
+  // phase.  A trajectory that reaches basin B restarts from the
+  // initial state.
+  //
+  // Interface phase i: `trials` runs start from configurations picked
+  // at random among those stored at lambda_i, and each ends either at
+  // lambda_{i+1} (success, configuration stored) or back in basin A.
+  // At most pool_size configurations are kept per interface; beyond
+  // that, successes replace stored ones by reservoir sampling, so the
+  // kept set stays a uniform sample.
+  //
+  // The rate is flux * prod p_i, with relative variance
+  // 1/crossings + sum (1-p_i)/(p_i*trials).
+public:
+  YY_2LatFFSSampler();
+  ~YY_2LatFFSSampler();
+
+  void Setup(const YY_2LatFFSSpec& spec_);
+  OC_BOOL Active() const { return spec.Active(); }
+  OC_BOOL Started() const { return started; }
+  OC_BOOL Done() const { return phase==DONE; }
+
+  OC_REAL8m OrderParameter(const Oxs_SimState& state1,
+                           const Oxs_SimState& state2) const;
+
+  void Start(const Oxs_SimState& state1,const Oxs_SimState& state2);
+  /// Stores the initial configuration and enters the flux phase.
+
+  OC_BOOL Observe(const Oxs_SimState& state1,
+                  const Oxs_SimState& state2,
+                  OC_REAL8m timestep);
+  /// Call after each accepted step with the new sublattice states.
+  /// Returns true if the next step should restart from the
+  /// configuration given by Restore instead of continuing.
+
+  void Restore(Oxs_SimState& state1,Oxs_SimState& state2) const;
+  /// Copies the restart configuration into the spin and Ms arrays of
+  /// the sublattice states.
+
+  OC_REAL8m Rate() const { return rate; }          // 1/s, 0 until done
+  OC_REAL8m RateError() const { return rate_error; } // 1/s
+  OC_REAL8m LastOrderParameter() const { return last_lambda; }
+
+private:
+  struct Config {
+    Oxs_MeshValue<ThreeVector> spin1, spin2;
+    Oxs_MeshValue<OC_REAL8m> Ms1, Ms2;
+  };
+  void Save(const Oxs_SimState& state1,const Oxs_SimState& state2,
+            Config& config) const;
+  void Offer(const Oxs_SimState& state1,const Oxs_SimState& state2,
+             OC_INDEX seen,vector<Config*>& pool_);
+  /// Reservoir sampling insert of the seen-th (1 based) candidate.
+  void PickStart();
+  void Finish();
+
+  YY_2LatFFSSpec spec;
+  enum Phase { FLUX, INTERFACE, DONE } phase;
+  OC_BOOL started;
+  OC_BOOL in_A;
+  OC_INDEX interface_index;  // i in interface phase i
+  OC_INDEX crossing_count;
+  OC_REAL8m flux_time;
+  OC_INDEX trial_count;
+  OC_INDEX success_count;
+  vector<OC_REAL8m> probability;
+  Config initial;
+  vector<Config*> pool, next_pool;
+  const Config* restart;
+  OC_REAL8m flux, rate, rate_error;
+  OC_REAL8m last_lambda;
+
+  static void ReleasePool(vector<Config*>& pool_);
+
+  // Disable copy constructor and assignment operator by declaring
+  // them without defining them.
+  YY_2LatFFSSampler(const YY_2LatFFSSampler&);
+  YY_2LatFFSSampler& operator=(const YY_2LatFFSSampler&);
+};
+
+#endif // _YY_2LAT_FFS
@@ -0,0 +1,222 @@
+/** FILE: yy_2lat_hugepage.cc                 -*-Mode: c++-*-
+ *
+ * Optional huge page backing for large two lattice work buffers.
+ *
+ * Copyright (C) 2015 Yu Yahagi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "oc.h"
+
+#include "yy_2lat_hugepage.h"
+
+#if defined(__linux__)
+# include <sys/mman.h>
+# define YY_2LAT_HAS_MMAP 1
+#else
+# define YY_2LAT_HAS_MMAP 0
+#endif
+
+/* End includes */
+
+OC_BOOL YY_2LatParseHugePageMode(const String& str,
+                                 YY_2LatHugePageMode& mode)
+{
+  if(str.compare("none")==0) {
+    mode = YY_2LAT_HUGEPAGE_NONE;
+  } else if(str.compare("transparent")==0) {
+    mode = YY_2LAT_HUGEPAGE_TRANSPARENT;
+  } else if(str.compare("explicit")==0) {
+    mode = YY_2LAT_HUGEPAGE_EXPLICIT;
+  } else {
+    return 0;
+  }
+  return 1;
+}
+
+static size_t RoundUp(size_t size,size_t align)
+{
+  return ((size + align - 1)/align)*align;
+}
+
+static void ReportBacking(const char* label,size_t bytes,
+                          const char* backing)
+{ // A null label means the caller reports for itself.
+  if(label==0) return;
+  fprintf(stderr,"YY_2Lat huge pages: %-28.28s %9.1f MB  %s\n",
+          label,double(bytes)/(1024.*1024.),backing);
+}
+
+#if YY_2LAT_HAS_MMAP
+// Returns 1 if the kernel will honor MADV_HUGEPAGE, i.e., the THP
+// setting is "always" or "madvise".  The result is cached; a racing
+// first call from several threads just reads the file more than once.
+static OC_BOOL TransparentHugePagesEnabled()
+{
+  static int enabled = -1;
+  if(enabled<0) {
+    int result = 0;
+#ifdef MADV_HUGEPAGE
+    FILE* fptr = fopen("/sys/kernel/mm/transparent_hugepage/enabled","r");
+    if(fptr!=NULL) {
+      char buf[256];
+      if(fgets(buf,sizeof(buf),fptr)!=NULL
+         && strstr(buf,"[never]")==NULL) {
+        result = 1;
+      }
+      fclose(fptr);
+    }
+#endif
+    enabled = result;
+  }
+  return (enabled!=0);
+}
+#endif // YY_2LAT_HAS_MMAP
+
+void* YY_2LatBigBlock::Alloc(size_t bytes,YY_2LatHugePageMode mode,
+                             const char* label)
+{
+  Free();
+  if(bytes==0) return 0;
+
+#if YY_2LAT_HAS_MMAP
+  if(mode != YY_2LAT_HUGEPAGE_NONE) {
+    const size_t hpsize = YY_2LAT_HUGEPAGE_SIZE;
+    const size_t mapsize = RoundUp(bytes,hpsize);
+    const char* fallback_note = "";
+#ifdef MAP_HUGETLB
+    if(mode == YY_2LAT_HUGEPAGE_EXPLICIT) {
+      void* addr = mmap(0,mapsize,PROT_READ|PROT_WRITE,
+                        MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB,-1,0);
+      if(addr != MAP_FAILED) {
+        // hugetlb mappings are always huge page aligned.
+        raw = ptr = addr;
+        rawsize = mapsize;
+        mapped = 1;
+        ReportBacking(label,bytes,"explicit 2 MB pages");
+        return ptr;
+      }
+      fallback_note = " (no free explicit huge pages)";
+    }
+#else
+    if(mode == YY_2LAT_HUGEPAGE_EXPLICIT) {
+      fallback_note = " (MAP_HUGETLB not supported)";
+    }
+#endif
+    // Transparent huge pages.  Over-map by one huge page so that the
+    // client block can start on a huge page boundary.
+    void* addr = mmap(0,mapsize+hpsize,PROT_READ|PROT_WRITE,
+                      MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+    if(addr != MAP_FAILED) {
+      raw = addr;
+      rawsize = mapsize + hpsize;
+      mapped = 1;
+      ptr = reinterpret_cast<void*>
+        (RoundUp(reinterpret_cast<size_t>(addr),hpsize));
+      char buf[256];
+#ifdef MADV_HUGEPAGE
+      if(TransparentHugePagesEnabled()
+         && madvise(ptr,mapsize,MADV_HUGEPAGE)==0) {
+        Oc_Snprintf(buf,sizeof(buf),"transparent 2 MB pages%s",
+                    fallback_note);
+      } else
+#endif
+      {
+        Oc_Snprintf(buf,sizeof(buf),
+                    "ordinary pages, THP disabled%s",fallback_note);
+      }
+      ReportBacking(label,bytes,buf);
+      return ptr;
+    }
+    // mmap failed outright; try the heap below.
+  }
+#endif // YY_2LAT_HAS_MMAP
+
+  const size_t align = YY_2LAT_BIGBLOCK_ALIGN;
+  raw = malloc(bytes + align - 1);
+  if(raw==NULL) {
+    if(mode != YY_2LAT_HUGEPAGE_NONE) {
+      ReportBacking(label,bytes,"allocation failed");
+    }
+    return 0;
+  }
+  rawsize = bytes + align - 1;
+  mapped = 0;
+  ptr = reinterpret_cast<void*>
+    (RoundUp(reinterpret_cast<size_t>(raw),align));
+  if(mode != YY_2LAT_HUGEPAGE_NONE) {
+#if YY_2LAT_HAS_MMAP
+    ReportBacking(label,bytes,"ordinary pages, mmap failed");
+#else
+    ReportBacking(label,bytes,"ordinary pages, not supported on"
+                  " this platform");
+#endif
+  }
+  return ptr;
+}
+
+void YY_2LatBigBlock::Free()
+{
+  if(raw!=0) {
+#if YY_2LAT_HAS_MMAP
+    if(mapped) munmap(raw,rawsize);
+    else       free(raw);
+#else
+    free(raw);
+#endif
+  }
+  raw = ptr = 0;
+  rawsize = 0;
+  mapped = 0;
+}
+
+size_t YY_2LatAdviseHugePages(void* start,size_t bytes,
+                              YY_2LatHugePageMode mode,
+                              const char* label)
+{
+  if(mode == YY_2LAT_HUGEPAGE_NONE || start==0 || bytes==0) return 0;
+#if YY_2LAT_HAS_MMAP && defined(MADV_HUGEPAGE)
+  const size_t hpsize = YY_2LAT_HUGEPAGE_SIZE;
+  const size_t addr = reinterpret_cast<size_t>(start);
+  const size_t first = RoundUp(addr,hpsize);
+  const size_t last = ((addr + bytes)/hpsize)*hpsize;
+  size_t covered = 0;
+  if(last>first && TransparentHugePagesEnabled()
+     && madvise(reinterpret_cast<void*>(first),last-first,
+                MADV_HUGEPAGE)==0) {
+    covered = last - first;
+  }
+  char buf[256];
+  if(covered>0) {
+    Oc_Snprintf(buf,sizeof(buf),"transparent 2 MB pages on %.1f MB",
+                double(covered)/(1024.*1024.));
+  } else if(last<=first) {
+    Oc_Snprintf(buf,sizeof(buf),"ordinary pages, too small");
+  } else {
+    Oc_Snprintf(buf,sizeof(buf),"ordinary pages, THP disabled");
+  }
+  ReportBacking(label,bytes,buf);
+  return covered;
+#else
+  ReportBacking(label,bytes,"ordinary pages, not supported on"
+                " this platform");
+  return 0;
+#endif
+}
@@ -0,0 +1,92 @@
+/** FILE: yy_2lat_hugepage.h                 -*-Mode: c++-*-
+ *
+ * Optional huge page backing for large two lattice work buffers.
+ *
+ * Copyright (C) 2015 Yu Yahagi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _YY_2LAT_HUGEPAGE
+#define _YY_2LAT_HUGEPAGE
+
+#include <stddef.h>
+
+#include "oc.h"
+
+OC_USE_STRING;
+
+/* End includes */
+
+enum YY_2LatHugePageMode {
+  YY_2LAT_HUGEPAGE_NONE,        // Ordinary pages (default)
+  YY_2LAT_HUGEPAGE_TRANSPARENT, // 2 MB aligned, advised for THP
+  YY_2LAT_HUGEPAGE_EXPLICIT     // Reserved hugetlbfs pages; falls
+                                // back to TRANSPARENT if none free
+};
+
+#define YY_2LAT_HUGEPAGE_SIZE  (size_t(2)*1024*1024)
+#define YY_2LAT_BIGBLOCK_ALIGN 64  // Cache line, and wide enough
+/// for any SIMD load used by the FFT code.
+
+OC_BOOL YY_2LatParseHugePageMode(const String& str,
+                                 YY_2LatHugePageMode& mode);
+// Maps the MIF option strings "none", "transparent" and "explicit"
+// to mode.  Returns 0 (and leaves mode alone) on any other string.
+
+class YY_2LatBigBlock {
+  // Owner of one large buffer (FFT workspace, demag coefficients).
+  // With mode NONE the memory is ordinary heap, aligned to
+  // YY_2LAT_BIGBLOCK_ALIGN.  Otherwise it is a private anonymous
+  // mapping aligned to YY_2LAT_HUGEPAGE_SIZE, backed by explicit huge
+  // pages or advised for transparent ones.  Pages are not touched
+  // here, so on NUMA machines they are placed by whichever thread
+  // writes them first.  Every request with mode != NONE reports to
+  // stderr what backing the buffer actually got.
+public:
+  YY_2LatBigBlock() : raw(0), ptr(0), rawsize(0), mapped(0) {}
+  ~YY_2LatBigBlock() { Free(); }
+
+  void* Alloc(size_t bytes,YY_2LatHugePageMode mode,const char* label);
+  // Releases any previous buffer.  Returns 0 if no memory at all
+  // could be obtained; the caller decides how to report that.
+
+  void Free();
+  void* GetPtr() const { return ptr; }
+
+private:
+  void* raw;      // Address returned by the system allocator
+  void* ptr;      // Aligned address handed to the client
+  size_t rawsize; // Size of raw, in bytes
+  OC_BOOL mapped; // True if raw came from mmap rather than malloc
+
+  // Declare but don't define copy constructor and assignment operator
+  YY_2LatBigBlock(const YY_2LatBigBlock&);
+  YY_2LatBigBlock& operator=(const YY_2LatBigBlock&);
+};
+
+size_t YY_2LatAdviseHugePages(void* start,size_t bytes,
+                              YY_2LatHugePageMode mode,
+                              const char* label);
+// For arrays whose storage is owned by OOMMF core (Oxs_MeshValue,
+// Oxs_StripedArray) and so cannot come from YY_2LatBigBlock.  Marks
+// the 2 MB aligned interior of [start,start+bytes) as eligible for
+// transparent huge pages, and returns the number of bytes covered.
+// Call this after sizing the array and before first touch.  EXPLICIT
+// is treated as TRANSPARENT, since the memory is already mapped.  If
+// label is null nothing is written to stderr, so that a caller with
+// many arrays can print one summary line instead.
+
+#endif // _YY_2LAT_HUGEPAGE
@@ -0,0 +1,568 @@
+/** FILE: yy_2lat_ovfwriter.cc                 -*-Mode: c++-*-
+ *
+ * Direct OVF 2.0 vector field writer for the two lattice driver, with
+ * multithreaded encoding and optional background file writes.
+ *
+ * Copyright (C) 2015 Yu Yahagi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "nb.h"
+#include "oxsexcept.h"
+#include "oxsthread.h"
+#include "rectangularmesh.h"
+
+#include "yy_2lat_ovfwriter.h"
+
+/* End includes */
+
+OC_BOOL YY_2LatParseOvfSchedule(const String& spec,
+                                YY_2LatOvfSchedule& schedule,
+                                String& errmsg)
+{
+  Nb_SplitList params;
+  if(params.Split(spec.c_str())!=TCL_OK) {
+    errmsg = String("not a proper Tcl list");
+    return 0;
+  }
+  if(params.Count()%2!=0) {
+    errmsg = String("odd number of elements in key/value list");
+    return 0;
+  }
+
+  YY_2LatOvfSchedule newsched;
+  for(int i=0;i<params.Count();i+=2) {
+    const String key = params[i];
+    const String value = params[i+1];
+    OC_BOOL ok = 1;
+    if(key.compare("quantities")==0) {
+      Nb_SplitList names;
+      ok = (names.Split(value.c_str())==TCL_OK && names.Count()>0);
+      for(int j=0;ok && j<names.Count();++j) {
+        newsched.quantities.push_back(String(names[j]));
+      }
+    } else if(key.compare("format")==0) {
+      if(value.compare("text")==0) {
+        newsched.format = YY_2LatOvfSchedule::TEXT;
+      } else if(value.compare("binary4")==0) {
+        newsched.format = YY_2LatOvfSchedule::BINARY4;
+      } else if(value.compare("binary8")==0) {
+        newsched.format = YY_2LatOvfSchedule::BINARY8;
+      } else {
+        errmsg = String("format should be text, binary4 or binary8, not ")
+          + value;
+        return 0;
+      }
+    } else if(key.compare("basename")==0) {
+      newsched.basename = value;
+      ok = !value.empty();
+    } else if(key.compare("step_interval")==0
+              || key.compare("max_pending")==0) {
+      OC_BOOL err;
+      const long ival = Nb_Atol(value.c_str(),err);
+      ok = (!err && ival>=0);
+      if(key.compare("step_interval")==0) {
+        newsched.step_interval = static_cast<OC_UINT4m>(ival);
+      } else {
+        newsched.max_pending = static_cast<OC_INDEX>(ival);
+        if(ival<1) ok = 0;
+      }
+    } else if(key.compare("change_angle")==0
+              || key.compare("change_rms")==0) {
+      OC_BOOL err;
+      const double dval = Nb_Atof(value.c_str(),err);
+      ok = (!err && dval>=0.0);
+      if(key.compare("change_angle")==0) {
+        newsched.change_angle = static_cast<OC_REAL8m>(dval);
+        if(dval>=180.0) ok = 0;
+      } else {
+        newsched.change_rms = static_cast<OC_REAL8m>(dval);
+      }
+    } else if(key.compare("stage_end")==0
+              || key.compare("background")==0) {
+      OC_BOOL err;
+      const long ival = Nb_Atol(value.c_str(),err);
+      ok = !err;
+      if(key.compare("stage_end")==0) newsched.stage_end = (ival!=0);
+      else                            newsched.background = (ival!=0);
+    } else {
+      errmsg = String("unrecognized key ") + key;
+      return 0;
+    }
+    if(!ok) {
+      errmsg = String("bad value for ") + key + String(": ") + value;
+      return 0;
+    }
+  }
+  if(newsched.quantities.empty()) {
+    errmsg = String("quantities must be specified");
+    return 0;
+  }
+  schedule = newsched;
+  return 1;
+}
+
+// OVF 2.0 binary data is little endian.
+static inline void YY_2LatOvfPut8(char* dst,OC_REAL8 val)
+{
+  memcpy(dst,&val,8);
+#if OC_BYTEORDER == 4321
+  char t;
+  t=dst[0]; dst[0]=dst[7]; dst[7]=t;
+  t=dst[1]; dst[1]=dst[6]; dst[6]=t;
+  t=dst[2]; dst[2]=dst[5]; dst[5]=t;
+  t=dst[3]; dst[3]=dst[4]; dst[4]=t;
+#endif
+}
+
+static inline void YY_2LatOvfPut4(char* dst,OC_REAL4 val)
+{
+  memcpy(dst,&val,4);
+#if OC_BYTEORDER == 4321
+  char t;
+  t=dst[0]; dst[0]=dst[3]; dst[3]=t;
+  t=dst[1]; dst[1]=dst[2]; dst[2]=t;
+#endif
+}
+
+// Thread class for YY_2LatOvfWriter::Write.  Each thread encodes its
+// own strip into (*body)[threadnumber].
+class _YY_2LatOvfEncodeThread : public Oxs_ThreadRunObj {
+public:
+  const Oxs_MeshValue<ThreeVector>* vec;
+  const Oxs_MeshValue<OC_REAL8m>* scale;
+  YY_2LatOvfSchedule::Format format;
+  vector<String>* body;
+
+  _YY_2LatOvfEncodeThread()
+    : vec(0), scale(0), format(YY_2LatOvfSchedule::BINARY8), body(0) {}
+
+  void Cmd(int threadnumber, void* /* data */) {
+    String& buf = (*body)[threadnumber];
+    buf.erase();
+    OC_INDEX istart,istop;
+    vec->GetArrayBlock()->GetStripPosition(threadnumber,istart,istop);
+    if(istart>=istop) return;
+
+    const Oxs_MeshValue<ThreeVector>& v = *vec;
+    const OC_INDEX count = istop - istart;
+    if(format == YY_2LatOvfSchedule::TEXT) {
+      buf.reserve(80*count);
+      char line[128];
+      for(OC_INDEX i=istart;i<istop;++i) {
+        ThreeVector val = v[i];
+        if(scale) val *= (*scale)[i];
+        Oc_Snprintf(line,sizeof(line),"% .17g % .17g % .17g\n",
+                    static_cast<double>(val.x),
+                    static_cast<double>(val.y),
+                    static_cast<double>(val.z));
+        buf += line;
+      }
+    } else if(format == YY_2LatOvfSchedule::BINARY8) {
+      buf.resize(24*count);
+      char* dst = &(buf[0]);
+      for(OC_INDEX i=istart;i<istop;++i,dst+=24) {
+        ThreeVector val = v[i];
+        if(scale) val *= (*scale)[i];
+        YY_2LatOvfPut8(dst,   static_cast<OC_REAL8>(val.x));
+        YY_2LatOvfPut8(dst+8, static_cast<OC_REAL8>(val.y));
+        YY_2LatOvfPut8(dst+16,static_cast<OC_REAL8>(val.z));
+      }
+    } else {
+      buf.resize(12*count);
+      char* dst = &(buf[0]);
+      for(OC_INDEX i=istart;i<istop;++i,dst+=12) {
+        ThreeVector val = v[i];
+        if(scale) val *= (*scale)[i];
+        YY_2LatOvfPut4(dst,  static_cast<OC_REAL4>(val.x));
+        YY_2LatOvfPut4(dst+4,static_cast<OC_REAL4>(val.y));
+        YY_2LatOvfPut4(dst+8,static_cast<OC_REAL4>(val.z));
+      }
+    }
+  }
+};
+
+// Thread class for YY_2LatOvfChangeTracker::Exceeds.  Each thread
+// scans its own strip of both sublattices and leaves max |m-m_ref|^2,
+// the sum of |m-m_ref|^2 and the cell count in its result slot, where
+// m = Ms/Ms0*spin is the reduced magnetization.
+class _YY_2LatOvfChangeThread : public Oxs_ThreadRunObj {
+public:
+  const Oxs_MeshValue<ThreeVector>* spin[2];
+  const Oxs_MeshValue<OC_REAL8m>* Ms[2];
+  const Oxs_MeshValue<OC_REAL8m>* Ms0_inverse[2];
+  const Oxs_MeshValue<ThreeVector>* ref[2];
+  OC_REAL8m stop_d2; // Quit early above this max; <=0 never
+  vector<OC_REAL8m>* max_d2;
+  vector<OC_REAL8m>* sum_d2;
+  vector<OC_INDEX>* count;
+
+  _YY_2LatOvfChangeThread()
+    : stop_d2(0.0), max_d2(0), sum_d2(0), count(0) {
+    spin[0] = spin[1] = 0; Ms[0] = Ms[1] = 0;
+    Ms0_inverse[0] = Ms0_inverse[1] = 0; ref[0] = ref[1] = 0;
+  }
+
+  void Cmd(int threadnumber, void* /* data */) {
+    OC_REAL8m tmax = 0.0, tsum = 0.0;
+    OC_INDEX tcount = 0;
+    OC_INDEX istart,istop;
+    spin[0]->GetArrayBlock()->GetStripPosition(threadnumber,istart,istop);
+    for(int ilat=0;ilat<2;++ilat) {
+      const Oxs_MeshValue<ThreeVector>& sspin = *(spin[ilat]);
+      const Oxs_MeshValue<OC_REAL8m>& sMs = *(Ms[ilat]);
+      const Oxs_MeshValue<OC_REAL8m>& sMs0i = *(Ms0_inverse[ilat]);
+      const Oxs_MeshValue<ThreeVector>& mref = *(ref[ilat]);
+      for(OC_INDEX i=istart;i<istop;++i) {
+        if(sMs0i[i]==0.0) continue;
+        ThreeVector d = sspin[i];
+        d *= sMs[i]*sMs0i[i];
+        d -= mref[i];
+        const OC_REAL8m d2 = d.MagSq();
+        if(d2>tmax) tmax = d2;
+        tsum += d2;
+        ++tcount;
+      }
+      if(stop_d2>0.0 && tmax>stop_d2) break; // Answer known
+    }
+    (*max_d2)[threadnumber] = tmax;
+    (*sum_d2)[threadnumber] = tsum;
+    (*count)[threadnumber]  = tcount;
+  }
+};
+
+static void YY_2LatOvfReducedM(const Oxs_SimState& state,
+                               Oxs_MeshValue<ThreeVector>& m)
+{ // m = Ms/Ms0*spin; zero in cells with Ms0 == 0.
+  const OC_INDEX size = state.spin.Size();
+  const Oxs_MeshValue<OC_REAL8m>& Ms = *(state.Ms);
+  const Oxs_MeshValue<OC_REAL8m>& Ms0_inverse = *(state.Ms0_inverse);
+  m.AdjustSize(state.mesh);
+  for(OC_INDEX i=0;i<size;++i) {
+    m[i] = state.spin[i];
+    m[i] *= Ms[i]*Ms0_inverse[i];
+  }
+}
+
+void YY_2LatOvfChangeTracker::TakeReference(const Oxs_SimState& state1,
+                                            const Oxs_SimState& state2)
+{
+  YY_2LatOvfReducedM(state1,ref1);
+  YY_2LatOvfReducedM(state2,ref2);
+  have_reference = 1;
+}
+
+OC_BOOL YY_2LatOvfChangeTracker::Exceeds(const Oxs_SimState& state1,
+                                         const Oxs_SimState& state2,
+                                         OC_REAL8m max_angle,
+                                         OC_REAL8m max_rms) const
+{
+  const OC_INDEX size = state1.spin.Size();
+  if(!have_reference || ref1.Size()!=size
+     || ref2.Size()!=state2.spin.Size() || state2.spin.Size()!=size) {
+    return 1;
+  }
+  // Compare in |m-m_ref|^2 = 4 sin^2(angle/2), so no trig per cell.
+  // For |m| = |m_ref| = 1 this is the turning angle; otherwise a change
+  // of the length of m counts as well.
+  OC_REAL8m angle_d2 = 0.0;
+  if(max_angle>0.0) {
+    const OC_REAL8m h = 2*sin(0.5*max_angle);
+    angle_d2 = h*h;
+  }
+
+  const int thread_count = Oc_GetMaxThreadCount();
+  vector<OC_REAL8m> max_d2(thread_count,0.0), sum_d2(thread_count,0.0);
+  vector<OC_INDEX> count(thread_count,0);
+  static Oxs_ThreadTree threadtree;
+  vector<_YY_2LatOvfChangeThread> change_thread(thread_count);
+  change_thread[0].spin[0] = &(state1.spin);
+  change_thread[0].spin[1] = &(state2.spin);
+  change_thread[0].Ms[0] = state1.Ms;
+  change_thread[0].Ms[1] = state2.Ms;
+  change_thread[0].Ms0_inverse[0] = state1.Ms0_inverse;
+  change_thread[0].Ms0_inverse[1] = state2.Ms0_inverse;
+  change_thread[0].ref[0] = &ref1;
+  change_thread[0].ref[1] = &ref2;
+  change_thread[0].stop_d2 = (max_rms>0.0 ? 0.0 : angle_d2);
+  change_thread[0].max_d2 = &max_d2;
+  change_thread[0].sum_d2 = &sum_d2;
+  change_thread[0].count = &count;
+  for(int ithread=1;ithread<thread_count;++ithread) {
+    change_thread[ithread] = change_thread[0];
+    threadtree.Launch(change_thread[ithread],0);
+  }
+  threadtree.LaunchRoot(change_thread[0],0);
+
+  OC_REAL8m tmax = 0.0, tsum = 0.0;
+  OC_INDEX tcount = 0;
+  for(int ithread=0;ithread<thread_count;++ithread) {
+    if(max_d2[ithread]>tmax) tmax = max_d2[ithread];
+    tsum += sum_d2[ithread];
+    tcount += count[ithread];
+  }
+  if(angle_d2>0.0 && tmax>angle_d2) return 1;
+  if(max_rms>0.0 && tcount>0 && tsum>max_rms*max_rms*tcount) return 1;
+  return 0;
+}
+
+#if OOMMF_THREADS
+static Tcl_ThreadCreateType YY_2LatOvfWriterThreadProc(ClientData cd)
+{
+  static_cast<YY_2LatOvfWriter*>(cd)->WriteJobThread();
+  TCL_THREAD_CREATE_RETURN;
+}
+#endif
+
+YY_2LatOvfWriter::YY_2LatOvfWriter()
+  : format(YY_2LatOvfSchedule::BINARY8), background(0), max_pending(2),
+    thread_running(0), stop_request(0)
+{}
+
+YY_2LatOvfWriter::~YY_2LatOvfWriter()
+{
+  StopThread();
+  if(!thread_error.empty()) {
+    fprintf(stderr,"YY_2LatOvfWriter: %.1000s\n",thread_error.c_str());
+  }
+}
+
+void YY_2LatOvfWriter::SetBackground(OC_BOOL background_,
+                                     OC_INDEX max_pending_)
+{
+#if OOMMF_THREADS
+  background = background_;
+#else
+  background = 0; // No threads; always write synchronously
+#endif
+  max_pending = (max_pending_<1 ? 1 : max_pending_);
+}
+
+OC_BOOL YY_2LatOvfWriter::WriteJob(const Job& job,String& errmsg) const
+{
+  FILE* fptr = fopen(job.filename.c_str(),"wb");
+  if(fptr==NULL) {
+    errmsg = String("Unable to open file ") + job.filename
+      + String(" for writing.");
+    return 0;
+  }
+  OC_BOOL ok
+    = (fwrite(job.header.data(),1,job.header.size(),fptr)
+       == job.header.size());
+  for(size_t i=0;ok && i<job.body.size();++i) {
+    const String& buf = job.body[i];
+    if(buf.empty()) continue;
+    ok = (fwrite(buf.data(),1,buf.size(),fptr)==buf.size());
+  }
+  if(ok) {
+    ok = (fwrite(job.trailer.data(),1,job.trailer.size(),fptr)
+          == job.trailer.size());
+  }
+  if(fclose(fptr)!=0) ok = 0;
+  if(!ok) {
+    errmsg = String("Error writing file ") + job.filename + String(".");
+  }
+  return ok;
+}
+
+void YY_2LatOvfWriter::WriteJobThread()
+{
+  control.Lock();
+  while(1) {
+    while(pending.empty() && !stop_request) control.Wait(0);
+    if(pending.empty()) break; // Stop requested and queue drained
+    Job* job = pending.front();
+    control.Unlock();
+    String errmsg;
+    OC_BOOL ok = WriteJob(*job,errmsg);
+    control.Lock();
+    // Pop only after the write, so Flush() sees the job until the file
+    // is complete.
+    pending.pop_front();
+    delete job;
+    if(!ok && thread_error.empty()) thread_error = errmsg;
+    control.NotifyAll();
+  }
+  control.Unlock();
+}
+
+void YY_2LatOvfWriter::StopThread()
+{
+  if(!thread_running) return;
+#if OOMMF_THREADS
+  control.Lock();
+  stop_request = 1;
+  control.NotifyAll();
+  control.Unlock();
+  int result;
+  Tcl_JoinThread(thread_id,&result);
+#endif
+  thread_running = 0;
+  stop_request = 0;
+}
+
+void YY_2LatOvfWriter::Flush()
+{
+  String errmsg;
+  control.Lock();
+  while(!pending.empty()) control.Wait(0);
+  errmsg.swap(thread_error);
+  control.Unlock();
+  if(!errmsg.empty()) throw Oxs_ExtError(errmsg.c_str());
+}
+
+void YY_2LatOvfWriter::Write(const String& filename,
+                             const char* quantity,
+                             const char* units,
+                             const Oxs_SimState& state,
+                             const Oxs_MeshValue<ThreeVector>& vec,
+                             const Oxs_MeshValue<OC_REAL8m>* scale)
+{
+  const Oxs_CommonRectangularMesh* mesh
+    = dynamic_cast<const Oxs_CommonRectangularMesh*>(state.mesh);
+  if(mesh==NULL) {
+    String msg =
+      String("Mesh (\"")
+      + String(state.mesh->InstanceName())
+      + String("\") passed to YY_2LatOvfWriter::Write()"
+               " is not a rectangular mesh object.");
+    throw Oxs_ExtError(msg.c_str());
+  }
+
+  Job* job = new Job;
+  job->filename = filename;
+
+  // Header
+  const char* dataname = "Binary 8";
+  if(format == YY_2LatOvfSchedule::TEXT)         dataname = "Text";
+  else if(format == YY_2LatOvfSchedule::BINARY4) dataname = "Binary 4";
+  const char* unitstr = (units[0]=='\0' ? "{}" : units);
+  const OC_REAL8m dx = mesh->EdgeLengthX();
+  const OC_REAL8m dy = mesh->EdgeLengthY();
+  const OC_REAL8m dz = mesh->EdgeLengthZ();
+  ThreeVector base;
+  mesh->Center(0,base);
+  const OC_REAL8m xmin = base.x - 0.5*dx;
+  const OC_REAL8m ymin = base.y - 0.5*dy;
+  const OC_REAL8m zmin = base.z - 0.5*dz;
+  char buf[4096];
+  Oc_Snprintf(buf,sizeof(buf),
+              "# OOMMF OVF 2.0\n#\n# Segment count: 1\n#\n"
+              "# Begin: Segment\n# Begin: Header\n#\n"
+              "# Title: %.500s\n"
+              "# Desc: Total simulation time: %.17g s\n"
+              "# Desc: Iteration: %u, Stage: %u\n"
+              "# meshtype: rectangular\n# meshunit: m\n#\n"
+              "# xmin: %.17g\n# ymin: %.17g\n# zmin: %.17g\n"
+              "# xmax: %.17g\n# ymax: %.17g\n# zmax: %.17g\n#\n"
+              "# valuedim: 3\n"
+              "# valuelabels: %.200s_x %.200s_y %.200s_z\n"
+              "# valueunits: %.100s %.100s %.100s\n#\n"
+              "# xbase: %.17g\n# ybase: %.17g\n# zbase: %.17g\n"
+              "# xnodes: %ld\n# ynodes: %ld\n# znodes: %ld\n"
+              "# xstepsize: %.17g\n# ystepsize: %.17g\n"
+              "# zstepsize: %.17g\n#\n"
+              "# End: Header\n#\n"
+              "# Begin: Data %s\n",
+              quantity,
+              static_cast<double>(state.stage_start_time
+                                  + state.stage_elapsed_time),
+              static_cast<unsigned int>(state.iteration_count),
+              static_cast<unsigned int>(state.stage_number),
+              static_cast<double>(xmin),static_cast<double>(ymin),
+              static_cast<double>(zmin),
+              static_cast<double>(xmin+mesh->DimX()*dx),
+              static_cast<double>(ymin+mesh->DimY()*dy),
+              static_cast<double>(zmin+mesh->DimZ()*dz),
+              quantity,quantity,quantity,
+              unitstr,unitstr,unitstr,
+              static_cast<double>(base.x),static_cast<double>(base.y),
+              static_cast<double>(base.z),
+              static_cast<long>(mesh->DimX()),
+              static_cast<long>(mesh->DimY()),
+              static_cast<long>(mesh->DimZ()),
+              static_cast<double>(dx),static_cast<double>(dy),
+              static_cast<double>(dz),
+              dataname);
+  job->header = buf;
+  if(format == YY_2LatOvfSchedule::BINARY8) {
+    char check[8];
+    YY_2LatOvfPut8(check,123456789012345.0);
+    job->header.append(check,8);
+  } else if(format == YY_2LatOvfSchedule::BINARY4) {
+    char check[4];
+    YY_2LatOvfPut4(check,1234567.0f);
+    job->header.append(check,4);
+  }
+  job->trailer = (format == YY_2LatOvfSchedule::TEXT ? "" : "\n");
+  job->trailer += String("# End: Data ") + String(dataname)
+    + String("\n# End: Segment\n");
+
+  // Body, encoded in parallel
+  const int thread_count = Oc_GetMaxThreadCount();
+  job->body.resize(thread_count);
+  static Oxs_ThreadTree threadtree;
+  vector<_YY_2LatOvfEncodeThread> encode_thread(thread_count);
+  encode_thread[0].vec = &vec;
+  encode_thread[0].scale = scale;
+  encode_thread[0].format = format;
+  encode_thread[0].body = &(job->body);
+  for(int ithread=1;ithread<thread_count;++ithread) {
+    encode_thread[ithread] = encode_thread[0];
+    threadtree.Launch(encode_thread[ithread],0);
+  }
+  threadtree.LaunchRoot(encode_thread[0],0);
+
+  if(!background) {
+    String errmsg;
+    OC_BOOL ok = WriteJob(*job,errmsg);
+    delete job;
+    if(!ok) throw Oxs_ExtError(errmsg.c_str());
+    return;
+  }
+
+#if OOMMF_THREADS
+  if(!thread_running) {
+    stop_request = 0;
+    if(Tcl_CreateThread(&thread_id,YY_2LatOvfWriterThreadProc,
+                        static_cast<ClientData>(this),
+                        TCL_THREAD_STACK_DEFAULT,
+                        TCL_THREAD_JOINABLE) != TCL_OK) {
+      delete job;
+      throw Oxs_ExtError("YY_2LatOvfWriter: unable to start"
+                         " background writer thread.");
+    }
+    thread_running = 1;
+  }
+#endif
+
+  String errmsg;
+  control.Lock();
+  while(static_cast<OC_INDEX>(pending.size())>=max_pending) {
+    control.Wait(0);
+  }
+  pending.push_back(job);
+  errmsg.swap(thread_error);
+  control.NotifyAll();
+  control.Unlock();
+  if(!errmsg.empty()) throw Oxs_ExtError(errmsg.c_str());
+}
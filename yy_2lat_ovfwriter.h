@@ -0,0 +1,171 @@
+/** FILE: yy_2lat_ovfwriter.h                 -*-Mode: c++-*-
+ *
+ * Direct OVF 2.0 vector field writer for the two lattice driver, with
+ * multithreaded encoding and optional background file writes.
+ *
+ * Copyright (C) 2015 Yu Yahagi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _YY_2LAT_OVFWRITER
+#define _YY_2LAT_OVFWRITER
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "oc.h"
+#include "meshvalue.h"
+#include "oxsthread.h"
+#include "simstate.h"
+#include "threevector.h"
+
+OC_USE_STD_NAMESPACE;
+OC_USE_STRING;
+
+/* End includes */
+
+struct YY_2LatOvfSchedule {
+  // Parsed "ovf_output" driver option.  Files are named
+  //   basename-quantity-SS-IIIIIII.ovf
+  // with SS the stage and IIIIIII the iteration number.
+  enum Format { TEXT, BINARY4, BINARY8 };
+  vector<String> quantities;
+  Format format;
+  String basename;
+  OC_UINT4m step_interval; // 0 means no step-triggered output
+  OC_BOOL stage_end;       // Write at the end of each stage
+  OC_BOOL background;      // Write files from a separate thread
+  OC_INDEX max_pending;    // Background queue depth, in snapshots
+  OC_REAL8m change_angle;  // Degrees; 0 means no angle trigger
+  OC_REAL8m change_rms;    // RMS |m-m_last|; 0 means no RMS trigger
+  YY_2LatOvfSchedule()
+    : format(BINARY8), step_interval(0), stage_end(0), background(1),
+      max_pending(2), change_angle(0.0), change_rms(0.0) {}
+  OC_BOOL Active() const { return !quantities.empty(); }
+  OC_BOOL ChangeTriggered() const {
+    return change_angle>0.0 || change_rms>0.0;
+  }
+};
+
+OC_BOOL YY_2LatParseOvfSchedule(const String& spec,
+                                YY_2LatOvfSchedule& schedule,
+                                String& errmsg);
+// Fills schedule from a MIF key/value list, e.g.
+//   quantities {Magnetization1 Magnetization2} format binary8
+//   step_interval 100 stage_end 1 background 1
+// Only quantities is required.  format is one of text, binary4 or
+// binary8.  basename, if given, overrides the MIF basename option.
+// change_angle (degrees) and change_rms (reduced magnetization
+// difference) add a write whenever the magnetization has moved that
+// far since the last one.
+// Returns 0 and sets errmsg on a malformed spec.  Quantity names are
+// not checked here.
+
+class YY_2LatOvfChangeTracker {
+  // Keeps the reduced magnetization m = Ms/Ms0*spin of both
+  // sublattices as of the last snapshot and measures how far the
+  // current m has moved from it, in one threaded read pass over the
+  // strips.  Cells with Ms0==0 are skipped.  The pass is separate from
+  // the evolver's update pass, so it costs one extra read of spin and
+  // Ms per step while change triggers are enabled.
+public:
+  YY_2LatOvfChangeTracker() : have_reference(0) {}
+
+  void Reset() { have_reference = 0; }
+
+  void TakeReference(const Oxs_SimState& state1,
+                     const Oxs_SimState& state2);
+  // Stores m of state1 and state2 as the new reference.
+
+  OC_BOOL Exceeds(const Oxs_SimState& state1,
+                  const Oxs_SimState& state2,
+                  OC_REAL8m max_angle,OC_REAL8m max_rms) const;
+  // True if there is no usable reference, if |m-m_ref| exceeds
+  // 2 sin(max_angle/2) in some cell (for |m|=1, a turn by more than
+  // max_angle radians) or if the RMS of |m-m_ref| over both sublattices
+  // exceeds max_rms.  A limit <=0 is not checked.
+
+private:
+  OC_BOOL have_reference;
+  Oxs_MeshValue<ThreeVector> ref1, ref2;
+};
+
+class YY_2LatOvfWriter {
+  // Writes one vector field per file in OVF 2.0 rectangular mesh
+  // format.  The mesh is cut into the usual thread strips and each
+  // thread encodes its own strip into a private buffer, so the text
+  // formatting (or byte shuffling, for binary) runs in parallel; the
+  // buffers are then written out in strip order.  With background
+  // writes enabled (threaded builds only) the encoded buffers are
+  // handed to a writer thread and Write returns as soon as encoding is
+  // done.  At most max_pending snapshots are held in memory; Write
+  // blocks if the writer falls further behind.  An error in the writer
+  // thread is reported as an exception by the next Write or Flush.
+public:
+  YY_2LatOvfWriter();
+  ~YY_2LatOvfWriter(); // Flushes pending writes
+
+  void SetFormat(YY_2LatOvfSchedule::Format fmt) { format = fmt; }
+  void SetBackground(OC_BOOL background_,OC_INDEX max_pending_);
+
+  void Write(const String& filename,
+             const char* quantity,
+             const char* units,
+             const Oxs_SimState& state,
+             const Oxs_MeshValue<ThreeVector>& vec,
+             const Oxs_MeshValue<OC_REAL8m>* scale);
+  // Writes vec, multiplied cellwise by scale if scale is not null.
+  // state provides the mesh and the time and iteration counts for the
+  // file description.  Throws Oxs_ExtError if the mesh is not
+  // rectangular or the file cannot be written.
+
+  void Flush();
+  // Waits until all queued files are written.
+
+  void WriteJobThread(); // Writer thread main loop; internal use.
+
+private:
+  struct Job {
+    String filename;
+    String header;
+    vector<String> body; // One buffer per encoding thread
+    String trailer;
+  };
+  OC_BOOL WriteJob(const Job& job,String& errmsg) const;
+
+  YY_2LatOvfSchedule::Format format;
+  OC_BOOL background;
+  OC_INDEX max_pending;
+
+  // Background writer state, guarded by control
+  Oxs_ThreadControl control;
+  deque<Job*> pending;
+  OC_BOOL thread_running;
+  OC_BOOL stop_request;
+  String thread_error;
+#if OOMMF_THREADS
+  Tcl_ThreadId thread_id;
+#endif
+  void StopThread();
+
+  // Disable copy constructor and assignment operator by declaring
+  // them without defining them.
+  YY_2LatOvfWriter(const YY_2LatOvfWriter&);
+  YY_2LatOvfWriter& operator=(const YY_2LatOvfWriter&);
+};
+
+#endif // _YY_2LAT_OVFWRITER
@@ -0,0 +1,307 @@
+/** FILE: yy_2lat_temperaturepulse.cc                 -*-Mode: c++-*-
+ *
+ * Analytic space and time dependent temperature profiles (e.g., laser
+ * heating pulses) for the two lattice evolvers.
+ *
+ * Copyright (C) 2015 Yu Yahagi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <math.h>
+#include <string>
+#include <vector>
+
+#include "nb.h"
+#include "energy.h"
+#include "oxsexcept.h"
+#include "oxsthread.h"
+
+#include "yy_2lat_temperaturepulse.h"
+#include "yy_2lat_util.h"
+
+/* End includes */
+
+// Time factors below this are treated as zero, so a pulse that is
+// long over (or not yet started) costs nothing per cell.
+#define YY_2LAT_TPULSE_CUTOFF 1e-12
+
+OC_REAL8m YY_2LatTemperaturePulse::TimeFactor(OC_REAL8m t) const
+{
+  const OC_REAL8m dt = t - t0;
+  if(shape == EXPONENTIAL) {
+    if(dt<0.0) return 0.0;
+    return exp(-dt/duration);
+  }
+  const OC_REAL8m u = dt/duration;
+  return exp(-0.5*u*u);
+}
+
+static OC_BOOL YY_2LatParsePulseReals(const char* str,
+                                      OC_REAL8m* vals,
+                                      int min_count,int max_count,
+                                      int& count)
+{ // Splits str into min_count to max_count reals.
+  Nb_SplitList items;
+  if(items.Split(str)!=TCL_OK) return 0;
+  count = items.Count();
+  if(count<min_count || count>max_count) return 0;
+  for(int i=0;i<count;++i) {
+    OC_BOOL err;
+    vals[i] = Nb_Atof(items[i],err);
+    if(err) return 0;
+  }
+  return 1;
+}
+
+OC_BOOL YY_2LatParseTemperaturePulse(const String& spec,
+                                     YY_2LatTemperaturePulse& pulse,
+                                     String& errmsg)
+{
+  Nb_SplitList params;
+  if(params.Split(spec.c_str())!=TCL_OK) {
+    errmsg = String("not a proper Tcl list");
+    return 0;
+  }
+  if(params.Count()%2!=0) {
+    errmsg = String("odd number of elements in key/value list");
+    return 0;
+  }
+
+  YY_2LatTemperaturePulse newpulse;
+  OC_BOOL has_peak=0, has_duration=0;
+  for(int i=0;i<params.Count();i+=2) {
+    const String key = params[i];
+    const char* value = params[i+1];
+    OC_REAL8m vals[3];
+    int count;
+    OC_BOOL ok = 1;
+    if(key.compare("peak")==0) {
+      ok = YY_2LatParsePulseReals(value,vals,1,1,count);
+      newpulse.peak = vals[0];
+      has_peak = 1;
+    } else if(key.compare("center")==0) {
+      ok = YY_2LatParsePulseReals(value,vals,2,3,count);
+      if(count==2) vals[2] = 0.0;
+      newpulse.center.Set(vals[0],vals[1],vals[2]);
+    } else if(key.compare("sigma")==0) {
+      ok = YY_2LatParsePulseReals(value,vals,1,2,count);
+      newpulse.sigma_x = vals[0];
+      newpulse.sigma_y = (count==2 ? vals[1] : vals[0]);
+    } else if(key.compare("depth")==0) {
+      ok = YY_2LatParsePulseReals(value,vals,1,1,count);
+      newpulse.depth = vals[0];
+    } else if(key.compare("t0")==0) {
+      ok = YY_2LatParsePulseReals(value,vals,1,1,count);
+      newpulse.t0 = vals[0];
+    } else if(key.compare("duration")==0) {
+      ok = YY_2LatParsePulseReals(value,vals,1,1,count);
+      newpulse.duration = vals[0];
+      has_duration = 1;
+    } else if(key.compare("shape")==0) {
+      String shapestr = value;
+      if(shapestr.compare("gaussian")==0) {
+        newpulse.shape = YY_2LatTemperaturePulse::GAUSSIAN;
+      } else if(shapestr.compare("exponential")==0) {
+        newpulse.shape = YY_2LatTemperaturePulse::EXPONENTIAL;
+      } else {
+        errmsg = String("shape should be gaussian or exponential, not ")
+          + shapestr;
+        return 0;
+      }
+    } else {
+      errmsg = String("unrecognized key ") + key;
+      return 0;
+    }
+    if(!ok) {
+      errmsg = String("bad value for ") + key + String(": ")
+        + String(value);
+      return 0;
+    }
+  }
+  if(!has_peak || !has_duration) {
+    errmsg = String("peak and duration must both be specified");
+    return 0;
+  }
+  if(newpulse.duration<=0.0) {
+    errmsg = String("duration must be >0");
+    return 0;
+  }
+  pulse = newpulse;
+  return 1;
+}
+
+void
+YY_2LatTemperatureProfile::FillTables
+(const Oxs_CommonRectangularMesh* mesh) const
+{
+  table_xdim = mesh->DimX();
+  table_ydim = mesh->DimY();
+  table_zdim = mesh->DimZ();
+  const size_t pcount = pulses.size();
+  xfactor.resize(pcount*table_xdim);
+  yfactor.resize(pcount*table_ydim);
+  zfactor.resize(pcount*table_zdim);
+
+  ThreeVector pos;
+  for(size_t ip=0;ip<pcount;++ip) {
+    const YY_2LatTemperaturePulse& p = pulses[ip];
+    OC_INDEX j;
+    for(j=0;j<table_xdim;++j) {
+      OC_REAL8m f = 1.0;
+      if(p.sigma_x>0.0) {
+        mesh->Center(mesh->Index(j,0,0),pos);
+        const OC_REAL8m u = (pos.x - p.center.x)/p.sigma_x;
+        f = exp(-0.5*u*u);
+      }
+      xfactor[ip*table_xdim+j] = f;
+    }
+    for(j=0;j<table_ydim;++j) {
+      OC_REAL8m f = 1.0;
+      if(p.sigma_y>0.0) {
+        mesh->Center(mesh->Index(0,j,0),pos);
+        const OC_REAL8m u = (pos.y - p.center.y)/p.sigma_y;
+        f = exp(-0.5*u*u);
+      }
+      yfactor[ip*table_ydim+j] = f;
+    }
+    for(j=0;j<table_zdim;++j) {
+      OC_REAL8m f = 1.0;
+      if(p.depth>0.0) {
+        mesh->Center(mesh->Index(0,0,j),pos);
+        f = exp(-fabs(pos.z - p.center.z)/p.depth);
+      }
+      zfactor[ip*table_zdim+j] = f;
+    }
+  }
+  table_mesh_id = mesh->Id();
+}
+
+// Thread class for YY_2LatTemperatureProfile::Fill
+class _YY_2LatTemperatureFillThread : public Oxs_ThreadRunObj {
+public:
+  const Oxs_CommonRectangularMesh* mesh;
+  OC_REAL8m tol;
+  const Oxs_MeshValue<OC_REAL8m>* T_base;
+  Oxs_MeshValue<OC_REAL8m>* T;
+  Oxs_MeshValue<OC_REAL8m>* kB_T;
+  const vector<size_t>* active;     // Pulses with non-zero time factor
+  const vector<OC_REAL8m>* amp;     // peak*f(t) for each active pulse
+  const vector<OC_REAL8m>* xfactor;
+  const vector<OC_REAL8m>* yfactor;
+  const vector<OC_REAL8m>* zfactor;
+  OC_BOOL track_changes;
+  vector<OC_INDEX> changed;         // Results, this thread's strip
+
+  _YY_2LatTemperatureFillThread()
+    : mesh(0), tol(0.), T_base(0), T(0), kB_T(0), active(0), amp(0),
+      xfactor(0), yfactor(0), zfactor(0), track_changes(0) {}
+
+  void Cmd(int threadnumber, void* /* data */) {
+    changed.clear();
+    OC_INDEX istart,istop;
+    T->GetArrayBlock()->GetStripPosition(threadnumber,istart,istop);
+    if(istart>=istop) return;
+
+    const OC_INDEX xdim = mesh->DimX();
+    const OC_INDEX ydim = mesh->DimY();
+    const OC_INDEX zdim = mesh->DimZ();
+    const size_t acount = active->size();
+    Oxs_MeshValue<OC_REAL8m>& Tref = *T;
+    Oxs_MeshValue<OC_REAL8m>& kB_Tref = *kB_T;
+
+    OC_INDEX x,y,z;
+    mesh->GetCoords(istart,x,y,z);
+    for(OC_INDEX i=istart;i<istop;++i) {
+      OC_REAL8m Tnew = (T_base ? (*T_base)[i] : 0.0);
+      for(size_t k=0;k<acount;++k) {
+        const size_t ip = (*active)[k];
+        Tnew += (*amp)[k] * (*xfactor)[ip*xdim+x]
+          * (*yfactor)[ip*ydim+y] * (*zfactor)[ip*zdim+z];
+      }
+      if(Tnew<0.0) Tnew = 0.0;
+      if(!track_changes || fabs(Tnew-Tref[i])>tol) {
+        Tref[i] = Tnew;
+        kB_Tref[i] = KB*Tnew;
+        if(track_changes) changed.push_back(i);
+      }
+      if((++x)>=xdim) {
+        x=0;
+        if((++y)>=ydim) { y=0; ++z; }
+      }
+    }
+  }
+};
+
+void YY_2LatTemperatureProfile::Fill
+(const Oxs_Mesh* genmesh,
+ OC_REAL8m time,
+ OC_REAL8m tol,
+ const Oxs_MeshValue<OC_REAL8m>* T_base,
+ Oxs_MeshValue<OC_REAL8m>& T,
+ Oxs_MeshValue<OC_REAL8m>& kB_T,
+ vector<OC_INDEX>* changed) const
+{
+  const Oxs_CommonRectangularMesh* mesh
+    = dynamic_cast<const Oxs_CommonRectangularMesh*>(genmesh);
+  if(mesh==NULL) {
+    String msg =
+      String("Import mesh (\"")
+      + String(genmesh->InstanceName())
+      + String("\") to YY_2LatTemperatureProfile::Fill()"
+               " is not a rectangular mesh object.");
+    throw Oxs_ExtError(msg.c_str());
+  }
+  if(table_mesh_id==0 || table_mesh_id!=mesh->Id()) FillTables(mesh);
+
+  // Time factors are per pulse, not per cell
+  vector<size_t> active;
+  vector<OC_REAL8m> amp;
+  for(size_t ip=0;ip<pulses.size();++ip) {
+    const OC_REAL8m f = pulses[ip].TimeFactor(time);
+    if(f<YY_2LAT_TPULSE_CUTOFF) continue;
+    active.push_back(ip);
+    amp.push_back(pulses[ip].peak*f);
+  }
+
+  const int thread_count = Oc_GetMaxThreadCount();
+  static Oxs_ThreadTree threadtree;
+  vector<_YY_2LatTemperatureFillThread> fill_thread(thread_count);
+  fill_thread[0].mesh = mesh;
+  fill_thread[0].tol = tol;
+  fill_thread[0].T_base = T_base;
+  fill_thread[0].T = &T;
+  fill_thread[0].kB_T = &kB_T;
+  fill_thread[0].active = &active;
+  fill_thread[0].amp = &amp;
+  fill_thread[0].xfactor = &xfactor;
+  fill_thread[0].yfactor = &yfactor;
+  fill_thread[0].zfactor = &zfactor;
+  fill_thread[0].track_changes = (changed != NULL);
+  for(int ithread=1;ithread<thread_count;++ithread) {
+    fill_thread[ithread] = fill_thread[0];
+    threadtree.Launch(fill_thread[ithread],0);
+  }
+  threadtree.LaunchRoot(fill_thread[0],0);
+
+  if(changed != NULL) {
+    // Strips are in thread order, so the concatenation is sorted.
+    changed->clear();
+    for(int ithread=0;ithread<thread_count;++ithread) {
+      const vector<OC_INDEX>& tc = fill_thread[ithread].changed;
+      changed->insert(changed->end(),tc.begin(),tc.end());
+    }
+  }
+}
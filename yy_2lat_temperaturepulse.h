@@ -0,0 +1,112 @@
+/** FILE: yy_2lat_temperaturepulse.h                 -*-Mode: c++-*-
+ *
+ * Analytic space and time dependent temperature profiles (e.g., laser
+ * heating pulses) for the two lattice evolvers.
+ *
+ * Copyright (C) 2015 Yu Yahagi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _YY_2LAT_TEMPERATUREPULSE
+#define _YY_2LAT_TEMPERATUREPULSE
+
+#include <vector>
+
+#include "oc.h"
+#include "mesh.h"
+#include "meshvalue.h"
+#include "rectangularmesh.h"
+#include "threevector.h"
+
+OC_USE_STD_NAMESPACE;
+OC_USE_STRING;
+
+/* End includes */
+
+struct YY_2LatTemperaturePulse {
+  // One heating pulse.  The temperature rise at cell center r and
+  // simulation time t is
+  //
+  //   peak * f(t) * exp(-(x-x0)^2/(2 sigma_x^2))
+  //               * exp(-(y-y0)^2/(2 sigma_y^2))
+  //               * exp(-|z-z0|/depth)
+  //
+  // where (x0,y0,z0) = center.  A sigma or depth <= 0 means the pulse
+  // is uniform in that direction.  For shape GAUSSIAN,
+  // f(t) = exp(-(t-t0)^2/(2 duration^2)); for EXPONENTIAL, f(t) is 0
+  // before t0 and exp(-(t-t0)/duration) after, i.e., a step rise with
+  // exponential cooling.
+  enum Shape { GAUSSIAN, EXPONENTIAL };
+  OC_REAL8m peak;      // Kelvin
+  ThreeVector center;  // m
+  OC_REAL8m sigma_x, sigma_y, depth; // m
+  OC_REAL8m t0, duration;            // s
+  Shape shape;
+  YY_2LatTemperaturePulse()
+    : peak(0.), center(0.,0.,0.), sigma_x(0.), sigma_y(0.), depth(0.),
+      t0(0.), duration(0.), shape(GAUSSIAN) {}
+  OC_REAL8m TimeFactor(OC_REAL8m t) const;
+};
+
+OC_BOOL YY_2LatParseTemperaturePulse(const String& spec,
+                                     YY_2LatTemperaturePulse& pulse,
+                                     String& errmsg);
+// Fills pulse from a MIF key/value list, e.g.
+//   peak 600 center {50e-9 50e-9 0} sigma {20e-9 20e-9} depth 15e-9
+//   t0 1e-12 duration 100e-15 shape gaussian
+// Only peak and duration are required.  "sigma" takes one value (same
+// in x and y) or two.  Returns 0 and sets errmsg on a malformed spec.
+
+class YY_2LatTemperatureProfile {
+  // Sum of YY_2LatTemperaturePulse's on top of a base temperature.
+  // The pulses are separable in x, y and z, so per-pulse factor
+  // tables along each mesh axis are built once per mesh, and a cell
+  // costs one multiply-add per active pulse.  Pulses whose time factor
+  // has dropped to nothing are skipped entirely.
+public:
+  YY_2LatTemperatureProfile() : table_mesh_id(0) {}
+
+  void AddPulse(const YY_2LatTemperaturePulse& pulse) {
+    pulses.push_back(pulse);
+    table_mesh_id = 0;
+  }
+  size_t PulseCount() const { return pulses.size(); }
+
+  void Fill(const Oxs_Mesh* mesh,
+            OC_REAL8m time,
+            OC_REAL8m tol,
+            const Oxs_MeshValue<OC_REAL8m>* T_base,
+            Oxs_MeshValue<OC_REAL8m>& T,
+            Oxs_MeshValue<OC_REAL8m>& kB_T,
+            vector<OC_INDEX>* changed) const;
+  // Evaluates the profile at "time" (s) in a threaded pass.  T_base
+  // may be null, in which case the base temperature is 0 K.  T and
+  // kB_T must be sized to mesh.  If changed is null, every cell of T
+  // and kB_T is written.  Otherwise a cell is only written if the new
+  // temperature differs from the current T by more than tol (K), and
+  // the indices of the written cells are returned in changed, sorted.
+  // Throws Oxs_ExtError if mesh is not rectangular.
+
+private:
+  vector<YY_2LatTemperaturePulse> pulses;
+  mutable OC_UINT4m table_mesh_id;
+  mutable OC_INDEX table_xdim, table_ydim, table_zdim;
+  mutable vector<OC_REAL8m> xfactor, yfactor, zfactor;
+  /// Pulse-major, i.e., xfactor[ipulse*xdim+x].
+  void FillTables(const Oxs_CommonRectangularMesh* mesh) const;
+};
+
+#endif // _YY_2LAT_TEMPERATUREPULSE
@@ -24,16 +24,22 @@
 #include "chunkenergy.h"
 #include "energy.h"
 #include "mesh.h"
+#include "oxsthread.h"
+#include "scalarfield.h"
+#include "uniformscalarfield.h"
+#include "uniformvectorfield.h"
+#include "vectorfield.h"
 
 #include "yy_2lat_util.h"
 
 struct Oxs_ComputeEnergies_ChunkStruct {
 public:
   Oxs_ChunkEnergy* energy;
+  const YY_2LatPairChunkEnergy* pair; // Non-null if energy supports it
   Oxs_ComputeEnergyDataThreaded ocedt;
   Oxs_ComputeEnergyDataThreadedAux ocedtaux;
   Oxs_ComputeEnergies_ChunkStruct()
-    : energy(0) {}
+    : energy(0), pair(0) {}
 };
 
 class Oxs_ComputeEnergiesChunkThread : public Oxs_ThreadRunObj {
@@ -72,12 +78,239 @@ public:
   // and destructor.
 };
 
+// Thread class for the fused pipeline.  Each cache block is run
+// through the chunk energies of sublattice 1, then those of sublattice
+// 2, and is then handed to the post-processor while the accumulated
+// fields are still in cache.
+class YY_2LatComputeEnergiesFusedThread : public Oxs_ThreadRunObj {
+public:
+  static Oxs_JobControl<ThreeVector> job_basket;
+  /// job_basket is static, so only one "set" of this class is allowed.
+
+  const Oxs_SimState* state;  // "total" lattice
+  vector<Oxs_ComputeEnergies_ChunkStruct> energy_terms1;
+  vector<Oxs_ComputeEnergies_ChunkStruct> energy_terms2;
+
+  Oxs_MeshValue<ThreeVector>* mxH_accum1;
+  Oxs_MeshValue<ThreeVector>* mxH_accum2;
+  const vector<OC_INDEX>* fixed_spins;
+
+  YY_2LatChunkPostProcess* postproc;
+
+  OC_INDEX cache_blocksize;
+
+  OC_BOOL accums_initialized;
+
+  YY_2LatComputeEnergiesFusedThread()
+    : state(0), mxH_accum1(0), mxH_accum2(0), fixed_spins(0),
+      postproc(0), cache_blocksize(0), accums_initialized(0) {}
+
+  void Cmd(int threadnumber, void* data);
+
+  static void Init(int thread_count,
+                   const Oxs_StripedArray<ThreeVector>* arrblock) {
+    job_basket.Init(thread_count,arrblock);
+  }
+
+private:
+  // Pointers stashed by BeginFirstPass; see RunTerms.
+  struct AccumSave {
+    Oxs_MeshValue<OC_REAL8m>* energy_accum;
+    Oxs_MeshValue<ThreeVector>* H_accum;
+    Oxs_MeshValue<ThreeVector>* mxH_accum;
+  };
+  static void BeginFirstPass(Oxs_ComputeEnergyDataThreaded& ocedt,
+                             AccumSave& save);
+  static void EndFirstPass(Oxs_ComputeEnergyDataThreaded& ocedt,
+                           const AccumSave& save,
+                           OC_INDEX icache_start,OC_INDEX icache_stop);
+  void RunTerms(OC_INDEX icache_start,OC_INDEX icache_stop,
+                int threadnumber);
+  void ZeroFixed(Oxs_MeshValue<ThreeVector>* mxH_accum,
+                 OC_INDEX& i_fixed,
+                 OC_INDEX icache_start,OC_INDEX icache_stop) const;
+
+  // Note: Default copy constructor and assignment operator,
+  // and destructor.
+};
+
+Oxs_JobControl<ThreeVector> YY_2LatComputeEnergiesFusedThread::job_basket;
+
+void YY_2LatComputeEnergiesFusedThread::BeginFirstPass
+(Oxs_ComputeEnergyDataThreaded& ocedt,
+ AccumSave& save)
+{ // Same first-pass initialization trick as in
+  // Oxs_ComputeEnergiesChunkThread::Cmd.
+  assert(ocedt.mxH == 0);
+  save.energy_accum = ocedt.energy_accum;
+  if(ocedt.energy == 0) ocedt.energy = ocedt.energy_accum;
+  ocedt.energy_accum = 0;
+
+  save.H_accum = ocedt.H_accum;
+  if(ocedt.H == 0)      ocedt.H      = ocedt.H_accum;
+  ocedt.H_accum      = 0;
+
+  save.mxH_accum = ocedt.mxH_accum;
+  if(ocedt.mxH == 0)    ocedt.mxH    = ocedt.mxH_accum;
+  ocedt.mxH_accum    = 0;
+}
+
+void YY_2LatComputeEnergiesFusedThread::EndFirstPass
+(Oxs_ComputeEnergyDataThreaded& ocedt,
+ const AccumSave& save,
+ OC_INDEX icache_start,OC_INDEX icache_stop)
+{
+  if(save.energy_accum) {
+    if(ocedt.energy != save.energy_accum) {
+      for(OC_INDEX i=icache_start;i<icache_stop;++i) {
+        (*save.energy_accum)[i] = (*(ocedt.energy))[i];
+      }
+    } else {
+      ocedt.energy = 0;
+    }
+  }
+  ocedt.energy_accum = save.energy_accum;
+
+  if(save.H_accum) {
+    if(ocedt.H != save.H_accum) {
+      for(OC_INDEX i=icache_start;i<icache_stop;++i) {
+        (*save.H_accum)[i] = (*(ocedt.H))[i];
+      }
+    } else {
+      ocedt.H = 0;
+    }
+  }
+  ocedt.H_accum = save.H_accum;
+
+  if(save.mxH_accum) {
+    if(ocedt.mxH != save.mxH_accum) {
+      // This branch should never run
+      abort();
+    } else {
+      ocedt.mxH = 0;
+    }
+  }
+  ocedt.mxH_accum = save.mxH_accum;
+}
+
+void YY_2LatComputeEnergiesFusedThread::RunTerms
+(OC_INDEX icache_start,OC_INDEX icache_stop,
+ int threadnumber)
+{ // Runs each term on the block for sublattice 1 and then sublattice 2,
+  // or on both at once for YY_2LatPairChunkEnergy terms.  Each
+  // sublattice still sees its terms in order, so the accumulated
+  // results are the same as running all sublattice 1 terms first.
+  const Oxs_SimState& state1 = *(state->lattice1);
+  const Oxs_SimState& state2 = *(state->lattice2);
+  const size_t term_count = energy_terms1.size();
+  for(size_t ei=0;ei<term_count;++ei) {
+    Oxs_ComputeEnergies_ChunkStruct& term1 = energy_terms1[ei];
+    Oxs_ComputeEnergies_ChunkStruct& term2 = energy_terms2[ei];
+    const OC_BOOL first_pass = (!accums_initialized && ei==0);
+    AccumSave save1, save2;
+    if(term1.pair != 0) {
+      // Both sublattices share the term's output caches.  On the first
+      // pass the pair kernel writes both sublattices before either
+      // EndFirstPass copy, so sublattice 1 must not go through the
+      // shared cache or it would pick up the sublattice 2 values.
+      // Instead sublattice 1 writes its accums directly, and the cache
+      // ends up holding sublattice 2, as for unpaired terms.
+      Oxs_MeshValue<OC_REAL8m>* const energy_out1 = term1.ocedt.energy;
+      Oxs_MeshValue<ThreeVector>* const H_out1 = term1.ocedt.H;
+      if(first_pass) {
+        if(energy_out1 != 0 && energy_out1 == term2.ocedt.energy) {
+          term1.ocedt.energy = 0;
+        }
+        if(H_out1 != 0 && H_out1 == term2.ocedt.H) {
+          term1.ocedt.H = 0;
+        }
+        BeginFirstPass(term1.ocedt,save1);
+        BeginFirstPass(term2.ocedt,save2);
+      }
+      term1.pair->ComputeEnergyPairChunk(state1,state2,
+                                         term1.ocedt,term2.ocedt,
+                                         term1.ocedtaux,term2.ocedtaux,
+                                         icache_start,icache_stop,
+                                         threadnumber);
+      if(first_pass) {
+        EndFirstPass(term1.ocedt,save1,icache_start,icache_stop);
+        EndFirstPass(term2.ocedt,save2,icache_start,icache_stop);
+        term1.ocedt.energy = energy_out1;
+        term1.ocedt.H = H_out1;
+      }
+      continue;
+    }
+    if(first_pass) BeginFirstPass(term1.ocedt,save1);
+    term1.energy->ComputeEnergyChunk(state1,term1.ocedt,term1.ocedtaux,
+                                     icache_start,icache_stop,
+                                     threadnumber);
+    if(first_pass) {
+      EndFirstPass(term1.ocedt,save1,icache_start,icache_stop);
+      BeginFirstPass(term2.ocedt,save2);
+    }
+    term2.energy->ComputeEnergyChunk(state2,term2.ocedt,term2.ocedtaux,
+                                     icache_start,icache_stop,
+                                     threadnumber);
+    if(first_pass) EndFirstPass(term2.ocedt,save2,icache_start,icache_stop);
+  }
+}
+
+void YY_2LatComputeEnergiesFusedThread::ZeroFixed
+(Oxs_MeshValue<ThreeVector>* mxH_accum,
+ OC_INDEX& i_fixed,
+ OC_INDEX icache_start,OC_INDEX icache_stop) const
+{ // Zero torque on fixed spins.  Assumes fixed_spins is sorted and
+  // chunks come in increasing order; see Oxs_ComputeEnergiesChunkThread.
+  if(fixed_spins && mxH_accum) {
+    const OC_INDEX i_fixed_total = fixed_spins->size();
+    while(i_fixed < i_fixed_total) {
+      OC_INDEX index = (*fixed_spins)[i_fixed];
+      if(index <  icache_start) { ++i_fixed; continue; }
+      if(index >= icache_stop) break;
+      (*mxH_accum)[index].Set(0.,0.,0.);
+      ++i_fixed;
+    }
+  }
+}
+
+void YY_2LatComputeEnergiesFusedThread::Cmd
+(int threadnumber,
+ void* /* data */)
+{
+  OC_INDEX i_fixed1 = 0;
+  OC_INDEX i_fixed2 = 0;
+
+  while(1) {
+    // Claim a chunk
+    OC_INDEX index_start,index_stop;
+    job_basket.GetJob(threadnumber,index_start,index_stop);
+
+    if(index_start>=index_stop) break;
+
+    for(OC_INDEX icache_start=index_start;
+        icache_start<index_stop; icache_start+=cache_blocksize) {
+      OC_INDEX icache_stop = icache_start + cache_blocksize;
+      if(icache_stop>index_stop) icache_stop = index_stop;
+
+      RunTerms(icache_start,icache_stop,threadnumber);
+      ZeroFixed(mxH_accum1,i_fixed1,icache_start,icache_stop);
+      ZeroFixed(mxH_accum2,i_fixed2,icache_start,icache_stop);
+
+      if(postproc) {
+        postproc->ProcessChunk(*state,icache_start,icache_stop,
+                               threadnumber);
+      }
+    }
+  }
+}
+
 void YY_2LatComputeEnergies(
     const Oxs_SimState& state,
     Oxs_ComputeEnergyData& oced1,
     Oxs_ComputeEnergyData& oced2,
     const vector<Oxs_Energy*>& energies,
-    Oxs_ComputeEnergyExtraData& oceed)
+    Oxs_ComputeEnergyExtraData& oceed,
+    YY_2LatChunkPostProcess* postproc)
 {
 
   if(state.lattice_type != Oxs_SimState::TOTAL) {
@@ -108,6 +341,13 @@ void YY_2LatComputeEnergies(
     throw Oxs_ExtError(msg);
   }
 
+  if(postproc != NULL && oceed.mxHxm != NULL) {
+    String msg = String("Programming error in function"
+                        " YY_2LatComputeEnergies:"
+                        " mxHxm output not supported by fused pipeline.");
+    throw Oxs_ExtError(msg);
+  }
+
   const Oxs_SimState& state1 = *(state.lattice1);
   const Oxs_SimState& state2 = *(state.lattice2);
 
@@ -182,6 +422,7 @@ void YY_2LatComputeEnergies(
 
   vector<Oxs_ComputeEnergies_ChunkStruct> chunk1, chunk2;
   vector<Oxs_Energy*> nonchunk1, nonchunk2;
+  OC_BOOL have_pair = 0;
 
   // Initialize those parts of ChunkStruct that are independent
   // of any particular energy term.
@@ -206,6 +447,8 @@ void YY_2LatComputeEnergies(
       // Set up and initialize chunk energy structures
       foo1.energy = ceptr;
       foo2.energy = ceptr;
+      foo1.pair = foo2.pair = dynamic_cast<YY_2LatPairChunkEnergy*>(ceptr);
+      if(foo1.pair != 0) have_pair = 1;
       if(ceptr->energy_density_output.GetCacheRequestCount()>0) {
         ceptr->energy_density_output.cache.state_id=0;
         foo1.ocedt.energy = &(ceptr->energy_density_output.cache.value);
@@ -383,6 +626,100 @@ void YY_2LatComputeEnergies(
   // Thread control
   static Oxs_ThreadTree threadtree;
 
+  if(postproc != NULL || (have_pair && oceed.mxHxm == NULL)) {
+// =========================================================================
+// Both lattices, fused with client post-processing (if any).  This
+// path is also taken without a post-processor when there are pair
+// terms, so that those see one pass per block for both sublattices.
+// It does not fill mxHxm, and leaves oceed.max_mxH at zero.
+// =========================================================================
+    YY_2LatComputeEnergiesFusedThread::Init(thread_count,
+                                            state.spin.GetArrayBlock());
+
+    vector<YY_2LatComputeEnergiesFusedThread> fused_thread;
+    fused_thread.resize(thread_count);
+    fused_thread[0].state = &state;
+    fused_thread[0].energy_terms1 = chunk1; // Make copies.
+    fused_thread[0].energy_terms2 = chunk2;
+    fused_thread[0].mxH_accum1 = oced1.mxH_accum;
+    fused_thread[0].mxH_accum2 = oced2.mxH_accum;
+    fused_thread[0].fixed_spins = oceed.fixed_spin_list;
+    fused_thread[0].postproc = postproc;
+    fused_thread[0].cache_blocksize = cache_blocksize;
+    fused_thread[0].accums_initialized = accums_initialized;
+
+    for(vector<Oxs_ComputeEnergies_ChunkStruct>::iterator it
+          = chunk1.begin(); it != chunk1.end() ; ++it ) {
+      it->energy->ComputeEnergyChunkInitialize(state1,it->ocedt,
+                                               it->ocedtaux,thread_count);
+    }
+    for(vector<Oxs_ComputeEnergies_ChunkStruct>::iterator it
+          = chunk2.begin(); it != chunk2.end() ; ++it ) {
+      it->energy->ComputeEnergyChunkInitialize(state2,it->ocedt,
+                                               it->ocedtaux,thread_count);
+    }
+
+    for(int ithread=1;ithread<thread_count;++ithread) {
+      fused_thread[ithread] = fused_thread[0];
+      threadtree.Launch(fused_thread[ithread],0);
+    }
+    threadtree.LaunchRoot(fused_thread[0],0);
+
+    // Finalize chunk energy computations, sublattice 1 then 2
+    for(int lat=1;lat<=2;++lat) {
+      const Oxs_SimState& lstate = (lat==1 ? state1 : state2);
+      vector<Oxs_ComputeEnergies_ChunkStruct>& chunk
+        = (lat==1 ? chunk1 : chunk2);
+      Oxs_ComputeEnergyData& oced = (lat==1 ? oced1 : oced2);
+      for(OC_INDEX ei=0;static_cast<size_t>(ei)<chunk.size();++ei) {
+        Oxs_ChunkEnergy& eterm = *(chunk[ei].energy);  // Convenience
+        eterm.ComputeEnergyChunkFinalize(lstate,chunk[ei].ocedt,
+                                         chunk[ei].ocedtaux,thread_count);
+        ++(eterm.calc_count);
+
+        // Sum energy and pE_pt contributions across threads
+        OC_REAL8m pE_pt_term = chunk[ei].ocedtaux.pE_pt_accum;
+        OC_REAL8m energy_term = chunk[ei].ocedtaux.energy_total_accum;
+        for(int ithread=0;ithread<thread_count;++ithread) {
+          const Oxs_ComputeEnergies_ChunkStruct& tterm
+            = (lat==1 ? fused_thread[ithread].energy_terms1[ei]
+                      : fused_thread[ithread].energy_terms2[ei]);
+          pE_pt_term += tterm.ocedtaux.pE_pt_accum;
+          energy_term += tterm.ocedtaux.energy_total_accum;
+        }
+        oced.pE_pt += pE_pt_term;
+        oced.energy_sum += energy_term;
+
+        if(eterm.energy_sum_output.GetCacheRequestCount()>0) {
+          eterm.energy_sum_output.cache.value=energy_term;
+          eterm.energy_sum_output.cache.state_id=state.Id();
+        }
+        if(eterm.field_output.GetCacheRequestCount()>0) {
+          eterm.field_output.cache.state_id=state.Id();
+        }
+        if(eterm.energy_density_output.GetCacheRequestCount()>0) {
+          eterm.energy_density_output.cache.state_id=state.Id();
+        }
+
+#if REPORT_TIME
+        Nb_StopWatch bar;
+        bar.ThreadAccum(chunk[ei].ocedtaux.energytime);
+        for(int ithread=0;ithread<thread_count;++ithread) {
+          bar.ThreadAccum(lat==1
+              ? fused_thread[ithread].energy_terms1[ei].ocedtaux.energytime
+              : fused_thread[ithread].energy_terms2[ei].ocedtaux.energytime);
+        }
+        eterm.energytime.Accum(bar);
+#endif // REPORT_TIME
+      }
+    }
+
+#if REPORT_TIME
+    Oxs_ChunkEnergy::chunktime.Stop();
+#endif
+    return;
+  }
+
 // =========================================================================
 // Lattice 1
 // =========================================================================
@@ -596,3 +933,152 @@ void YY_2LatComputeEnergies(
 #endif
 
 }
+
+// Thread class for YY_2LatFirstTouch
+class YY_2LatFirstTouchThread : public Oxs_ThreadRunObj {
+public:
+  const vector<Oxs_MeshValue<ThreeVector>*>* vec_arrays;
+  const vector<Oxs_MeshValue<OC_REAL8m>*>* scalar_arrays;
+  YY_2LatFirstTouchThread() : vec_arrays(0), scalar_arrays(0) {}
+  void Cmd(int threadnumber, void* /* data */) {
+    OC_INDEX istart,istop;
+    for(size_t ia=0;ia<vec_arrays->size();++ia) {
+      Oxs_MeshValue<ThreeVector>& arr = *((*vec_arrays)[ia]);
+      arr.GetArrayBlock()->GetStripPosition(threadnumber,istart,istop);
+      for(OC_INDEX i=istart;i<istop;++i) arr[i].Set(0.,0.,0.);
+    }
+    for(size_t ia=0;ia<scalar_arrays->size();++ia) {
+      Oxs_MeshValue<OC_REAL8m>& arr = *((*scalar_arrays)[ia]);
+      arr.GetArrayBlock()->GetStripPosition(threadnumber,istart,istop);
+      for(OC_INDEX i=istart;i<istop;++i) arr[i] = 0.0;
+    }
+  }
+};
+
+void YY_2LatFirstTouch(
+    const vector<Oxs_MeshValue<ThreeVector>*>& vec_arrays,
+    const vector<Oxs_MeshValue<OC_REAL8m>*>& scalar_arrays)
+{
+  const int thread_count = Oc_GetMaxThreadCount();
+  static Oxs_ThreadTree threadtree;
+  vector<YY_2LatFirstTouchThread> touch_thread(thread_count);
+  touch_thread[0].vec_arrays = &vec_arrays;
+  touch_thread[0].scalar_arrays = &scalar_arrays;
+  for(int ithread=1;ithread<thread_count;++ithread) {
+    touch_thread[ithread] = touch_thread[0];
+    threadtree.Launch(touch_thread[ithread],0);
+  }
+  threadtree.LaunchRoot(touch_thread[0],0);
+}
+
+// Native field types whose Value() only reads immutable state, and so
+// may be called concurrently.  Anything not listed here is filled
+// through its own FillMeshValue on the calling thread.  The atlas
+// fields are left out: their per-region values are arbitrary field
+// objects, often script fields that call into Tcl.
+static OC_BOOL YY_2LatIsThreadSafeField(const Oxs_Ext* field)
+{
+  static const char* const safe_classes[] = {
+    "Oxs_LinearScalarField", "Oxs_UniformScalarField",
+    "Oxs_UniformVectorField"
+  };
+  const String name = field->ClassName();
+  for(size_t i=0;i<sizeof(safe_classes)/sizeof(safe_classes[0]);++i) {
+    if(name.compare(safe_classes[i])==0) return 1;
+  }
+  return 0;
+}
+
+// Thread class for YY_2LatFillMeshValue.  If uniform is set, every
+// cell gets uniform_value, otherwise field->Value() at the cell center.
+template<class FIELD,class T>
+class YY_2LatFillMeshValueThread : public Oxs_ThreadRunObj {
+public:
+  const FIELD* field;
+  const Oxs_Mesh* mesh;
+  Oxs_MeshValue<T>* array;
+  OC_BOOL uniform;
+  T uniform_value;
+  YY_2LatFillMeshValueThread()
+    : field(0), mesh(0), array(0), uniform(0), uniform_value() {}
+  void Cmd(int threadnumber, void* /* data */) {
+    OC_INDEX istart,istop;
+    array->GetArrayBlock()->GetStripPosition(threadnumber,istart,istop);
+    Oxs_MeshValue<T>& arr = *array;
+    if(uniform) {
+      for(OC_INDEX i=istart;i<istop;++i) arr[i] = uniform_value;
+      return;
+    }
+    ThreeVector pt;
+    for(OC_INDEX i=istart;i<istop;++i) {
+      mesh->Center(i,pt);
+      Eval(pt,arr[i]);
+    }
+  }
+private:
+  void Eval(const ThreeVector& pt,OC_REAL8m& value) const {
+    value = field->Value(pt);
+  }
+  void Eval(const ThreeVector& pt,ThreeVector& value) const {
+    field->Value(pt,value);
+  }
+};
+
+template<class FIELD,class T>
+static void YY_2LatRunFillMeshValue
+(const YY_2LatFillMeshValueThread<FIELD,T>& proto)
+{
+  const int thread_count = Oc_GetMaxThreadCount();
+  static Oxs_ThreadTree threadtree;
+  vector< YY_2LatFillMeshValueThread<FIELD,T> > fill_thread(thread_count);
+  fill_thread[0] = proto;
+  for(int ithread=1;ithread<thread_count;++ithread) {
+    fill_thread[ithread] = fill_thread[0];
+    threadtree.Launch(fill_thread[ithread],0);
+  }
+  threadtree.LaunchRoot(fill_thread[0],0);
+}
+
+void YY_2LatFillMeshValue(const Oxs_ScalarField* field,
+                          const Oxs_Mesh* mesh,
+                          Oxs_MeshValue<OC_REAL8m>& array)
+{
+  if(!YY_2LatIsThreadSafeField(field)) {
+    field->FillMeshValue(mesh,array);
+    return;
+  }
+  array.AdjustSize(mesh);
+  YY_2LatFillMeshValueThread<Oxs_ScalarField,OC_REAL8m> proto;
+  proto.field = field;
+  proto.mesh = mesh;
+  proto.array = &array;
+  const Oxs_UniformScalarField* ufield
+    = dynamic_cast<const Oxs_UniformScalarField*>(field);
+  if(ufield != NULL) {
+    proto.uniform = 1;
+    proto.uniform_value = ufield->SoleValue();
+  }
+  YY_2LatRunFillMeshValue(proto);
+}
+
+void YY_2LatFillMeshValue(const Oxs_VectorField* field,
+                          const Oxs_Mesh* mesh,
+                          Oxs_MeshValue<ThreeVector>& array)
+{
+  if(!YY_2LatIsThreadSafeField(field)) {
+    field->FillMeshValue(mesh,array);
+    return;
+  }
+  array.AdjustSize(mesh);
+  YY_2LatFillMeshValueThread<Oxs_VectorField,ThreeVector> proto;
+  proto.field = field;
+  proto.mesh = mesh;
+  proto.array = &array;
+  const Oxs_UniformVectorField* ufield
+    = dynamic_cast<const Oxs_UniformVectorField*>(field);
+  if(ufield != NULL) {
+    proto.uniform = 1;
+    proto.uniform_value = ufield->SoleValue();
+  }
+  YY_2LatRunFillMeshValue(proto);
+}
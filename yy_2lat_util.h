@@ -24,12 +24,76 @@
 
 #define KB OC_REAL8m(1.38062e-23)
 
+class Oxs_Mesh;
+class Oxs_ScalarField;
+class Oxs_VectorField;
+
+class YY_2LatChunkPostProcess {
+  // Optional hook into YY_2LatComputeEnergies.  If a post-processor is
+  // passed in, the chunk energies of both sublattices are run in a
+  // single threaded pass, and after the last chunk term for a given
+  // cache block has been applied to both sublattices ProcessChunk is
+  // called on that same block.  At that point H_accum and mxH_accum
+  // are complete for the block and still resident in cache, so the
+  // client can consume them (e.g., to form dm/dt) without a separate
+  // read pass through memory.  ProcessChunk is called concurrently
+  // from all threads on disjoint [node_start,node_stop) ranges, and
+  // must not call into the Tcl interpreter.
+public:
+  virtual void ProcessChunk(const Oxs_SimState& state, // total lattice
+                            OC_INDEX node_start,OC_INDEX node_stop,
+                            int threadnumber) = 0;
+  virtual ~YY_2LatChunkPostProcess() {}
+};
+
+class YY_2LatPairChunkEnergy {
+  // Optional interface for Oxs_ChunkEnergy terms that can evaluate
+  // both sublattices in a single pass.  In YY_2LatComputeEnergies
+  // (whenever oceed.mxHxm is null, with or without a post-processor),
+  // a chunk energy that also derives from this class gets one
+  // ComputeEnergyPairChunk call per cache block, in place of the two ComputeEnergyChunk calls for
+  // state1 and state2.  The contract is that of ComputeEnergyChunk,
+  // applied to each (state,ocedt,ocedtaux) triple; results must match
+  // the separate calls.  ComputeEnergyChunkInitialize and Finalize are
+  // still called per sublattice.
+public:
+  virtual void ComputeEnergyPairChunk(
+      const Oxs_SimState& state1,
+      const Oxs_SimState& state2,
+      Oxs_ComputeEnergyDataThreaded& ocedt1,
+      Oxs_ComputeEnergyDataThreaded& ocedt2,
+      Oxs_ComputeEnergyDataThreadedAux& ocedtaux1,
+      Oxs_ComputeEnergyDataThreadedAux& ocedtaux2,
+      OC_INDEX node_start,OC_INDEX node_stop,
+      int threadnumber) const = 0;
+  virtual ~YY_2LatPairChunkEnergy() {}
+};
+
+class YY_2LatStiffnessEnergy {
+  // Optional interface for energy terms that can bound the local
+  // stiffness of their field, used by the auto_timestep option of
+  // YY_2LatEulerEvolve.  For each cell of the sublattice state,
+  // AccumStiffness adds to kt the change of the transverse field per
+  // radian of spin turn, and to kl the change of the longitudinal
+  // field per unit of reduced magnetization m = Ms/Ms0, both in A/m,
+  // for the stiffest local mode (neighbors and sublattices turning in
+  // antiphase).  Coefficients, m_e and chi_l are those of the last
+  // energy evaluation; a term that has not been evaluated on the
+  // state's mesh adds nothing.  Called from the main thread only.
+public:
+  virtual void AccumStiffness(const Oxs_SimState& state,
+                              Oxs_MeshValue<OC_REAL8m>& kt,
+                              Oxs_MeshValue<OC_REAL8m>& kl) const = 0;
+  virtual ~YY_2LatStiffnessEnergy() {}
+};
+
 void YY_2LatComputeEnergies(
     const Oxs_SimState& state,  // the "total" lattice
     Oxs_ComputeEnergyData& oced1,
     Oxs_ComputeEnergyData& oced2,
     const vector<Oxs_Energy*>& energies,
-    Oxs_ComputeEnergyExtraData& oceed);
+    Oxs_ComputeEnergyExtraData& oceed,
+    YY_2LatChunkPostProcess* postproc);  // Default (0) set in energy.h
   // Compute sums of energies, fields, and/or torques for all energies
   // in "energies" import.  On entry, oced.energy_accum, oced.H_accum,
   // and oced.mxH_accum should be set or null as desired.
@@ -65,5 +129,40 @@ void YY_2LatComputeEnergies(
   //    Data in Oxs_ComputeEnergyExtraData are filled in on the backside
   // of the chunk compute code.  These results could be computed by the
   // client, but doing it here gives improved cache locality.
+  //
+  //    If postproc is non-null, see YY_2LatChunkPostProcess above.
+  // In this case oceed.mxHxm must be null.  The same single pass over
+  // both sublattices is used without a post-processor when some term is
+  // a YY_2LatPairChunkEnergy and oceed.mxHxm is null; pair terms are
+  // then run on both sublattices at once.  oceed.max_mxH is not
+  // computed on that path and is returned as zero.
+
+void YY_2LatFirstTouch(
+    const vector<Oxs_MeshValue<ThreeVector>*>& vec_arrays,
+    const vector<Oxs_MeshValue<OC_REAL8m>*>& scalar_arrays);
+  // Zero-fills each of the import arrays in a threaded pass, with each
+  // thread writing only its own strip of the Oxs_StripedArray layout.
+  // The arrays must already be sized to the same mesh.  Strips are the
+  // unit of work for the chunk energies and the evolver sweeps, so on
+  // NUMA machines where pages are placed on first touch, this puts each
+  // strip in memory local to the thread that will stream it.  Call it
+  // right after AdjustSize, before any serial pass touches the arrays.
+
+void YY_2LatFillMeshValue(const Oxs_ScalarField* field,
+                          const Oxs_Mesh* mesh,
+                          Oxs_MeshValue<OC_REAL8m>& array);
+void YY_2LatFillMeshValue(const Oxs_VectorField* field,
+                          const Oxs_Mesh* mesh,
+                          Oxs_MeshValue<ThreeVector>& array);
+  // Drop-in replacements for field->FillMeshValue(mesh,array).  Fields
+  // of the native Oxs types whose Value() is a pure function of
+  // position (uniform, atlas, linear) are evaluated in a threaded pass
+  // over the Oxs_StripedArray strips, which also places each strip on
+  // first touch as YY_2LatFirstTouch does.  All other fields, which may
+  // call into the Tcl interpreter, are passed through to their own
+  // FillMeshValue on the calling thread.  Script fields can be made
+  // cheap to load by using YY_2LatBatchScriptScalarField or
+  // YY_2LatBatchScriptVectorField, which make one script call per
+  // batch of cells.
 
 #endif  // _YY_2LAT_UTIL
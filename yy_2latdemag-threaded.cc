@@ -52,6 +52,7 @@
 
 #include "rectangularmesh.h"
 #include "demagcoef.h"
+#include "yy_2lat_hugepage.h"
 
 OC_USE_STRING;
 
@@ -200,7 +201,7 @@ YY_2LatDemag::Oxs_FFTLocker::Oxs_FFTLocker
     ifftx_scratch_size(0), fftz_Hwork_size(0),
     fftyz_Hwork_size(0), fftyz_Hwork_base_size(0),
     fftyconvolve_Hwork_size(0),
-    A_copy_size(0)
+    A_copy_size(0), ffty_panel(0), ffty_panel_size(0)
 {
   // Check import data
   assert(info.rdimx>0 && info.rdimy>0 && info.rdimz>0 &&
@@ -265,8 +266,12 @@ YY_2LatDemag::Oxs_FFTLocker::~Oxs_FFTLocker()
   if(fftyconvolve_Hwork)
                     Oc_FreeThreadLocal(fftyconvolve_Hwork,
                        fftyconvolve_Hwork_size*sizeof(OXS_FFT_REAL_TYPE));
-  if(A_copy)        Oc_FreeThreadLocal(A_copy,
+  if(A_copy && A_copy_block.GetPtr()==0)
+                    Oc_FreeThreadLocal(A_copy,
                        A_copy_size*sizeof(YY_2LatDemag::A_coefs));
+  /// Otherwise A_copy lives in A_copy_block, which frees itself.
+  if(ffty_panel)    Oc_FreeThreadLocal(ffty_panel,
+                       ffty_panel_size*sizeof(OXS_FFT_REAL_TYPE));
 }
 
 ////////////////////////////////////////////////////////////////////////
@@ -281,8 +286,11 @@ YY_2LatDemag::YY_2LatDemag(
     xperiodic(0),yperiodic(0),zperiodic(0),
     mesh_id(0),
     A(0),asymptotic_radius(-1),Mtemp(0),
+    huge_pages(YY_2LAT_HUGEPAGE_NONE),
     MaxThreadCount(Oc_GetMaxThreadCount()),
-    embed_block_size(0), embed_yzblock_size(0)
+    ffty_panel_width(0),
+    embed_block_size(0), embed_yzblock_size(0),
+    frozen_mesh_id(0), static_stage(0)
 {
   asymptotic_radius = GetRealInitValue("asymptotic_radius",32.0);
   /// Units of (dx*dy*dz)^(1/3) (geometric mean of cell dimensions).
@@ -306,6 +314,20 @@ YY_2LatDemag::YY_2LatDemag(
   /// by a multiple of m, the torque and therefore the magnetization
   /// dynamics are unaffected.
 
+  String hpstr = GetStringInitValue("huge_pages","none");
+  if(!YY_2LatParseHugePageMode(hpstr,huge_pages)) {
+    String msg = String("Invalid huge_pages request: ") + hpstr
+      + String("\n Should be one of none, transparent, or explicit.");
+    throw Oxs_ExtError(this,msg.c_str());
+  }
+  /// Backing for the demag coefficients, Mtemp, and the FFT
+  /// workspaces.  On large meshes the strided y- and z-axis FFT
+  /// passes miss the TLB on nearly every access with 4 KB pages.
+
+  GetFrozenRegions();
+  /// Atlas regions whose magnetization is held fixed by the evolver.
+  /// Their stray field is computed once per stage and cached.
+
   VerifyAllInitArgsUsed();
 }
 
@@ -453,14 +475,15 @@ OC_BOOL YY_2LatDemag::Init()
   dottime.Reset();
 #endif // REPORT_TIME
   mesh_id = 0;
+  frozen_mesh_id = 0;
   ReleaseMemory();
   return Oxs_Energy::Init();
 }
 
 void YY_2LatDemag::ReleaseMemory() const
 { // Conceptually const
-  if(A!=0) { delete[] A; A=0; }
-  if(Mtemp!=0)       { delete[] Mtemp;       Mtemp=0;       }
+  A_block.Free();     A=0;
+  Mtemp_block.Free(); Mtemp=0;
   Hxfrm_base.Free();
   Hxfrm_base_yz.Free();
   rdimx=rdimy=rdimz=0;
@@ -522,7 +545,14 @@ void YY_2LatDemag::FillCoefficientArrays(const Oxs_Mesh* genmesh) const
   rdimz = mesh->DimZ();
   if(rdimx==0 || rdimy==0 || rdimz==0) return; // Empty mesh!
 
-  Mtemp = new OXS_FFT_REAL_TYPE[ODTV_VECSIZE*rdimx*rdimy*rdimz];
+  Mtemp = static_cast<OXS_FFT_REAL_TYPE*>
+    (Mtemp_block.Alloc(ODTV_VECSIZE*rdimx*rdimy*rdimz
+                       *sizeof(OXS_FFT_REAL_TYPE),
+                       huge_pages,"YY_2LatDemag Mtemp"));
+  if(Mtemp==NULL) {
+    String msg = String("Insufficient memory in Demag setup.");
+    throw Oxs_ExtError(this,msg);
+  }
   /// Temporary space to hold Ms[]*m[].  The plan is to make this space
   /// unnecessary by introducing FFT functions that can take Ms as input
   /// and do the multiplication on the fly.
@@ -600,6 +630,27 @@ void YY_2LatDemag::FillCoefficientArrays(const Oxs_Mesh* genmesh) const
     fprintf(stderr,"Embed yz-block size=%ld\n",long(embed_yzblock_size)); /**/
   }
 
+  // Panel width for the stand-alone y-axis FFT passes (cdimz>1).  The
+  // strided transforms touch cdimy rows of up to ODTV_VECSIZE*cdimx
+  // columns each; once that no longer fits in cache, each butterfly
+  // pass goes out to memory.  In that case columns are copied in
+  // panels into a contiguous buffer, transformed there and copied
+  // back.  The footprint counts the panel and the source rows.
+  ffty_panel_width = 0;
+  if(cdimz>1) {
+    const OC_INDEX panel_footprint
+      = 2*cdimy*ODTV_COMPLEXSIZE*sizeof(OXS_FFT_REAL_TYPE);
+    OC_INDEX trialsize = cache_size/(3*panel_footprint); // "3" is fudge
+    if(trialsize<8) trialsize = 8;
+    trialsize -= trialsize%8; // Whole cache lines per panel row
+    if(trialsize<ODTV_VECSIZE*cdimx) {
+      ffty_panel_width = trialsize;
+#if VERBOSE_DEBUG && !defined(NDEBUG)
+      fprintf(stderr,"FFTy panel width=%ld\n",long(ffty_panel_width)); /**/
+#endif // NDEBUG
+    }
+  }
+
   // The following 3 statements are cribbed from
   // Oxs_FFT3DThreeVector::SetDimensions().  The corresponding
   // code using that class is
@@ -654,6 +705,9 @@ void YY_2LatDemag::FillCoefficientArrays(const Oxs_Mesh* genmesh) const
   // Allocate memory for FFT xfrm target H, and scratch space
   // for computing interaction coefficients
   Hxfrm_base.SetSize(xfrm_size);
+  YY_2LatAdviseHugePages(Hxfrm_base.GetArrBase(),
+                         xfrm_size*sizeof(OXS_FFT_REAL_TYPE),
+                         huge_pages,"YY_2LatDemag Hxfrm");
   OXS_FFT_REAL_TYPE* scratch = new OXS_FFT_REAL_TYPE[scratch_size];
   if(scratch==NULL) {
     // Safety check for those machines on which new[] doesn't throw
@@ -1320,7 +1374,12 @@ void YY_2LatDemag::FillCoefficientArrays(const Oxs_Mesh* genmesh) const
   OC_INDEX astridey = adimx;
   OC_INDEX astridez = astridey*adimy;
   OC_INDEX a_size = astridez*adimz;
-  A = new A_coefs[a_size];
+  A = static_cast<A_coefs*>(A_block.Alloc(a_size*sizeof(A_coefs),
+                                          huge_pages,"YY_2LatDemag A"));
+  if(A==NULL) {
+    String msg = String("Insufficient memory in Demag setup.");
+    throw Oxs_ExtError(this,msg);
+  }
 
   OC_INDEX cstridey = 2*ODTV_VECSIZE*cdimx; // "2" for complex data
   OC_INDEX cstridez = cstridey*cdimy;
@@ -1960,6 +2019,17 @@ public:
 
   OC_INDEX jk_max;
 
+  // Frozen regions, forward direction only.  If row_class is set, then
+  // rows of class skip_class are zeroed instead of transformed, and
+  // mixed rows are transformed with Ms copied into Ms_mask, zeroed at
+  // the cells to leave out.  See YY_2LatDemag::ConvolveField.
+  const vector<char>* row_class;
+  const vector<char>* cell_frozen;
+  char skip_class;
+  OC_REAL8m* Ms_mask;
+
+  void ForwardFrozenRows(OC_INDEX k,OC_INDEX jstart,OC_INDEX jstop);
+
   enum { INVALID, FORWARD, INVERSE } direction;
   _YY_2LatDemagFFTxThread()
     : rarr(0),carr(0),
@@ -1968,10 +2038,44 @@ public:
       j_dim(0),j_rstride(0),j_cstride(0),
       k_rstride(0),k_cstride(0),
       jk_max(0),
+      row_class(0),cell_frozen(0),skip_class(0),Ms_mask(0),
       direction(INVALID) {}
   void Cmd(int threadnumber, void* data);
 };
 
+void _YY_2LatDemagFFTxThread::ForwardFrozenRows
+(OC_INDEX k,OC_INDEX jstart,OC_INDEX jstop)
+{ // Runs of rows of the same class are transformed together.
+  const OC_BOOL keep_frozen
+    = (skip_class == YY_2LatDemag::FROZEN_ROW_FREE);
+  OC_INDEX j = jstart;
+  while(j<jstop) {
+    const char rc = (*row_class)[j+k*j_dim];
+    const OC_INDEX istart = j*spin_xdim + k*spin_xydim;
+    OXS_FFT_REAL_TYPE* crow = carr+j*j_cstride+k*k_cstride;
+    if(rc == skip_class) {
+      for(OC_INDEX m=0;m<j_cstride;++m) crow[m] = 0.0;
+      ++j;
+    } else if(rc == YY_2LatDemag::FROZEN_ROW_MIXED) {
+      for(OC_INDEX i=istart;i<istart+spin_xdim;++i) {
+        Ms_mask[i] = ((*cell_frozen)[i]!=0) == keep_frozen ? (*Ms)[i] : 0.0;
+      }
+      fftx->AdjustArrayCount(1);
+      fftx->ForwardRealToComplexFFT(static_cast<const OC_REAL8m*>(&((*spin)[istart].x)), // CHEAT
+                                    crow,Ms_mask+istart);
+      ++j;
+    } else {
+      OC_INDEX jrun = j+1;
+      while(jrun<jstop && (*row_class)[jrun+k*j_dim] == rc) ++jrun;
+      fftx->AdjustArrayCount(jrun - j);
+      fftx->ForwardRealToComplexFFT(static_cast<const OC_REAL8m*>(&((*spin)[istart].x)), // CHEAT
+                                    crow,
+                                    static_cast<const OC_REAL8m*>(&((*Ms)[istart]))); // CHEAT
+      j = jrun;
+    }
+  }
+}
+
 void _YY_2LatDemagFFTxThread::Cmd(int threadnumber, void* /* data */)
 {
   // Thread local storage
@@ -2006,7 +2110,9 @@ void _YY_2LatDemagFFTxThread::Cmd(int threadnumber, void* /* data */)
     for(OC_INDEX k=kstart;k<=kstop;++k) {
       OC_INDEX j_line_stop = j_dim;
       if(k==kstop) j_line_stop = jstop;
-      if(jstart<j_line_stop) {
+      if(jstart<j_line_stop && direction == FORWARD && row_class) {
+        ForwardFrozenRows(k,jstart,j_line_stop);
+      } else if(jstart<j_line_stop) {
         fftx->AdjustArrayCount(j_line_stop - jstart);
         if(direction == FORWARD) {
           const OC_INDEX istart = jstart*spin_xdim + k*spin_xydim;
@@ -2033,6 +2139,12 @@ public:
   const Oxs_MeshValue<OC_REAL8m> *Ms_ptr;
   Oxs_ComputeEnergyData* oced_ptr;
 
+  // Frozen regions.  H_static, if set, is added to the field of each
+  // row.  If static_out is set, then the field is stored there and
+  // nothing else is computed.
+  const Oxs_MeshValue<ThreeVector>* H_static;
+  Oxs_MeshValue<ThreeVector>* static_out;
+
   YY_2LatDemag::Oxs_FFTLocker_Info locker_info;
   YY_2LatDemag::Oxs_FFTLocker* locker;
 
@@ -2069,7 +2181,8 @@ public:
 
   _YY_2LatDemagiFFTxDotThread()
     : carr(0),
-      spin_ptr(0), Ms_ptr(0), oced_ptr(0), locker(0),
+      spin_ptr(0), Ms_ptr(0), oced_ptr(0),
+      H_static(0), static_out(0), locker(0),
       rdimx(0), 
       j_dim(0), j_rstride(0), j_cstride(0),
       k_rstride(0), k_cstride(0),
@@ -2148,6 +2261,22 @@ void _YY_2LatDemagiFFTxDotThread::Cmd(int threadnumber, void* /* data */)
 
         fftx->InverseComplexToRealFFT(carr+j*j_cstride+k*k_cstride,scratch);
 
+        if(static_out) {
+          for(OC_INDEX i=0;i<rdimx;++i) {
+            (*static_out)[ioffset + i].Set(scratch[3*i],scratch[3*i+1],scratch[3*i+2]);
+          }
+          continue;
+        }
+
+        if(H_static) {
+          const ThreeVector* iHs = &((*H_static)[ioffset]);
+          for(OC_INDEX i=0;i<rdimx;++i) {
+            scratch[3*i]   += iHs[i].x;
+            scratch[3*i+1] += iHs[i].y;
+            scratch[3*i+2] += iHs[i].z;
+          }
+        }
+
         if(oced.H) {
           for(OC_INDEX i=0;i<rdimx;++i) {
             (*oced.H)[ioffset + i].Set(scratch[3*i],scratch[3*i+1],scratch[3*i+2]);
@@ -2339,6 +2468,7 @@ public:
   OXS_FFT_REAL_TYPE* carr;
 
   YY_2LatDemag::Oxs_FFTLocker_Info locker_info;
+  YY_2LatDemag::Oxs_FFTLocker* locker;
   Oxs_FFTStrided* ffty;
 
   static _YY_2LatDemagJobControl job_control;
@@ -2346,12 +2476,13 @@ public:
   OC_INDEX k_stride;
   OC_INDEX k_dim;
   OC_INDEX i_dim;
+  OC_INDEX panel_width; // 0 => transform in place
 
   enum { INVALID, FORWARD, INVERSE } direction;
   _YY_2LatDemagFFTyThread()
-    : carr(0), ffty(0),
+    : carr(0), locker(0), ffty(0),
       k_stride(0), k_dim(0),
-      i_dim(0), direction(INVALID) {}
+      i_dim(0), panel_width(0), direction(INVALID) {}
   void Cmd(int threadnumber, void* data);
 };
 
@@ -2367,16 +2498,35 @@ void _YY_2LatDemagFFTyThread::Cmd(int /* threadnumber */, void* /* data */)
       foo = new YY_2LatDemag::Oxs_FFTLocker(locker_info);
       local_locker.AddItem(locker_info.name,foo);
     }
-    ffty = &(dynamic_cast<YY_2LatDemag::Oxs_FFTLocker*>(foo)->ffty);
-    if(!ffty) {
+    locker = dynamic_cast<YY_2LatDemag::Oxs_FFTLocker*>(foo);
+    if(!locker) {
       Oxs_ThreadError::SetError(String("Error in"
-         "_YY_2LatDemagFFTyThread::Cmd(): ffty downcast failed."));
+         "_YY_2LatDemagFFTyThread::Cmd(): locker downcast failed."));
       return;
     }
+    ffty = &(locker->ffty);
   }
 
   const OC_INDEX istride = ODTV_COMPLEXSIZE;
 
+  // Panel staging.  Rows of the panel are padded by a cache line so
+  // that successive rows don't map onto the same cache sets.
+  const OC_INDEX rdimy = locker_info.rdimy;
+  const OC_INDEX cdimy = locker_info.cdimy;
+  const OC_INDEX jstride = ODTV_COMPLEXSIZE*ODTV_VECSIZE*locker_info.cdimx;
+  const OC_INDEX panel_stride = ODTV_COMPLEXSIZE*panel_width
+    + OC_CACHE_LINESIZE/sizeof(OXS_FFT_REAL_TYPE);
+  if(panel_width>0 && locker->ffty_panel == NULL) {
+    size_t psize = static_cast<size_t>(panel_stride*cdimy);
+    locker->ffty_panel = static_cast<OXS_FFT_REAL_TYPE*>
+      (Oc_AllocThreadLocal(psize*sizeof(OXS_FFT_REAL_TYPE)));
+    locker->ffty_panel_size = psize;
+    locker->ffty_panel_fft.SetDimensions(rdimy,cdimy,
+                                         panel_stride,panel_width);
+  }
+  OXS_FFT_REAL_TYPE* const panel = locker->ffty_panel;
+  Oxs_FFTStrided* const pfft = &(locker->ffty_panel_fft);
+
   while(1) {
     OC_INDEX ikstart,ikstop;
     job_control.ClaimJob(ikstart,ikstop);
@@ -2392,11 +2542,39 @@ void _YY_2LatDemagFFTyThread::Cmd(int /* threadnumber */, void* /* data */)
       OC_INDEX i_line_stop = i_dim;
       if(k==kstop) i_line_stop = istop;
       if(istart>=i_line_stop) continue;
-      ffty->AdjustArrayCount(i_line_stop - istart);
-      if(direction == FORWARD) {
-        ffty->ForwardFFT(carr+istart*istride+k*k_stride);
-      } else { // direction == INVERSE
-        ffty->InverseFFT(carr+istart*istride+k*k_stride);
+      if(panel_width<=0 || i_line_stop - istart <= panel_width) {
+        ffty->AdjustArrayCount(i_line_stop - istart);
+        if(direction == FORWARD) {
+          ffty->ForwardFFT(carr+istart*istride+k*k_stride);
+        } else { // direction == INVERSE
+          ffty->InverseFFT(carr+istart*istride+k*k_stride);
+        }
+        continue;
+      }
+      // Wide range; transform panel_width columns at a time in the
+      // contiguous panel.  Forward reads rdimy rows and writes cdimy,
+      // inverse the other way around.
+      const OC_INDEX rows_in  = (direction == FORWARD ? rdimy : cdimy);
+      const OC_INDEX rows_out = (direction == FORWARD ? cdimy : rdimy);
+      for(OC_INDEX i=istart;i<i_line_stop;i+=panel_width) {
+        const OC_INDEX width = (i+panel_width<i_line_stop
+                                ? panel_width : i_line_stop - i);
+        const size_t rowbytes = static_cast<size_t>(ODTV_COMPLEXSIZE*width)
+          *sizeof(OXS_FFT_REAL_TYPE);
+        OXS_FFT_REAL_TYPE* const base = carr+i*istride+k*k_stride;
+        OC_INDEX j;
+        for(j=0;j<rows_in;++j) {
+          memcpy(panel+j*panel_stride,base+j*jstride,rowbytes);
+        }
+        pfft->AdjustArrayCount(width);
+        if(direction == FORWARD) {
+          pfft->ForwardFFT(panel);
+        } else { // direction == INVERSE
+          pfft->InverseFFT(panel);
+        }
+        for(j=0;j<rows_out;++j) {
+          memcpy(base+j*jstride,panel+j*panel_stride,rowbytes);
+        }
       }
     }
 
@@ -2489,19 +2667,7 @@ void _YY_2LatDemagFFTyConvolveThread::Cmd(int /* threadnumber */, void* /* data
           const YY_2LatDemag::A_coefs& Aref = A[i];
           {
             OC_INDEX  index = istride*(i-ix);
-            OXS_FFT_REAL_TYPE Hx_re = Hwork[index];
-            OXS_FFT_REAL_TYPE Hx_im = Hwork[index+1];
-            OXS_FFT_REAL_TYPE Hy_re = Hwork[index+2];
-            OXS_FFT_REAL_TYPE Hy_im = Hwork[index+3];
-            OXS_FFT_REAL_TYPE Hz_re = Hwork[index+4];
-            OXS_FFT_REAL_TYPE Hz_im = Hwork[index+5];
-
-            Hwork[index]   = Aref.A00*Hx_re + Aref.A01*Hy_re + Aref.A02*Hz_re;
-            Hwork[index+1] = Aref.A00*Hx_im + Aref.A01*Hy_im + Aref.A02*Hz_im;
-            Hwork[index+2] = Aref.A01*Hx_re + Aref.A11*Hy_re + Aref.A12*Hz_re;
-            Hwork[index+3] = Aref.A01*Hx_im + Aref.A11*Hy_im + Aref.A12*Hz_im;
-            Hwork[index+4] = Aref.A02*Hx_re + Aref.A12*Hy_re + Aref.A22*Hz_re;
-            Hwork[index+5] = Aref.A02*Hx_im + Aref.A12*Hy_im + Aref.A22*Hz_im;
+            YY_2LatDemagApplyA<1,1>(Aref,Hwork+index);
           }
         }
       }
@@ -2515,37 +2681,13 @@ void _YY_2LatDemagFFTyConvolveThread::Cmd(int /* threadnumber */, void* /* data
           const YY_2LatDemag::A_coefs& Aref = A[ajindex+i];
           { // j>0
             OC_INDEX  index = jindex + istride*(i-ix);
-            OXS_FFT_REAL_TYPE Hx_re = Hwork[index];
-            OXS_FFT_REAL_TYPE Hx_im = Hwork[index+1];
-            OXS_FFT_REAL_TYPE Hy_re = Hwork[index+2];
-            OXS_FFT_REAL_TYPE Hy_im = Hwork[index+3];
-            OXS_FFT_REAL_TYPE Hz_re = Hwork[index+4];
-            OXS_FFT_REAL_TYPE Hz_im = Hwork[index+5];
-
-            Hwork[index]   = Aref.A00*Hx_re + Aref.A01*Hy_re + Aref.A02*Hz_re;
-            Hwork[index+1] = Aref.A00*Hx_im + Aref.A01*Hy_im + Aref.A02*Hz_im;
-            Hwork[index+2] = Aref.A01*Hx_re + Aref.A11*Hy_re + Aref.A12*Hz_re;
-            Hwork[index+3] = Aref.A01*Hx_im + Aref.A11*Hy_im + Aref.A12*Hz_im;
-            Hwork[index+4] = Aref.A02*Hx_re + Aref.A12*Hy_re + Aref.A22*Hz_re;
-            Hwork[index+5] = Aref.A02*Hx_im + Aref.A12*Hy_im + Aref.A22*Hz_im;
+            YY_2LatDemagApplyA<1,1>(Aref,Hwork+index);
           }
           { // j2<0
             OC_INDEX  index2 = j2index + istride*(i-ix);
-            OXS_FFT_REAL_TYPE Hx_re = Hwork[index2];
-            OXS_FFT_REAL_TYPE Hx_im = Hwork[index2+1];
-            OXS_FFT_REAL_TYPE Hy_re = Hwork[index2+2];
-            OXS_FFT_REAL_TYPE Hy_im = Hwork[index2+3];
-            OXS_FFT_REAL_TYPE Hz_re = Hwork[index2+4];
-            OXS_FFT_REAL_TYPE Hz_im = Hwork[index2+5];
-
             // Flip signs on a01 and a12 as compared to the j>=0
             // case because a01 and a12 are odd in y.
-            Hwork[index2]   =  Aref.A00*Hx_re - Aref.A01*Hy_re + Aref.A02*Hz_re;
-            Hwork[index2+1] =  Aref.A00*Hx_im - Aref.A01*Hy_im + Aref.A02*Hz_im;
-            Hwork[index2+2] = -Aref.A01*Hx_re + Aref.A11*Hy_re - Aref.A12*Hz_re;
-            Hwork[index2+3] = -Aref.A01*Hx_im + Aref.A11*Hy_im - Aref.A12*Hz_im;
-            Hwork[index2+4] =  Aref.A02*Hx_re - Aref.A12*Hy_re + Aref.A22*Hz_re;
-            Hwork[index2+5] =  Aref.A02*Hx_im - Aref.A12*Hy_im + Aref.A22*Hz_im;
+            YY_2LatDemagApplyA<-1,1>(Aref,Hwork+index2);
           }
         }
       }
@@ -2561,19 +2703,7 @@ void _YY_2LatDemagFFTyConvolveThread::Cmd(int /* threadnumber */, void* /* data
           const YY_2LatDemag::A_coefs& Aref = A[ajindex+i];
           { // j>0
             OC_INDEX  index = jindex + istride*(i-ix);
-            OXS_FFT_REAL_TYPE Hx_re = Hwork[index];
-            OXS_FFT_REAL_TYPE Hx_im = Hwork[index+1];
-            OXS_FFT_REAL_TYPE Hy_re = Hwork[index+2];
-            OXS_FFT_REAL_TYPE Hy_im = Hwork[index+3];
-            OXS_FFT_REAL_TYPE Hz_re = Hwork[index+4];
-            OXS_FFT_REAL_TYPE Hz_im = Hwork[index+5];
-
-            Hwork[index]   = Aref.A00*Hx_re + Aref.A01*Hy_re + Aref.A02*Hz_re;
-            Hwork[index+1] = Aref.A00*Hx_im + Aref.A01*Hy_im + Aref.A02*Hz_im;
-            Hwork[index+2] = Aref.A01*Hx_re + Aref.A11*Hy_re + Aref.A12*Hz_re;
-            Hwork[index+3] = Aref.A01*Hx_im + Aref.A11*Hy_im + Aref.A12*Hz_im;
-            Hwork[index+4] = Aref.A02*Hx_re + Aref.A12*Hy_re + Aref.A22*Hz_re;
-            Hwork[index+5] = Aref.A02*Hx_im + Aref.A12*Hy_im + Aref.A22*Hz_im;
+            YY_2LatDemagApplyA<1,1>(Aref,Hwork+index);
           }
         }
       }
@@ -2595,6 +2725,7 @@ class _YY_2LatDemagFFTzConvolveThread : public Oxs_ThreadRunObj {
 public:
   OXS_FFT_REAL_TYPE* Hxfrm;
   const YY_2LatDemag::A_coefs* A;
+  YY_2LatHugePageMode huge_pages; // Backing for locker->A_copy
 
   YY_2LatDemag::Oxs_FFTLocker_Info locker_info;
   YY_2LatDemag::Oxs_FFTLocker* locker;
@@ -2609,7 +2740,7 @@ public:
   OC_INDEX jstride,ajstride;
   OC_INDEX kstride,akstride;
   _YY_2LatDemagFFTzConvolveThread()
-    : Hxfrm(0), A(0), locker(0),
+    : Hxfrm(0), A(0), huge_pages(YY_2LAT_HUGEPAGE_NONE), locker(0),
       thread_count(0),
       cdimx(0),cdimy(0),cdimz(0),
       adimx(0),adimy(0),adimz(0),rdimz(0),
@@ -2649,8 +2780,21 @@ void _YY_2LatDemagFFTzConvolveThread::Cmd(int /* threadnumber */, void* /* data
   if(locker->A_copy == NULL) {
     size_t asize = static_cast<size_t>(adimx*adimy*adimz);
     locker->A_copy_size = asize;
-    locker->A_copy = static_cast<YY_2LatDemag::A_coefs*>
-      (Oc_AllocThreadLocal(asize*sizeof(YY_2LatDemag::A_coefs)));
+    if(huge_pages == YY_2LAT_HUGEPAGE_NONE) {
+      locker->A_copy = static_cast<YY_2LatDemag::A_coefs*>
+        (Oc_AllocThreadLocal(asize*sizeof(YY_2LatDemag::A_coefs)));
+    } else {
+      // The memcpy below is the first touch, so the pages still land
+      // on this thread's node.
+      locker->A_copy = static_cast<YY_2LatDemag::A_coefs*>
+        (locker->A_copy_block.Alloc(asize*sizeof(YY_2LatDemag::A_coefs),
+                                    huge_pages,"YY_2LatDemag A copy"));
+      if(locker->A_copy == NULL) {
+        Oxs_ThreadError::SetError(String("Error in YY_2LatDemag:"
+           " insufficient memory for thread copy of A."));
+        return;
+      }
+    }
     memcpy(locker->A_copy,A,asize*sizeof(YY_2LatDemag::A_coefs));
   }
   const YY_2LatDemag::A_coefs* const Acopy = locker->A_copy;
@@ -2719,36 +2863,12 @@ void _YY_2LatDemagFFTzConvolveThread::Cmd(int /* threadnumber */, void* /* data
             const YY_2LatDemag::A_coefs& Aref = Acopy[akindex+i];
             const OC_INDEX index = ODTV_COMPLEXSIZE*ODTV_VECSIZE*(i-m)+windex;
             {
-              OXS_FFT_REAL_TYPE Hx_re = Hwork1[index];
-              OXS_FFT_REAL_TYPE Hx_im = Hwork1[index+1];
-              OXS_FFT_REAL_TYPE Hy_re = Hwork1[index+2];
-              OXS_FFT_REAL_TYPE Hy_im = Hwork1[index+3];
-              OXS_FFT_REAL_TYPE Hz_re = Hwork1[index+4];
-              OXS_FFT_REAL_TYPE Hz_im = Hwork1[index+5];
-
-              Hwork1[index]   = Aref.A00*Hx_re + Aref.A01*Hy_re + Aref.A02*Hz_re;
-              Hwork1[index+1] = Aref.A00*Hx_im + Aref.A01*Hy_im + Aref.A02*Hz_im;
-              Hwork1[index+2] = Aref.A01*Hx_re + Aref.A11*Hy_re + Aref.A12*Hz_re;
-              Hwork1[index+3] = Aref.A01*Hx_im + Aref.A11*Hy_im + Aref.A12*Hz_im;
-              Hwork1[index+4] = Aref.A02*Hx_re + Aref.A12*Hy_re + Aref.A22*Hz_re;
-              Hwork1[index+5] = Aref.A02*Hx_im + Aref.A12*Hy_im + Aref.A22*Hz_im;
+              YY_2LatDemagApplyA<1,1>(Aref,Hwork1+index);
             }
             if(adimy<=j2 && j2<cdimy) {
-              OXS_FFT_REAL_TYPE Hx_re = Hwork2[index];
-              OXS_FFT_REAL_TYPE Hx_im = Hwork2[index+1];
-              OXS_FFT_REAL_TYPE Hy_re = Hwork2[index+2];
-              OXS_FFT_REAL_TYPE Hy_im = Hwork2[index+3];
-              OXS_FFT_REAL_TYPE Hz_re = Hwork2[index+4];
-              OXS_FFT_REAL_TYPE Hz_im = Hwork2[index+5];
-
               // Flip signs on a01 and a12 as compared to the j>=0
               // case because a01 and a12 are odd in y.
-              Hwork2[index]   =  Aref.A00*Hx_re - Aref.A01*Hy_re + Aref.A02*Hz_re;
-              Hwork2[index+1] =  Aref.A00*Hx_im - Aref.A01*Hy_im + Aref.A02*Hz_im;
-              Hwork2[index+2] = -Aref.A01*Hx_re + Aref.A11*Hy_re - Aref.A12*Hz_re;
-              Hwork2[index+3] = -Aref.A01*Hx_im + Aref.A11*Hy_im - Aref.A12*Hz_im;
-              Hwork2[index+4] =  Aref.A02*Hx_re - Aref.A12*Hy_re + Aref.A22*Hz_re;
-              Hwork2[index+5] =  Aref.A02*Hx_im - Aref.A12*Hy_im + Aref.A22*Hz_im;
+              YY_2LatDemagApplyA<-1,1>(Aref,Hwork2+index);
             }
           }
         }
@@ -2760,40 +2880,16 @@ void _YY_2LatDemagFFTzConvolveThread::Cmd(int /* threadnumber */, void* /* data
             const YY_2LatDemag::A_coefs& Aref = Acopy[akindex+i];
             const OC_INDEX index = ODTV_COMPLEXSIZE*ODTV_VECSIZE*(i-m)+windex;
             {
-              OXS_FFT_REAL_TYPE Hx_re = Hwork1[index];
-              OXS_FFT_REAL_TYPE Hx_im = Hwork1[index+1];
-              OXS_FFT_REAL_TYPE Hy_re = Hwork1[index+2];
-              OXS_FFT_REAL_TYPE Hy_im = Hwork1[index+3];
-              OXS_FFT_REAL_TYPE Hz_re = Hwork1[index+4];
-              OXS_FFT_REAL_TYPE Hz_im = Hwork1[index+5];
-
               // Flip signs on a02 and a12 as compared to the k>=0, j>=0 case
               // because a02 and a12 are odd in z.
-              Hwork1[index]   =  Aref.A00*Hx_re + Aref.A01*Hy_re - Aref.A02*Hz_re;
-              Hwork1[index+1] =  Aref.A00*Hx_im + Aref.A01*Hy_im - Aref.A02*Hz_im;
-              Hwork1[index+2] =  Aref.A01*Hx_re + Aref.A11*Hy_re - Aref.A12*Hz_re;
-              Hwork1[index+3] =  Aref.A01*Hx_im + Aref.A11*Hy_im - Aref.A12*Hz_im;
-              Hwork1[index+4] = -Aref.A02*Hx_re - Aref.A12*Hy_re + Aref.A22*Hz_re;
-              Hwork1[index+5] = -Aref.A02*Hx_im - Aref.A12*Hy_im + Aref.A22*Hz_im;
+              YY_2LatDemagApplyA<1,-1>(Aref,Hwork1+index);
             }
             if(adimy<=j2 && j2<cdimy) {
-              OXS_FFT_REAL_TYPE Hx_re = Hwork2[index];
-              OXS_FFT_REAL_TYPE Hx_im = Hwork2[index+1];
-              OXS_FFT_REAL_TYPE Hy_re = Hwork2[index+2];
-              OXS_FFT_REAL_TYPE Hy_im = Hwork2[index+3];
-              OXS_FFT_REAL_TYPE Hz_re = Hwork2[index+4];
-              OXS_FFT_REAL_TYPE Hz_im = Hwork2[index+5];
-
               // Flip signs on a01 and a02 as compared to the k>=0, j>=0 case
               // because a01 is odd in y and even in z,
               //     and a02 is odd in z and even in y.
               // No change to a12 because it is odd in both y and z.
-              Hwork2[index]   =  Aref.A00*Hx_re - Aref.A01*Hy_re - Aref.A02*Hz_re;
-              Hwork2[index+1] =  Aref.A00*Hx_im - Aref.A01*Hy_im - Aref.A02*Hz_im;
-              Hwork2[index+2] = -Aref.A01*Hx_re + Aref.A11*Hy_re + Aref.A12*Hz_re;
-              Hwork2[index+3] = -Aref.A01*Hx_im + Aref.A11*Hy_im + Aref.A12*Hz_im;
-              Hwork2[index+4] = -Aref.A02*Hx_re + Aref.A12*Hy_re + Aref.A22*Hz_re;
-              Hwork2[index+5] = -Aref.A02*Hx_im + Aref.A12*Hy_im + Aref.A22*Hz_im;
+              YY_2LatDemagApplyA<-1,-1>(Aref,Hwork2+index);
             }
           }
         }
@@ -2828,6 +2924,7 @@ void _YY_2LatDemagFFTzConvolveThread::Cmd(int /* threadnumber */, void* /* data
 class _YY_2LatDemagFFTyzConvolveThread : public Oxs_ThreadRunObj {
 public:
   const YY_2LatDemag::A_coefs* A;
+  YY_2LatHugePageMode huge_pages; // Backing for locker->A_copy
   OXS_FFT_REAL_TYPE* carr;
 
   YY_2LatDemag::Oxs_FFTLocker_Info locker_info;
@@ -2841,7 +2938,7 @@ public:
   OC_INDEX embed_block_size;
 
   _YY_2LatDemagFFTyzConvolveThread()
-    : A(0), carr(0), locker(0),
+    : A(0), huge_pages(YY_2LAT_HUGEPAGE_NONE), carr(0), locker(0),
       rdimx(0),rdimy(0),rdimz(0),
       cdimx(0),cdimy(0),cdimz(0),
       adimx(0),adimy(0),adimz(0),
@@ -2889,8 +2986,21 @@ void _YY_2LatDemagFFTyzConvolveThread::Cmd(int thread_number, void* /* data */)
   if(locker->A_copy == NULL) {
     size_t asize = static_cast<size_t>(adimx*adimy*adimz);
     locker->A_copy_size = asize;
-    locker->A_copy = static_cast<YY_2LatDemag::A_coefs*>
-      (Oc_AllocThreadLocal(asize*sizeof(YY_2LatDemag::A_coefs)));
+    if(huge_pages == YY_2LAT_HUGEPAGE_NONE) {
+      locker->A_copy = static_cast<YY_2LatDemag::A_coefs*>
+        (Oc_AllocThreadLocal(asize*sizeof(YY_2LatDemag::A_coefs)));
+    } else {
+      // The memcpy below is the first touch, so the pages still land
+      // on this thread's node.
+      locker->A_copy = static_cast<YY_2LatDemag::A_coefs*>
+        (locker->A_copy_block.Alloc(asize*sizeof(YY_2LatDemag::A_coefs),
+                                    huge_pages,"YY_2LatDemag A copy"));
+      if(locker->A_copy == NULL) {
+        Oxs_ThreadError::SetError(String("Error in YY_2LatDemag:"
+           " insufficient memory for thread copy of A."));
+        return;
+      }
+    }
     memcpy(locker->A_copy,A,asize*sizeof(YY_2LatDemag::A_coefs));
   }
   const YY_2LatDemag::A_coefs* const Acopy = locker->A_copy;
@@ -2970,19 +3080,7 @@ void _YY_2LatDemagFFTyzConvolveThread::Cmd(int thread_number, void* /* data */)
           const YY_2LatDemag::A_coefs& Aref = Acopy[Aindex+i];
           { // j>=0, k>=0
             const OC_INDEX index = Hindex + (ODTV_COMPLEXSIZE*ODTV_VECSIZE)*i;
-            OXS_FFT_REAL_TYPE Hx_re = Hwork[index];
-            OXS_FFT_REAL_TYPE Hy_re = Hwork[index+2];
-            OXS_FFT_REAL_TYPE Hz_re = Hwork[index+4];
-            Hwork[index]   = Aref.A00*Hx_re + Aref.A01*Hy_re + Aref.A02*Hz_re;
-            Hwork[index+2] = Aref.A01*Hx_re + Aref.A11*Hy_re + Aref.A12*Hz_re;
-            Hwork[index+4] = Aref.A02*Hx_re + Aref.A12*Hy_re + Aref.A22*Hz_re;
-
-            OXS_FFT_REAL_TYPE Hx_im = Hwork[index+1];
-            OXS_FFT_REAL_TYPE Hy_im = Hwork[index+3];
-            OXS_FFT_REAL_TYPE Hz_im = Hwork[index+5];
-            Hwork[index+1] = Aref.A00*Hx_im + Aref.A01*Hy_im + Aref.A02*Hz_im;
-            Hwork[index+3] = Aref.A01*Hx_im + Aref.A11*Hy_im + Aref.A12*Hz_im;
-            Hwork[index+5] = Aref.A02*Hx_im + Aref.A12*Hy_im + Aref.A22*Hz_im;
+            YY_2LatDemagApplyA<1,1>(Aref,Hwork+index);
           }
           const OC_INDEX j2 = cdimy-j1;
           if(adimy<=j2 && j2<cdimy) {
@@ -2991,19 +3089,7 @@ void _YY_2LatDemagFFTyzConvolveThread::Cmd(int thread_number, void* /* data */)
             // case because a01 and a12 are odd in y.
             const OC_INDEX index = k1*Hwkstride + (cdimy-j1)*Hwjstride
               + ODTV_COMPLEXSIZE*ODTV_VECSIZE*i;
-            OXS_FFT_REAL_TYPE Hx_re = Hwork[index];
-            OXS_FFT_REAL_TYPE Hy_re = Hwork[index+2];
-            OXS_FFT_REAL_TYPE Hz_re = Hwork[index+4];
-            Hwork[index]   =  Aref.A00*Hx_re - Aref.A01*Hy_re + Aref.A02*Hz_re;
-            Hwork[index+2] = -Aref.A01*Hx_re + Aref.A11*Hy_re - Aref.A12*Hz_re;
-            Hwork[index+4] =  Aref.A02*Hx_re - Aref.A12*Hy_re + Aref.A22*Hz_re;
-            
-            OXS_FFT_REAL_TYPE Hx_im = Hwork[index+1];
-            OXS_FFT_REAL_TYPE Hy_im = Hwork[index+3];
-            OXS_FFT_REAL_TYPE Hz_im = Hwork[index+5];
-            Hwork[index+1] =  Aref.A00*Hx_im - Aref.A01*Hy_im + Aref.A02*Hz_im;
-            Hwork[index+3] = -Aref.A01*Hx_im + Aref.A11*Hy_im - Aref.A12*Hz_im;
-            Hwork[index+5] =  Aref.A02*Hx_im - Aref.A12*Hy_im + Aref.A22*Hz_im;
+            YY_2LatDemagApplyA<-1,1>(Aref,Hwork+index);
           }
           const OC_INDEX k2 = cdimz-k1;
           if(adimz<=k2 && k2<cdimz) {
@@ -3012,19 +3098,7 @@ void _YY_2LatDemagFFTyzConvolveThread::Cmd(int thread_number, void* /* data */)
             // because a02 and a12 are odd in z.
             const OC_INDEX index = (cdimz-k1)*Hwkstride + j1*Hwjstride
               + ODTV_COMPLEXSIZE*ODTV_VECSIZE*i;
-            OXS_FFT_REAL_TYPE Hx_re = Hwork[index];
-            OXS_FFT_REAL_TYPE Hy_re = Hwork[index+2];
-            OXS_FFT_REAL_TYPE Hz_re = Hwork[index+4];
-            Hwork[index]   =  Aref.A00*Hx_re + Aref.A01*Hy_re - Aref.A02*Hz_re;
-            Hwork[index+2] =  Aref.A01*Hx_re + Aref.A11*Hy_re - Aref.A12*Hz_re;
-            Hwork[index+4] = -Aref.A02*Hx_re - Aref.A12*Hy_re + Aref.A22*Hz_re;
-
-            OXS_FFT_REAL_TYPE Hx_im = Hwork[index+1];
-            OXS_FFT_REAL_TYPE Hy_im = Hwork[index+3];
-            OXS_FFT_REAL_TYPE Hz_im = Hwork[index+5];
-            Hwork[index+1] =  Aref.A00*Hx_im + Aref.A01*Hy_im - Aref.A02*Hz_im;
-            Hwork[index+3] =  Aref.A01*Hx_im + Aref.A11*Hy_im - Aref.A12*Hz_im;
-            Hwork[index+5] = -Aref.A02*Hx_im - Aref.A12*Hy_im + Aref.A22*Hz_im;
+            YY_2LatDemagApplyA<1,-1>(Aref,Hwork+index);
           }
           if(adimy<=j2 && j2<cdimy && adimz<=k2 && k2<cdimz) {
             // j<0, k<0
@@ -3034,19 +3108,7 @@ void _YY_2LatDemagFFTyzConvolveThread::Cmd(int thread_number, void* /* data */)
             // No change to a12 because it is odd in both y and z.
             const OC_INDEX index = (cdimz-k1)*Hwkstride + (cdimy-j1)*Hwjstride
               + ODTV_COMPLEXSIZE*ODTV_VECSIZE*i;
-            OXS_FFT_REAL_TYPE Hx_re = Hwork[index];
-            OXS_FFT_REAL_TYPE Hy_re = Hwork[index+2];
-            OXS_FFT_REAL_TYPE Hz_re = Hwork[index+4];
-            Hwork[index]   =  Aref.A00*Hx_re - Aref.A01*Hy_re - Aref.A02*Hz_re;
-            Hwork[index+2] = -Aref.A01*Hx_re + Aref.A11*Hy_re + Aref.A12*Hz_re;
-            Hwork[index+4] = -Aref.A02*Hx_re + Aref.A12*Hy_re + Aref.A22*Hz_re;
-
-            OXS_FFT_REAL_TYPE Hx_im = Hwork[index+1];
-            OXS_FFT_REAL_TYPE Hy_im = Hwork[index+3];
-            OXS_FFT_REAL_TYPE Hz_im = Hwork[index+5];
-            Hwork[index+1] =  Aref.A00*Hx_im - Aref.A01*Hy_im - Aref.A02*Hz_im;
-            Hwork[index+3] = -Aref.A01*Hx_im + Aref.A11*Hy_im + Aref.A12*Hz_im;
-            Hwork[index+5] = -Aref.A02*Hx_im + Aref.A12*Hy_im + Aref.A22*Hz_im;
+            YY_2LatDemagApplyA<-1,-1>(Aref,Hwork+index);
           }
         } // for(i)
       } // for(j1)
@@ -3103,27 +3165,11 @@ void _YY_2LatDemagFFTyzConvolveThread::Cmd(int thread_number, void* /* data */)
 // asdf //////////////////////////////
 
 
-// Note: 2015-03-06 Yu Yahagi
-// For now, ComputeEnergy is called twice for each sublattice. Since it 
-// repeats almost identical calculations with the total spin, it can and
-// should be much more efficient either by caching or calling it just once.
-void YY_2LatDemag::ComputeEnergy
-(const Oxs_SimState& state,
- Oxs_ComputeEnergyData& oced
- ) const
+void YY_2LatDemag::ConvolveField
+(const Oxs_MeshValue<ThreeVector>& spin,
+ const Oxs_MeshValue<OC_REAL8m>& Ms,
+ char skip_class) const
 {
-  // (Re)-initialize mesh coefficient array if mesh has changed.
-  if(mesh_id != state.mesh->Id()) {
-    mesh_id = 0; // Safety
-    FillCoefficientArrays(state.mesh);
-    mesh_id = state.mesh->Id();
-  }
-
-  const Oxs_MeshValue<ThreeVector>& spin = state.total_lattice->spin;
-  const Oxs_MeshValue<ThreeVector>& spinA = state.spin;
-  const Oxs_MeshValue<OC_REAL8m>& Ms = *(state.total_lattice->Ms);
-  const Oxs_MeshValue<OC_REAL8m>& MsA = *(state.Ms);
-
   // Fill Mtemp with Ms[]*spin[].  The plan is to eventually
   // roll this step into the forward FFT routine.
   assert(rdimx*rdimy*rdimz == Ms.Size());
@@ -3143,7 +3189,13 @@ void YY_2LatDemag::ComputeEnergy
       Hxfrm_kstride = cxydim;
     } else {
       // For yz-convolve code.  This has a smaller footprint
-      Hxfrm_base_yz.SetSize(2*ODTV_VECSIZE*cdimx*rdimy*rdimz);
+      const OC_INDEX yz_size = 2*ODTV_VECSIZE*cdimx*rdimy*rdimz;
+      if(Hxfrm_base_yz.GetSize() != yz_size) {
+        Hxfrm_base_yz.SetSize(yz_size);
+        YY_2LatAdviseHugePages(Hxfrm_base_yz.GetArrBase(),
+                               yz_size*sizeof(OXS_FFT_REAL_TYPE),
+                               huge_pages,"YY_2LatDemag Hxfrm yz");
+      }
       Hxfrm = Hxfrm_base_yz.GetArrBase();
       Hxfrm_kstride = cxdim*rdimy;
     }
@@ -3177,6 +3229,13 @@ void YY_2LatDemag::ComputeEnergy
 
       fftx_thread[ithread].jk_max = rdimy*rdimz;
 
+      if(!frozen_cell.empty()) {
+        fftx_thread[ithread].row_class = &frozen_row;
+        fftx_thread[ithread].cell_frozen = &frozen_cell;
+        fftx_thread[ithread].skip_class = skip_class;
+        fftx_thread[ithread].Ms_mask = &(Ms_mask[OC_INDEX(0)]);
+      }
+
       fftx_thread[ithread].direction = _YY_2LatDemagFFTxThread::FORWARD;
       if(ithread>0) threadtree.Launch(fftx_thread[ithread],0);
     }
@@ -3245,6 +3304,7 @@ void YY_2LatDemag::ComputeEnergy
         ffty_thread[ithread].k_stride = cxydim;
         ffty_thread[ithread].k_dim = rdimz;
         ffty_thread[ithread].i_dim = cdimx*ODTV_VECSIZE;
+        ffty_thread[ithread].panel_width = ffty_panel_width;
         ffty_thread[ithread].direction = _YY_2LatDemagFFTyThread::FORWARD;
         if(ithread>0) threadtree.Launch(ffty_thread[ithread],0);
       }
@@ -3297,6 +3357,7 @@ void YY_2LatDemag::ComputeEnergy
       for(ithread=0;ithread<MaxThreadCount;++ithread) {
         fftzconv[ithread].Hxfrm = Hxfrm;
         fftzconv[ithread].A = A;
+        fftzconv[ithread].huge_pages = huge_pages;
         fftzconv[ithread].locker_info.Set(rdimx,rdimy,rdimz,
                                           cdimx,cdimy,cdimz,
                                           embed_block_size,
@@ -3348,6 +3409,7 @@ void YY_2LatDemag::ComputeEnergy
         ffty_thread[ithread].k_stride = cxydim;
         ffty_thread[ithread].k_dim = rdimz;
         ffty_thread[ithread].i_dim = cdimx*ODTV_VECSIZE;
+        ffty_thread[ithread].panel_width = ffty_panel_width;
         ffty_thread[ithread].direction = _YY_2LatDemagFFTyThread::INVERSE;
         if(ithread>0) threadtree.Launch(ffty_thread[ithread],0);
       }
@@ -3396,6 +3458,7 @@ void YY_2LatDemag::ComputeEnergy
 
       for(ithread=0;ithread<MaxThreadCount;++ithread) {
         fftyzconv[ithread].A = A;
+        fftyzconv[ithread].huge_pages = huge_pages;
         fftyzconv[ithread].carr = Hxfrm;
         fftyzconv[ithread].locker_info.Set(rdimx,rdimy,rdimz,
                                           cdimx,cdimy,cdimz,
@@ -3428,6 +3491,20 @@ void YY_2LatDemag::ComputeEnergy
 
 #endif // USE_FFT_YZ_CONVOLVE
   }  // cdimz<2
+}
+
+void YY_2LatDemag::InverseFieldDot
+(const Oxs_MeshValue<ThreeVector>& spinA,
+ const Oxs_MeshValue<OC_REAL8m>& MsA,
+ Oxs_ComputeEnergyData& oced,
+ Oxs_MeshValue<ThreeVector>* static_out) const
+{
+  const OC_INDEX rxdim = ODTV_VECSIZE*rdimx;
+  const OC_INDEX cxdim = ODTV_COMPLEXSIZE*ODTV_VECSIZE*cdimx;
+  const OC_INDEX rxydim = rxdim*rdimy;
+  const OC_INDEX cxydim = cxdim*cdimy;
+
+  OC_INT4m ithread;
 #if REPORT_TIME
   fftxinversetime.Start();
 #endif // REPORT_TIME
@@ -3454,6 +3531,11 @@ void YY_2LatDemag::ComputeEnergy
       fftx_thread[ithread].spin_ptr = &spinA;
       fftx_thread[ithread].Ms_ptr   = &MsA;
       fftx_thread[ithread].oced_ptr = &oced;
+      if(static_out) {
+        fftx_thread[ithread].static_out = static_out;
+      } else if(!frozen_cell.empty()) {
+        fftx_thread[ithread].H_static = &H_static;
+      }
       fftx_thread[ithread].locker_info.Set(rdimx,rdimy,rdimz,
                                          cdimx,cdimy,cdimz,
                                          embed_block_size,
@@ -3472,14 +3554,6 @@ void YY_2LatDemag::ComputeEnergy
       if(ithread>0) threadtree.Launch(fftx_thread[ithread],0);
     }
     threadtree.LaunchRoot(fftx_thread[0],0);
-
-    Nb_Xpfloat tempsum;
-    _YY_2LatDemagiFFTxDotThread::result_mutex.Lock();
-    tempsum = _YY_2LatDemagiFFTxDotThread::energy_sum;
-    _YY_2LatDemagiFFTxDotThread::result_mutex.Unlock();
-    oced.energy_sum
-      = static_cast<OC_REAL8m>(tempsum.GetValue() * state.mesh->Volume(0));
-    /// All cells have same volume in an Oxs_RectangularMesh.
   }
 
 #if REPORT_TIME
@@ -3487,4 +3561,49 @@ void YY_2LatDemag::ComputeEnergy
 #endif // REPORT_TIME
 }
 
+// Note: 2015-03-06 Yu Yahagi
+// For now, ComputeEnergy is called twice for each sublattice. Since it 
+// repeats almost identical calculations with the total spin, it can and
+// should be much more efficient either by caching or calling it just once.
+void YY_2LatDemag::ComputeEnergy
+(const Oxs_SimState& state,
+ Oxs_ComputeEnergyData& oced
+ ) const
+{
+  // (Re)-initialize mesh coefficient array if mesh has changed.
+  if(mesh_id != state.mesh->Id()) {
+    mesh_id = 0; // Safety
+    FillCoefficientArrays(state.mesh);
+    mesh_id = state.mesh->Id();
+  }
+  UpdateFrozenCells(state.mesh);
+
+  const Oxs_MeshValue<ThreeVector>& spin = state.total_lattice->spin;
+  const Oxs_MeshValue<ThreeVector>& spinA = state.spin;
+  const Oxs_MeshValue<OC_REAL8m>& Ms = *(state.total_lattice->Ms);
+  const Oxs_MeshValue<OC_REAL8m>& MsA = *(state.Ms);
+
+  if(!frozen_cell.empty()) {
+    Ms_mask.AdjustSize(state.mesh);
+    if(FrozenFieldStale(state)) {
+      // Field of the frozen cells alone.
+      H_static.AdjustSize(state.mesh);
+      ConvolveField(spin,Ms,FROZEN_ROW_FREE);
+      InverseFieldDot(spinA,MsA,oced,&H_static);
+    }
+  }
+
+  ConvolveField(spin,Ms,FROZEN_ROW_ALL);
+  InverseFieldDot(spinA,MsA,oced,0);
+
+  Nb_Xpfloat tempsum;
+  _YY_2LatDemagiFFTxDotThread::result_mutex.Lock();
+  tempsum = _YY_2LatDemagiFFTxDotThread::energy_sum;
+  _YY_2LatDemagiFFTxDotThread::result_mutex.Unlock();
+  oced.energy_sum
+    = static_cast<OC_REAL8m>(tempsum.GetValue() * state.mesh->Volume(0));
+  /// All cells have same volume in an Oxs_RectangularMesh.
+}
+
+
 #endif // OOMMF_THREADS
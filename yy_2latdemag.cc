@@ -49,6 +49,7 @@
 #include "energy.h"             // Needed to make MSVC++ 5 happy
 
 #include "rectangularmesh.h"
+#include "yy_2lat_hugepage.h"
 
 OC_USE_STRING;
 
@@ -80,7 +81,9 @@ YY_2LatDemag::YY_2LatDemag(
     xperiodic(0),yperiodic(0),zperiodic(0),
     mesh_id(0),
     A(0),Hxfrm(0),asymptotic_radius(-1),Mtemp(0),
-    embed_convolution(0),embed_block_size(0)
+    huge_pages(YY_2LAT_HUGEPAGE_NONE),
+    embed_convolution(0),embed_block_size(0),
+    frozen_mesh_id(0),static_stage(0)
 {
   asymptotic_radius = GetRealInitValue("asymptotic_radius",32.0);
   /// Units of (dx*dy*dz)^(1/3) (geometric mean of cell dimensions).
@@ -104,6 +107,20 @@ YY_2LatDemag::YY_2LatDemag(
   /// by a multiple of m, the torque and therefore the magnetization
   /// dynamics are unaffected.
 
+  String hpstr = GetStringInitValue("huge_pages","none");
+  if(!YY_2LatParseHugePageMode(hpstr,huge_pages)) {
+    String msg = String("Invalid huge_pages request: ") + hpstr
+      + String("\n Should be one of none, transparent, or explicit.");
+    throw Oxs_ExtError(this,msg.c_str());
+  }
+  /// Backing for the demag coefficients, Mtemp, and Hxfrm.  On large
+  /// meshes the strided y- and z-axis FFT passes miss the TLB on
+  /// nearly every access with 4 KB pages.
+
+  GetFrozenRegions();
+  /// Atlas regions whose magnetization is held fixed by the evolver.
+  /// Their stray field is computed once per stage and cached.
+
   VerifyAllInitArgsUsed();
 }
 
@@ -270,15 +287,16 @@ OC_BOOL YY_2LatDemag::Init()
   dottime.Reset();
 #endif // REPORT_TIME
   mesh_id = 0;
+  frozen_mesh_id = 0;
   ReleaseMemory();
   return Oxs_Energy::Init();
 }
 
 void YY_2LatDemag::ReleaseMemory() const
 { // Conceptually const
-  if(A!=0) { delete[] A; A=0; }
-  if(Hxfrm!=0)       { delete[] Hxfrm;       Hxfrm=0;       }
-  if(Mtemp!=0)       { delete[] Mtemp;       Mtemp=0;       }
+  A_block.Free();     A=0;
+  Hxfrm_block.Free(); Hxfrm=0;
+  Mtemp_block.Free(); Mtemp=0;
   rdimx=rdimy=rdimz=0;
   cdimx=cdimy=cdimz=0;
   adimx=adimy=adimz=0;
@@ -375,7 +393,10 @@ void YY_2LatDemag::FillCoefficientArrays(const Oxs_Mesh* genmesh) const
     throw Oxs_ExtError(this,msg);
   }
 
-  Mtemp = new OXS_FFT_REAL_TYPE[ODTV_VECSIZE*rdimx*rdimy*rdimz];
+  Mtemp = static_cast<OXS_FFT_REAL_TYPE*>
+    (Mtemp_block.Alloc(ODTV_VECSIZE*rdimx*rdimy*rdimz
+                       *sizeof(OXS_FFT_REAL_TYPE),
+                       huge_pages,"YY_2LatDemag Mtemp"));
   /// Temporary space to hold Ms[]*m[].  The plan is to make this space
   /// unnecessary by introducing FFT functions that can take Ms as input
   /// and do the multiplication on the fly.
@@ -429,10 +450,12 @@ void YY_2LatDemag::FillCoefficientArrays(const Oxs_Mesh* genmesh) const
 
   // Allocate memory for FFT xfrm target H, and scratch space
   // for computing interaction coefficients
-  Hxfrm = new OXS_FFT_REAL_TYPE[xfrm_size];
+  Hxfrm = static_cast<OXS_FFT_REAL_TYPE*>
+    (Hxfrm_block.Alloc(xfrm_size*sizeof(OXS_FFT_REAL_TYPE),
+                       huge_pages,"YY_2LatDemag Hxfrm"));
   OXS_FFT_REAL_TYPE* scratch = new OXS_FFT_REAL_TYPE[scratch_size];
 
-  if(Hxfrm==NULL || scratch==NULL) {
+  if(Mtemp==NULL || Hxfrm==NULL || scratch==NULL) {
     // Safety check for those machines on which new[] doesn't throw
     // BadAlloc.
     String msg = String("Insufficient memory in Demag setup.");
@@ -1157,7 +1180,12 @@ SDA01_count = 0;
   OC_INDEX astridez = astridey*adimy;
   OC_INDEX a_size = astridez*adimz;
   assert(0 == A);
-  A = new A_coefs[a_size];
+  A = static_cast<A_coefs*>(A_block.Alloc(a_size*sizeof(A_coefs),
+                                          huge_pages,"YY_2LatDemag A"));
+  if(A==NULL) {
+    String msg = String("Insufficient memory in Demag setup.");
+    throw Oxs_ExtError(this,msg);
+  }
 
   OC_INDEX cstridey = 2*ODTV_VECSIZE*cdimx; // "2" for complex data
   OC_INDEX cstridez = cstridey*cdimy;
@@ -1830,48 +1858,13 @@ SDA01_count = 0;
 
 }
 
-// Note: 2015-03-06 Yu Yahagi
-// For now, GetEnergy is called twice for each sublattice. Since it repeats
-// almost identical calculations with the total spin, it can and should be 
-// much more efficient either by caching or calling it just once.
-void YY_2LatDemag::GetEnergy
-(const Oxs_SimState& state,
- Oxs_EnergyData& oed
+void YY_2LatDemag::ConvolveMtemp
+(Oxs_MeshValue<ThreeVector>& field
  ) const
 {
   OC_INDEX i,j,k;
+  const OC_INDEX rsize = rdimx*rdimy*rdimz;
 
-  // (Re)-initialize mesh coefficient array if mesh has changed.
-  if(mesh_id != state.mesh->Id()) {
-    mesh_id = 0; // Safety
-    FillCoefficientArrays(state.mesh);
-    mesh_id = state.mesh->Id();
-  }
-
-  const Oxs_MeshValue<ThreeVector>& spin = state.total_lattice->spin;
-  const Oxs_MeshValue<ThreeVector>& spinA = state.spin;
-  const Oxs_MeshValue<OC_REAL8m>& Ms = *(state.total_lattice->Ms);
-  const Oxs_MeshValue<OC_REAL8m>& MsA = *(state.Ms);
-
-  // Use supplied buffer space, and reflect that use in oed.
-  oed.energy = oed.energy_buffer;
-  oed.field = oed.field_buffer;
-  Oxs_MeshValue<OC_REAL8m>& energy = *oed.energy_buffer;
-  Oxs_MeshValue<ThreeVector>& field = *oed.field_buffer;
-  energy.AdjustSize(state.mesh);
-  field.AdjustSize(state.mesh);
-
-  // Fill Mtemp with Ms[]*spin[].  The plan is to eventually
-  // roll this step into the forward FFT routine.
-  const OC_INDEX rsize = Ms.Size();
-  assert(rdimx*rdimy*rdimz == rsize);
-  for(i=0;i<rsize;++i) {
-    OC_REAL8m scale = Ms[i];
-    const ThreeVector& vec = spin[i];
-    Mtemp[3*i]   = scale*vec.x;
-    Mtemp[3*i+1] = scale*vec.y;
-    Mtemp[3*i+2] = scale*vec.z;
-  }
 
   if(!embed_convolution) {
     // Do not embed convolution inside z-axis FFTs.  Instead,
@@ -1930,21 +1923,8 @@ void YY_2LatDemag::GetEnergy
         OC_INDEX ajindex = akindex + j*ajstride;
         for(i=0;i<cdimx;++i) {
           OC_INDEX  index = ODTV_COMPLEXSIZE*ODTV_VECSIZE*i+jindex;
-          OXS_FFT_REAL_TYPE Hx_re = Hxfrm[index];
-          OXS_FFT_REAL_TYPE Hx_im = Hxfrm[index+1];
-          OXS_FFT_REAL_TYPE Hy_re = Hxfrm[index+2];
-          OXS_FFT_REAL_TYPE Hy_im = Hxfrm[index+3];
-          OXS_FFT_REAL_TYPE Hz_re = Hxfrm[index+4];
-          OXS_FFT_REAL_TYPE Hz_im = Hxfrm[index+5];
-
-          const A_coefs& Aref = A[ajindex+i]; 
-
-          Hxfrm[index]   = Aref.A00*Hx_re + Aref.A01*Hy_re + Aref.A02*Hz_re;
-          Hxfrm[index+1] = Aref.A00*Hx_im + Aref.A01*Hy_im + Aref.A02*Hz_im;
-          Hxfrm[index+2] = Aref.A01*Hx_re + Aref.A11*Hy_re + Aref.A12*Hz_re;
-          Hxfrm[index+3] = Aref.A01*Hx_im + Aref.A11*Hy_im + Aref.A12*Hz_im;
-          Hxfrm[index+4] = Aref.A02*Hx_re + Aref.A12*Hy_re + Aref.A22*Hz_re;
-          Hxfrm[index+5] = Aref.A02*Hx_im + Aref.A12*Hy_im + Aref.A22*Hz_im;
+          const A_coefs& Aref = A[ajindex+i];
+          YY_2LatDemagApplyA<1,1>(Aref,Hxfrm+index);
         }
       }
       for(j=adimy;j<cdimy;++j) {
@@ -1953,23 +1933,10 @@ void YY_2LatDemag::GetEnergy
         OC_INDEX ajindex = akindex + (cdimy-j)*ajstride;
         for(i=0;i<cdimx;++i) {
           OC_INDEX  index = ODTV_COMPLEXSIZE*ODTV_VECSIZE*i+jindex;
-          OXS_FFT_REAL_TYPE Hx_re = Hxfrm[index];
-          OXS_FFT_REAL_TYPE Hx_im = Hxfrm[index+1];
-          OXS_FFT_REAL_TYPE Hy_re = Hxfrm[index+2];
-          OXS_FFT_REAL_TYPE Hy_im = Hxfrm[index+3];
-          OXS_FFT_REAL_TYPE Hz_re = Hxfrm[index+4];
-          OXS_FFT_REAL_TYPE Hz_im = Hxfrm[index+5];
-
-          const A_coefs& Aref = A[ajindex+i]; 
-
+          const A_coefs& Aref = A[ajindex+i];
           // Flip signs on a01 and a12 as compared to the j>=0
           // case because a01 and a12 are odd in y.
-          Hxfrm[index]   =  Aref.A00*Hx_re - Aref.A01*Hy_re + Aref.A02*Hz_re;
-          Hxfrm[index+1] =  Aref.A00*Hx_im - Aref.A01*Hy_im + Aref.A02*Hz_im;
-          Hxfrm[index+2] = -Aref.A01*Hx_re + Aref.A11*Hy_re - Aref.A12*Hz_re;
-          Hxfrm[index+3] = -Aref.A01*Hx_im + Aref.A11*Hy_im - Aref.A12*Hz_im;
-          Hxfrm[index+4] =  Aref.A02*Hx_re - Aref.A12*Hy_re + Aref.A22*Hz_re;
-          Hxfrm[index+5] =  Aref.A02*Hx_im - Aref.A12*Hy_im + Aref.A22*Hz_im;
+          YY_2LatDemagApplyA<-1,1>(Aref,Hxfrm+index);
         }
       }
     }
@@ -1983,23 +1950,10 @@ void YY_2LatDemag::GetEnergy
         OC_INDEX ajindex = akindex + j*ajstride;
         for(i=0;i<cdimx;++i) {
           OC_INDEX  index = ODTV_COMPLEXSIZE*ODTV_VECSIZE*i+jindex;
-          OXS_FFT_REAL_TYPE Hx_re = Hxfrm[index];
-          OXS_FFT_REAL_TYPE Hx_im = Hxfrm[index+1];
-          OXS_FFT_REAL_TYPE Hy_re = Hxfrm[index+2];
-          OXS_FFT_REAL_TYPE Hy_im = Hxfrm[index+3];
-          OXS_FFT_REAL_TYPE Hz_re = Hxfrm[index+4];
-          OXS_FFT_REAL_TYPE Hz_im = Hxfrm[index+5];
-
-          const A_coefs& Aref = A[ajindex+i]; 
-
+          const A_coefs& Aref = A[ajindex+i];
           // Flip signs on a02 and a12 as compared to the k>=0, j>=0 case
           // because a02 and a12 are odd in z.
-          Hxfrm[index]   =  Aref.A00*Hx_re + Aref.A01*Hy_re - Aref.A02*Hz_re;
-          Hxfrm[index+1] =  Aref.A00*Hx_im + Aref.A01*Hy_im - Aref.A02*Hz_im;
-          Hxfrm[index+2] =  Aref.A01*Hx_re + Aref.A11*Hy_re - Aref.A12*Hz_re;
-          Hxfrm[index+3] =  Aref.A01*Hx_im + Aref.A11*Hy_im - Aref.A12*Hz_im;
-          Hxfrm[index+4] = -Aref.A02*Hx_re - Aref.A12*Hy_re + Aref.A22*Hz_re;
-          Hxfrm[index+5] = -Aref.A02*Hx_im - Aref.A12*Hy_im + Aref.A22*Hz_im;
+          YY_2LatDemagApplyA<1,-1>(Aref,Hxfrm+index);
         }
       }
       for(j=adimy;j<cdimy;++j) {
@@ -2008,25 +1962,12 @@ void YY_2LatDemag::GetEnergy
         OC_INDEX ajindex = akindex + (cdimy-j)*ajstride;
         for(i=0;i<cdimx;++i) {
           OC_INDEX  index = ODTV_COMPLEXSIZE*ODTV_VECSIZE*i+jindex;
-          OXS_FFT_REAL_TYPE Hx_re = Hxfrm[index];
-          OXS_FFT_REAL_TYPE Hx_im = Hxfrm[index+1];
-          OXS_FFT_REAL_TYPE Hy_re = Hxfrm[index+2];
-          OXS_FFT_REAL_TYPE Hy_im = Hxfrm[index+3];
-          OXS_FFT_REAL_TYPE Hz_re = Hxfrm[index+4];
-          OXS_FFT_REAL_TYPE Hz_im = Hxfrm[index+5];
-
-          const A_coefs& Aref = A[ajindex+i]; 
-
+          const A_coefs& Aref = A[ajindex+i];
           // Flip signs on a01 and a02 as compared to the k>=0, j>=0 case
           // because a01 is odd in y and even in z,
           //     and a02 is odd in z and even in y.
           // No change to a12 because it is odd in both y and z.
-          Hxfrm[index]   =  Aref.A00*Hx_re - Aref.A01*Hy_re - Aref.A02*Hz_re;
-          Hxfrm[index+1] =  Aref.A00*Hx_im - Aref.A01*Hy_im - Aref.A02*Hz_im;
-          Hxfrm[index+2] = -Aref.A01*Hx_re + Aref.A11*Hy_re + Aref.A12*Hz_re;
-          Hxfrm[index+3] = -Aref.A01*Hx_im + Aref.A11*Hy_im + Aref.A12*Hz_im;
-          Hxfrm[index+4] = -Aref.A02*Hx_re + Aref.A12*Hy_re + Aref.A22*Hz_re;
-          Hxfrm[index+5] = -Aref.A02*Hx_im + Aref.A12*Hy_im + Aref.A22*Hz_im;
+          YY_2LatDemagApplyA<-1,-1>(Aref,Hxfrm+index);
         }
       }
     }
@@ -2156,21 +2097,8 @@ void YY_2LatDemag::GetEnergy
           OC_INDEX akindex = ajindex + k*akstride;
           for(i=m;i<istop;++i) {
             OC_INDEX  index = ODTV_COMPLEXSIZE*ODTV_VECSIZE*i+kindex;
-            OXS_FFT_REAL_TYPE Hx_re = Hxfrm[index];
-            OXS_FFT_REAL_TYPE Hx_im = Hxfrm[index+1];
-            OXS_FFT_REAL_TYPE Hy_re = Hxfrm[index+2];
-            OXS_FFT_REAL_TYPE Hy_im = Hxfrm[index+3];
-            OXS_FFT_REAL_TYPE Hz_re = Hxfrm[index+4];
-            OXS_FFT_REAL_TYPE Hz_im = Hxfrm[index+5];
-
-            const A_coefs& Aref = A[akindex+i]; 
-
-            Hxfrm[index]   = Aref.A00*Hx_re + Aref.A01*Hy_re + Aref.A02*Hz_re;
-            Hxfrm[index+1] = Aref.A00*Hx_im + Aref.A01*Hy_im + Aref.A02*Hz_im;
-            Hxfrm[index+2] = Aref.A01*Hx_re + Aref.A11*Hy_re + Aref.A12*Hz_re;
-            Hxfrm[index+3] = Aref.A01*Hx_im + Aref.A11*Hy_im + Aref.A12*Hz_im;
-            Hxfrm[index+4] = Aref.A02*Hx_re + Aref.A12*Hy_re + Aref.A22*Hz_re;
-            Hxfrm[index+5] = Aref.A02*Hx_im + Aref.A12*Hy_im + Aref.A22*Hz_im;
+            const A_coefs& Aref = A[akindex+i];
+            YY_2LatDemagApplyA<1,1>(Aref,Hxfrm+index);
           }
         }
         for(k=adimz;k<cdimz;++k) {
@@ -2179,23 +2107,10 @@ void YY_2LatDemag::GetEnergy
           OC_INDEX akindex = ajindex + (cdimz-k)*akstride;
           for(i=m;i<istop;++i) {
             OC_INDEX  index = ODTV_COMPLEXSIZE*ODTV_VECSIZE*i+kindex;
-            OXS_FFT_REAL_TYPE Hx_re = Hxfrm[index];
-            OXS_FFT_REAL_TYPE Hx_im = Hxfrm[index+1];
-            OXS_FFT_REAL_TYPE Hy_re = Hxfrm[index+2];
-            OXS_FFT_REAL_TYPE Hy_im = Hxfrm[index+3];
-            OXS_FFT_REAL_TYPE Hz_re = Hxfrm[index+4];
-            OXS_FFT_REAL_TYPE Hz_im = Hxfrm[index+5];
-
-            const A_coefs& Aref = A[akindex+i]; 
-
+            const A_coefs& Aref = A[akindex+i];
             // Flip signs on a02 and a12 as compared to the k>=0, j>=0 case
             // because a02 and a12 are odd in z.
-            Hxfrm[index]   =  Aref.A00*Hx_re + Aref.A01*Hy_re - Aref.A02*Hz_re;
-            Hxfrm[index+1] =  Aref.A00*Hx_im + Aref.A01*Hy_im - Aref.A02*Hz_im;
-            Hxfrm[index+2] =  Aref.A01*Hx_re + Aref.A11*Hy_re - Aref.A12*Hz_re;
-            Hxfrm[index+3] =  Aref.A01*Hx_im + Aref.A11*Hy_im - Aref.A12*Hz_im;
-            Hxfrm[index+4] = -Aref.A02*Hx_re - Aref.A12*Hy_re + Aref.A22*Hz_re;
-            Hxfrm[index+5] = -Aref.A02*Hx_im - Aref.A12*Hy_im + Aref.A22*Hz_im;
+            YY_2LatDemagApplyA<1,-1>(Aref,Hxfrm+index);
           }
         }
         // Do inverse z-direction transforms for block
@@ -2223,23 +2138,10 @@ void YY_2LatDemag::GetEnergy
           OC_INDEX akindex = ajindex + k*akstride;
           for(i=m;i<istop;++i) {
             OC_INDEX  index = ODTV_COMPLEXSIZE*ODTV_VECSIZE*i+kindex;
-            OXS_FFT_REAL_TYPE Hx_re = Hxfrm[index];
-            OXS_FFT_REAL_TYPE Hx_im = Hxfrm[index+1];
-            OXS_FFT_REAL_TYPE Hy_re = Hxfrm[index+2];
-            OXS_FFT_REAL_TYPE Hy_im = Hxfrm[index+3];
-            OXS_FFT_REAL_TYPE Hz_re = Hxfrm[index+4];
-            OXS_FFT_REAL_TYPE Hz_im = Hxfrm[index+5];
-
             const A_coefs& Aref = A[akindex+i];
-
             // Flip signs on a01 and a12 as compared to the j>=0
             // case because a01 and a12 are odd in y.
-            Hxfrm[index]   =  Aref.A00*Hx_re - Aref.A01*Hy_re + Aref.A02*Hz_re;
-            Hxfrm[index+1] =  Aref.A00*Hx_im - Aref.A01*Hy_im + Aref.A02*Hz_im;
-            Hxfrm[index+2] = -Aref.A01*Hx_re + Aref.A11*Hy_re - Aref.A12*Hz_re;
-            Hxfrm[index+3] = -Aref.A01*Hx_im + Aref.A11*Hy_im - Aref.A12*Hz_im;
-            Hxfrm[index+4] =  Aref.A02*Hx_re - Aref.A12*Hy_re + Aref.A22*Hz_re;
-            Hxfrm[index+5] =  Aref.A02*Hx_im - Aref.A12*Hy_im + Aref.A22*Hz_im;
+            YY_2LatDemagApplyA<-1,1>(Aref,Hxfrm+index);
           }
         }
         for(k=adimz;k<cdimz;++k) {
@@ -2248,25 +2150,12 @@ void YY_2LatDemag::GetEnergy
           OC_INDEX akindex = ajindex + (cdimz-k)*akstride;
           for(i=m;i<istop;++i) {
             OC_INDEX  index = ODTV_COMPLEXSIZE*ODTV_VECSIZE*i+kindex;
-            OXS_FFT_REAL_TYPE Hx_re = Hxfrm[index];
-            OXS_FFT_REAL_TYPE Hx_im = Hxfrm[index+1];
-            OXS_FFT_REAL_TYPE Hy_re = Hxfrm[index+2];
-            OXS_FFT_REAL_TYPE Hy_im = Hxfrm[index+3];
-            OXS_FFT_REAL_TYPE Hz_re = Hxfrm[index+4];
-            OXS_FFT_REAL_TYPE Hz_im = Hxfrm[index+5];
-
-            const A_coefs& Aref = A[akindex+i]; 
-
+            const A_coefs& Aref = A[akindex+i];
             // Flip signs on a01 and a02 as compared to the k>=0, j>=0 case
             // because a01 is odd in y and even in z,
             //     and a02 is odd in z and even in y.
             // No change to a12 because it is odd in both y and z.
-            Hxfrm[index]   =  Aref.A00*Hx_re - Aref.A01*Hy_re - Aref.A02*Hz_re;
-            Hxfrm[index+1] =  Aref.A00*Hx_im - Aref.A01*Hy_im - Aref.A02*Hz_im;
-            Hxfrm[index+2] = -Aref.A01*Hx_re + Aref.A11*Hy_re + Aref.A12*Hz_re;
-            Hxfrm[index+3] = -Aref.A01*Hx_im + Aref.A11*Hy_im + Aref.A12*Hz_im;
-            Hxfrm[index+4] = -Aref.A02*Hx_re + Aref.A12*Hy_re + Aref.A22*Hz_re;
-            Hxfrm[index+5] = -Aref.A02*Hx_im + Aref.A12*Hy_im + Aref.A22*Hz_im;
+            YY_2LatDemagApplyA<-1,-1>(Aref,Hxfrm+index);
           }
         }
         // Do inverse z-direction transforms for block
@@ -2327,6 +2216,72 @@ void YY_2LatDemag::GetEnergy
     }
 
   } // if(!embed_convolution)
+}
+
+// Note: 2015-03-06 Yu Yahagi
+// For now, GetEnergy is called twice for each sublattice. Since it repeats
+// almost identical calculations with the total spin, it can and should be 
+// much more efficient either by caching or calling it just once.
+void YY_2LatDemag::GetEnergy
+(const Oxs_SimState& state,
+ Oxs_EnergyData& oed
+ ) const
+{
+  OC_INDEX i;
+
+  // (Re)-initialize mesh coefficient array if mesh has changed.
+  if(mesh_id != state.mesh->Id()) {
+    mesh_id = 0; // Safety
+    FillCoefficientArrays(state.mesh);
+    mesh_id = state.mesh->Id();
+  }
+  UpdateFrozenCells(state.mesh);
+
+  const Oxs_MeshValue<ThreeVector>& spin = state.total_lattice->spin;
+  const Oxs_MeshValue<ThreeVector>& spinA = state.spin;
+  const Oxs_MeshValue<OC_REAL8m>& Ms = *(state.total_lattice->Ms);
+  const Oxs_MeshValue<OC_REAL8m>& MsA = *(state.Ms);
+
+  // Use supplied buffer space, and reflect that use in oed.
+  oed.energy = oed.energy_buffer;
+  oed.field = oed.field_buffer;
+  Oxs_MeshValue<OC_REAL8m>& energy = *oed.energy_buffer;
+  Oxs_MeshValue<ThreeVector>& field = *oed.field_buffer;
+  energy.AdjustSize(state.mesh);
+  field.AdjustSize(state.mesh);
+
+  const OC_INDEX rsize = Ms.Size();
+  assert(rdimx*rdimy*rdimz == rsize);
+  const char* frozen = (frozen_cell.empty() ? 0 : &(frozen_cell[0]));
+
+  if(frozen && FrozenFieldStale(state)) {
+    // Field of the frozen cells alone.
+    for(i=0;i<rsize;++i) {
+      OC_REAL8m scale = (frozen[i] ? Ms[i] : 0.0);
+      const ThreeVector& vec = spin[i];
+      Mtemp[3*i]   = scale*vec.x;
+      Mtemp[3*i+1] = scale*vec.y;
+      Mtemp[3*i+2] = scale*vec.z;
+    }
+    H_static.AdjustSize(state.mesh);
+    ConvolveMtemp(H_static);
+  }
+
+  // Fill Mtemp with Ms[]*spin[], leaving out frozen cells.  The plan
+  // is to eventually roll this step into the forward FFT routine.
+  for(i=0;i<rsize;++i) {
+    OC_REAL8m scale = Ms[i];
+    if(frozen && frozen[i]) scale = 0.0;
+    const ThreeVector& vec = spin[i];
+    Mtemp[3*i]   = scale*vec.x;
+    Mtemp[3*i+1] = scale*vec.y;
+    Mtemp[3*i+2] = scale*vec.z;
+  }
+
+  ConvolveMtemp(field);
+  if(frozen) {
+    for(i=0;i<rsize;++i) field[i] += H_static[i];
+  }
 
 #if REPORT_TIME
   dottime.Start();
@@ -2343,3 +2298,125 @@ void YY_2LatDemag::GetEnergy
 }
 
 #endif // OOMMF_THREADS
+
+////////////////// COMMON SINGLE/MULTI-THREADED CODE ///////////////
+
+#include <algorithm>
+
+OC_USE_STD_NAMESPACE;
+
+// Revision information
+static const Oxs_WarningMessageRevisionInfo revision_info
+  (__FILE__,
+   "$Revision:$",
+   "$Date:$",
+   "$Author:$",
+   "Yu Yahagi (yuyahagi2@gmail.com)");
+
+void YY_2LatDemag::GetFrozenRegions()
+{ // Parses a { atlas region ... } list, as for Oxs_Evolver fixed_spins
+  frozen_region_ids.clear();
+  if(!HasInitValue("frozen_regions")) return;
+  vector<String> frozeninfo;
+  FindRequiredInitValue("frozen_regions",frozeninfo);
+  if(!frozeninfo.empty()) {
+    OXS_GET_EXT_OBJECT(frozeninfo[0],Oxs_Atlas,frozen_atlas);
+    for(size_t j=1;j<frozeninfo.size();++j) {
+      OC_INDEX id = frozen_atlas->GetRegionId(frozeninfo[j]);
+      if(id<0) {
+        String msg = String("Region \"") + frozeninfo[j]
+          + String("\" specified in frozen_regions list"
+                   " is not a known region in atlas \"")
+          + String(frozen_atlas->InstanceName()) + String("\".");
+        throw Oxs_ExtError(this,msg.c_str());
+      }
+      frozen_region_ids.push_back(id);
+    }
+  }
+  DeleteInitValue("frozen_regions");
+}
+
+void YY_2LatDemag::UpdateFrozenCells(const Oxs_Mesh* genmesh) const
+{ // This routine is conceptually const.
+  if(frozen_mesh_id == genmesh->Id()) return;
+  frozen_mesh_id = 0;
+  static_stage = 0;
+  frozen_cell.clear();
+  frozen_row.clear();
+  H_static.Release();
+  M_static.clear();
+  Ms_mask.Release();
+  if(frozen_region_ids.empty()) {
+    frozen_mesh_id = genmesh->Id();
+    return;
+  }
+
+  const Oxs_CommonRectangularMesh* mesh
+    = dynamic_cast<const Oxs_CommonRectangularMesh*>(genmesh);
+  if(mesh==NULL) {
+    String msg=String("Object ")
+      + String(genmesh->InstanceName())
+      + String(" is not a rectangular mesh.");
+    throw Oxs_ExtError(this,msg);
+  }
+  const OC_INDEX xdim = mesh->DimX();
+  const OC_INDEX rowcount = mesh->DimY()*mesh->DimZ();
+  const OC_INDEX size = mesh->Size();
+  frozen_cell.resize(size,0);
+  frozen_row.resize(rowcount,FROZEN_ROW_FREE);
+  OC_INDEX frozen_count = 0;
+  for(OC_INDEX i=0;i<size;++i) {
+    ThreeVector pos;
+    mesh->Center(i,pos);
+    if(find(frozen_region_ids.begin(),frozen_region_ids.end(),
+            frozen_atlas->GetRegionId(pos)) != frozen_region_ids.end()) {
+      frozen_cell[i] = 1;
+      ++frozen_count;
+    }
+  }
+  for(OC_INDEX jk=0;jk<rowcount;++jk) {
+    OC_INDEX count = 0;
+    for(OC_INDEX i=jk*xdim;i<(jk+1)*xdim;++i) count += frozen_cell[i];
+    if(count==xdim) {
+      frozen_row[jk] = FROZEN_ROW_ALL;
+    } else if(count>0) {
+      frozen_row[jk] = FROZEN_ROW_MIXED;
+    }
+  }
+  M_static.resize(frozen_count);
+  frozen_mesh_id = genmesh->Id();
+}
+
+OC_BOOL YY_2LatDemag::FrozenFieldStale(const Oxs_SimState& state) const
+{ // This routine is conceptually const.  The check is one pass over
+  // the frozen flags, which is small next to the transforms it saves.
+  const Oxs_MeshValue<ThreeVector>& spin = state.total_lattice->spin;
+  const Oxs_MeshValue<OC_REAL8m>& Ms = *(state.total_lattice->Ms);
+  const OC_INDEX size = static_cast<OC_INDEX>(frozen_cell.size());
+  OC_BOOL changed = (static_stage==0);
+  OC_INDEX k = 0;
+  for(OC_INDEX i=0;i<size;++i) {
+    if(!frozen_cell[i]) continue;
+    const ThreeVector m = Ms[i]*spin[i];
+    if(m != M_static[k]) {
+      M_static[k] = m;
+      changed = 1;
+    }
+    ++k;
+  }
+  if(!changed) return 0;
+  if(static_stage == state.stage_number+1) {
+    static Oxs_WarningMessage frozenchanged(3);
+    char buf[1024];
+    Oc_Snprintf(buf,sizeof(buf),
+                "Magnetization in frozen_regions of %s changed within"
+                " stage %u, so their stray field is recomputed."
+                " Pin these regions on both sublattices with"
+                " fixed_spins1 and fixed_spins2 of the evolver.",
+                InstanceName(),
+                static_cast<unsigned int>(state.stage_number));
+    frozenchanged.Send(revision_info,OC_STRINGIFY(__LINE__),buf);
+  }
+  static_stage = state.stage_number+1;
+  return 1;
+}
@@ -30,7 +30,12 @@
 #ifndef _YY_2LATDEMAG
 #define _YY_2LATDEMAG
 
+#include <assert.h>
+
+#include <vector>
+
 #include "oc.h"  // Includes OOMMF_THREADS macro in ocport.h
+#include "atlas.h"
 #include "energy.h"
 #include "fft3v.h"
 #include "key.h"
@@ -40,6 +45,8 @@
 #include "threevector.h"
 #include "rectangularmesh.h"
 
+#include "yy_2lat_hugepage.h"
+
 #if OOMMF_THREADS
 # include "oxsthread.h"
 #endif
@@ -163,9 +170,11 @@ private:
   //   All of these arrays are actually arrays of complex-valued
   // three vectors, but are handled as simple REAL arrays.
   mutable A_coefs* A;
+  mutable YY_2LatBigBlock A_block; // Storage for A
 
 #if !OOMMF_THREADS
   mutable OXS_FFT_REAL_TYPE *Hxfrm;
+  mutable YY_2LatBigBlock Hxfrm_block;
 #else
   // In the threaded code, the memory pointed to by Hxfrm
   // is managed by an Oxs_StripedArray object
@@ -183,6 +192,11 @@ private:
   /// Ms[]*m[].  The plan is to make this space unnecessary
   /// by introducing FFT functions that can take Ms as input
   /// and do the multiplication on the fly.
+  mutable YY_2LatBigBlock Mtemp_block; // Storage for Mtemp
+
+  YY_2LatHugePageMode huge_pages;
+  /// Backing for A, Mtemp and the FFT workspaces; set from the MIF
+  /// option huge_pages.  Default is ordinary pages.
 
   // Object to perform FFTs.  All transforms are the same size, so we
   // only need one Oxs_FFT3DThreeVector object.  (Note: A
@@ -217,18 +231,22 @@ private:
     Oxs_FFT1DThreeVector fftx;
     Oxs_FFTStrided ffty;
     Oxs_FFTStrided fftz;
+    Oxs_FFTStrided ffty_panel_fft; // ffty on ffty_panel, set up with it
     OXS_FFT_REAL_TYPE* ifftx_scratch;
     OXS_FFT_REAL_TYPE* fftz_Hwork;
     OXS_FFT_REAL_TYPE* fftyz_Hwork;
     char* fftyz_Hwork_base; // Block used for aligning fftyz_Hwork
     OXS_FFT_REAL_TYPE* fftyconvolve_Hwork;
     A_coefs* A_copy;
+    YY_2LatBigBlock A_copy_block; // Holds A_copy if huge pages are on
     size_t ifftx_scratch_size;
     size_t fftz_Hwork_size;
     size_t fftyz_Hwork_size;      // In OXS_FFT_REAL_TYPE units
     size_t fftyz_Hwork_base_size; // For alignment; count in bytes
     size_t fftyconvolve_Hwork_size;
     size_t A_copy_size;
+    OXS_FFT_REAL_TYPE* ffty_panel; // Staging for _YY_2LatDemagFFTyThread
+    size_t ffty_panel_size;        // In OXS_FFT_REAL_TYPE units
 
     Oxs_FFTLocker(const Oxs_FFTLocker_Info& info);
     ~Oxs_FFTLocker();
@@ -249,6 +267,11 @@ private:
     return name;
   }
 
+  // Number of y-axis FFT columns staged per panel in the threaded
+  // y-axis passes, or 0 if a whole k-plane row fits in cache and the
+  // columns are transformed in place.  Set in FillCoefficientArrays.
+  mutable OC_INDEX ffty_panel_width;
+
 #endif
   mutable OC_INDEX embed_block_size;
   mutable OC_INDEX embed_yzblock_size;
@@ -263,6 +286,36 @@ private:
   /// demag field is changed by a multiple of m, the torque and
   /// therefore the magnetization dynamics are unaffected.
 
+  // Frozen regions.  Cells in these regions are expected not to
+  // change (pinned on both sublattices by the evolver), so their stray
+  // field is computed once into H_static, and each evaluation
+  // transforms only the remaining cells.  M_static holds Ms*m of the
+  // frozen cells that H_static was computed from; see FrozenFieldStale.  The rows
+  // along x are classed as FROZEN_ROW_FREE, _MIXED or _ALL; the
+  // x-axis transforms of rows without cells to transform are skipped.
+  enum { FROZEN_ROW_FREE=0, FROZEN_ROW_MIXED=1, FROZEN_ROW_ALL=2 };
+  Oxs_OwnedPointer<Oxs_Atlas> frozen_atlas;
+  vector<OC_INDEX> frozen_region_ids;
+  mutable OC_UINT4m frozen_mesh_id;  // Mesh the lists below belong to
+  mutable vector<char> frozen_cell;  // 1 if cell is frozen
+  mutable vector<char> frozen_row;   // Class of row j+k*rdimy
+  mutable OC_UINT4m static_stage;    // Stage of H_static, +1; 0 if stale
+  mutable Oxs_MeshValue<ThreeVector> H_static;
+  mutable vector<ThreeVector> M_static; // Packed, frozen cells only
+  mutable Oxs_MeshValue<OC_REAL8m> Ms_mask; // Ms with masked cells zeroed
+
+  void GetFrozenRegions();
+  /// Parses the frozen_regions { atlas region ... } option.
+
+  void UpdateFrozenCells(const Oxs_Mesh* mesh) const;
+  /// Fills frozen_cell and frozen_row for mesh.  Marks H_static stale.
+
+  OC_BOOL FrozenFieldStale(const Oxs_SimState& state) const;
+  /// Returns 1 if H_static must be (re)computed for state, i.e., if
+  /// it is stale or Ms*m differs from M_static in any frozen cell, and
+  /// brings M_static up to date.  Warns if this happens more than
+  /// once in a stage, since the frozen cells are then not pinned.
+
   void FillCoefficientArrays(const Oxs_Mesh* mesh) const;
 
   void ReleaseMemory() const;
@@ -270,9 +323,28 @@ private:
 
 protected:
 #if !OOMMF_THREADS
+  void ConvolveMtemp(Oxs_MeshValue<ThreeVector>& field) const;
+  /// Field of the magnetization in Mtemp, into field.
+
   virtual void GetEnergy(const Oxs_SimState& state,
 			 Oxs_EnergyData& oed) const;
 #else
+  void ConvolveField(const Oxs_MeshValue<ThreeVector>& spin,
+                     const Oxs_MeshValue<OC_REAL8m>& Ms,
+                     char skip_class) const;
+  /// Forward transform and convolution of Ms*spin, leaving the field
+  /// transform in Hxfrm_base or Hxfrm_base_yz.  If frozen regions are
+  /// set, then skip_class FROZEN_ROW_ALL leaves out the frozen cells,
+  /// and FROZEN_ROW_FREE the free ones.  Rows with none of the other
+  /// kind are not transformed (zero); mixed rows go through Ms_mask.
+
+  void InverseFieldDot(const Oxs_MeshValue<ThreeVector>& spinA,
+                       const Oxs_MeshValue<OC_REAL8m>& MsA,
+                       Oxs_ComputeEnergyData& oced,
+                       Oxs_MeshValue<ThreeVector>* static_out) const;
+  /// Inverse transform of the field and energy of sublattice spinA.
+  /// If static_out is set, then the field is stored there instead.
+
   virtual void GetEnergy(const Oxs_SimState& state,
 			 Oxs_EnergyData& oed) const {
     GetEnergyAlt(state,oed);
@@ -292,5 +364,55 @@ public:
 
 };
 
+// Applies the demag tensor to one complex three-vector in transform
+// space, in place.  H points to (Hx_re,Hx_im,Hy_re,Hy_im,Hz_re,Hz_im).
+// Only the first octant of A is stored; A01 and A12 are odd in y, and
+// A02 and A12 are odd in z, so SY = -1 (SZ = -1) selects the image for
+// j<0 (k<0).  On SSE builds with double precision FFT data each
+// (re,im) pair is one Oc_Duet, so the real and imaginary dot products
+// run together.  The Oc_Duet loads need 16-byte alignment; H is checked
+// at run time and falls back to the scalar form otherwise, as does any
+// other OXS_FFT_REAL_TYPE.  The products and sums are the same, in the
+// same order, in both forms, and a sign flip is exact, so both paths
+// give identical results.
+template<int SY,int SZ>
+inline void YY_2LatDemagApplyA(const YY_2LatDemag::A_coefs& Aref,
+                               OXS_FFT_REAL_TYPE* H)
+{
+  const OXS_FFT_REAL_TYPE a00 = Aref.A00;
+  const OXS_FFT_REAL_TYPE a01 = (SY>0 ? Aref.A01 : -Aref.A01);
+  const OXS_FFT_REAL_TYPE a02 = (SZ>0 ? Aref.A02 : -Aref.A02);
+  const OXS_FFT_REAL_TYPE a11 = Aref.A11;
+  const OXS_FFT_REAL_TYPE a12 = (SY*SZ>0 ? Aref.A12 : -Aref.A12);
+  const OXS_FFT_REAL_TYPE a22 = Aref.A22;
+#if OC_USE_SSE
+  if(sizeof(OXS_FFT_REAL_TYPE) == 8 &&  // Check SSE OK
+     reinterpret_cast<OC_UINDEX>(H)%16 == 0) {
+    OC_REAL8m* const Hd = reinterpret_cast<OC_REAL8m*>(H);
+    Oc_Duet Hx; Hx.LoadAligned(Hd[0]);
+    Oc_Duet Hy; Hy.LoadAligned(Hd[2]);
+    Oc_Duet Hz; Hz.LoadAligned(Hd[4]);
+    Oc_Duet tx = Oc_Duet(a00)*Hx + Oc_Duet(a01)*Hy + Oc_Duet(a02)*Hz;
+    Oc_Duet ty = Oc_Duet(a01)*Hx + Oc_Duet(a11)*Hy + Oc_Duet(a12)*Hz;
+    Oc_Duet tz = Oc_Duet(a02)*Hx + Oc_Duet(a12)*Hy + Oc_Duet(a22)*Hz;
+    tx.StoreAligned(Hd[0]);
+    ty.StoreAligned(Hd[2]);
+    tz.StoreAligned(Hd[4]);
+    return;
+  }
+#endif
+  const OXS_FFT_REAL_TYPE Hx_re = H[0];
+  const OXS_FFT_REAL_TYPE Hx_im = H[1];
+  const OXS_FFT_REAL_TYPE Hy_re = H[2];
+  const OXS_FFT_REAL_TYPE Hy_im = H[3];
+  const OXS_FFT_REAL_TYPE Hz_re = H[4];
+  const OXS_FFT_REAL_TYPE Hz_im = H[5];
+  H[0] = a00*Hx_re + a01*Hy_re + a02*Hz_re;
+  H[1] = a00*Hx_im + a01*Hy_im + a02*Hz_im;
+  H[2] = a01*Hx_re + a11*Hy_re + a12*Hz_re;
+  H[3] = a01*Hx_im + a11*Hy_im + a12*Hz_im;
+  H[4] = a02*Hx_re + a12*Hy_re + a22*Hz_re;
+  H[5] = a02*Hx_im + a12*Hy_im + a22*Hz_im;
+}
 
 #endif // _YY_2LATDEMAG
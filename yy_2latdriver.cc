@@ -35,6 +35,7 @@
 #include "oxswarn.h"
 #include "vectorfield.h"
 
+#include "yy_2lat_util.h"
 #include "yy_2latdriver.h"
 
 /* End includes */
@@ -62,20 +63,34 @@ YY_2LatDriver::YY_2LatDriver
   OXS_GET_INIT_EXT_OBJECT("m01",Oxs_VectorField,m01);
   OXS_GET_INIT_EXT_OBJECT("m02",Oxs_VectorField,m02);
 
-  Ms1init->FillMeshValue(mesh_obj.GetPtr(),Ms1_A);
-  Ms1init->FillMeshValue(mesh_obj.GetPtr(),Ms01);
-  Ms2init->FillMeshValue(mesh_obj.GetPtr(),Ms2_A);
-  Ms2init->FillMeshValue(mesh_obj.GetPtr(),Ms02);
-  Ms_B.AdjustSize(mesh_obj.GetPtr());
-  Ms1_B.AdjustSize(mesh_obj.GetPtr());
-  Ms2_B.AdjustSize(mesh_obj.GetPtr());
-  Ms1_inverse_A.AdjustSize(mesh_obj.GetPtr());
-  Ms1_inverse_B.AdjustSize(mesh_obj.GetPtr());
-  Ms01_inverse.AdjustSize(mesh_obj.GetPtr());
-  Ms2_inverse_A.AdjustSize(mesh_obj.GetPtr());
-  Ms2_inverse_B.AdjustSize(mesh_obj.GetPtr());
-  Ms_inverse_B.AdjustSize(mesh_obj.GetPtr());
-  Ms02_inverse.AdjustSize(mesh_obj.GetPtr());
+  // Size the sublattice Ms arrays and first-touch them from the worker
+  // threads before filling, so pages are local to the thread that
+  // owns each strip (see YY_2LatFirstTouch).
+  {
+    vector<Oxs_MeshValue<OC_REAL8m>*> sarr;
+    sarr.push_back(&Ms1_A);
+    sarr.push_back(&Ms01);
+    sarr.push_back(&Ms2_A);
+    sarr.push_back(&Ms02);
+    sarr.push_back(&Ms_B);
+    sarr.push_back(&Ms1_B);
+    sarr.push_back(&Ms2_B);
+    sarr.push_back(&Ms1_inverse_A);
+    sarr.push_back(&Ms1_inverse_B);
+    sarr.push_back(&Ms01_inverse);
+    sarr.push_back(&Ms2_inverse_A);
+    sarr.push_back(&Ms2_inverse_B);
+    sarr.push_back(&Ms_inverse_B);
+    sarr.push_back(&Ms02_inverse);
+    for(size_t ia=0;ia<sarr.size();++ia) {
+      sarr[ia]->AdjustSize(mesh_obj.GetPtr());
+    }
+    YY_2LatFirstTouch(vector<Oxs_MeshValue<ThreeVector>*>(),sarr);
+  }
+  YY_2LatFillMeshValue(Ms1init.GetPtr(),mesh_obj.GetPtr(),Ms1_A);
+  YY_2LatFillMeshValue(Ms2init.GetPtr(),mesh_obj.GetPtr(),Ms2_A);
+  Ms01 = Ms1_A;  // Copy rather than evaluate the (possibly Tcl) fields
+  Ms02 = Ms2_A;  // a second time.
 
   for(OC_INDEX icell=0;icell<mesh_obj->Size();icell++) {
     if(Ms1_A[icell]<0.0) {
@@ -155,6 +170,34 @@ YY_2LatDriver::YY_2LatDriver
   aveMy2_output.Register(director,0);
   aveMz1_output.Register(director,0);
   aveMz2_output.Register(director,0);
+
+  // Optional direct OVF snapshots, encoded in parallel and written
+  // from a background thread.
+  ovf_last_state_id = 0;
+  if(HasInitValue("ovf_output")) {
+    String errmsg;
+    if(!YY_2LatParseOvfSchedule(GetStringInitValue("ovf_output"),
+                                ovf_schedule,errmsg)) {
+      throw Oxs_ExtError(this,String("Bad ovf_output value: ")+errmsg);
+    }
+    for(size_t iq=0;iq<ovf_schedule.quantities.size();++iq) {
+      const String& q = ovf_schedule.quantities[iq];
+      if(q.compare("Magnetization1")!=0 && q.compare("Magnetization2")!=0
+         && q.compare("spin1")!=0 && q.compare("spin2")!=0) {
+        throw Oxs_ExtError(this,String("Unsupported ovf_output quantity ")
+                           + q + String("; should be one of"
+                           " Magnetization1, Magnetization2, spin1"
+                           " or spin2."));
+      }
+    }
+    if(ovf_schedule.basename.empty()) {
+      ovf_schedule.basename = "oxs";
+      director->GetMifOption("basename",ovf_schedule.basename);
+    }
+    ovf_writer.SetFormat(ovf_schedule.format);
+    ovf_writer.SetBackground(ovf_schedule.background,
+                             ovf_schedule.max_pending);
+  }
 }
 
 //Destructor
@@ -208,17 +251,17 @@ void YY_2LatDriver::SetStartValues(
     istate.Ms0 = &Ms;
     istate.Ms_inverse = &Ms_inverse;
     istate.Ms0_inverse = &Ms0_inverse;
-    m0->FillMeshValue(istate.mesh,istate.spin);
+    YY_2LatFillMeshValue(m0.GetPtr(),istate.mesh,istate.spin);
     istate1.Ms = &Ms1_A;
     istate1.Ms0 = &Ms01;
     istate1.Ms_inverse = &Ms1_inverse_A;
     istate1.Ms0_inverse = &Ms01_inverse;
-    m01->FillMeshValue(istate1.mesh,istate1.spin);
+    YY_2LatFillMeshValue(m01.GetPtr(),istate1.mesh,istate1.spin);
     istate2.Ms = &Ms2_A;
     istate2.Ms0 = &Ms02;
     istate2.Ms_inverse = &Ms2_inverse_A;
     istate2.Ms0_inverse = &Ms02_inverse;
-    m02->FillMeshValue(istate2.mesh,istate2.spin);
+    YY_2LatFillMeshValue(m02.GetPtr(),istate2.mesh,istate2.spin);
 
     // Insure that spins are unit vectors
     OC_INDEX size = istate.spin.Size();
@@ -294,6 +337,11 @@ OC_BOOL YY_2LatDriver::Init()
   driversteptime.Reset();
 #endif // REPORT_TIME
 
+  // Snapshots from a previous run must be on disk before restarting.
+  ovf_writer.Flush();
+  ovf_last_state_id = 0;
+  ovf_change.Reset();
+
   // Finish output initializations.
   if(!mesh_obj->HasUniformCellVolumes()) {
     // Magnetization averaging should be weighted by cell volume.  At
@@ -327,7 +375,7 @@ OC_BOOL YY_2LatDriver::Init()
     Oxs_MeshValue<ThreeVector>& trellis = po.trellis;
     Oxs_OwnedPointer<Oxs_VectorField> tmpinit; // Initializer
     OXS_GET_EXT_OBJECT(po.trellis_init,Oxs_VectorField,tmpinit);
-    tmpinit->FillMeshValue(mesh_obj.GetPtr(),trellis);
+    YY_2LatFillMeshValue(tmpinit.GetPtr(),mesh_obj.GetPtr(),trellis);
 
     // Adjust scaling
     po.scaling = 1.0; // Safety
@@ -634,6 +682,10 @@ void YY_2LatDriver::Run(vector<OxsRunEvent>& results,
           nstate2.m_e = cstate2.m_e;
           nstate1.chi_l = cstate1.chi_l;
           nstate2.chi_l = cstate2.chi_l;
+          nstate1.T_update_count = cstate1.T_update_count;
+          nstate2.T_update_count = cstate2.T_update_count;
+          nstate1.T_changed = cstate1.T_changed;
+          nstate2.T_changed = cstate2.T_changed;
         }
 #if REPORT_TIME
         driversteptime.Start();
@@ -779,6 +831,10 @@ void YY_2LatDriver::Run(vector<OxsRunEvent>& results,
       cstate2.AddDerivedData("YY_2LatDriver Problem Status",
                             static_cast<OC_REAL8m>(problem_status));
 #endif
+      if(ovf_schedule.Active()) {
+        WriteOvfSnapshots(cstate,cstate1,cstate2,
+                          problem_status!=OXSDRIVER_PS_INSIDE_STAGE);
+      }
     }
 
     // TODO: Implement checkpoint file save
@@ -799,6 +855,49 @@ void YY_2LatDriver::Run(vector<OxsRunEvent>& results,
   }
 }
 
+void YY_2LatDriver::WriteOvfSnapshots(const Oxs_SimState& state,
+                                      const Oxs_SimState& state1,
+                                      const Oxs_SimState& state2,
+                                      OC_BOOL stage_done)
+{
+  if(state.Id()==ovf_last_state_id) return; // e.g., STAGE_START repeat
+  OC_BOOL write = (ovf_schedule.stage_end && stage_done);
+  if(ovf_schedule.step_interval>0
+     && state.iteration_count%ovf_schedule.step_interval==0) write = 1;
+  if(!write && ovf_schedule.ChangeTriggered()) {
+    // The first state of a run has no reference, so it is written.
+    write = ovf_change.Exceeds(state1,state2,
+                               ovf_schedule.change_angle*(PI/180.),
+                               ovf_schedule.change_rms);
+  }
+  if(!write) return;
+  ovf_last_state_id = state.Id();
+  if(ovf_schedule.ChangeTriggered()) {
+    ovf_change.TakeReference(state1,state2);
+  }
+
+  for(size_t iq=0;iq<ovf_schedule.quantities.size();++iq) {
+    const String& q = ovf_schedule.quantities[iq];
+    char buf[64];
+    Oc_Snprintf(buf,sizeof(buf),"-%02u-%07u.ovf",
+                static_cast<unsigned int>(state.stage_number),
+                static_cast<unsigned int>(state.iteration_count));
+    const String filename = ovf_schedule.basename + String("-") + q
+      + String(buf);
+    if(q.compare("Magnetization1")==0) {
+      ovf_writer.Write(filename,q.c_str(),"A/m",state1,
+                       state1.spin,state1.Ms);
+    } else if(q.compare("Magnetization2")==0) {
+      ovf_writer.Write(filename,q.c_str(),"A/m",state2,
+                       state2.spin,state2.Ms);
+    } else if(q.compare("spin1")==0) {
+      ovf_writer.Write(filename,q.c_str(),"",state1,state1.spin,NULL);
+    } else {
+      ovf_writer.Write(filename,q.c_str(),"",state2,state2.spin,NULL);
+    }
+  }
+}
+
 void YY_2LatDriver::FillStateMemberData(const Oxs_SimState& old_state,
                                  Oxs_SimState& new_state) const
 {
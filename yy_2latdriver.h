@@ -38,6 +38,8 @@
 
 #include "driver.h"
 
+#include "yy_2lat_ovfwriter.h"
+
 OC_USE_STRING;
 
 /* End includes */
@@ -74,6 +76,16 @@ private:
   // Override output function for average M
   void Fill__aveM_output(const Oxs_SimState&);
 
+  // Direct OVF snapshots of sublattice fields (ovf_output option)
+  YY_2LatOvfSchedule ovf_schedule;
+  YY_2LatOvfWriter ovf_writer;
+  YY_2LatOvfChangeTracker ovf_change; // Spins at the last snapshot
+  OC_UINT4m ovf_last_state_id;
+  void WriteOvfSnapshots(const Oxs_SimState& state,
+                         const Oxs_SimState& state1,
+                         const Oxs_SimState& state2,
+                         OC_BOOL stage_done);
+
   void UpdateSpinAngleData(
       const Oxs_SimState& state,
       const Oxs_SimState& state1,
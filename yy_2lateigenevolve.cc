@@ -0,0 +1,984 @@
+/** FILE: yy_2lateigenevolve.cc                 -*-Mode: c++-*-
+ *
+ * Linearized spin wave eigenmodes of a two lattice system about an
+ * equilibrium state.
+ *
+ * Copyright (C) 2015 Yu Yahagi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <float.h>
+#include <algorithm>
+
+#include "oc.h"
+#include "nb.h"
+#include "director.h"
+#include "simstate.h"
+#include "key.h"
+#include "energy.h"    // Needed to make MSVC++ 5 happy
+#include "meshvalue.h"
+#include "scalarfield.h"
+#include "vectorfield.h"
+
+#include "yy_2lat_blocksum.h"
+#include "yy_2lat_util.h"
+#include "yy_2lattimedriver.h"
+#include "yy_2lateigenevolve.h"
+
+// Oxs_Ext registration support
+OXS_EXT_REGISTER(YY_2LatEigenEvolve);
+
+/* End includes */
+
+// Revision information
+static const Oxs_WarningMessageRevisionInfo revision_info
+  (__FILE__,
+   "$Revision:$",
+   "$Date:$",
+   "$Author:$",
+   "Yu Yahagi (yuyahagi2@gmail.com)");
+
+// Eigenvalues and eigenvectors of the symmetric tridiagonal matrix
+// with diagonal d[0..n-1] and off-diagonal e[0..n-2] (e[i] couples i
+// and i+1), by QL iteration with implicit shifts.  On return d holds
+// the eigenvalues, unsorted, and column k of the row major n x n
+// matrix z the eigenvector of d[k].  e is destroyed.  Returns 0 if an
+// eigenvalue fails to converge.
+static OC_BOOL YY_2LatEigenTridiagonal(OC_INDEX n,
+                                       vector<OC_REAL8m>& d,
+                                       vector<OC_REAL8m>& e,
+                                       vector<OC_REAL8m>& z)
+{
+  OC_INDEX i, k, l, m;
+  z.assign(n*n,0.);
+  for(i=0;i<n;++i) z[i*n+i] = 1.0;
+  e.resize(n,0.);
+  e[n-1] = 0.;
+  for(l=0;l<n;++l) {
+    int iter = 0;
+    do {
+      for(m=l;m+1<n;++m) {
+        OC_REAL8m dd = fabs(d[m]) + fabs(d[m+1]);
+        if(fabs(e[m]) <= DBL_EPSILON*dd) break;
+      }
+      if(m!=l) {
+        if(++iter>60) return 0;
+        OC_REAL8m g = (d[l+1]-d[l])/(2.0*e[l]);
+        OC_REAL8m r = sqrt(g*g+1.0);
+        g = d[m] - d[l] + e[l]/(g + (g>=0. ? r : -r));
+        OC_REAL8m s = 1.0, c = 1.0, p = 0.0;
+        for(i=m-1;i>=l;--i) {
+          OC_REAL8m f = s*e[i];
+          OC_REAL8m b = c*e[i];
+          r = sqrt(f*f+g*g);
+          e[i+1] = r;
+          if(r==0.) {
+            // Underflow; deflate and start over.
+            d[i+1] -= p;
+            e[m] = 0.;
+            break;
+          }
+          s = f/r;
+          c = g/r;
+          g = d[i+1] - p;
+          r = (d[i]-g)*s + 2.0*c*b;
+          p = s*r;
+          d[i+1] = g + p;
+          g = c*r - b;
+          for(k=0;k<n;++k) {
+            f = z[k*n+i+1];
+            z[k*n+i+1] = s*z[k*n+i] + c*f;
+            z[k*n+i] = c*z[k*n+i] - s*f;
+          }
+        }
+        if(r==0. && i>=l) continue;
+        d[l] -= p;
+        e[l] = g;
+        e[m] = 0.;
+      }
+    } while(m!=l);
+  }
+  return 1;
+}
+
+// Orders mode indices by decreasing eigenvalue.
+struct YY_2LatEigenGreater {
+  const vector<OC_REAL8m>& value;
+  YY_2LatEigenGreater(const vector<OC_REAL8m>& value_) : value(value_) {}
+  bool operator()(OC_INDEX a,OC_INDEX b) const {
+    return value[a]>value[b];
+  }
+};
+
+// Constructor
+YY_2LatEigenEvolve::YY_2LatEigenEvolve(
+    const char* name,     // Child instance id
+    Oxs_Director* newdtr, // App director
+    const char* argstr)   // MIF input block parameters
+    : YY_2LatTimeEvolver(name,newdtr,argstr),
+    mode_count(0), lanczos_steps(0), fd_step(0.),
+    cg_tolerance(0.), cg_max_iterations(0),
+    relax_tolerance(0.), max_rotation(0.), mode_output(1),
+    mesh_id(0), relax_state_id(0), relax_step(0.), solved_stage(0)
+{
+  // Process arguments
+  mode_count = GetIntInitValue("mode_count",10);
+  if(mode_count<1) {
+    throw Oxs_Ext::Error(this,"Invalid initialization detected:"
+       " mode_count must be positive.");
+  }
+  lanczos_steps = GetIntInitValue("lanczos_steps",0);
+  if(lanczos_steps!=0 && lanczos_steps<mode_count) {
+    throw Oxs_Ext::Error(this,"Invalid initialization detected:"
+       " lanczos_steps must be 0 (automatic) or at least mode_count.");
+  }
+  fd_step = GetRealInitValue("fd_step",1e-4);
+  if(fd_step<=0. || fd_step>0.1) {
+    throw Oxs_Ext::Error(this,"Invalid initialization detected:"
+       " fd_step must be in (0,0.1] radians.");
+  }
+  cg_tolerance = GetRealInitValue("cg_tolerance",1e-6);
+  if(cg_tolerance<=0. || cg_tolerance>=1.) {
+    throw Oxs_Ext::Error(this,"Invalid initialization detected:"
+       " cg_tolerance must be in (0,1).");
+  }
+  cg_max_iterations = GetIntInitValue("cg_max_iterations",2000);
+  if(cg_max_iterations<1) {
+    throw Oxs_Ext::Error(this,"Invalid initialization detected:"
+       " cg_max_iterations must be positive.");
+  }
+  relax_tolerance = GetRealInitValue("relax_tolerance",0.01);
+  if(relax_tolerance<=0.) {
+    throw Oxs_Ext::Error(this,"Invalid initialization detected:"
+       " relax_tolerance must be positive.");
+  }
+  relax_tolerance *= PI*1e9/180.; // Convert from deg/ns to rad/s
+  max_rotation = GetRealInitValue("max_rotation",2.0);
+  if(max_rotation<=0. || max_rotation>90.) {
+    throw Oxs_Ext::Error(this,"Invalid initialization detected:"
+       " max_rotation must be in (0,90] degrees.");
+  }
+  max_rotation *= PI/180.; // Convert from deg to rad
+  mode_output = GetIntInitValue("mode_output",1);
+  if(HasInitValue("basename")) {
+    basename = GetStringInitValue("basename");
+  } else {
+    basename = "oxs";
+    director->GetMifOption("basename",basename);
+  }
+
+  if(HasInitValue("gamma_LL1")) {
+    OXS_GET_INIT_EXT_OBJECT("gamma_LL1",Oxs_ScalarField,gamma1_init);
+  } else {
+    gamma1_init.SetAsOwner(dynamic_cast<Oxs_ScalarField *>
+                           (MakeNew("Oxs_UniformScalarField",director,
+                                    "value 2.211e5")));
+  }
+  if(HasInitValue("gamma_LL2")) {
+    OXS_GET_INIT_EXT_OBJECT("gamma_LL2",Oxs_ScalarField,gamma2_init);
+  } else {
+    gamma2_init.SetAsOwner(dynamic_cast<Oxs_ScalarField *>
+                           (MakeNew("Oxs_UniformScalarField",director,
+                                    "value 2.211e5")));
+  }
+
+  if(HasInitValue("temperature")) {
+    OXS_GET_INIT_EXT_OBJECT("temperature",Oxs_ScalarField,temperature_init);
+  } else {
+    temperature_init.SetAsOwner(dynamic_cast<Oxs_ScalarField *>
+                          (MakeNew("Oxs_UniformScalarField",director,
+                                   "value 0.0")));
+  }
+
+  // Mode profiles are few and written once per stage; no need for the
+  // background writer.
+  mode_writer.SetBackground(0,1);
+
+  // Trial states (total and both sublattices).
+  director->ReserveSimulationStateRequest(3);
+
+  // Setup outputs
+  max_dm_dt_output.Setup(this,InstanceName(),"Max dm/dt","deg/ns",0,
+     &YY_2LatEigenEvolve::UpdateDerivedOutputs);
+  lowest_frequency_output.Setup(this,InstanceName(),"Lowest frequency",
+     "Hz",0,&YY_2LatEigenEvolve::UpdateDerivedOutputs);
+
+  VerifyAllInitArgsUsed();
+}   // end Constructor
+
+OC_BOOL YY_2LatEigenEvolve::Init()
+{
+  // Register outputs
+  max_dm_dt_output.Register(director,-5);
+  lowest_frequency_output.Register(director,-5);
+
+  mesh_id = 0;
+  relax_state_id = 0;
+  relax_step = 0.;
+  solved_stage = 0;
+  frequency.clear();
+  residual.clear();
+  gamma1.Release();
+  gamma2.Release();
+  temperature.Release();
+  relax_dm1.Release();
+  relax_dm2.Release();
+  relax_g1.Release();
+  relax_g2.Release();
+  energy.Release();
+  H1.Release();
+  H2.Release();
+  trial1.Release();
+  trial2.Release();
+  shift1.Release();
+  shift2.Release();
+  trial_Ms.Release();
+  trial_Ms_inverse.Release();
+
+  return YY_2LatTimeEvolver::Init();  // Initialize parent class.
+  // Do this after child output registration so that
+  // UpdateDerivedOutputs gets called before the parent
+  // total_energy_output update function.
+}
+
+YY_2LatEigenEvolve::~YY_2LatEigenEvolve()
+{}
+
+void YY_2LatEigenEvolve::UpdateMeshArrays(const Oxs_SimState& state)
+{
+  const Oxs_Mesh* mesh = state.mesh;
+  if(mesh_id != mesh->Id()) {
+    mesh_id = 0;
+    YY_2LatFillMeshValue(gamma1_init.GetPtr(),mesh,gamma1);
+    YY_2LatFillMeshValue(gamma2_init.GetPtr(),mesh,gamma2);
+    YY_2LatFillMeshValue(temperature_init.GetPtr(),mesh,temperature);
+    const OC_INDEX size = mesh->Size();
+    for(OC_INDEX i=0;i<size;++i) {
+      gamma1[i] = fabs(gamma1[i]);
+      gamma2[i] = fabs(gamma2[i]);
+    }
+    relax_state_id = 0;
+    relax_step = 0.;
+    mesh_id = mesh->Id();
+  }
+  // The exchange terms need the temperature.
+  if(state.lattice1->T==NULL) {
+    state.lattice1->T = &temperature;
+    state.lattice2->T = &temperature;
+  }
+  UpdateFixedSpinList(mesh);
+}
+
+void YY_2LatEigenEvolve::EvaluateSpins(
+    const Oxs_SimState& cstate_,
+    const Oxs_SimState& cstate1_,
+    const Oxs_SimState& cstate2_,
+    const Oxs_MeshValue<ThreeVector>& spin1_,
+    const Oxs_MeshValue<ThreeVector>& spin2_)
+{
+  const Oxs_Mesh* mesh = cstate_.mesh;
+  const OC_INDEX size = mesh->Size();
+  trial_Ms.AdjustSize(mesh);
+  trial_Ms_inverse.AdjustSize(mesh);
+
+  Oxs_Key<Oxs_SimState> tempkey, tempkey1, tempkey2;
+  director->GetNewSimulationState(tempkey);
+  director->GetNewSimulationState(tempkey1);
+  director->GetNewSimulationState(tempkey2);
+  Oxs_SimState& tstate = tempkey.GetWriteReference();
+  Oxs_SimState& tstate1 = tempkey1.GetWriteReference();
+  Oxs_SimState& tstate2 = tempkey2.GetWriteReference();
+  cstate_.CloneHeader(tstate);
+  cstate1_.CloneHeader(tstate1);
+  cstate2_.CloneHeader(tstate2);
+
+  // Sublattice Ms is that of the current state; only the total lattice,
+  // whose magnitude depends on the spin directions, needs its own.
+  tstate.Ms = &trial_Ms;    tstate.Ms_inverse = &trial_Ms_inverse;
+  tstate1.Ms = cstate1_.Ms; tstate1.Ms_inverse = cstate1_.Ms_inverse;
+  tstate2.Ms = cstate2_.Ms; tstate2.Ms_inverse = cstate2_.Ms_inverse;
+
+  tstate.lattice_type = Oxs_SimState::TOTAL;
+  tstate1.lattice_type = Oxs_SimState::LATTICE1;
+  tstate2.lattice_type = Oxs_SimState::LATTICE2;
+  tstate.total_lattice = NULL;
+  tstate.lattice1 = &tstate1;
+  tstate.lattice2 = &tstate2;
+  tstate1.total_lattice = &tstate;
+  tstate1.lattice1 = NULL;
+  tstate1.lattice2 = &tstate2;
+  tstate2.total_lattice = &tstate;
+  tstate2.lattice1 = &tstate1;
+  tstate2.lattice2 = NULL;
+  tstate1.T = cstate1_.T;
+  tstate2.T = cstate2_.T;
+  tstate1.Tc = cstate1_.Tc;
+  tstate2.Tc = cstate2_.Tc;
+  tstate1.m_e = cstate1_.m_e;
+  tstate2.m_e = cstate2_.m_e;
+  tstate1.chi_l = cstate1_.chi_l;
+  tstate2.chi_l = cstate2_.chi_l;
+
+  tstate1.spin = spin1_;
+  tstate2.spin = spin2_;
+  const Oxs_MeshValue<OC_REAL8m>& Ms1 = *(cstate1_.Ms);
+  const Oxs_MeshValue<OC_REAL8m>& Ms2 = *(cstate2_.Ms);
+  tstate.spin.AdjustSize(mesh);
+  for(OC_INDEX i=0;i<size;++i) {
+    ThreeVector tempspin = Ms1[i]*spin1_[i];
+    tempspin += Ms2[i]*spin2_[i];
+    trial_Ms[i] = sqrt(tempspin.MagSq());
+    tempspin.MakeUnit();
+    tstate.spin[i] = tempspin;
+    trial_Ms_inverse[i] = (trial_Ms[i]!=0.0 ? 1.0/trial_Ms[i] : 0.0);
+  }
+
+  tempkey1.GetReadReference();  // Release write locks
+  tempkey2.GetReadReference();
+  const Oxs_SimState& tstate_read = tempkey.GetReadReference();
+  OC_REAL8m pE_pt, total_E;
+  GetEnergyDensity(tstate_read,energy,NULL,NULL,&H1,&H2,pE_pt,total_E);
+  tempkey.Release();
+  tempkey1.Release();
+  tempkey2.Release();
+}
+
+OC_REAL8m YY_2LatEigenEvolve::TransverseField(
+    const Oxs_SimState& state1,
+    const Oxs_SimState& state2,
+    const Oxs_MeshValue<ThreeVector>& spin1_,
+    const Oxs_MeshValue<ThreeVector>& spin2_,
+    Oxs_MeshValue<ThreeVector>& g1,
+    Oxs_MeshValue<ThreeVector>& g2) const
+{
+  const Oxs_Mesh* mesh = state1.mesh;
+  const OC_INDEX size = mesh->Size();
+  const Oxs_MeshValue<OC_REAL8m>& Ms1 = *(state1.Ms);
+  const Oxs_MeshValue<OC_REAL8m>& Ms2 = *(state2.Ms);
+  g1.AdjustSize(mesh);
+  g2.AdjustSize(mesh);
+  OC_INDEX i;
+  for(i=0;i<size;++i) {
+    const ThreeVector& m1 = spin1_[i];
+    const ThreeVector& m2 = spin2_[i];
+    if(Ms1[i]!=0.0) g1[i] = H1[i] - (H1[i]*m1)*m1;
+    else            g1[i].Set(0.,0.,0.);
+    if(Ms2[i]!=0.0) g2[i] = H2[i] - (H2[i]*m2)*m2;
+    else            g2[i].Set(0.,0.,0.);
+  }
+  const vector<OC_INDEX>* fixed = GetFixedSpinList();
+  if(fixed!=NULL) {
+    for(size_t j=0;j<fixed->size();++j) {
+      g1[(*fixed)[j]].Set(0.,0.,0.);
+      g2[(*fixed)[j]].Set(0.,0.,0.);
+    }
+  }
+  OC_REAL8m max_rate_sq = 0.;
+  for(i=0;i<size;++i) {
+    OC_REAL8m r1 = gamma1[i]*gamma1[i]*g1[i].MagSq();
+    OC_REAL8m r2 = gamma2[i]*gamma2[i]*g2[i].MagSq();
+    if(r1>max_rate_sq) max_rate_sq = r1;
+    if(r2>max_rate_sq) max_rate_sq = r2;
+  }
+  return sqrt(max_rate_sq);
+}
+
+void YY_2LatEigenEvolve::Relax(
+    const Oxs_SimState& cstate_,
+    const Oxs_SimState& cstate1_,
+    const Oxs_SimState& cstate2_,
+    const Oxs_MeshValue<ThreeVector>& g1,
+    const Oxs_MeshValue<ThreeVector>& g2)
+{
+  const Oxs_Mesh* mesh = cstate_.mesh;
+  const OC_INDEX size = mesh->Size();
+  OC_INDEX i;
+
+  // Barzilai-Borwein step length from the last displacement and the
+  // change in gradient (-H_perp) it caused.  Without a usable previous
+  // step, the largest transverse field turns its spin by max_rotation.
+  OC_BOOL have_step = 0;
+  if(relax_state_id!=0 && relax_state_id==cstate_.Id()
+     && relax_step>0.) {
+    YY_2LatBlockSum num, den;
+    for(i=0;i<size;++i) {
+      num += relax_dm1[i].MagSq() + relax_dm2[i].MagSq();
+      den += relax_dm1[i]*(relax_g1[i]-g1[i])
+        + relax_dm2[i]*(relax_g2[i]-g2[i]);
+    }
+    if(den.GetValue()>0.) {
+      relax_step = num.GetValue()/den.GetValue();
+    }
+    have_step = 1;
+  }
+  if(!have_step) {
+    OC_REAL8m max_g_sq = 0.;
+    for(i=0;i<size;++i) {
+      if(g1[i].MagSq()>max_g_sq) max_g_sq = g1[i].MagSq();
+      if(g2[i].MagSq()>max_g_sq) max_g_sq = g2[i].MagSq();
+    }
+    relax_step = (max_g_sq>0. ? max_rotation/sqrt(max_g_sq) : 0.);
+  }
+
+  relax_dm1.AdjustSize(mesh);
+  relax_dm2.AdjustSize(mesh);
+  trial1.AdjustSize(mesh);
+  trial2.AdjustSize(mesh);
+  relax_g1 = g1;
+  relax_g2 = g2;
+  const OC_REAL8m max_rot_sq = max_rotation*max_rotation;
+  const Oxs_MeshValue<ThreeVector>* spin[2]
+    = { &cstate1_.spin, &cstate2_.spin };
+  const Oxs_MeshValue<ThreeVector>* g[2] = { &g1, &g2 };
+  Oxs_MeshValue<ThreeVector>* trial[2] = { &trial1, &trial2 };
+  Oxs_MeshValue<ThreeVector>* dm[2] = { &relax_dm1, &relax_dm2 };
+  for(int l=0;l<2;++l) {
+    for(i=0;i<size;++i) {
+      ThreeVector step = relax_step*(*(g[l]))[i];
+      OC_REAL8m stepsq = step.MagSq();
+      if(stepsq>max_rot_sq) {
+        step *= max_rotation/sqrt(stepsq);
+      }
+      (*(dm[l]))[i] = step;
+      ThreeVector m = (*(spin[l]))[i] + step;
+      m.MakeUnit();
+      (*(trial[l]))[i] = m;
+    }
+  }
+}
+
+void YY_2LatEigenEvolve::ApplyHessian(
+    const Oxs_SimState& cstate_,
+    const Oxs_SimState& cstate1_,
+    const Oxs_SimState& cstate2_,
+    const Oxs_MeshValue<ThreeVector>& base1,
+    const Oxs_MeshValue<ThreeVector>& base2,
+    const ModeVector& x,ModeVector& y)
+{
+  const Oxs_Mesh* mesh = cstate_.mesh;
+  const OC_INDEX size = mesh->Size();
+  OC_INDEX i;
+  y.resize(2*size);
+
+  OC_REAL8m xmax_sq = 0.;
+  for(i=0;i<2*size;++i) {
+    if(x[i].MagSq()>xmax_sq) xmax_sq = x[i].MagSq();
+  }
+  if(xmax_sq==0.) {
+    for(i=0;i<2*size;++i) y[i].Set(0.,0.,0.);
+    return;
+  }
+  const OC_REAL8m eps = fd_step/sqrt(xmax_sq);
+
+  shift1.AdjustSize(mesh);
+  shift2.AdjustSize(mesh);
+  for(int pass=0;pass<2;++pass) {
+    const OC_REAL8m du = (pass==0 ? eps : -eps);
+    for(i=0;i<size;++i) {
+      ThreeVector m1 = base1[i];  m1.Accum(du,x[i]);
+      ThreeVector m2 = base2[i];  m2.Accum(du,x[size+i]);
+      m1.MakeUnit();
+      m2.MakeUnit();
+      shift1[i] = m1;
+      shift2[i] = m2;
+    }
+    EvaluateSpins(cstate_,cstate1_,cstate2_,shift1,shift2);
+    for(i=0;i<size;++i) {
+      ThreeVector h1 = H1[i] - (H1[i]*shift1[i])*shift1[i];
+      ThreeVector h2 = H2[i] - (H2[i]*shift2[i])*shift2[i];
+      if(pass==0) {
+        y[i] = h1;
+        y[size+i] = h2;
+      } else {
+        y[i] -= h1;
+        y[size+i] -= h2;
+      }
+    }
+  }
+
+  // Back onto the tangent planes of the base spins.
+  const OC_REAL8m scale = -0.5/eps;
+  for(i=0;i<size;++i) {
+    if(active[i]) {
+      y[i] -= (y[i]*base1[i])*base1[i];
+      y[i] *= scale;
+    } else {
+      y[i].Set(0.,0.,0.);
+    }
+    if(active[size+i]) {
+      y[size+i] -= (y[size+i]*base2[i])*base2[i];
+      y[size+i] *= scale;
+    } else {
+      y[size+i].Set(0.,0.,0.);
+    }
+  }
+}
+
+void YY_2LatEigenEvolve::ApplyGammaJInverse(
+    const Oxs_MeshValue<ThreeVector>& base1,
+    const Oxs_MeshValue<ThreeVector>& base2,
+    const ModeVector& x,ModeVector& y) const
+{
+  const OC_INDEX size = base1.Size();
+  y.resize(2*size);
+  for(OC_INDEX i=0;i<size;++i) {
+    const OC_REAL8m ig1 = (gamma1[i]!=0. ? -1.0/gamma1[i] : 0.);
+    const OC_REAL8m ig2 = (gamma2[i]!=0. ? -1.0/gamma2[i] : 0.);
+    y[i] = ig1*(base1[i]^x[i]);
+    y[size+i] = ig2*(base2[i]^x[size+i]);
+  }
+}
+
+OC_REAL8m YY_2LatEigenEvolve::WeightedDot(
+    const Oxs_SimState& state1,
+    const Oxs_SimState& state2,
+    const ModeVector& x,const ModeVector& y) const
+{
+  const Oxs_Mesh* mesh = state1.mesh;
+  const OC_INDEX size = mesh->Size();
+  const Oxs_MeshValue<OC_REAL8m>& Ms1 = *(state1.Ms);
+  const Oxs_MeshValue<OC_REAL8m>& Ms2 = *(state2.Ms);
+  YY_2LatBlockSum sum;
+  for(OC_INDEX i=0;i<size;++i) {
+    sum += mesh->Volume(i)*(Ms1[i]*(x[i]*y[i])
+                            + Ms2[i]*(x[size+i]*y[size+i]));
+  }
+  return sum.GetValue();
+}
+
+OC_BOOL YY_2LatEigenEvolve::SolveHessian(
+    const Oxs_SimState& cstate_,
+    const Oxs_SimState& cstate1_,
+    const Oxs_SimState& cstate2_,
+    const Oxs_MeshValue<ThreeVector>& base1,
+    const Oxs_MeshValue<ThreeVector>& base2,
+    const ModeVector& r,ModeVector& x)
+{
+  // H is self adjoint and, at a stable equilibrium, positive definite
+  // in the W inner product, so plain CG in that product applies.
+  const OC_INDEX n = static_cast<OC_INDEX>(r.size());
+  OC_INDEX i;
+  x.assign(n,ThreeVector(0.,0.,0.));
+  ModeVector res(r), p(r), q;
+  OC_REAL8m rr = WeightedDot(cstate1_,cstate2_,res,res);
+  const OC_REAL8m rr_stop = cg_tolerance*cg_tolerance*rr;
+  if(rr==0.) return 1;
+  OC_INDEX iter;
+  for(iter=0;iter<cg_max_iterations;++iter) {
+    ApplyHessian(cstate_,cstate1_,cstate2_,base1,base2,p,q);
+    const OC_REAL8m pq = WeightedDot(cstate1_,cstate2_,p,q);
+    if(pq<=0.) return 0;
+    const OC_REAL8m a = rr/pq;
+    for(i=0;i<n;++i) {
+      x[i].Accum(a,p[i]);
+      res[i].Accum(-a,q[i]);
+    }
+    const OC_REAL8m rr_new = WeightedDot(cstate1_,cstate2_,res,res);
+    if(rr_new<=rr_stop) break;
+    const OC_REAL8m b = rr_new/rr;
+    for(i=0;i<n;++i) {
+      ThreeVector tmp = res[i];
+      tmp.Accum(b,p[i]);
+      p[i] = tmp;
+    }
+    rr = rr_new;
+  }
+  return (iter<cg_max_iterations);
+}
+
+void YY_2LatEigenEvolve::SolveModes(
+    const Oxs_SimState& cstate_,
+    const Oxs_SimState& cstate1_,
+    const Oxs_SimState& cstate2_,
+    const Oxs_MeshValue<ThreeVector>& base1,
+    const Oxs_MeshValue<ThreeVector>& base2)
+{
+  const OC_INDEX size = cstate_.mesh->Size();
+  const Oxs_MeshValue<OC_REAL8m>& Ms1 = *(cstate1_.Ms);
+  const Oxs_MeshValue<OC_REAL8m>& Ms2 = *(cstate2_.Ms);
+  OC_INDEX i, j, k;
+  frequency.clear();
+  residual.clear();
+
+  // Free degrees of freedom: two per spin with Ms!=0 and not fixed.
+  active.assign(2*size,1);
+  for(i=0;i<size;++i) {
+    if(Ms1[i]==0.0) active[i] = 0;
+    if(Ms2[i]==0.0) active[size+i] = 0;
+  }
+  const vector<OC_INDEX>* fixed = GetFixedSpinList();
+  if(fixed!=NULL) {
+    for(size_t jf=0;jf<fixed->size();++jf) {
+      active[(*fixed)[jf]] = 0;
+      active[size+(*fixed)[jf]] = 0;
+    }
+  }
+  OC_INDEX dimension = 0;
+  for(i=0;i<2*size;++i) if(active[i]) dimension += 2;
+  if(dimension==0) return;
+  OC_INDEX steps = (lanczos_steps>0 ? lanczos_steps : 2*mode_count+10);
+  if(steps>dimension) steps = dimension;
+
+  // Random start in the tangent space
+  ModeVector v(2*size), hv(2*size), w(2*size), hw(2*size);
+  ModeVector t(2*size), y(2*size);
+  for(i=0;i<2*size;++i) {
+    if(!active[i]) { v[i].Set(0.,0.,0.); continue; }
+    const ThreeVector& m = (i<size ? base1[i] : base2[i-size]);
+    ThreeVector r(Oc_UnifRand()-0.5,Oc_UnifRand()-0.5,Oc_UnifRand()-0.5);
+    r -= (r*m)*m;
+    v[i] = r;
+  }
+  ApplyHessian(cstate_,cstate1_,cstate2_,base1,base2,v,hv);
+  OC_REAL8m norm_sq = WeightedDot(cstate1_,cstate2_,v,hv);
+  if(norm_sq<=0.) {
+    static Oxs_WarningMessage notstable(3);
+    char buf[1024];
+    Oc_Snprintf(buf,sizeof(buf),
+                "Stage %u: energy Hessian is not positive definite;"
+                " the state is not a stable equilibrium."
+                " No modes computed.",
+                static_cast<unsigned int>(cstate_.stage_number));
+    notstable.Send(revision_info,OC_STRINGIFY(__LINE__),buf);
+    return;
+  }
+  OC_REAL8m inorm = 1.0/sqrt(norm_sq);
+  for(i=0;i<2*size;++i) { v[i] *= inorm; hv[i] *= inorm; }
+
+  // Lanczos on B^-1 in the <x,y> = x^T W H y inner product, with full
+  // reorthogonalization.  basis_h holds H applied to each basis vector,
+  // so that inner products with the basis need no further Hessian
+  // evaluations.
+  vector<ModeVector> basis, basis_h;
+  vector<OC_REAL8m> alpha, beta;
+  OC_BOOL indefinite = 0;
+  for(j=0;j<steps;++j) {
+    basis.push_back(v);
+    basis_h.push_back(hv);
+
+    // w = B^-1 v = -K^-1 K^-1 v, K^-1 x = H^-1 (gamma m x)^-1 x.  The
+    // first solve gives y = K^-1 v, and H w = -(gamma m x)^-1 y.
+    ApplyGammaJInverse(base1,base2,v,t);
+    if(!SolveHessian(cstate_,cstate1_,cstate2_,base1,base2,t,y)) {
+      indefinite = 1;
+      break;
+    }
+    ApplyGammaJInverse(base1,base2,y,t);
+    if(!SolveHessian(cstate_,cstate1_,cstate2_,base1,base2,t,w)) {
+      indefinite = 1;
+      break;
+    }
+    for(i=0;i<2*size;++i) {
+      w[i] *= -1.0;
+      hw[i] = -1.0*t[i];
+    }
+
+    const OC_REAL8m a = WeightedDot(cstate1_,cstate2_,w,hv);
+    alpha.push_back(a);
+    for(i=0;i<2*size;++i) {
+      w[i].Accum(-a,v[i]);
+      hw[i].Accum(-a,hv[i]);
+      if(j>0) {
+        w[i].Accum(-beta[j-1],basis[j-1][i]);
+        hw[i].Accum(-beta[j-1],basis_h[j-1][i]);
+      }
+    }
+    for(int pass=0;pass<2;++pass) {
+      for(k=0;k<=j;++k) {
+        const OC_REAL8m c = WeightedDot(cstate1_,cstate2_,w,basis_h[k]);
+        for(i=0;i<2*size;++i) {
+          w[i].Accum(-c,basis[k][i]);
+          hw[i].Accum(-c,basis_h[k][i]);
+        }
+      }
+    }
+
+    const OC_REAL8m b_sq = WeightedDot(cstate1_,cstate2_,w,hw);
+    if(b_sq<=1e-20*a*a) break; // Invariant subspace
+    const OC_REAL8m b = sqrt(b_sq);
+    beta.push_back(b);
+    const OC_REAL8m ib = 1.0/b;
+    for(i=0;i<2*size;++i) {
+      v[i] = ib*w[i];
+      hv[i] = ib*hw[i];
+    }
+  }
+  if(indefinite) {
+    static Oxs_WarningMessage solvefailed(3);
+    char buf[1024];
+    Oc_Snprintf(buf,sizeof(buf),
+                "Stage %u: Hessian solve failed after %ld Lanczos steps."
+                " Either the state is not a stable equilibrium or has a"
+                " zero mode, or the solve did not reach cg_tolerance %g"
+                " in %ld iterations.  Modes are from the steps done.",
+                static_cast<unsigned int>(cstate_.stage_number),
+                static_cast<long>(alpha.size()),
+                static_cast<double>(cg_tolerance),
+                static_cast<long>(cg_max_iterations));
+    solvefailed.Send(revision_info,OC_STRINGIFY(__LINE__),buf);
+  }
+  if(alpha.empty()) return;
+
+  // Ritz values and vectors of the tridiagonal matrix.  The largest
+  // Ritz values theta = 1/omega^2 are the lowest modes.
+  const OC_INDEX m = static_cast<OC_INDEX>(alpha.size());
+  const OC_REAL8m beta_last
+    = (static_cast<OC_INDEX>(beta.size())>=m ? beta[m-1] : 0.);
+  vector<OC_REAL8m> d(alpha), e(beta), z;
+  e.resize(m,0.);
+  if(!YY_2LatEigenTridiagonal(m,d,e,z)) {
+    throw Oxs_Ext::Error(this,"YY_2LatEigenEvolve::SolveModes:"
+       " tridiagonal eigenvalue iteration failed to converge.");
+  }
+  vector<OC_INDEX> order(m);
+  for(k=0;k<m;++k) order[k] = k;
+  std::sort(order.begin(),order.end(),YY_2LatEigenGreater(d));
+
+  OC_INDEX nmodes = 0;
+  while(nmodes<mode_count && nmodes<m && d[order[nmodes]]>0.) ++nmodes;
+  for(k=0;k<nmodes;++k) {
+    const OC_REAL8m theta = d[order[k]];
+    frequency.push_back(1.0/(2*PI*sqrt(theta)));
+    residual.push_back(beta_last*fabs(z[(m-1)*m+order[k]])/theta);
+  }
+
+  // Mode table, next to the mode profiles
+  char buf[64];
+  Oc_Snprintf(buf,sizeof(buf),"-mode-%02u.txt",
+              static_cast<unsigned int>(cstate_.stage_number));
+  const String table_name = basename + String(buf);
+  FILE* table = fopen(table_name.c_str(),"w");
+  if(table==NULL) {
+    String msg = String("YY_2LatEigenEvolve::SolveModes:"
+                        " Unable to open mode table file ") + table_name;
+    throw Oxs_Ext::Error(this,msg.c_str());
+  }
+  fprintf(table,"# Stage %u, %ld Lanczos steps\n"
+          "# mode   frequency (Hz)   residual\n",
+          static_cast<unsigned int>(cstate_.stage_number),
+          static_cast<long>(m));
+  for(k=0;k<nmodes;++k) {
+    fprintf(table,"%6ld   %.17g   %.6e\n",static_cast<long>(k),
+            static_cast<double>(frequency[k]),
+            static_cast<double>(residual[k]));
+  }
+  if(fclose(table)!=0) {
+    String msg = String("YY_2LatEigenEvolve::SolveModes:"
+                        " Error writing mode table file ") + table_name;
+    throw Oxs_Ext::Error(this,msg.c_str());
+  }
+
+  if(!mode_output) return;
+  Oxs_MeshValue<ThreeVector> mode1, mode2;
+  mode1.AdjustSize(cstate_.mesh);
+  mode2.AdjustSize(cstate_.mesh);
+  for(k=0;k<nmodes;++k) {
+    for(i=0;i<size;++i) {
+      mode1[i].Set(0.,0.,0.);
+      mode2[i].Set(0.,0.,0.);
+    }
+    for(j=0;j<m;++j) {
+      const OC_REAL8m c = z[j*m+order[k]];
+      const ModeVector& b = basis[j];
+      for(i=0;i<size;++i) {
+        mode1[i].Accum(c,b[i]);
+        mode2[i].Accum(c,b[size+i]);
+      }
+    }
+    OC_REAL8m amax_sq = 0.;
+    for(i=0;i<size;++i) {
+      if(mode1[i].MagSq()>amax_sq) amax_sq = mode1[i].MagSq();
+      if(mode2[i].MagSq()>amax_sq) amax_sq = mode2[i].MagSq();
+    }
+    if(amax_sq>0.) {
+      const OC_REAL8m iamax = 1.0/sqrt(amax_sq);
+      for(i=0;i<size;++i) {
+        mode1[i] *= iamax;
+        mode2[i] *= iamax;
+      }
+    }
+    Oc_Snprintf(buf,sizeof(buf),"-mode-%02u-%03u",
+                static_cast<unsigned int>(cstate_.stage_number),
+                static_cast<unsigned int>(k));
+    const String stem = basename + String(buf);
+    mode_writer.Write(stem+String("-1.ovf"),"Mode1","",cstate1_,
+                      mode1,NULL);
+    mode_writer.Write(stem+String("-2.ovf"),"Mode2","",cstate2_,
+                      mode2,NULL);
+  }
+  mode_writer.Flush();
+}
+
+OC_BOOL
+YY_2LatEigenEvolve::Step(const YY_2LatTimeDriver* driver,
+          Oxs_ConstKey<Oxs_SimState> current_state,
+          Oxs_ConstKey<Oxs_SimState> current_state1,
+          Oxs_ConstKey<Oxs_SimState> current_state2,
+          const Oxs_DriverStepInfo& /* step_info */,
+          Oxs_Key<Oxs_SimState>& next_state,
+          Oxs_Key<Oxs_SimState>& next_state1,
+          Oxs_Key<Oxs_SimState>& next_state2)
+{
+  const Oxs_SimState& cstate = current_state.GetReadReference();
+  const Oxs_SimState& cstate1 = current_state1.GetReadReference();
+  const Oxs_SimState& cstate2 = current_state2.GetReadReference();
+
+  UpdateMeshArrays(cstate);
+
+  // Transverse field of the current state
+  OC_REAL8m pE_pt, total_E;
+  GetEnergyDensity(cstate,energy,NULL,NULL,&H1,&H2,pE_pt,total_E);
+  Oxs_MeshValue<ThreeVector> g1, g2;
+  OC_REAL8m rate = TransverseField(cstate1,cstate2,
+                                   cstate1.spin,cstate2.spin,g1,g2);
+
+  // Relax until the torque is below relax_tolerance, then solve.  The
+  // solve happens in the step that reaches the tolerance, so that the
+  // stage cannot end on stopping_dm_dt before the modes are known.
+  const OC_UINT4m stage_tag = cstate.stage_number + 1;
+  OC_BOOL relaxed = 0;
+  if(solved_stage!=stage_tag && rate>relax_tolerance) {
+    Relax(cstate,cstate1,cstate2,g1,g2);
+    EvaluateSpins(cstate,cstate1,cstate2,trial1,trial2);
+    rate = TransverseField(cstate1,cstate2,trial1,trial2,g1,g2);
+    relaxed = 1;
+  } else {
+    trial1 = cstate1.spin;
+    trial2 = cstate2.spin;
+  }
+  if(solved_stage!=stage_tag && rate<=relax_tolerance) {
+    SolveModes(cstate,cstate1,cstate2,trial1,trial2);
+    solved_stage = stage_tag;
+  }
+  if(solved_stage==stage_tag) rate = 0.;
+
+  Oxs_SimState& workstate = next_state.GetWriteReference();
+  Oxs_SimState& workstate1 = next_state1.GetWriteReference();
+  Oxs_SimState& workstate2 = next_state2.GetWriteReference();
+  driver->FillState(cstate,workstate);
+  driver->FillState(cstate1,workstate1);
+  driver->FillState(cstate2,workstate2);
+
+  // Set pointers to the sublattice
+  workstate.lattice1 = &workstate1;
+  workstate.lattice2 = &workstate2;
+  workstate1.total_lattice = &workstate;
+  workstate1.lattice2 = &workstate2;
+  workstate2.total_lattice = &workstate;
+  workstate2.lattice1 = &workstate1;
+  workstate1.lattice_type = Oxs_SimState::LATTICE1;
+  workstate2.lattice_type = Oxs_SimState::LATTICE2;
+
+  if(cstate.Id() != workstate.previous_state_id) {
+    throw Oxs_Ext::Error(this,
+        "YY_2LatEigenEvolve::Step: State continuity break detected.");
+  }
+
+  // Relaxation and mode solve do not move in time.
+  workstate.last_timestep = 0.;
+  workstate1.last_timestep = 0.;
+  workstate2.last_timestep = 0.;
+  workstate.stage_start_time = cstate.stage_start_time;
+  workstate.stage_elapsed_time = cstate.stage_elapsed_time;
+  workstate1.stage_start_time = cstate.stage_start_time;
+  workstate1.stage_elapsed_time = cstate.stage_elapsed_time;
+  workstate2.stage_start_time = cstate.stage_start_time;
+  workstate2.stage_elapsed_time = cstate.stage_elapsed_time;
+  workstate.iteration_count = cstate.iteration_count + 1;
+  workstate.stage_iteration_count = cstate.stage_iteration_count + 1;
+  workstate1.iteration_count = cstate1.iteration_count + 1;
+  workstate1.stage_iteration_count = cstate1.stage_iteration_count + 1;
+  workstate2.iteration_count = cstate2.iteration_count + 1;
+  workstate2.stage_iteration_count = cstate2.stage_iteration_count + 1;
+
+  const OC_INDEX size = cstate.mesh->Size();
+  const Oxs_MeshValue<OC_REAL8m>& Ms1 = *(workstate1.Ms);
+  const Oxs_MeshValue<OC_REAL8m>& Ms2 = *(workstate2.Ms);
+  Oxs_MeshValue<OC_REAL8m>& wMs = *(workstate.Ms);
+  Oxs_MeshValue<OC_REAL8m>& wMs_inverse = *(workstate.Ms_inverse);
+  workstate1.spin = trial1;
+  workstate2.spin = trial2;
+  workstate.spin.AdjustSize(cstate.mesh);
+  for(OC_INDEX i=0;i<size;++i) {
+    ThreeVector tempspin = Ms1[i]*trial1[i];
+    tempspin += Ms2[i]*trial2[i];
+    wMs[i] = sqrt(tempspin.MagSq());
+    tempspin.MakeUnit();
+    workstate.spin[i] = tempspin;
+    wMs_inverse[i] = (wMs[i]!=0.0 ? 1.0/wMs[i] : 0.0);
+  }
+  driver->FillStateSupplemental(workstate);
+  driver->FillStateSupplemental(workstate1);
+  driver->FillStateSupplemental(workstate2);
+
+  next_state1.GetReadReference();  // Release write locks
+  next_state2.GetReadReference();
+  const Oxs_SimState& nstate
+    = next_state.GetReadReference();  // Release write lock
+
+  // The Barzilai-Borwein data are only good for a step from nstate.
+  relax_state_id = (relaxed ? nstate.Id() : 0);
+
+  if(!nstate.AddDerivedData("Max dm/dt",rate) ||
+     !nstate.AddDerivedData("Lowest frequency",
+                            frequency.empty() ? 0. : frequency[0])) {
+    throw Oxs_Ext::Error(this,
+       "YY_2LatEigenEvolve::Step:"
+       " Programming error; data cache already set.");
+  }
+
+  return 1;  // Good step
+}   // end Step
+
+void YY_2LatEigenEvolve::UpdateDerivedOutputs(const Oxs_SimState& state)
+{ // This routine fills all the YY_2LatEigenEvolve Oxs_ScalarOutput's
+  // from the data recorded in state.  A state not produced by Step,
+  // i.e., the initial state or a new stage state, gets the torque of
+  // its own spins.
+  max_dm_dt_output.cache.state_id
+    = lowest_frequency_output.cache.state_id
+    = 0;  // Mark change in progress
+
+  OC_REAL8m max_dm_dt, lowest;
+  if(!state.GetDerivedData("Max dm/dt",max_dm_dt) ||
+     !state.GetDerivedData("Lowest frequency",lowest)) {
+    UpdateMeshArrays(state);
+    OC_REAL8m pE_pt, total_E;
+    GetEnergyDensity(state,energy,NULL,NULL,&H1,&H2,pE_pt,total_E);
+    Oxs_MeshValue<ThreeVector> g1, g2;
+    max_dm_dt = TransverseField(*(state.lattice1),*(state.lattice2),
+                                state.lattice1->spin,state.lattice2->spin,
+                                g1,g2);
+    lowest = (frequency.empty() ? 0. : frequency[0]);
+    OC_REAL8m dummy_value;
+    if(!state.GetDerivedData("Max dm/dt",dummy_value)) {
+      state.AddDerivedData("Max dm/dt",max_dm_dt);
+    }
+    if(!state.GetDerivedData("Lowest frequency",dummy_value)) {
+      state.AddDerivedData("Lowest frequency",lowest);
+    }
+  }
+
+  max_dm_dt_output.cache.value = max_dm_dt*(180e-9/PI);
+  /// Convert from radians/second to deg/ns
+  lowest_frequency_output.cache.value = lowest;
+
+  max_dm_dt_output.cache.state_id
+    = lowest_frequency_output.cache.state_id
+    = state.Id();
+}   // end UpdateDerivedOutputs
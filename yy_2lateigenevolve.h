@@ -0,0 +1,252 @@
+/** FILE: yy_2lateigenevolve.h                 -*-Mode: c++-*-
+ *
+ * Linearized spin wave eigenmodes of a two lattice system about an
+ * equilibrium state.
+ *
+ * Copyright (C) 2015 Yu Yahagi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _YY_2LATEIGENEVOLVE
+#define _YY_2LATEIGENEVOLVE
+
+#include <string>
+#include <vector>
+
+#include "nb.h"
+
+#include "yy_2lattimeevolver.h"
+#include "yy_2lat_ovfwriter.h"
+#include "key.h"
+#include "output.h"
+#include "scalarfield.h"
+#include "vectorfield.h"
+
+OC_USE_STD_NAMESPACE;
+OC_USE_STRING;
+
+/* End includes */
+
+class YY_2LatEigenEvolve:public YY_2LatTimeEvolver {
+private:
+  // =======================================================================
+  // Solver parameters.  See notes at the bottom.
+  // =======================================================================
+  OC_INDEX mode_count;         // Number of modes reported
+  OC_INDEX lanczos_steps;      // Krylov space size; 0 selects default
+  OC_REAL8m fd_step;           // Finite difference rotation, radians
+  OC_REAL8m cg_tolerance;      // Relative residual of the inner solves
+  OC_INDEX cg_max_iterations;
+  OC_REAL8m relax_tolerance;   // Max dm/dt to start the solve, rad/s
+  OC_REAL8m max_rotation;      // Relaxation cap, radians per step
+  OC_BOOL mode_output;         // Write mode profiles as OVF files
+  String basename;             // OVF file name prefix
+
+  Oxs_OwnedPointer<Oxs_ScalarField> gamma1_init, gamma2_init;
+  Oxs_MeshValue<OC_REAL8m> gamma1, gamma2; // LL form, m/(A.s)
+
+  // Temperature is fixed, and only enters through the temperature
+  // dependence of the energy terms.
+  Oxs_OwnedPointer<Oxs_ScalarField> temperature_init;
+  Oxs_MeshValue<OC_REAL8m> temperature; // in Kelvin
+
+  OC_UINT4m mesh_id;
+
+  // =======================================================================
+  // Relaxation towards the equilibrium (Barzilai-Borwein descent).
+  // =======================================================================
+  OC_UINT4m relax_state_id;    // State the relax data below belong to
+  OC_REAL8m relax_step;        // radians per A/m; 0 until first step
+  Oxs_MeshValue<ThreeVector> relax_dm1, relax_dm2; // Last displacement
+  Oxs_MeshValue<ThreeVector> relax_g1, relax_g2;   // Last H_perp
+
+  OC_UINT4m solved_stage;      // Stage the modes belong to, +1; 0 none
+  vector<OC_REAL8m> frequency; // Hz, ascending
+  vector<OC_REAL8m> residual;  // Relative residual estimate per mode
+
+  // Scratch space for the energy evaluations
+  Oxs_MeshValue<OC_REAL8m> energy;
+  Oxs_MeshValue<ThreeVector> H1, H2;
+  Oxs_MeshValue<ThreeVector> trial1, trial2;  // Next state spins
+  Oxs_MeshValue<ThreeVector> shift1, shift2;  // Hessian probe spins
+  Oxs_MeshValue<OC_REAL8m> trial_Ms, trial_Ms_inverse;
+
+  YY_2LatOvfWriter mode_writer;
+
+  void UpdateMeshArrays(const Oxs_SimState& state);
+  /// Fills gamma, temperature and the fixed spin list for state.mesh.
+
+  void EvaluateSpins(const Oxs_SimState& cstate_,
+                     const Oxs_SimState& cstate1_,
+                     const Oxs_SimState& cstate2_,
+                     const Oxs_MeshValue<ThreeVector>& spin1_,
+                     const Oxs_MeshValue<ThreeVector>& spin2_);
+  /// Effective fields H1, H2 for the spins spin1_, spin2_, evaluated
+  /// on a temporary state trio built from the cstate_ headers.
+
+  OC_REAL8m TransverseField(const Oxs_SimState& state1,
+                            const Oxs_SimState& state2,
+                            const Oxs_MeshValue<ThreeVector>& spin1_,
+                            const Oxs_MeshValue<ThreeVector>& spin2_,
+                            Oxs_MeshValue<ThreeVector>& g1,
+                            Oxs_MeshValue<ThreeVector>& g2) const;
+  /// Fills g1, g2 with the part of H1, H2 transverse to spin1_,
+  /// spin2_, zero in empty cells and at fixed spins, and returns
+  /// max gamma*|g| in rad/s.
+
+  void Relax(const Oxs_SimState& cstate_,
+             const Oxs_SimState& cstate1_,
+             const Oxs_SimState& cstate2_,
+             const Oxs_MeshValue<ThreeVector>& g1,
+             const Oxs_MeshValue<ThreeVector>& g2);
+  /// One descent step from the cstate_ spins along g1, g2 (the
+  /// transverse fields of cstate_), into trial1, trial2.
+
+  // Krylov vectors hold the tangent displacement of sublattice 1 in
+  // cells [0,size) and of sublattice 2 in [size,2*size).
+  typedef vector<ThreeVector> ModeVector;
+  vector<char> active; // Free entries: Ms!=0 and not fixed
+
+  void ApplyHessian(const Oxs_SimState& cstate_,
+                    const Oxs_SimState& cstate1_,
+                    const Oxs_SimState& cstate2_,
+                    const Oxs_MeshValue<ThreeVector>& base1,
+                    const Oxs_MeshValue<ThreeVector>& base2,
+                    const ModeVector& x,ModeVector& y);
+  /// y = -d(H_perp)/du x, the energy Hessian in field units about the
+  /// spins base1, base2, by central differences along x.
+
+  void ApplyGammaJInverse(const Oxs_MeshValue<ThreeVector>& base1,
+                          const Oxs_MeshValue<ThreeVector>& base2,
+                          const ModeVector& x,ModeVector& y) const;
+  /// y = -(m x x)/gamma, the inverse of x -> gamma m x x on the
+  /// tangent planes.
+
+  OC_BOOL SolveHessian(const Oxs_SimState& cstate_,
+                       const Oxs_SimState& cstate1_,
+                       const Oxs_SimState& cstate2_,
+                       const Oxs_MeshValue<ThreeVector>& base1,
+                       const Oxs_MeshValue<ThreeVector>& base2,
+                       const ModeVector& r,ModeVector& x);
+  /// Conjugate gradient solve of H x = r in the W inner product.
+  /// Returns 0 if H turns out not to be positive definite, or if
+  /// cg_tolerance is not reached in cg_max_iterations iterations.
+
+  OC_REAL8m WeightedDot(const Oxs_SimState& state1,
+                        const Oxs_SimState& state2,
+                        const ModeVector& x,const ModeVector& y) const;
+  /// Sum over cells of Ms*volume*(x.y).
+
+  void SolveModes(const Oxs_SimState& cstate_,
+                  const Oxs_SimState& cstate1_,
+                  const Oxs_SimState& cstate2_,
+                  const Oxs_MeshValue<ThreeVector>& base1,
+                  const Oxs_MeshValue<ThreeVector>& base2);
+  /// Lanczos solve about base1, base2.  Fills frequency and residual,
+  /// writes the mode table and, with mode_output, the mode profiles.
+
+  // =======================================================================
+  // Outputs
+  // =======================================================================
+  void UpdateDerivedOutputs(const Oxs_SimState&);
+  Oxs_ScalarOutput<YY_2LatEigenEvolve> max_dm_dt_output;
+  Oxs_ScalarOutput<YY_2LatEigenEvolve> lowest_frequency_output;
+
+  // Disable copy constructor and assignment operator by declaring
+  // them without defining them.
+  YY_2LatEigenEvolve(const YY_2LatEigenEvolve&);
+  YY_2LatEigenEvolve& operator=(const YY_2LatEigenEvolve&);
+
+public:
+  virtual const char* ClassName() const; // ClassName() is
+  /// automatically generated by the OXS_EXT_REGISTER macro.
+  virtual OC_BOOL Init();
+  YY_2LatEigenEvolve(const char* name,     // Child instance id
+     Oxs_Director* newdtr, // App director
+     const char* argstr);  // MIF input block parameters
+  virtual ~YY_2LatEigenEvolve();
+
+  virtual  OC_BOOL
+  Step(const YY_2LatTimeDriver* driver,
+       Oxs_ConstKey<Oxs_SimState> current_state,
+       Oxs_ConstKey<Oxs_SimState> current_state1,
+       Oxs_ConstKey<Oxs_SimState> current_state2,
+       const Oxs_DriverStepInfo& step_info,
+       Oxs_Key<Oxs_SimState>& next_state,
+       Oxs_Key<Oxs_SimState>& next_state1,
+       Oxs_Key<Oxs_SimState>& next_state2);
+  // One relaxation step, or the mode solve once the state is relaxed.
+};
+
+/**
+ * Notes on the mode solve
+ *
+ * Each stage first relaxes the state: steps move the spins downhill
+ * along the transverse effective field H_perp with Barzilai-Borwein
+ * step lengths, each cell turning by at most max_rotation.  Once
+ * gamma*|H_perp| is below relax_tolerance everywhere, the modes are
+ * solved in that same step, and from then on "Max dm/dt" reports 0 and
+ * the spins stay put.  So stopping_dm_dt of YY_2LatTimeDriver must be
+ * positive and below relax_tolerance for the stage to end after the
+ * solve.  Ms is held fixed: the modes are the transverse (precessional)
+ * modes of both sublattices, including the inter-sublattice exchange
+ * modes, at the temperature given by the temperature option.  Damping
+ * is left out, so the frequencies are those of the conservative
+ * dynamics.
+ *
+ * With u the small rotation of each spin (a tangent vector per cell
+ * and sublattice), the effective field changes by -Hu, with H the
+ * energy Hessian in field units, and the linearized dynamics is
+ *
+ *   du/dt = K u,   K = gamma m x (H u).
+ *
+ * H is applied matrix free: a central difference of H_perp between
+ * the spins rotated by +-fd_step along u (largest cell rotation),
+ * projected on the tangent planes of the equilibrium.  This includes
+ * the curvature term -(m.H) of the sphere.  The eigenvalues of K are
+ * +-i*omega, so those of B = -K^2 are omega^2, each twice.  B is self
+ * adjoint in the inner product <x,y> = x^T W H y, W = Ms*volume, which
+ * is positive definite at a stable equilibrium.
+ *
+ * The low end of the spectrum is crowded next to the exchange
+ * dominated top, so Lanczos on B itself would need a huge Krylov space
+ * for the lowest modes.  Instead Lanczos runs on B^-1 (same inner
+ * product, full reorthogonalization, random start), whose largest
+ * eigenvalues 1/omega^2 are the lowest modes and are well separated.
+ * Each step applies K^-1 twice; K^-1 x is a conjugate gradient solve
+ * with H, stopped at a relative residual of cg_tolerance.  H of every
+ * basis vector follows from the solves, so the inner products need no
+ * extra evaluations.  The cost is thus about lanczos_steps times two
+ * solves, each a few hundred energy evaluations for exchange
+ * dominated meshes, and the basis takes 2*lanczos_steps vectors of 6
+ * doubles per cell.  Lanczos finds one copy of each degenerate pair.
+ * The solves need H positive definite; an unstable state, or a zero
+ * mode (e.g. no anisotropy and no applied field), stops the solve
+ * with a warning, as does a CG solve that does not reach cg_tolerance
+ * within cg_max_iterations.
+ *
+ * The lowest mode_count Ritz values give the frequencies
+ * f = omega/(2 pi), written to basename-mode-SS.txt with the residual
+ * estimate |beta*y_last|/theta of the Ritz value theta.  If the residuals are
+ * not small, increase lanczos_steps.
+ *
+ * With mode_output enabled, the in-phase profile u of mode k (the
+ * other quadrature is K u/omega) is written per sublattice to
+ * basename-mode-SS-KKK-1.ovf and -2.ovf, scaled so that the largest
+ * cell amplitude over both sublattices is 1.
+ */
+
+#endif // _YY_2LATEIGENEVOLVE
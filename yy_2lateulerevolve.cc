@@ -22,6 +22,7 @@
  */
 
 #include <math.h>
+#include <algorithm>
 
 #include "nb.h"
 #include "director.h"
@@ -31,7 +32,11 @@
 #include "meshvalue.h"
 #include "rectangularmesh.h"
 #include "scalarfield.h"
+#include "chunkenergy.h"
+#include "oxsthread.h"
 
+#include "yy_2lat_blocksum.h"
+#include "yy_2lat_util.h"
 #include "yy_2lattimedriver.h"
 #include "yy_2lateulerevolve.h"
 
@@ -40,38 +45,87 @@ OXS_EXT_REGISTER(YY_2LatEulerEvolve);
 
 /* End includes */
 
+// Revision information
+static const Oxs_WarningMessageRevisionInfo revision_info
+  (__FILE__,
+   "$Revision:$",
+   "$Date:$",
+   "$Author:$",
+   "Yu Yahagi (yuyahagi2@gmail.com)");
+
 void YY_2LatEulerEvolve::UpdateStageTemperature(const Oxs_SimState& state)
 {
-  if(!has_tempscript) return;
+  if(!has_tempscript && !has_temperature_pulses) return;
 
   const Oxs_Mesh* mesh = state.mesh;
-  const OC_REAL8m stage = state.stage_number;
-  const OC_REAL8m size = mesh->Size();
-  OC_INDEX index;
-  if((index = tempscript_opts[0].position)>=0) { // stage
-    tempscript_cmd.SetCommandArg(index,stage);
-  }
-  if((index = tempscript_opts[1].position)>=0) { // stage_time
-    tempscript_cmd.SetCommandArg(index,state.stage_elapsed_time);
-  }
-  if((index = tempscript_opts[2].position)>=0) { // total_time
-    tempscript_cmd.SetCommandArg(index,state.stage_start_time+state.stage_elapsed_time);
-  }
+  const OC_INDEX size = mesh->Size();
+  if(has_tempscript) {
+    const OC_REAL8m stage = state.stage_number;
+    OC_INDEX index;
+    if((index = tempscript_opts[0].position)>=0) { // stage
+      tempscript_cmd.SetCommandArg(index,stage);
+    }
+    if((index = tempscript_opts[1].position)>=0) { // stage_time
+      tempscript_cmd.SetCommandArg(index,state.stage_elapsed_time);
+    }
+    if((index = tempscript_opts[2].position)>=0) { // total_time
+      tempscript_cmd.SetCommandArg(index,state.stage_start_time+state.stage_elapsed_time);
+    }
 
-  vector<String> params;
-  tempscript_cmd.SaveInterpResult();
-  tempscript_cmd.Eval();
-  tempscript_cmd.GetResultList(params);
-  tempscript_cmd.RestoreInterpResult();
+    vector<String> params;
+    tempscript_cmd.SaveInterpResult();
+    tempscript_cmd.Eval();
+    tempscript_cmd.GetResultList(params);
+    tempscript_cmd.RestoreInterpResult();
+
+    OXS_GET_EXT_OBJECT(params,Oxs_ScalarField,temperature_init);
+  }
 
-  OXS_GET_EXT_OBJECT(params,Oxs_ScalarField,temperature_init);
-  temperature_init->FillMeshValue(mesh,temperature);
   kB_T.AdjustSize(mesh);
+  temperature_changed.clear(); // All of T is rewritten
+  ++temperature_update_count;
+  if(has_temperature_pulses) {
+    // The stage temperature is the base for the pulses; fill every
+    // cell so that no stale value survives a stage change.
+    YY_2LatFillMeshValue(temperature_init.GetPtr(),mesh,temperature_base);
+    temperature.AdjustSize(mesh);
+    temperature_pulses.Fill(mesh,
+                            state.stage_start_time+state.stage_elapsed_time,
+                            temperature_tol,&temperature_base,
+                            temperature,kB_T,0);
+    return;
+  }
+
+  YY_2LatFillMeshValue(temperature_init.GetPtr(),mesh,temperature);
   for(OC_INDEX i=0; i<size; i++) {
     kB_T[i] = KBoltzmann*temperature[i];
   }
 }
 
+void YY_2LatEulerEvolve::UpdatePulseTemperature(const Oxs_SimState& state)
+{ // Call with the total_lattice state at its new time.  Re-evaluates
+  // the temperature pulses and refreshes the temperature dependent
+  // parameters in the cells that changed.
+  if(!has_temperature_pulses) return;
+  temperature_pulses.Fill(state.mesh,
+                          state.stage_start_time+state.stage_elapsed_time,
+                          temperature_tol,&temperature_base,
+                          temperature,kB_T,&temperature_changed);
+  if(!temperature_changed.empty()) {
+    ++temperature_update_count;
+    UpdateMeshArrays(state,&temperature_changed);
+  }
+}
+
+void YY_2LatEulerEvolve::SetTemperaturePointers(const Oxs_SimState& state)
+{ // Call with the total_lattice state.
+  state.lattice1->T = state.lattice2->T = &temperature;
+  state.lattice1->T_update_count = &temperature_update_count;
+  state.lattice2->T_update_count = &temperature_update_count;
+  state.lattice1->T_changed = &temperature_changed;
+  state.lattice2->T_changed = &temperature_changed;
+}
+
 // Constructor
 YY_2LatEulerEvolve::YY_2LatEulerEvolve(
     const char* name,     // Child instance id
@@ -85,11 +139,16 @@ YY_2LatEulerEvolve::YY_2LatEulerEvolve(
     iteration_hFluct1_calculated(0),
     iteration_hFluct2_calculated(0),
     has_tempscript(0),
-    last_stage_number(0)
+    last_stage_number(0),
+    has_temperature_pulses(0),
+    temperature_tol(0.),
+    temperature_update_count(0),
+    frozen_mesh_id(0)
 {
   // Process arguments
   // For now, it works with a fixed time step but there still are min_ and
   // max_timestep for future implementation of adaptive stepsize.
+  const OC_BOOL has_fixed_timestep = HasInitValue("fixed_timestep");
   fixed_timestep = GetRealInitValue("fixed_timestep",1e-16);
   min_timestep = max_timestep = fixed_timestep;
   if(max_timestep<=0.0) {
@@ -119,6 +178,19 @@ YY_2LatEulerEvolve::YY_2LatEulerEvolve(
        " step_headroom value must be bigger than 0.");
   }
 
+  // Stability-derived step, re-estimated at each stage start
+  auto_timestep = GetIntInitValue("auto_timestep",0);
+  auto_timestep_margin = GetRealInitValue("auto_timestep_margin",0.2);
+  if(auto_timestep_margin<=0.0) {
+    char buf[4096];
+    Oc_Snprintf(buf,sizeof(buf),
+    "Invalid parameter value:"
+    " Specified auto_timestep_margin is %g (should be >0.)",
+    auto_timestep_margin);
+    throw Oxs_Ext::Error(this,buf);
+  }
+  auto_timestep_stage = 0;
+
   if(HasInitValue("alpha_t1")) {
     OXS_GET_INIT_EXT_OBJECT("alpha_t1",Oxs_ScalarField,alpha_t1_init);
   } else {
@@ -175,6 +247,22 @@ YY_2LatEulerEvolve::YY_2LatEulerEvolve(
 
   do_precess = GetIntInitValue("do_precess",1);
 
+  // Compute dm/dt inside the chunk energy pass rather than in a
+  // separate sweep over H and mxH.  Results match the unfused path
+  // up to floating point summation order.
+  use_fused_dm_dt = GetIntInitValue("fused_dm_dt",0);
+
+  String hpstr = GetStringInitValue("huge_pages","none");
+  if(!YY_2LatParseHugePageMode(hpstr,huge_pages)) {
+    String msg = String("Invalid huge_pages request: ") + hpstr
+      + String("\n Should be one of none, transparent, or explicit.");
+    throw Oxs_Ext::Error(this,msg.c_str());
+  }
+
+  // Per-sublattice pinned regions, in addition to fixed_spins
+  GetFrozenRegions("fixed_spins1",frozen_atlas1,frozen_region_ids1);
+  GetFrozenRegions("fixed_spins2",frozen_atlas2,frozen_region_ids2);
+
   start_dm = GetRealInitValue("start_dm",0.01);
   start_dm *= PI/180.; // Convert from deg to rad
 
@@ -198,12 +286,61 @@ YY_2LatEulerEvolve::YY_2LatEulerEvolve(
                                    "value 0.0")));
   }
 
+  // Analytic temperature pulses, evaluated natively every step
+  if(HasInitValue("temperature_pulses")) {
+    String pulsestr = GetStringInitValue("temperature_pulses");
+    Nb_SplitList pulselist;
+    if(pulselist.Split(pulsestr.c_str())!=TCL_OK) {
+      char bit[4000];
+      Oc_EllipsizeMessage(bit,sizeof(bit),pulsestr.c_str());
+      char buf[4500];
+      Oc_Snprintf(buf,sizeof(buf),
+                  "Format error in temperature_pulses---"
+                  "not a proper Tcl list: %.4000s",
+                  bit);
+      throw Oxs_Ext::Error(this,buf);
+    }
+    for(int ip=0;ip<pulselist.Count();++ip) {
+      YY_2LatTemperaturePulse pulse;
+      String errmsg;
+      if(!YY_2LatParseTemperaturePulse(pulselist[ip],pulse,errmsg)) {
+        char buf[4096];
+        Oc_Snprintf(buf,sizeof(buf),
+                    "Invalid temperature_pulses entry %d: %.3500s",
+                    ip,errmsg.c_str());
+        throw Oxs_Ext::Error(this,buf);
+      }
+      temperature_pulses.AddPulse(pulse);
+    }
+    has_temperature_pulses = (temperature_pulses.PulseCount()>0);
+  }
+  temperature_tol = GetRealInitValue("temperature_tol",0.0);
+  if(temperature_tol<0.0) {
+    char buf[4096];
+    Oc_Snprintf(buf,sizeof(buf),
+    "Invalid parameter value:"
+    " Specified temperature_tol is %g (should be >=0.)",
+    temperature_tol);
+    throw Oxs_Ext::Error(this,buf);
+  }
+
   // set temperature to zero to get an estimate for a reasonable stepsize
   // or use it for comparison (acts like eulerevolve with temperature=0K)
-  if(!has_tempscript){ // That is, T = 0.
+  if(!has_tempscript && !has_temperature_pulses){ // That is, T = 0.
     min_timestep = 0.;    
     max_timestep = 1e-10; 
   }
+  stage_min_timestep = min_timestep;
+  stage_max_timestep = max_timestep;
+  stage_fixed_timestep = fixed_timestep;
+
+  // The auto_timestep result is capped by the adaptive step cap at
+  // T = 0, and for T > 0 by fixed_timestep if that was given.
+  if(!has_tempscript && !has_temperature_pulses) {
+    auto_timestep_cap = max_timestep;
+  } else {
+    auto_timestep_cap = (has_fixed_timestep ? fixed_timestep : DBL_MAX);
+  }
 
   if(HasInitValue("uniform_seed")) {
     uniform_seed = GetIntInitValue("uniform_seed");
@@ -233,6 +370,8 @@ YY_2LatEulerEvolve::YY_2LatEulerEvolve(
      &YY_2LatEulerEvolve::UpdateDerivedOutputs);
   mxH2_output.Setup(this,InstanceName(),"mxH2","A/m",1,
      &YY_2LatEulerEvolve::UpdateDerivedOutputs);
+  footprint_output.Setup(this,InstanceName(),"Work array memory","MB",0,
+     &YY_2LatEulerEvolve::UpdateFootprintOutput);
 
   VerifyAllInitArgsUsed();
 }   // end Constructor
@@ -249,20 +388,23 @@ OC_BOOL YY_2LatEulerEvolve::Init()
   dm_dt_t2_output.Register(director,-5);
   dm_dt_l2_output.Register(director,-5);
   mxH2_output.Register(director,-5);
+  footprint_output.Register(director,-5);
 
-  // dm_dt and mxH output caches are used for intermediate storage,
-  // so enable caching.
-  dm_dt_t1_output.CacheRequestIncrement(1);
-  dm_dt_l1_output.CacheRequestIncrement(1);
-  mxH1_output.CacheRequestIncrement(1);
-  dm_dt_t2_output.CacheRequestIncrement(1);
-  dm_dt_l2_output.CacheRequestIncrement(1);
-  mxH2_output.CacheRequestIncrement(1);
+  // The dm_dt and mxH output caches are only filled on request; see
+  // FillDmDtOutput and MxHRequest.  Stepping uses dm_dt_t1 etc.
+  dm_dt_t1_output.cache.value.Release();
+  dm_dt_l1_output.cache.value.Release();
+  dm_dt_t2_output.cache.value.Release();
+  dm_dt_l2_output.cache.value.Release();
+  mxH1_output.cache.value.Release();
+  mxH2_output.cache.value.Release();
 
   alpha_t10.Release(); alpha_t1.Release(); alpha_l1.Release();
   alpha_t20.Release(); alpha_t2.Release(); alpha_l2.Release();
   gamma1.Release(); gamma2.Release();
   energy.Release();
+  dm_dt_t1.Release(); dm_dt_l1.Release();
+  dm_dt_t2.Release(); dm_dt_l2.Release();
   total_field1.Release();
   total_field2.Release();
   new_energy.Release();
@@ -270,6 +412,7 @@ OC_BOOL YY_2LatEulerEvolve::Init()
   new_dm_dt_l1.Release();
   new_dm_dt_t2.Release();
   new_dm_dt_l2.Release();
+  stiffness_t.Release(); stiffness_l.Release();
 
   hFluct_t1.Release(); hFluct_l1.Release();
   hFluct_t2.Release(); hFluct_l2.Release();
@@ -277,6 +420,11 @@ OC_BOOL YY_2LatEulerEvolve::Init()
   hFluctVarConst_t2.Release(); hFluctVarConst_l2.Release();
 
   energy_state_id=0;   // Mark as invalid state
+  frozen_mesh_id=0;    // Rebuild frozen cell lists on first use
+  auto_timestep_stage=0; // Re-estimate auto_timestep on first step
+  stage_min_timestep = min_timestep;
+  stage_max_timestep = max_timestep;
+  stage_fixed_timestep = fixed_timestep;
   next_timestep=0.;    // Dummy value
   energy_accum_count=energy_accum_count_limit; // Force cold count
   // on first pass
@@ -298,31 +446,79 @@ OC_BOOL YY_2LatEulerEvolve::Init()
 YY_2LatEulerEvolve::~YY_2LatEulerEvolve()
 {}
 
-void YY_2LatEulerEvolve::Calculate_dm_dt(
+void YY_2LatEulerEvolve::GetFrozenRegions(
+    const char* key,
+    Oxs_OwnedPointer<Oxs_Atlas>& atlas_,
+    vector<OC_INDEX>& region_ids_)
+{ // Parses a { atlas region ... } list, as for Oxs_Evolver fixed_spins
+  region_ids_.clear();
+  if(!HasInitValue(key)) return;
+  vector<String> fixedinfo;
+  FindRequiredInitValue(key,fixedinfo);
+  if(!fixedinfo.empty()) {
+    OXS_GET_EXT_OBJECT(fixedinfo[0],Oxs_Atlas,atlas_);
+    for(size_t j=1;j<fixedinfo.size();++j) {
+      OC_INDEX id = atlas_->GetRegionId(fixedinfo[j]);
+      if(id<0) {
+        String msg = String("Region \"") + fixedinfo[j]
+          + String("\" specified in ") + String(key)
+          + String(" list is not a known region in atlas \"")
+          + String(atlas_->InstanceName()) + String("\".");
+        throw Oxs_Ext::Error(this,msg.c_str());
+      }
+      region_ids_.push_back(id);
+    }
+  }
+  DeleteInitValue(key);
+}
+
+void YY_2LatEulerEvolve::UpdateFrozenSpinLists(const Oxs_Mesh* mesh_)
+{
+  if(frozen_mesh_id == mesh_->Id()) return;
+  UpdateFixedSpinList(mesh_); // Transverse-only; see Calculate_dm_dt_Chunk
+  frozen_spins1.clear();
+  frozen_spins2.clear();
+  if(!frozen_region_ids1.empty() || !frozen_region_ids2.empty()) {
+    const OC_INDEX size = mesh_->Size();
+    ThreeVector pos;
+    for(OC_INDEX i=0;i<size;++i) {
+      mesh_->Center(i,pos);
+      if(!frozen_region_ids1.empty()
+         && find(frozen_region_ids1.begin(),frozen_region_ids1.end(),
+                 frozen_atlas1->GetRegionId(pos))
+            != frozen_region_ids1.end()) {
+        frozen_spins1.push_back(i);
+      }
+      if(!frozen_region_ids2.empty()
+         && find(frozen_region_ids2.begin(),frozen_region_ids2.end(),
+                 frozen_atlas2->GetRegionId(pos))
+            != frozen_region_ids2.end()) {
+        frozen_spins2.push_back(i);
+      }
+    }
+  }
+  frozen_mesh_id = mesh_->Id();
+}
+
+const vector<OC_INDEX>*
+YY_2LatEulerEvolve::GetFrozenSpinList(const Oxs_SimState& state_) const
+{
+  const vector<OC_INDEX>& frozen
+    = (state_.lattice_type==Oxs_SimState::LATTICE2
+       ? frozen_spins2 : frozen_spins1);
+  return (frozen.empty() ? 0 : &frozen);
+}
+
+void YY_2LatEulerEvolve::Prepare_dm_dt(
     const Oxs_SimState& state_,
-    const Oxs_MeshValue<ThreeVector>& mxH_,
-    const Oxs_MeshValue<ThreeVector>& total_field_,
-    OC_REAL8m pE_pt_,
     Oxs_MeshValue<ThreeVector>& dm_dt_t_,
     Oxs_MeshValue<ThreeVector>& dm_dt_l_,
-    OC_REAL8m& max_dm_dt_,
-    OC_REAL8m& dE_dt_,
-    OC_REAL8m& min_timestep_)
+    LatticeParams& params_)
 {
-  // Imports: state_, mxH_, pE_pt
-  // Exports: dm_dt_t_, dm_dt_l_, max_dm_dt_, dE_dt_
   const Oxs_Mesh* mesh_ = state_.mesh;
   const OC_INDEX size = mesh_->Size(); // Assume all imports are compatible
   const Oxs_MeshValue<OC_REAL8m>& Ms_ = *(state_.Ms);
-  const Oxs_MeshValue<OC_REAL8m>& Ms_inverse_ = *(state_.Ms_inverse);
-  const Oxs_MeshValue<OC_REAL8m>& Ms0_ = *(state_.Ms0);
-  const Oxs_MeshValue<OC_REAL8m>& Ms0_inverse_ = *(state_.Ms0_inverse);
-  const Oxs_MeshValue<ThreeVector>& spin_ = state_.spin;
   OC_UINT4m iteration_now = state_.iteration_count;
-  ThreeVector scratch_t;
-  ThreeVector scratch_l;
-  ThreeVector dm_fluct_t;
-  ThreeVector dm_fluct_l;
   OC_REAL8m hFluctSigma_t;
   OC_REAL8m hFluctSigma_l;
   dm_dt_t_.AdjustSize(mesh_);
@@ -340,10 +536,10 @@ void YY_2LatEulerEvolve::Calculate_dm_dt(
   
   if(mesh_id != mesh_->Id() || !gamma1.CheckMesh(mesh_)) {
     // First go or mesh change detected
-    alpha_t1_init->FillMeshValue(mesh_,alpha_t10);
-    alpha_t2_init->FillMeshValue(mesh_,alpha_t20);
-    gamma1_init->FillMeshValue(mesh_,gamma1);
-    gamma2_init->FillMeshValue(mesh_,gamma2);
+    YY_2LatFillMeshValue(alpha_t1_init.GetPtr(),mesh_,alpha_t10);
+    YY_2LatFillMeshValue(alpha_t2_init.GetPtr(),mesh_,alpha_t20);
+    YY_2LatFillMeshValue(gamma1_init.GetPtr(),mesh_,gamma1);
+    YY_2LatFillMeshValue(gamma2_init.GetPtr(),mesh_,gamma2);
     if(!allow_signed_gamma) {
       for(i=0;i<size;++i) {
         gamma1[i] = fabs(gamma1[i]);
@@ -367,18 +563,20 @@ void YY_2LatEulerEvolve::Calculate_dm_dt(
     alpha_t2.AdjustSize(mesh_);
     alpha_l1.AdjustSize(mesh_);
     alpha_l2.AdjustSize(mesh_);
-    hFluctVarConst_t1.AdjustSize(mesh_);
-    hFluctVarConst_t2.AdjustSize(mesh_);
-    hFluctVarConst_l1.AdjustSize(mesh_);
-    hFluctVarConst_l2.AdjustSize(mesh_);
 
     // Other mesh value arrays
-    total_field1.AdjustSize(mesh_);
-    total_field2.AdjustSize(mesh_);
-    hFluct_t1.AdjustSize(mesh_);     
-    hFluct_t2.AdjustSize(mesh_);     
-    hFluct_l1.AdjustSize(mesh_);     
-    hFluct_l2.AdjustSize(mesh_);     
+    if(use_stochastic) {
+      // The stochastic field arrays are only read with use_stochastic
+      // set, so otherwise they are not held at all.
+      hFluctVarConst_t1.AdjustSize(mesh_);
+      hFluctVarConst_t2.AdjustSize(mesh_);
+      hFluctVarConst_l1.AdjustSize(mesh_);
+      hFluctVarConst_l2.AdjustSize(mesh_);
+      hFluct_t1.AdjustSize(mesh_);
+      hFluct_t2.AdjustSize(mesh_);
+      hFluct_l1.AdjustSize(mesh_);
+      hFluct_l2.AdjustSize(mesh_);
+    }
     iteration_hFluct1_calculated = 0;     
     iteration_hFluct2_calculated = 0;     
 
@@ -387,43 +585,22 @@ void YY_2LatEulerEvolve::Calculate_dm_dt(
     UpdateMeshArrays(*(state_.total_lattice));
 
     // Set pointers for the temperature-dependent parameters in states.
-    switch(state_.lattice_type) {
-    case Oxs_SimState::LATTICE1:
-      state_.T = &temperature;
-      state_.lattice2->T = &temperature;
-      break;
-    case Oxs_SimState::LATTICE2:
-      state_.lattice1->T = &temperature;
-      state_.T = &temperature;
-      break;
-    default:
-      // Program should not reach here.
-      break;
-    }
+    SetTemperaturePointers(*(state_.total_lattice));
   }
 
   // Judge the type of lattice (sublattice1 or 2) and use corresponding
   // parameters for calculation
-  const Oxs_MeshValue<OC_REAL8m>* Tc;
-  const Oxs_MeshValue<OC_REAL8m>* alpha_t;
-  const Oxs_MeshValue<OC_REAL8m>* alpha_l;
-  const Oxs_MeshValue<OC_REAL8m>* gamma;
-  const Oxs_MeshValue<OC_REAL8m>* m_e;
-  const Oxs_MeshValue<OC_REAL8m>* chi_l;
-  Oxs_MeshValue<OC_REAL8m>* hFluctVarConst_t;
-  Oxs_MeshValue<OC_REAL8m>* hFluctVarConst_l;
-  Oxs_MeshValue<ThreeVector>* hFluct_t;
-  Oxs_MeshValue<ThreeVector>* hFluct_l;
-  OC_UINT4m* iteration_hFluct_calculated;
+  Oxs_MeshValue<OC_REAL8m>* hFluctVarConst_t = NULL;
+  Oxs_MeshValue<OC_REAL8m>* hFluctVarConst_l = NULL;
+  Oxs_MeshValue<ThreeVector>* hFluct_t = NULL;
+  Oxs_MeshValue<ThreeVector>* hFluct_l = NULL;
+  OC_UINT4m* iteration_hFluct_calculated = NULL;
 
   switch(state_.lattice_type) {
   case Oxs_SimState::LATTICE1:
-    Tc = state_.Tc;
-    alpha_t = &alpha_t1;
-    alpha_l = &alpha_l1;
-    gamma = &gamma1;
-    m_e = state_.m_e;
-    chi_l = state_.chi_l;
+    params_.alpha_t = &alpha_t1;
+    params_.alpha_l = &alpha_l1;
+    params_.gamma = &gamma1;
     hFluctVarConst_t = &hFluctVarConst_t1;
     hFluctVarConst_l = &hFluctVarConst_l1;
     hFluct_t = &hFluct_t1;
@@ -431,12 +608,9 @@ void YY_2LatEulerEvolve::Calculate_dm_dt(
     iteration_hFluct_calculated = &iteration_hFluct1_calculated;
     break;
   case Oxs_SimState::LATTICE2:
-    Tc = state_.Tc;
-    alpha_t = &alpha_t2;
-    alpha_l = &alpha_l2;
-    gamma = &gamma2;
-    m_e = state_.m_e;
-    chi_l = state_.chi_l;
+    params_.alpha_t = &alpha_t2;
+    params_.alpha_l = &alpha_l2;
+    params_.gamma = &gamma2;
     hFluctVarConst_t = &hFluctVarConst_t2;
     hFluctVarConst_l = &hFluctVarConst_l2;
     hFluct_t = &hFluct_t2;
@@ -447,17 +621,28 @@ void YY_2LatEulerEvolve::Calculate_dm_dt(
     // Program should not reach here.
     break;
   }
+  params_.hFluct_t = hFluct_t;
+  params_.hFluct_l = hFluct_l;
+
+  UpdateFrozenSpinLists(mesh_);
 
   if (use_stochastic && iteration_now > *iteration_hFluct_calculated) {
     // i.e. if thermal field is not calculated for this step
+    const vector<OC_INDEX>* frozen = GetFrozenSpinList(state_);
+    vector<OC_INDEX>::const_iterator fit;
+    if(frozen != NULL) fit = frozen->begin();
     for(i=0;i<size;i++){
+      if(frozen != NULL && fit != frozen->end() && *fit == i) {
+        ++fit; // Frozen cell; no noise
+        continue;
+      }
       if(Ms_[i] != 0){
         // Only sqrt(delta_t) is multiplied for stochastic functions
         // opposed to dm_dt * delta_t for deterministic functions.
         // This is the standard deviation of the gaussian distribution
         // used to represent the thermal perturbations
-        hFluctSigma_t = sqrt((*hFluctVarConst_t)[i] / fixed_timestep);
-        hFluctSigma_l = sqrt((*hFluctVarConst_l)[i] / fixed_timestep);
+        hFluctSigma_t = sqrt((*hFluctVarConst_t)[i] / stage_fixed_timestep);
+        hFluctSigma_l = sqrt((*hFluctVarConst_l)[i] / stage_fixed_timestep);
 
         (*hFluct_t)[i].x = hFluctSigma_t*Gaussian_Random(0.0, 1.0);
         (*hFluct_t)[i].y = hFluctSigma_t*Gaussian_Random(0.0, 1.0);
@@ -469,97 +654,179 @@ void YY_2LatEulerEvolve::Calculate_dm_dt(
     }
   }
 
-  for(i=0;i<size;i++) {
-    if(Ms_[i]==0) {
-      dm_dt_t_[i].Set(0.0,0.0,0.0);
-      dm_dt_l_[i].Set(0.0,0.0,0.0);
-    } else {
-      OC_REAL8m cell_alpha_t = (*alpha_t)[i];
-      OC_REAL8m cell_alpha_l = (*alpha_l)[i];
-      OC_REAL8m cell_gamma = (*gamma)[i];
-      OC_REAL8m cell_m_inverse = Ms0_[i]*Ms_inverse_[i];
+  // now hFluct_t is definetely calculated for this iteration
+  *iteration_hFluct_calculated = iteration_now;
+}
 
-      // deterministic part
-      scratch_t = mxH_[i];
-      scratch_t *= -cell_gamma; // -|gamma|*(mxH)
+void YY_2LatEulerEvolve::Calculate_dm_dt_Chunk(
+    const Oxs_SimState& state_,
+    const LatticeParams& params_,
+    const Oxs_MeshValue<ThreeVector>& mxH_,
+    const Oxs_MeshValue<ThreeVector>& total_field_,
+    Oxs_MeshValue<ThreeVector>& dm_dt_t_,
+    Oxs_MeshValue<ThreeVector>& dm_dt_l_,
+    const vector<OC_INDEX>* frozen_spins_,
+    OC_INDEX node_start,OC_INDEX node_stop,
+    DmDtStats& stats_) const
+{
+  const Oxs_Mesh* mesh_ = state_.mesh;
+  const Oxs_MeshValue<OC_REAL8m>& Ms_ = *(state_.Ms);
+  const Oxs_MeshValue<OC_REAL8m>& Ms_inverse_ = *(state_.Ms_inverse);
+  const Oxs_MeshValue<OC_REAL8m>& Ms0_ = *(state_.Ms0);
+  const Oxs_MeshValue<ThreeVector>& spin_ = state_.spin;
+  const Oxs_MeshValue<OC_REAL8m>& alpha_t = *(params_.alpha_t);
+  const Oxs_MeshValue<OC_REAL8m>& alpha_l = *(params_.alpha_l);
+  const Oxs_MeshValue<OC_REAL8m>& gamma = *(params_.gamma);
+  const Oxs_MeshValue<ThreeVector>& hFluct_t = *(params_.hFluct_t);
+  const Oxs_MeshValue<ThreeVector>& hFluct_l = *(params_.hFluct_l);
+  const OC_BOOL have_mxH = (mxH_.Size()>0); // Else form m x H here
+  ThreeVector scratch_t;
+  ThreeVector scratch_l;
+  ThreeVector dm_fluct_t;
+  ThreeVector cell_mxH;
+  OC_INDEX i;
 
-      if(do_precess) {
-        dm_dt_t_[i]  = scratch_t;
-        dm_dt_l_[i].Set(0.0,0.0,0.0);
-      } else {
-        dm_dt_t_[i].Set(0.0,0.0,0.0);
-        dm_dt_l_[i].Set(0.0,0.0,0.0);
-      }
+  // Work through the free cells between consecutive frozen cells.
+  // The frozen list is sorted, so jump straight to the first entry
+  // inside this range.
+  vector<OC_INDEX>::const_iterator fit;
+  if(frozen_spins_ != NULL) {
+    fit = lower_bound(frozen_spins_->begin(),frozen_spins_->end(),
+                      node_start);
+  }
 
-      // Transverse damping term
-      if(use_stochastic) {
-        // Note: The stochastic field is NOT included in the first term of 
-        // the LLB equation. See PRB 85, 014433 (2012). The second form of 
-        // LLB is the above article is implemented here.
-        dm_fluct_t = spin_[i] ^ (*hFluct_t)[i];  // cross product mxhFluct_t
-        dm_fluct_t *= -cell_gamma;
-        scratch_t += dm_fluct_t;  // -|gamma|*mx(H+hFluct_t)
-      }
-      scratch_t ^= spin_[i];
-      // -|gamma|((mx(H+hFluct_t))xm) = |gamma|(mx(mx(H+hFluct_t)))
-      scratch_t *= -cell_alpha_t*cell_m_inverse; // -|alpha*gamma|(mx(mx(H+hFluct_t)))
-      dm_dt_t_[i] += scratch_t;
-
-      // Longitudinal terms
-      OC_REAL8m temp = spin_[i]*total_field_[i];
-      temp *= cell_gamma*cell_alpha_l;
-      temp *= cell_m_inverse;
-      scratch_l = temp*spin_[i];
-      dm_dt_l_[i] += scratch_l;
-
-      // Check for overshooting
-      scratch_l = dm_dt_l_[i]*fixed_timestep;
-      scratch_l += spin_[i];
-      if( scratch_l*spin_[i]<0.0 ) {
-        dm_dt_l_[i] = -1*spin_[i];
-        dm_dt_l_[i].x /= fixed_timestep;
-        dm_dt_l_[i].y /= fixed_timestep;
-        dm_dt_l_[i].z /= fixed_timestep;
-      }
+  // Cells of the common fixed_spins list only lose the transverse
+  // torque; they still relax longitudinally, as in Oxs_Evolver.
+  const vector<OC_INDEX>* pinned_spins = GetFixedSpinList();
+  vector<OC_INDEX>::const_iterator pit, pend;
+  if(pinned_spins != NULL) {
+    pit = lower_bound(pinned_spins->begin(),pinned_spins->end(),node_start);
+    pend = pinned_spins->end();
+  }
+  YY_2LatBlockSum dE_dt_sum;
+  OC_INDEX seg_start = node_start;
+  while(seg_start<node_stop) {
+    OC_INDEX seg_stop = node_stop;
+    if(frozen_spins_ != NULL && fit != frozen_spins_->end()
+       && *fit < node_stop) {
+      seg_stop = *fit;
+    }
 
-      if(temperature[i] != 0 && use_stochastic) {
-        // Longitudinal stochastic field parallel to spin
-        dm_dt_l_[i] += (*hFluct_l)[i]*cell_m_inverse;
-        dm_dt_t_[i] += (*hFluct_l)[i]*cell_m_inverse;
+    for(i=seg_start;i<seg_stop;i++) {
+      if(Ms_[i]==0) {
+        dm_dt_t_[i].Set(0.0,0.0,0.0);
+        dm_dt_l_[i].Set(0.0,0.0,0.0);
+      } else {
+        OC_REAL8m cell_alpha_t = alpha_t[i];
+        OC_REAL8m cell_alpha_l = alpha_l[i];
+        OC_REAL8m cell_gamma = gamma[i];
+        OC_REAL8m cell_m_inverse = Ms0_[i]*Ms_inverse_[i];
+        const ThreeVector cell_H = total_field_[i]; // May alias dm_dt_l_
+
+        // deterministic part
+        if(have_mxH) {
+          cell_mxH = mxH_[i];
+        } else {
+          cell_mxH = spin_[i] ^ cell_H;
+        }
+        scratch_t = cell_mxH;
+        scratch_t *= -cell_gamma; // -|gamma|*(mxH)
+
+        if(do_precess) {
+          dm_dt_t_[i]  = scratch_t;
+          dm_dt_l_[i].Set(0.0,0.0,0.0);
+        } else {
+          dm_dt_t_[i].Set(0.0,0.0,0.0);
+          dm_dt_l_[i].Set(0.0,0.0,0.0);
+        }
+
+        // Transverse damping term
+        if(use_stochastic) {
+          // Note: The stochastic field is NOT included in the first term of 
+          // the LLB equation. See PRB 85, 014433 (2012). The second form of 
+          // LLB is the above article is implemented here.
+          dm_fluct_t = spin_[i] ^ hFluct_t[i];  // cross product mxhFluct_t
+          dm_fluct_t *= -cell_gamma;
+          scratch_t += dm_fluct_t;  // -|gamma|*mx(H+hFluct_t)
+        }
+        scratch_t ^= spin_[i];
+        // -|gamma|((mx(H+hFluct_t))xm) = |gamma|(mx(mx(H+hFluct_t)))
+        scratch_t *= -cell_alpha_t*cell_m_inverse; // -|alpha*gamma|(mx(mx(H+hFluct_t)))
+        dm_dt_t_[i] += scratch_t;
+
+        // Longitudinal terms
+        OC_REAL8m temp = spin_[i]*cell_H;
+        temp *= cell_gamma*cell_alpha_l;
+        temp *= cell_m_inverse;
+        scratch_l = temp*spin_[i];
+        dm_dt_l_[i] += scratch_l;
+
+        // Check for overshooting
+        scratch_l = dm_dt_l_[i]*stage_fixed_timestep;
+        scratch_l += spin_[i];
+        if( scratch_l*spin_[i]<0.0 ) {
+          dm_dt_l_[i] = -1*spin_[i];
+          dm_dt_l_[i].x /= stage_fixed_timestep;
+          dm_dt_l_[i].y /= stage_fixed_timestep;
+          dm_dt_l_[i].z /= stage_fixed_timestep;
+        }
+
+        if(temperature[i] != 0 && use_stochastic) {
+          // Longitudinal stochastic field parallel to spin
+          dm_dt_l_[i] += hFluct_l[i]*cell_m_inverse;
+          dm_dt_t_[i] += hFluct_l[i]*cell_m_inverse;
+        }
+
+        if(pinned_spins != NULL) {
+          while(pit != pend && *pit < i) ++pit;
+          if(pit != pend && *pit == i) {
+            // No torque on pinned cells.  mxH_ is zeroed there by the
+            // energy pass, but a locally formed m x H is not.
+            dm_dt_t_[i].Set(0.0,0.0,0.0);
+            cell_mxH.Set(0.0,0.0,0.0);
+          }
+        }
+
+        // Collect statistics.  Done here rather than in a second pass,
+        // since H is gone once dm_dt_l_ is written.
+        ThreeVector tempvec = dm_dt_t_[i];
+        tempvec += dm_dt_l_[i];
+        OC_REAL8m dm_dt_sq = tempvec.MagSq();
+        if(dm_dt_sq>0.0) {
+          dE_dt_sum += -1*MU0*fabs(cell_gamma*cell_alpha_t)
+            *cell_mxH.MagSq() * Ms_[i] * mesh_->Volume(i);
+          if(dm_dt_sq>stats_.max_dm_dt_sq) {
+            stats_.max_dm_dt_sq=dm_dt_sq;
+            stats_.max_index = i;
+          }
+        }
       }
     }
-  }
-
-  // now hFluct_t is definetely calculated for this iteration
-  *iteration_hFluct_calculated = iteration_now;
 
-  // Zero dm_dt at fixed spin sites
-  UpdateFixedSpinList(mesh_);
-  const OC_INDEX fixed_count = GetFixedSpinCount();
-  for(OC_INDEX j=0;j<fixed_count;j++) {
-    dm_dt_t_[GetFixedSpin(j)].Set(0.,0.,0.);
-  }
-
-  // Collect statistics
-  OC_REAL8m max_dm_dt_sq=0.0;
-  OC_REAL8m dE_dt_sum=0.0;
-  OC_INDEX max_index=0;
-  for(i=0;i<size;i++) {
-    ThreeVector tempvec = dm_dt_t_[i];
-    tempvec += dm_dt_l_[i];
-    OC_REAL8m dm_dt_sq = tempvec.MagSq();
-    if(dm_dt_sq>0.0) {
-      dE_dt_sum += -1*MU0*fabs((*gamma)[i]*(*alpha_t)[i])
-        *mxH_[i].MagSq() * Ms_[i] * mesh_->Volume(i);
-      if(dm_dt_sq>max_dm_dt_sq) {
-        max_dm_dt_sq=dm_dt_sq;
-        max_index = i;
-      }
+    if(seg_stop<node_stop) { // Frozen cell
+      dm_dt_t_[seg_stop].Set(0.,0.,0.);
+      dm_dt_l_[seg_stop].Set(0.,0.,0.);
+      ++fit;
     }
+    seg_start = seg_stop + 1;
   }
+  stats_.dE_dt_sum += dE_dt_sum.GetValue();
+}
+
+void YY_2LatEulerEvolve::Finish_dm_dt(
+    const Oxs_SimState& state_,
+    const Oxs_MeshValue<ThreeVector>& dm_dt_t_,
+    OC_REAL8m pE_pt_,
+    const DmDtStats& stats_,
+    OC_REAL8m& max_dm_dt_,
+    OC_REAL8m& dE_dt_,
+    OC_REAL8m& min_timestep_) const
+{
+  const Oxs_MeshValue<ThreeVector>& spin_ = state_.spin;
+  const OC_INDEX max_index = stats_.max_index;
 
-  max_dm_dt_ = sqrt(max_dm_dt_sq);
-  dE_dt_ = dE_dt_sum; // Transverse terms
+  max_dm_dt_ = sqrt(stats_.max_dm_dt_sq);
+  dE_dt_ = stats_.dE_dt_sum; // Transverse terms
   dE_dt_ += pE_pt_;
   // TODO: What about the longitudinal terms?
   /// The first term is (partial E/partial M)*dM/dt, the
@@ -568,7 +835,8 @@ void YY_2LatEulerEvolve::Calculate_dm_dt(
   /// is always non-negative, so dE_dt_ can only be made positive
   /// by positive pE_pt_.
 
-  if(!has_tempscript) { // temperature == 0 at all cells
+  if(!has_tempscript && !has_temperature_pulses) {
+    // temperature == 0 at all cells
     // Get bound on smallest stepsize that would actually
     // change spin new_max_dm_dt_index:
     OC_REAL8m min_ratio = DBL_MAX/2.;
@@ -586,11 +854,454 @@ void YY_2LatEulerEvolve::Calculate_dm_dt(
     }
   min_timestep_ = min_ratio * OC_REAL8_EPSILON;
   }
-  else {min_timestep_ = fixed_timestep;}
+  else {min_timestep_ = stage_fixed_timestep;}
+}
+
+void YY_2LatEulerEvolve::AdvanceChunk(
+    const Oxs_SimState& cstate1_,
+    const Oxs_SimState& cstate2_,
+    OC_REAL8m stepsize_,
+    Oxs_SimState& workstate_,
+    Oxs_SimState& workstate1_,
+    Oxs_SimState& workstate2_,
+    OC_INDEX node_start,OC_INDEX node_stop) const
+{
+  Oxs_MeshValue<OC_REAL8m>& wMs = *(workstate_.Ms);
+  Oxs_MeshValue<OC_REAL8m>& wMs_inverse = *(workstate_.Ms_inverse);
+  ThreeVector tempspin;
+
+  for(int lat=0;lat<2;++lat) {
+    const Oxs_SimState& cstate_ = (lat==0 ? cstate1_ : cstate2_);
+    Oxs_SimState& wstate_ = (lat==0 ? workstate1_ : workstate2_);
+    const Oxs_MeshValue<ThreeVector>& dm_dt_t = (lat==0 ? dm_dt_t1 : dm_dt_t2);
+    const Oxs_MeshValue<ThreeVector>& dm_dt_l = (lat==0 ? dm_dt_l1 : dm_dt_l2);
+    const Oxs_MeshValue<OC_REAL8m>& cMs = *(cstate_.Ms);
+    const Oxs_MeshValue<OC_REAL8m>& Ms0 = *(cstate_.Ms0);
+    Oxs_MeshValue<OC_REAL8m>& wMs_lat = *(wstate_.Ms);
+    Oxs_MeshValue<OC_REAL8m>& wMs_inverse_lat = *(wstate_.Ms_inverse);
+    const Oxs_MeshValue<OC_REAL8m>& cMs_inverse = *(cstate_.Ms_inverse);
+    const vector<OC_INDEX>* frozen = GetFrozenSpinList(cstate_);
+    vector<OC_INDEX>::const_iterator fit;
+    if(frozen != NULL) {
+      fit = lower_bound(frozen->begin(),frozen->end(),node_start);
+    }
+    OC_INDEX seg_start = node_start;
+    while(seg_start<node_stop) {
+      OC_INDEX seg_stop = node_stop;
+      if(frozen != NULL && fit != frozen->end() && *fit < node_stop) {
+        seg_stop = *fit;
+      }
+      for(OC_INDEX i=seg_start;i<seg_stop;++i) {
+        const ThreeVector& m0 = cstate_.spin[i];
+
+        // Transverse movement
+        tempspin = dm_dt_t[i];
+        tempspin *= stepsize_;
+
+        // For improved accuracy, adjust step vector so that
+        // to first order m0 + adjusted_step = v/|v| where
+        // v = m0 + step.
+        OC_REAL8m adj = 0.5 * tempspin.MagSq();
+        tempspin -= adj*m0;
+        tempspin *= 1.0/(1.0+adj);
+        tempspin += m0;
+        tempspin.MakeUnit();
+        wstate_.spin[i] = tempspin;
+
+        // Longitudinal movement
+        tempspin = dm_dt_l[i]*stepsize_;
+        tempspin += m0;
+
+        // Update Ms in the next state.
+        // Both of wMs and wMs_inverse should be updated at the same time.
+        OC_REAL8m Ms_new = sqrt(tempspin.MagSq())*cMs[i];
+        if(tempspin*m0<0.0) {  // Dot product
+          // If spin overshoots to the opposite direction, keep Ms positive
+          // and flip spin direction.
+          wstate_.spin[i] *= -1;
+        }
+        if(Ms_new > Ms0[i]) {
+          // Ms cannot be >Ms0.
+          Ms_new = Ms0[i];
+        }
+        wMs_lat[i] = Ms_new;
+        if(Ms_new != 0.0) {
+          wMs_inverse_lat[i] = 1.0/Ms_new;
+        } else {
+          wMs_inverse_lat[i] = 0.0;
+        }
+      }
+      if(seg_stop<node_stop) { // Frozen cell; carry over unchanged
+        wstate_.spin[seg_stop] = cstate_.spin[seg_stop];
+        wMs_lat[seg_stop] = cMs[seg_stop];
+        wMs_inverse_lat[seg_stop] = cMs_inverse[seg_stop];
+        ++fit;
+      }
+      seg_start = seg_stop + 1;
+    }
+  }
+
+  // Total spin
+  const Oxs_MeshValue<OC_REAL8m>& wMs1 = *(workstate1_.Ms);
+  const Oxs_MeshValue<OC_REAL8m>& wMs2 = *(workstate2_.Ms);
+  for(OC_INDEX i=node_start;i<node_stop;++i) {
+    tempspin = wMs1[i]*workstate1_.spin[i];
+    tempspin += wMs2[i]*workstate2_.spin[i];
+    wMs[i] = sqrt(tempspin.MagSq());
+    tempspin.MakeUnit();
+    workstate_.spin[i] = tempspin;
+    if(wMs[i] != 0.0) {
+      wMs_inverse[i] = 1.0/wMs[i];
+    } else {
+      wMs_inverse[i] = 0.0;
+    }
+  }
+}
+
+Oxs_MeshValue<ThreeVector>*
+YY_2LatEulerEvolve::MxHRequest
+(Oxs_VectorFieldOutput<YY_2LatEulerEvolve>& mxH_output_)
+{
+  if(mxH_output_.GetCacheRequestCount()>0) {
+    mxH_output_.cache.state_id = 0; // Filled by the caller
+    return &mxH_output_.cache.value;
+  }
+  mxH_output_.cache.state_id = 0;
+  mxH_output_.cache.value.Release();
+  return NULL;
+}
+
+void YY_2LatEulerEvolve::PlaceMeshArrays(const Oxs_Mesh* mesh_)
+{
+  vector<Oxs_MeshValue<ThreeVector>*> varr;
+  varr.push_back(&dm_dt_t1);
+  varr.push_back(&dm_dt_l1);
+  varr.push_back(&dm_dt_t2);
+  varr.push_back(&dm_dt_l2);
+  varr.push_back(&new_dm_dt_t1);
+  varr.push_back(&new_dm_dt_l1);
+  varr.push_back(&new_dm_dt_t2);
+  varr.push_back(&new_dm_dt_l2);
+  if(use_stochastic) {
+    varr.push_back(&hFluct_t1);
+    varr.push_back(&hFluct_l1);
+    varr.push_back(&hFluct_t2);
+    varr.push_back(&hFluct_l2);
+  }
+  if(use_fused_dm_dt && TotalFieldRequested()) {
+    varr.push_back(&total_field1);
+    varr.push_back(&total_field2);
+  }
+  if(mxH1_output.GetCacheRequestCount()>0) {
+    varr.push_back(&mxH1_output.cache.value);
+  }
+  if(mxH2_output.GetCacheRequestCount()>0) {
+    varr.push_back(&mxH2_output.cache.value);
+  }
+  vector<Oxs_MeshValue<OC_REAL8m>*> sarr;
+  sarr.push_back(&energy);
+  sarr.push_back(&new_energy);
+  sarr.push_back(&gamma1);
+  sarr.push_back(&gamma2);
+  sarr.push_back(&alpha_t10);
+  sarr.push_back(&alpha_t20);
+  sarr.push_back(&alpha_t1);
+  sarr.push_back(&alpha_t2);
+  sarr.push_back(&alpha_l1);
+  sarr.push_back(&alpha_l2);
+  if(use_stochastic) {
+    sarr.push_back(&hFluctVarConst_t1);
+    sarr.push_back(&hFluctVarConst_t2);
+    sarr.push_back(&hFluctVarConst_l1);
+    sarr.push_back(&hFluctVarConst_l2);
+  }
+  size_t ia;
+  for(ia=0;ia<varr.size();++ia) varr[ia]->AdjustSize(mesh_);
+  for(ia=0;ia<sarr.size();++ia) sarr[ia]->AdjustSize(mesh_);
+  if(huge_pages != YY_2LAT_HUGEPAGE_NONE) {
+    // Advise before the first touch below, so that the initial faults
+    // are already served with huge pages.  One summary line rather
+    // than one per array.
+    size_t bytes = 0, covered = 0;
+    for(ia=0;ia<varr.size();++ia) {
+      Oxs_MeshValue<ThreeVector>& arr = *(varr[ia]);
+      if(arr.Size()==0) continue;
+      const size_t asize = size_t(arr.Size())*sizeof(ThreeVector);
+      bytes += asize;
+      covered += YY_2LatAdviseHugePages(&(arr[0]),asize,huge_pages,0);
+    }
+    for(ia=0;ia<sarr.size();++ia) {
+      Oxs_MeshValue<OC_REAL8m>& arr = *(sarr[ia]);
+      if(arr.Size()==0) continue;
+      const size_t asize = size_t(arr.Size())*sizeof(OC_REAL8m);
+      bytes += asize;
+      covered += YY_2LatAdviseHugePages(&(arr[0]),asize,huge_pages,0);
+    }
+    fprintf(stderr,"YY_2Lat huge pages: %-28.28s %9.1f MB  "
+            "transparent 2 MB pages on %.1f MB\n",InstanceName(),
+            double(bytes)/(1024.*1024.),double(covered)/(1024.*1024.));
+  }
+  YY_2LatFirstTouch(varr,sarr);
+}
+
+void YY_2LatEulerEvolve::UpdateFootprintOutput(const Oxs_SimState& state)
+{ // Sum of the per-cell arrays currently held, so that the mesh size a
+  // node can hold can be read off the data table.  The auto_timestep
+  // stiffness arrays exist only during the estimate at stage start,
+  // and output caches other than mxH are not counted.
+  const Oxs_MeshValue<ThreeVector>* varr[] = {
+    &dm_dt_t1, &dm_dt_l1, &dm_dt_t2, &dm_dt_l2,
+    &new_dm_dt_t1, &new_dm_dt_l1, &new_dm_dt_t2, &new_dm_dt_l2,
+    &total_field1, &total_field2,
+    &hFluct_t1, &hFluct_l1, &hFluct_t2, &hFluct_l2,
+    &mxH1_output.cache.value, &mxH2_output.cache.value
+  };
+  const Oxs_MeshValue<OC_REAL8m>* sarr[] = {
+    &energy, &new_energy, &gamma1, &gamma2,
+    &alpha_t10, &alpha_t20, &alpha_t1, &alpha_t2, &alpha_l1, &alpha_l2,
+    &hFluctVarConst_t1, &hFluctVarConst_t2,
+    &hFluctVarConst_l1, &hFluctVarConst_l2
+  };
+  size_t footprint = 0;
+  size_t ia;
+  for(ia=0;ia<sizeof(varr)/sizeof(varr[0]);++ia) {
+    footprint += size_t(varr[ia]->Size())*sizeof(ThreeVector);
+  }
+  for(ia=0;ia<sizeof(sarr)/sizeof(sarr[0]);++ia) {
+    footprint += size_t(sarr[ia]->Size())*sizeof(OC_REAL8m);
+  }
+  footprint_output.cache.state_id=state.Id();
+  footprint_output.cache.value=double(footprint)/(1024.*1024.);
+}
+
+void YY_2LatEulerEvolve::FillDmDtOutput
+(Oxs_VectorFieldOutput<YY_2LatEulerEvolve>& output_,
+ const Oxs_MeshValue<ThreeVector>& dm_dt_,
+ const Oxs_SimState& state_)
+{
+  if(output_.GetCacheRequestCount()>0) {
+    if(output_.cache.state_id != state_.Id()) {
+      output_.cache.state_id = 0;
+      output_.cache.value = dm_dt_;
+      output_.cache.state_id = state_.Id();
+    }
+  } else {
+    output_.cache.state_id = 0;
+    output_.cache.value.Release();
+  }
+}
+
+Oxs_MeshValue<ThreeVector>*
+YY_2LatEulerEvolve::FieldRequest(Oxs_MeshValue<ThreeVector>& total_field_,
+                                 Oxs_MeshValue<ThreeVector>& dm_dt_l_,
+                                 OC_BOOL fused)
+{ // The fused pipeline writes dm_dt_l_ block by block inside the
+  // energy pass, before the total field output copies H out of the
+  // field array, so only then does H need an array of its own.
+  if(fused && TotalFieldRequested()) return &total_field_;
+  total_field_.Release();
+  return &dm_dt_l_;
+}
 
-  return;
+// Thread object for the per-cell sweeps that are not part of the
+// chunk energy pass.  Each thread works on its own Oxs_StripedArray
+// strip, the same decomposition used by YY_2LatFirstTouch, so with a
+// fixed thread to core binding every strip is always streamed by the
+// thread (and NUMA node) that first touched it.
+class _YY_2LatEulerThread : public Oxs_ThreadRunObj {
+public:
+  enum { INVALID, DM_DT, ADVANCE } task;
+  const YY_2LatEulerEvolve* evolver;
+
+  // DM_DT imports/exports
+  const Oxs_SimState* state;
+  YY_2LatEulerEvolve::LatticeParams params;
+  const Oxs_MeshValue<ThreeVector>* mxH;
+  const Oxs_MeshValue<ThreeVector>* total_field;
+  Oxs_MeshValue<ThreeVector>* dm_dt_t;
+  Oxs_MeshValue<ThreeVector>* dm_dt_l;
+  const vector<OC_INDEX>* frozen_spins;
+  vector<YY_2LatEulerEvolve::DmDtStats>* stats; // One per thread
+
+  // ADVANCE imports/exports
+  const Oxs_SimState* cstate1;
+  const Oxs_SimState* cstate2;
+  Oxs_SimState* workstate;
+  Oxs_SimState* workstate1;
+  Oxs_SimState* workstate2;
+  OC_REAL8m stepsize;
+
+  _YY_2LatEulerThread()
+    : task(INVALID), evolver(0), state(0), mxH(0), total_field(0),
+      dm_dt_t(0), dm_dt_l(0), frozen_spins(0), stats(0),
+      cstate1(0), cstate2(0), workstate(0), workstate1(0), workstate2(0),
+      stepsize(0.) {}
+
+  void Cmd(int threadnumber, void* /* data */) {
+    OC_INDEX istart,istop;
+    if(task == DM_DT) {
+      state->spin.GetArrayBlock()->GetStripPosition(threadnumber,
+                                                    istart,istop);
+      evolver->Calculate_dm_dt_Chunk(*state,params,*mxH,*total_field,
+                                     *dm_dt_t,*dm_dt_l,frozen_spins,
+                                     istart,istop,(*stats)[threadnumber]);
+    } else if(task == ADVANCE) {
+      cstate1->spin.GetArrayBlock()->GetStripPosition(threadnumber,
+                                                      istart,istop);
+      evolver->AdvanceChunk(*cstate1,*cstate2,stepsize,
+                            *workstate,*workstate1,*workstate2,
+                            istart,istop);
+    }
+  }
+};
+
+void YY_2LatEulerEvolve::Calculate_dm_dt(
+    const Oxs_SimState& state_,
+    const Oxs_MeshValue<ThreeVector>& mxH_,
+    const Oxs_MeshValue<ThreeVector>& total_field_,
+    OC_REAL8m pE_pt_,
+    Oxs_MeshValue<ThreeVector>& dm_dt_t_,
+    Oxs_MeshValue<ThreeVector>& dm_dt_l_,
+    OC_REAL8m& max_dm_dt_,
+    OC_REAL8m& dE_dt_,
+    OC_REAL8m& min_timestep_)
+{
+  // Imports: state_, mxH_, pE_pt
+  // Exports: dm_dt_t_, dm_dt_l_, max_dm_dt_, dE_dt_
+  const int thread_count = Oc_GetMaxThreadCount();
+  vector<DmDtStats> stats(thread_count);
+
+  static Oxs_ThreadTree threadtree;
+  vector<_YY_2LatEulerThread> dm_dt_thread(thread_count);
+  dm_dt_thread[0].task = _YY_2LatEulerThread::DM_DT;
+  dm_dt_thread[0].evolver = this;
+  dm_dt_thread[0].state = &state_;
+  dm_dt_thread[0].mxH = &mxH_;
+  dm_dt_thread[0].total_field = &total_field_;
+  dm_dt_thread[0].dm_dt_t = &dm_dt_t_;
+  dm_dt_thread[0].dm_dt_l = &dm_dt_l_;
+  dm_dt_thread[0].stats = &stats;
+  Prepare_dm_dt(state_,dm_dt_t_,dm_dt_l_,dm_dt_thread[0].params);
+  dm_dt_thread[0].frozen_spins = GetFrozenSpinList(state_);
+  for(int ithread=1;ithread<thread_count;++ithread) {
+    dm_dt_thread[ithread] = dm_dt_thread[0];
+    threadtree.Launch(dm_dt_thread[ithread],0);
+  }
+  threadtree.LaunchRoot(dm_dt_thread[0],0);
+
+  for(int ithread=1;ithread<thread_count;++ithread) {
+    stats[0].Merge(stats[ithread]);
+  }
+  Finish_dm_dt(state_,dm_dt_t_,pE_pt_,stats[0],
+               max_dm_dt_,dE_dt_,min_timestep_);
 } // end Calculate_dm_dt
 
+// Post-processor handed to GetEnergyDensity when the fused pipeline
+// is enabled.  For each cache block of the chunk energy pass, it
+// turns the freshly accumulated mxH and H of both sublattices into
+// dm_dt_t and dm_dt_l, and collects per-thread statistics.
+class _YY_2LatEulerFusedDmDt : public YY_2LatChunkPostProcess {
+public:
+  const YY_2LatEulerEvolve* evolver;
+  YY_2LatEulerEvolve::LatticeParams params1, params2;
+  const Oxs_MeshValue<ThreeVector>* mxH1;
+  const Oxs_MeshValue<ThreeVector>* mxH2;
+  const Oxs_MeshValue<ThreeVector>* H1;
+  const Oxs_MeshValue<ThreeVector>* H2;
+  Oxs_MeshValue<ThreeVector>* dm_dt_t1;
+  Oxs_MeshValue<ThreeVector>* dm_dt_l1;
+  Oxs_MeshValue<ThreeVector>* dm_dt_t2;
+  Oxs_MeshValue<ThreeVector>* dm_dt_l2;
+  const vector<OC_INDEX>* frozen_spins1;
+  const vector<OC_INDEX>* frozen_spins2;
+  vector<YY_2LatEulerEvolve::DmDtStats> stats1, stats2; // Per thread
+
+  _YY_2LatEulerFusedDmDt(int thread_count)
+    : evolver(0), mxH1(0), mxH2(0), H1(0), H2(0),
+      dm_dt_t1(0), dm_dt_l1(0), dm_dt_t2(0), dm_dt_l2(0),
+      frozen_spins1(0), frozen_spins2(0),
+      stats1(thread_count), stats2(thread_count) {}
+
+  void ProcessChunk(const Oxs_SimState& state,
+                    OC_INDEX node_start,OC_INDEX node_stop,
+                    int threadnumber) {
+    evolver->Calculate_dm_dt_Chunk(*(state.lattice1),params1,*mxH1,*H1,
+                                   *dm_dt_t1,*dm_dt_l1,frozen_spins1,
+                                   node_start,node_stop,
+                                   stats1[threadnumber]);
+    evolver->Calculate_dm_dt_Chunk(*(state.lattice2),params2,*mxH2,*H2,
+                                   *dm_dt_t2,*dm_dt_l2,frozen_spins2,
+                                   node_start,node_stop,
+                                   stats2[threadnumber]);
+  }
+};
+
+OC_REAL8m YY_2LatEulerEvolve::EstimateTimestep(
+    const Oxs_SimState& cstate_,
+    const Oxs_SimState& cstate1_,
+    const Oxs_SimState& cstate2_)
+{
+  const Oxs_Mesh* mesh = cstate_.mesh;
+  const OC_INDEX size = mesh->Size();
+
+  vector<const YY_2LatStiffnessEnergy*> terms;
+  const vector<Oxs_Energy*>& energies = director->GetEnergyObjects();
+  for(vector<Oxs_Energy*>::const_iterator it = energies.begin();
+      it != energies.end(); ++it) {
+    const YY_2LatStiffnessEnergy* term
+      = dynamic_cast<const YY_2LatStiffnessEnergy*>(*it);
+    if(term) terms.push_back(term);
+  }
+  if(terms.empty()) {
+    static Oxs_WarningMessage nostiffness(3);
+    nostiffness.Send(revision_info,OC_STRINGIFY(__LINE__),
+                     "auto_timestep: no energy term reports its"
+                     " stiffness; keeping the configured timestep.");
+    return 0.0;
+  }
+
+  stiffness_t.AdjustSize(mesh);
+  stiffness_l.AdjustSize(mesh);
+  OC_REAL8m max_rate_t = 0.0, max_rate_l = 0.0;
+  for(int lat=0;lat<2;++lat) {
+    const Oxs_SimState& cst = (lat==0 ? cstate1_ : cstate2_);
+    stiffness_t = 0.0;
+    stiffness_l = 0.0;
+    for(size_t it=0;it<terms.size();++it) {
+      terms[it]->AccumStiffness(cst,stiffness_t,stiffness_l);
+    }
+
+    const Oxs_MeshValue<OC_REAL8m>& Ms = *(cst.Ms);
+    const Oxs_MeshValue<OC_REAL8m>& Ms0 = *(cst.Ms0);
+    const Oxs_MeshValue<OC_REAL8m>& alpha_t = (lat==0 ? alpha_t1 : alpha_t2);
+    const Oxs_MeshValue<OC_REAL8m>& alpha_l = (lat==0 ? alpha_l1 : alpha_l2);
+    const Oxs_MeshValue<OC_REAL8m>& gamma = (lat==0 ? gamma1 : gamma2);
+    const vector<OC_INDEX>* frozen = GetFrozenSpinList(cst);
+    vector<OC_INDEX>::const_iterator fit;
+    if(frozen != NULL) fit = frozen->begin();
+    for(OC_INDEX i=0;i<size;++i) {
+      if(frozen != NULL && fit != frozen->end() && *fit == i) {
+        ++fit;
+        continue;
+      }
+      if(Ms[i]==0.0) continue;
+      const OC_REAL8m damp = fabs(alpha_t[i])*Ms0[i]/Ms[i];
+      OC_REAL8m rate = fabs(gamma[i])*stiffness_t[i];
+      rate *= (do_precess ? sqrt(1+damp*damp) : damp);
+      if(rate>max_rate_t) max_rate_t = rate;
+      rate = fabs(gamma[i]*alpha_l[i])*stiffness_l[i];
+      if(rate>max_rate_l) max_rate_l = rate;
+    }
+  }
+
+  // Estimates run once per stage; don't hold the arrays in between.
+  stiffness_t.Release();
+  stiffness_l.Release();
+
+  const OC_REAL8m max_rate = OC_MAX(max_rate_t,max_rate_l);
+  return (max_rate>0.0 ? auto_timestep_margin/max_rate : 0.0);
+}
+
 OC_BOOL
 YY_2LatEulerEvolve::Step(const YY_2LatTimeDriver* driver,
           Oxs_ConstKey<Oxs_SimState> current_state,
@@ -640,13 +1351,77 @@ YY_2LatEulerEvolve::Step(const YY_2LatTimeDriver* driver,
   // If cstate.Id() == energy_state_id, then cstate has been run
   // through either this method or UpdateDerivedOutputs.  Either
   // way, all derived state data should be stored in cstate,
-  // except currently the "energy" mesh value array, which is
-  // stored independently inside *this.  Eventually that should
+  // except currently the "energy" and dm_dt_* mesh value arrays,
+  // which are stored independently inside *this.  Eventually that should
   // probably be moved in some fashion into cstate too.
   if(energy_state_id != cstate.Id()) {
     // cached data out-of-date
     UpdateDerivedOutputs(cstate);
   }
+
+  OC_BOOL stage_temperature_set = 0; // Stage temperature already applied
+  OC_BOOL auto_refreshed = 0; // cstate dm_dt redone by auto_timestep
+  OC_REAL8m auto_max_dm_dt = 0., auto_dE_dt = 0., auto_pE_pt = 0.;
+  OC_REAL8m auto_timestep_lower_bound = 0.;
+  if(auto_timestep && auto_timestep_stage != cstate.stage_number+1) {
+    // New stage: bring temperature dependent parameters to the stage
+    // temperature, derive the step from the local rates, and redo the
+    // dm_dt of cstate with those parameters and a stochastic field
+    // drawn for the new step.
+    auto_timestep_stage = cstate.stage_number+1;
+    UpdateStageTemperature(cstate);
+    UpdateMeshArrays(cstate);
+    stage_temperature_set = 1;
+    stage_min_timestep = min_timestep;
+    stage_max_timestep = max_timestep;
+    stage_fixed_timestep = fixed_timestep;
+    OC_REAL8m auto_step = EstimateTimestep(cstate,cstate1,cstate2);
+    if(auto_step>auto_timestep_cap) auto_step = auto_timestep_cap;
+    if(auto_step>0.0) {
+      if(has_tempscript || has_temperature_pulses) {
+        stage_fixed_timestep = stage_min_timestep
+          = stage_max_timestep = auto_step;
+      } else if(auto_step>min_timestep) {
+        stage_max_timestep = auto_step; // T = 0; cap the adaptive step
+      } else {
+        stage_max_timestep = min_timestep;
+      }
+    }
+    OC_REAL8m max_dm_dt2, dE_dt2, timestep_lower_bound2;
+    Oxs_MeshValue<ThreeVector>* mxH1_fill = MxHRequest(mxH1_output);
+    Oxs_MeshValue<ThreeVector>* mxH2_fill = MxHRequest(mxH2_output);
+    Oxs_MeshValue<ThreeVector>* H1_fill
+      = FieldRequest(total_field1,dm_dt_l1,0);
+    Oxs_MeshValue<ThreeVector>* H2_fill
+      = FieldRequest(total_field2,dm_dt_l2,0);
+    dm_dt_t1_output.cache.state_id = dm_dt_l1_output.cache.state_id = 0;
+    dm_dt_t2_output.cache.state_id = dm_dt_l2_output.cache.state_id = 0;
+    GetEnergyDensity(cstate,energy,mxH1_fill,mxH2_fill,
+                     H1_fill,H2_fill,auto_pE_pt);
+    if(mxH1_fill) mxH1_output.cache.state_id=cstate.Id();
+    if(mxH2_fill) mxH2_output.cache.state_id=cstate.Id();
+    iteration_hFluct1_calculated = iteration_hFluct2_calculated = 0;
+    Calculate_dm_dt(cstate1,mxH1_output.cache.value,*H1_fill,
+                    auto_pE_pt,dm_dt_t1,dm_dt_l1,
+                    auto_max_dm_dt,auto_dE_dt,auto_timestep_lower_bound);
+    Calculate_dm_dt(cstate2,mxH2_output.cache.value,*H2_fill,
+                    auto_pE_pt,dm_dt_t2,dm_dt_l2,
+                    max_dm_dt2,dE_dt2,timestep_lower_bound2);
+    auto_refreshed = 1;
+
+    // The derived data of cstate are write-once and still describe the
+    // old dm_dt, so the refreshed values are used below in their place
+    // (sublattice 1 values, as Step stores for each new state).  Bring
+    // the outputs of cstate up to date as well.
+    max_dm_dt_output.cache.value = auto_max_dm_dt*(180e-9/PI);
+    dE_dt_output.cache.value = auto_dE_dt;
+    max_dm_dt_output.cache.state_id
+      = dE_dt_output.cache.state_id = cstate.Id();
+    FillDmDtOutput(dm_dt_t1_output,dm_dt_t1,cstate);
+    FillDmDtOutput(dm_dt_l1_output,dm_dt_l1,cstate);
+    FillDmDtOutput(dm_dt_t2_output,dm_dt_t2,cstate);
+    FillDmDtOutput(dm_dt_l2_output,dm_dt_l2,cstate);
+  }
   OC_BOOL cache_good = 1;
   OC_REAL8m max_dm_dt;
   OC_REAL8m dE_dt, delta_E, pE_pt;
@@ -665,20 +1440,17 @@ YY_2LatEulerEvolve::Step(const YY_2LatTimeDriver* driver,
   cache_good &= cstate.GetDerivedData("Timestep lower bound",
               timestep_lower_bound);
   cache_good &= (energy_state_id == cstate.Id());
-  cache_good &= (dm_dt_t1_output.cache.state_id == cstate.Id());
-  cache_good &= (dm_dt_l1_output.cache.state_id == cstate.Id());
-  cache_good &= (dm_dt_t2_output.cache.state_id == cstate.Id());
-  cache_good &= (dm_dt_l2_output.cache.state_id == cstate.Id());
 
   if(!cache_good) {
     throw Oxs_Ext::Error(this,
        "YY_2LatEulerEvolve::Step: Invalid data cache.");
   }
-
-  const Oxs_MeshValue<ThreeVector>& dm_dt_t1 = dm_dt_t1_output.cache.value;
-  const Oxs_MeshValue<ThreeVector>& dm_dt_l1 = dm_dt_l1_output.cache.value;
-  const Oxs_MeshValue<ThreeVector>& dm_dt_t2 = dm_dt_t2_output.cache.value;
-  const Oxs_MeshValue<ThreeVector>& dm_dt_l2 = dm_dt_l2_output.cache.value;
+  if(auto_refreshed) {
+    max_dm_dt = auto_max_dm_dt;
+    dE_dt = auto_dE_dt;
+    pE_pt = auto_pE_pt;
+    timestep_lower_bound = auto_timestep_lower_bound;
+  }
 
   // Negotiate with driver over size of next step
   OC_REAL8m stepsize = next_timestep;
@@ -692,13 +1464,13 @@ YY_2LatEulerEvolve::Step(const YY_2LatTimeDriver* driver,
   }
    OC_BOOL forcestep=0;
   // Insure step is not outside requested step bounds
-  if(stepsize<min_timestep) {
+  if(stepsize<stage_min_timestep) {
     // the step has to be forced here,to make sure we don't produce
     // an infinite loop
-    stepsize = min_timestep;
+    stepsize = stage_min_timestep;
     forcestep = 1;
     }
-  if(stepsize>max_timestep) stepsize = max_timestep;
+  if(stepsize>stage_max_timestep) stepsize = stage_max_timestep;
 
   workstate.last_timestep=stepsize;
   workstate1.last_timestep=stepsize;
@@ -722,9 +1494,12 @@ YY_2LatEulerEvolve::Step(const YY_2LatTimeDriver* driver,
                                 + cstate.stage_elapsed_time;
     workstate2.stage_elapsed_time = workstate2.last_timestep;
 
-    // Update stage-dependent temperature and temperature-dependent parameters
-    UpdateStageTemperature(workstate);
-    UpdateMeshArrays(workstate);
+    // Update stage-dependent temperature and temperature-dependent
+    // parameters, unless auto_timestep already did so for this stage.
+    if(!stage_temperature_set) {
+      UpdateStageTemperature(workstate);
+      UpdateMeshArrays(workstate);
+    }
   } else {
     workstate.stage_start_time = cstate.stage_start_time;
     workstate.stage_elapsed_time = cstate.stage_elapsed_time
@@ -735,6 +1510,9 @@ YY_2LatEulerEvolve::Step(const YY_2LatTimeDriver* driver,
     workstate2.stage_start_time = cstate.stage_start_time;
     workstate2.stage_elapsed_time = cstate.stage_elapsed_time
                                   + workstate2.last_timestep;
+
+    // Time-dependent temperature pulses
+    UpdatePulseTemperature(workstate);
   }
   workstate.iteration_count = cstate.iteration_count + 1;
   workstate.stage_iteration_count = cstate.stage_iteration_count + 1;
@@ -759,140 +1537,109 @@ YY_2LatEulerEvolve::Step(const YY_2LatTimeDriver* driver,
   workstate1.spin.AdjustSize(workstate.mesh);
   workstate2.spin.AdjustSize(workstate.mesh);
   size = workstate.spin.Size();
-  Oxs_MeshValue<OC_REAL8m>& wMs = *(workstate.Ms);
-  Oxs_MeshValue<OC_REAL8m>& wMs_inverse = *(workstate.Ms_inverse);
-  Oxs_MeshValue<OC_REAL8m>& wMs1 = *(workstate1.Ms);
-  Oxs_MeshValue<OC_REAL8m>& wMs_inverse1 = *(workstate1.Ms_inverse);
-  Oxs_MeshValue<OC_REAL8m>& wMs2 = *(workstate2.Ms);
-  Oxs_MeshValue<OC_REAL8m>& wMs_inverse2 = *(workstate2.Ms_inverse);
-  ThreeVector tempspin;
-
-  // Sublattice 1
-  for(i=0;i<size;++i) {
-    // Transverse movement
-    tempspin = dm_dt_t1[i];
-    tempspin *= stepsize;
-
-    // For improved accuracy, adjust step vector so that
-    // to first order m0 + adjusted_step = v/|v| where
-    // v = m0 + step.
-    OC_REAL8m adj = 0.5 * tempspin.MagSq();
-    tempspin -= adj*cstate1.spin[i];
-    tempspin *= 1.0/(1.0+adj);
-    tempspin += cstate1.spin[i];
-    tempspin.MakeUnit();
-    workstate1.spin[i] = tempspin;
-
-    // Longitudinal movement
-    tempspin = dm_dt_l1[i]*stepsize;
-    tempspin += cstate1.spin[i];
-
-    // Update Ms in the next state.
-    // Both of wMs and wMs_inverse should be updated at the same time.
-    OC_REAL8m Ms_temp = wMs1[i];
-    wMs1[i] = sqrt(tempspin.MagSq())*Ms_temp;
-    if(tempspin*cstate1.spin[i]<0.0) {  // Dot product
-      // If spin overshoots to the opposite direction, keep Ms positive
-      // and flip spin direction.
-      workstate1.spin[i] *= -1;
-    }
-    if(wMs1[i] > (*cstate1.Ms0)[i]) {
-      // Ms cannot be >Ms0.
-      wMs1[i] = (*cstate1.Ms0)[i];
-    }
-    if(wMs1[i] != 0.0) {
-      wMs_inverse1[i] = 1.0/wMs1[i];
-    } else {
-      wMs_inverse1[i] = 0.0;
+  {
+    const int thread_count = Oc_GetMaxThreadCount();
+    static Oxs_ThreadTree threadtree;
+    vector<_YY_2LatEulerThread> advance_thread(thread_count);
+    advance_thread[0].task = _YY_2LatEulerThread::ADVANCE;
+    advance_thread[0].evolver = this;
+    advance_thread[0].cstate1 = &cstate1;
+    advance_thread[0].cstate2 = &cstate2;
+    advance_thread[0].workstate = &workstate;
+    advance_thread[0].workstate1 = &workstate1;
+    advance_thread[0].workstate2 = &workstate2;
+    advance_thread[0].stepsize = stepsize;
+    for(int ithread=1;ithread<thread_count;++ithread) {
+      advance_thread[ithread] = advance_thread[0];
+      threadtree.Launch(advance_thread[ithread],0);
     }
+    threadtree.LaunchRoot(advance_thread[0],0);
   }
   const Oxs_SimState& nstate1
     = next_state1.GetReadReference();  // Release write lock
-
-  // Sublattice 2
-  for(i=0;i<size;++i) {
-    // Transverse movement
-    tempspin = dm_dt_t2[i];
-    tempspin *= stepsize;
-
-    // For improved accuracy, adjust step vector so that
-    // to first order m0 + adjusted_step = v/|v| where
-    // v = m0 + step.
-    OC_REAL8m adj = 0.5 * tempspin.MagSq();
-    tempspin -= adj*cstate2.spin[i];
-    tempspin *= 1.0/(1.0+adj);
-    tempspin += cstate2.spin[i];
-    tempspin.MakeUnit();
-    workstate2.spin[i] = tempspin;
-
-    // Longitudinal movement
-    tempspin = dm_dt_l2[i]*stepsize;
-    tempspin += cstate2.spin[i];
-
-    // Update Ms in the next state.
-    // Both of wMs2 and wMs_inverse2 should be updated at the same time.
-    OC_REAL8m Ms_temp = wMs2[i];
-    wMs2[i] = sqrt(tempspin.MagSq())*Ms_temp;
-    if(tempspin*cstate2.spin[i]<0.0) {  // Dot product
-      // If spin overshoots to the opposite direction, keep Ms positive
-      // and flip spin direction.
-      workstate2.spin[i] *= -1;
-    }
-    if(wMs2[i] > (*cstate2.Ms0)[i]) {
-      // Ms cannot be >Ms0.
-      wMs2[i] = (*cstate2.Ms0)[i];
-    }
-    if(wMs2[i] != 0.0) {
-      wMs_inverse2[i] = 1.0/wMs2[i];
-    } else {
-      wMs_inverse2[i] = 0.0;
-    }
-  }
   const Oxs_SimState& nstate2
     = next_state2.GetReadReference();  // Release write lock
-
-  // Total spin
-  for(i=0; i<size; i++) {
-    tempspin = wMs1[i]*workstate1.spin[i];
-    tempspin += wMs2[i]*workstate2.spin[i];
-    wMs[i] = sqrt(tempspin.MagSq());
-    tempspin.MakeUnit();
-    workstate.spin[i] = tempspin;
-    if(wMs[i] != 0.0) {
-      wMs_inverse[i] = 1.0/wMs[i];
-    } else {
-      wMs_inverse[i] = 0.0;
-    }
-  }
   const Oxs_SimState& nstate
     = next_state.GetReadReference();  // Release write lock
 
   //  Calculate delta E
   OC_REAL8m new_pE_pt1, new_pE_pt2;
-  GetEnergyDensity(
-      nstate,
-      new_energy,
-      &mxH1_output.cache.value,
-      &mxH2_output.cache.value,
-      &total_field1,
-      &total_field2,
-      new_pE_pt1);
-  mxH1_output.cache.state_id=nstate.Id();
-  mxH2_output.cache.state_id=nstate.Id();
+  OC_REAL8m new_max_dm_dt, new_max_dm_dt2;
+  OC_REAL8m new_dE_dt1, new_timestep_lower_bound;
+  OC_REAL8m new_dE_dt2, new_timestep_lower_bound2;
+  Oxs_MeshValue<ThreeVector>* mxH1_fill = MxHRequest(mxH1_output);
+  Oxs_MeshValue<ThreeVector>* mxH2_fill = MxHRequest(mxH2_output);
+  Oxs_MeshValue<ThreeVector>* H1_fill
+    = FieldRequest(total_field1,new_dm_dt_l1,use_fused_dm_dt);
+  Oxs_MeshValue<ThreeVector>* H2_fill
+    = FieldRequest(total_field2,new_dm_dt_l2,use_fused_dm_dt);
+  if(use_fused_dm_dt) {
+    // Fused pipeline: dm_dt for both sublattices is formed inside the
+    // chunk energy pass, block by block.  Only the stochastic field
+    // and the non-chunk (demag) terms are computed up front.
+    _YY_2LatEulerFusedDmDt fused(Oc_GetMaxThreadCount());
+    fused.evolver = this;
+    Prepare_dm_dt(nstate1,new_dm_dt_t1,new_dm_dt_l1,fused.params1);
+    Prepare_dm_dt(nstate2,new_dm_dt_t2,new_dm_dt_l2,fused.params2);
+    fused.mxH1 = &mxH1_output.cache.value; // Empty if not requested
+    fused.mxH2 = &mxH2_output.cache.value;
+    fused.H1 = H1_fill;
+    fused.H2 = H2_fill;
+    fused.dm_dt_t1 = &new_dm_dt_t1;
+    fused.dm_dt_l1 = &new_dm_dt_l1;
+    fused.dm_dt_t2 = &new_dm_dt_t2;
+    fused.dm_dt_l2 = &new_dm_dt_l2;
+    fused.frozen_spins1 = GetFrozenSpinList(nstate1);
+    fused.frozen_spins2 = GetFrozenSpinList(nstate2);
+    OC_REAL8m new_total_E;
+    GetEnergyDensity(
+        nstate,
+        new_energy,
+        mxH1_fill,
+        mxH2_fill,
+        H1_fill,
+        H2_fill,
+        new_pE_pt1,
+        new_total_E,
+        &fused);
+    new_pE_pt2 = new_pE_pt1;
+    DmDtStats stats1, stats2;
+    for(size_t it=0;it<fused.stats1.size();++it) {
+      stats1.Merge(fused.stats1[it]);
+      stats2.Merge(fused.stats2[it]);
+    }
+    Finish_dm_dt(nstate1,new_dm_dt_t1,new_pE_pt1,stats1,
+                 new_max_dm_dt,new_dE_dt1,new_timestep_lower_bound);
+    Finish_dm_dt(nstate2,new_dm_dt_t2,new_pE_pt2,stats2,
+                 new_max_dm_dt2,new_dE_dt2,new_timestep_lower_bound2);
+  } else {
+    GetEnergyDensity(
+        nstate,
+        new_energy,
+        mxH1_fill,
+        mxH2_fill,
+        H1_fill,
+        H2_fill,
+        new_pE_pt1);
+  }
+  if(mxH1_fill) mxH1_output.cache.state_id=nstate.Id();
+  if(mxH2_fill) mxH2_output.cache.state_id=nstate.Id();
   const Oxs_MeshValue<ThreeVector>& mxH1 = mxH1_output.cache.value;
   const Oxs_MeshValue<ThreeVector>& mxH2 = mxH2_output.cache.value;
 
-  OC_REAL8m dE=0.0;
+  YY_2LatBlockSum dE_sum;
+  YY_2LatBlockSum total_E_sum;
   OC_REAL8m var_dE=0.0;
-  OC_REAL8m total_E=0.0;
   for(i=0;i<size;++i) {
     OC_REAL8m vol = nstate1.mesh->Volume(i);
     OC_REAL8m e = energy[i];
-    total_E += e * vol;
+    total_E_sum += e * vol;
     OC_REAL8m new_e = new_energy[i];
-    dE += (new_e - e) * vol;
-    var_dE += (new_e*new_e + e*e)*vol*vol;
+    dE_sum += (new_e - e) * vol;
+    var_dE += (new_e*new_e + e*e)*vol*vol; // Only an error scale
   }
+  const OC_REAL8m dE = dE_sum.GetValue();
+  const OC_REAL8m total_E = total_E_sum.GetValue();
   var_dE *= 256*OC_REAL8_EPSILON*OC_REAL8_EPSILON/3.; // Variance, assuming
   /// error in each energy[i] term is independent, uniformly
   /// distributed, 0-mean, with range +/- 16*OC_REAL8_EPSILON*energy[i].
@@ -902,33 +1649,32 @@ YY_2LatEulerEvolve::Step(const YY_2LatTimeDriver* driver,
   // Get error estimate.  See step size adjustment discussion in
   // MJD Notes II, p72 (18-Jan-2001).
 
-  OC_REAL8m new_max_dm_dt, new_max_dm_dt2;
-  OC_REAL8m new_dE_dt1, new_timestep_lower_bound;
-  OC_REAL8m new_dE_dt2, new_timestep_lower_bound2;
-
-  // For sublattice 1
-  Calculate_dm_dt(
-      nstate1, 
-      mxH1, 
-      total_field1, 
-      new_pE_pt1, 
-      new_dm_dt_t1,
-      new_dm_dt_l1,
-      new_max_dm_dt, 
-      new_dE_dt1, 
-      new_timestep_lower_bound);
-
-  // For sublattice 2
-  Calculate_dm_dt(
-      nstate2,
-      mxH2,
-      total_field2,
-      new_pE_pt2,
-      new_dm_dt_t2,
-      new_dm_dt_l2,
-      new_max_dm_dt2,
-      new_dE_dt2,
-      new_timestep_lower_bound2);
+  if(!use_fused_dm_dt) {
+    // For sublattice 1
+    Calculate_dm_dt(
+        nstate1, 
+        mxH1, 
+        *H1_fill, 
+        new_pE_pt1, 
+        new_dm_dt_t1,
+        new_dm_dt_l1,
+        new_max_dm_dt, 
+        new_dE_dt1, 
+        new_timestep_lower_bound);
+
+    // For sublattice 2
+    new_pE_pt2 = new_pE_pt1;
+    Calculate_dm_dt(
+        nstate2,
+        mxH2,
+        *H2_fill,
+        new_pE_pt2,
+        new_dm_dt_t2,
+        new_dm_dt_l2,
+        new_max_dm_dt2,
+        new_dE_dt2,
+        new_timestep_lower_bound2);
+  }
 
   // TODO: check sublattice 2 as well
   OC_REAL8m max_error=0;
@@ -1031,14 +1777,12 @@ YY_2LatEulerEvolve::Step(const YY_2LatTimeDriver* driver,
        " Programming error; data cache already set.");
   }
 
-  dm_dt_t1_output.cache.value.Swap(new_dm_dt_t1);
-  dm_dt_l1_output.cache.value.Swap(new_dm_dt_l1);
-  dm_dt_t1_output.cache.state_id = nstate.Id();
-  dm_dt_l1_output.cache.state_id = nstate.Id();
-  dm_dt_t2_output.cache.value.Swap(new_dm_dt_t2);
-  dm_dt_l2_output.cache.value.Swap(new_dm_dt_l2);
-  dm_dt_t2_output.cache.state_id = nstate.Id();
-  dm_dt_l2_output.cache.state_id = nstate.Id();
+  // The dm_dt output caches are copied from these on request; see
+  // UpdateDerivedOutputs.
+  dm_dt_t1.Swap(new_dm_dt_t1);
+  dm_dt_l1.Swap(new_dm_dt_l1);
+  dm_dt_t2.Swap(new_dm_dt_t2);
+  dm_dt_l2.Swap(new_dm_dt_l2);
 
   energy.Swap(new_energy);
   energy_state_id = nstate.Id();
@@ -1048,7 +1792,8 @@ YY_2LatEulerEvolve::Step(const YY_2LatTimeDriver* driver,
 
 // Call with the total_lattice state and it updates values for both
 // sublattices.
-void YY_2LatEulerEvolve::UpdateMeshArrays(const Oxs_SimState& state)
+void YY_2LatEulerEvolve::UpdateMeshArrays(const Oxs_SimState& state,
+                                          const vector<OC_INDEX>* cells)
 {
   mesh_id = 0; // Mark update in progress
   const Oxs_Mesh* mesh = state.mesh;
@@ -1058,11 +1803,12 @@ void YY_2LatEulerEvolve::UpdateMeshArrays(const Oxs_SimState& state)
   const Oxs_MeshValue<OC_REAL8m>& Ms20_inverse = *(state.lattice2->Ms0_inverse);
   const Oxs_MeshValue<OC_REAL8m>& Tc1 = *(state.lattice1->Tc);
   const Oxs_MeshValue<OC_REAL8m>& Tc2 = *(state.lattice2->Tc);
-  const OC_INDEX size = mesh->Size();
-  OC_INDEX i;
+  const OC_INDEX count
+    = (cells ? static_cast<OC_INDEX>(cells->size()) : mesh->Size());
   // Note: Tc1 and Tc2 are functions of T, m_e1, and m_e2.
 
-  for(i=0;i<size;i++) {
+  for(OC_INDEX k=0;k<count;k++) {
+    const OC_INDEX i = (cells ? (*cells)[k] : k);
     if(temperature[i] > Tc1[i]) {
       alpha_t1[i] = 2./3.*alpha_t10[i];
       alpha_l1[i] = alpha_t1[i];
@@ -1081,6 +1827,7 @@ void YY_2LatEulerEvolve::UpdateMeshArrays(const Oxs_SimState& state)
     // Update variance of stochastic field
     // h_fluctVarConst_t = 2*(alpha_t-alpha_l)*kB*T/(MU0*gamma*alpha_t^2*Ms0*Vol)
     // h_fluctVarConst_l = 2*(alpha_l-gamma)*kB*T/(MU0*Ms0*Vol)
+    if(!use_stochastic) continue; // Arrays not held
     OC_REAL8m cell_alpha_t1 = fabs(alpha_t1[i]);
     OC_REAL8m cell_alpha_t2 = fabs(alpha_t2[i]);
     OC_REAL8m cell_alpha_l1 = fabs(alpha_l1[i]);
@@ -1122,8 +1869,13 @@ void YY_2LatEulerEvolve::UpdateDerivedOutputs(const Oxs_SimState& state)
   // energy calculation.
   if(state.lattice1->T==NULL) {
     UpdateStageTemperature(state);
-    state.lattice1->T = &temperature;
-    state.lattice2->T = &temperature;
+    SetTemperaturePointers(state);
+  }
+
+  if(!energy.CheckMesh(state.mesh)) {
+    // First go or mesh change; place work arrays before the first
+    // (partly serial) energy pass writes to them.
+    PlaceMeshArrays(state.mesh);
   }
 
   OC_REAL8m dummy_value;
@@ -1132,36 +1884,37 @@ void YY_2LatEulerEvolve::UpdateDerivedOutputs(const Oxs_SimState& state)
      !state.GetDerivedData("Delta E",delta_E_output.cache.value) ||
      !state.GetDerivedData("pE/pt",dummy_value) ||
      !state.GetDerivedData("Timestep lower bound",dummy_value) ||
-     (dm_dt_t1_output.GetCacheRequestCount()>0
-      && dm_dt_t1_output.cache.state_id != state.Id()) ||
-     (dm_dt_l1_output.GetCacheRequestCount()>0
-      && dm_dt_l1_output.cache.state_id != state.Id()) ||
+     energy_state_id != state.Id() ||
      (mxH1_output.GetCacheRequestCount()>0
       && mxH1_output.cache.state_id != state.Id()) ||
-     (dm_dt_t2_output.GetCacheRequestCount()>0
-      && dm_dt_t2_output.cache.state_id != state.Id()) ||
-     (dm_dt_l2_output.GetCacheRequestCount()>0
-      && dm_dt_l2_output.cache.state_id != state.Id()) ||
      (mxH2_output.GetCacheRequestCount()>0
       && mxH2_output.cache.state_id != state.Id()) ) {
 
     // Missing at least some data, so calculate from scratch
 
     // Calculate H and mxH outputs
-    Oxs_MeshValue<ThreeVector>& mxH1 = mxH1_output.cache.value;
-    Oxs_MeshValue<ThreeVector>& mxH2 = mxH2_output.cache.value;
+    Oxs_MeshValue<ThreeVector>* mxH1_fill = MxHRequest(mxH1_output);
+    Oxs_MeshValue<ThreeVector>* mxH2_fill = MxHRequest(mxH2_output);
+    const Oxs_MeshValue<ThreeVector>& mxH1 = mxH1_output.cache.value;
+    const Oxs_MeshValue<ThreeVector>& mxH2 = mxH2_output.cache.value;
+    Oxs_MeshValue<ThreeVector>* H1_fill
+      = FieldRequest(total_field1,dm_dt_l1,0);
+    Oxs_MeshValue<ThreeVector>* H2_fill
+      = FieldRequest(total_field2,dm_dt_l2,0);
+    dm_dt_t1_output.cache.state_id = dm_dt_l1_output.cache.state_id = 0;
+    dm_dt_t2_output.cache.state_id = dm_dt_l2_output.cache.state_id = 0;
+    energy_state_id=0;
     OC_REAL8m pE_pt;
     GetEnergyDensity(
         state,
         energy,
-        &mxH1,
-        &mxH2,
-        &total_field1,
-        &total_field2,
+        mxH1_fill,
+        mxH2_fill,
+        H1_fill,
+        H2_fill,
         pE_pt);
-    energy_state_id=state.Id();
-    mxH1_output.cache.state_id=state.Id();
-    mxH2_output.cache.state_id=state.Id();
+    if(mxH1_fill) mxH1_output.cache.state_id=state.Id();
+    if(mxH2_fill) mxH2_output.cache.state_id=state.Id();
 
     // TODO: How can I include pE_pt2?
     if(!state.GetDerivedData("pE/pt",dummy_value)) {
@@ -1170,43 +1923,28 @@ void YY_2LatEulerEvolve::UpdateDerivedOutputs(const Oxs_SimState& state)
 
     // Calculate dm/dt, Max dm/dt and dE/dt
     OC_REAL8m timestep_lower_bound;
-    Oxs_MeshValue<ThreeVector>& dm_dt_t1
-      = dm_dt_t1_output.cache.value;
-    Oxs_MeshValue<ThreeVector>& dm_dt_l1
-      = dm_dt_l1_output.cache.value;
-    dm_dt_t1_output.cache.state_id=0;
-    dm_dt_l1_output.cache.state_id=0;
     Calculate_dm_dt(
         *(state.lattice1),
         mxH1,
-        total_field1,
+        *H1_fill,
         pE_pt,
         dm_dt_t1,
         dm_dt_l1,
         max_dm_dt_output.cache.value,
         dE_dt_output.cache.value,
         timestep_lower_bound);
-    dm_dt_t1_output.cache.state_id=state.Id();
-    dm_dt_l1_output.cache.state_id=state.Id();
-
-    Oxs_MeshValue<ThreeVector>& dm_dt_t2
-      = dm_dt_t2_output.cache.value;
-    Oxs_MeshValue<ThreeVector>& dm_dt_l2
-      = dm_dt_l2_output.cache.value;
-    dm_dt_t2_output.cache.state_id=0;
-    dm_dt_l2_output.cache.state_id=0;
+
     Calculate_dm_dt(
         *(state.lattice2),
         mxH2,
-        total_field2,
+        *H2_fill,
         pE_pt,
         dm_dt_t2,
         dm_dt_l2,
         max_dm_dt_output.cache.value,
         dE_dt_output.cache.value,
         timestep_lower_bound);
-    dm_dt_t2_output.cache.state_id=state.Id();
-    dm_dt_l2_output.cache.state_id=state.Id();
+    energy_state_id=state.Id();
 
     if(!state.GetDerivedData("Max dm/dt",dummy_value)) {
       state.AddDerivedData("Max dm/dt",max_dm_dt_output.cache.value);
@@ -1238,6 +1976,11 @@ void YY_2LatEulerEvolve::UpdateDerivedOutputs(const Oxs_SimState& state)
   max_dm_dt_output.cache.value*=(180e-9/PI);
   /// Convert from radians/second to deg/ns
 
+  FillDmDtOutput(dm_dt_t1_output,dm_dt_t1,state);
+  FillDmDtOutput(dm_dt_l1_output,dm_dt_l1,state);
+  FillDmDtOutput(dm_dt_t2_output,dm_dt_t2,state);
+  FillDmDtOutput(dm_dt_l2_output,dm_dt_l2,state);
+
   max_dm_dt_output.cache.state_id
     = dE_dt_output.cache.state_id
     = delta_E_output.cache.state_id
@@ -31,9 +31,16 @@
 #include "tclcommand.h"
 #include "output.h"
 #include "scalarfield.h"
+#include "atlas.h"
+
+#include "yy_2lat_hugepage.h"
+#include "yy_2lat_temperaturepulse.h"
 
 /* End includes */
 
+class _YY_2LatEulerFusedDmDt; // Helper class for the fused pipeline
+class _YY_2LatEulerThread;    // Helper class for threaded sweeps
+
 class YY_2LatEulerEvolve:public YY_2LatTimeEvolver {
 private:
   mutable OC_UINT4m mesh_id;
@@ -46,6 +53,13 @@ private:
   OC_REAL8m max_timestep;   // Seconds
   OC_REAL8m fixed_timestep; // Seconds -> min_timestep = max_timestep
 
+  // Step settings in use for the current stage.  These are the values
+  // above, except that auto_timestep replaces them at each stage start
+  // by the derived step, clamped to auto_timestep_cap.
+  OC_REAL8m stage_min_timestep;
+  OC_REAL8m stage_max_timestep;
+  OC_REAL8m stage_fixed_timestep;
+
   OC_REAL8m allowed_error_rate;
   OC_REAL8m allowed_absolute_step_error;
   OC_REAL8m allowed_relative_step_error;
@@ -53,6 +67,23 @@ private:
 
   OC_REAL8m start_dm;
 
+  // Automatic step from the stiffest local rates, re-estimated at each
+  // stage start (auto_timestep option).  See notes at the bottom.
+  OC_BOOL auto_timestep;
+  OC_REAL8m auto_timestep_margin;
+  OC_UINT4m auto_timestep_stage; // Stage of the last estimate, +1; 0 none
+  OC_REAL8m auto_timestep_cap; // Largest derived step (user settings)
+  Oxs_MeshValue<OC_REAL8m> stiffness_t, stiffness_l; // Only during estimate
+
+  OC_REAL8m EstimateTimestep(const Oxs_SimState& cstate_,
+                             const Oxs_SimState& cstate1_,
+                             const Oxs_SimState& cstate2_);
+  /// Largest explicit step the local transverse and longitudinal
+  /// rates of cstate_ allow, times auto_timestep_margin.  Returns 0 if
+  /// there is no free cell or no energy term reports its stiffness.
+  /// Uses the current alpha and gamma arrays, and the coefficients of
+  /// the last energy evaluation.
+
   const OC_UINT4m energy_accum_count_limit ;
   OC_UINT4m energy_accum_count;
 
@@ -76,16 +107,24 @@ private:
   mutable Oxs_MeshValue<OC_REAL8m> alpha_t10, alpha_t20;
   // alpha_t10, _t20 are the values at T = 0 K.
 
-  void UpdateMeshArrays(const Oxs_SimState& state);
+  void UpdateMeshArrays(const Oxs_SimState& state,
+                        const vector<OC_INDEX>* cells);
+  void UpdateMeshArrays(const Oxs_SimState& state) {
+    UpdateMeshArrays(state,0);
+  }
   // Call with the total_lattice state and it updates values for both
-  // sublattices.
+  // sublattices.  If cells is non-null, only those cells are updated.
 
   // =======================================================================
   // Caches and scratch spaces
   // =======================================================================
-  // Data cached from last state
+  // Data cached from last state.  energy and dm_dt_* belong to the
+  // state with id energy_state_id.  The dm_dt output caches are
+  // copied from dm_dt_* only while an output requests them.
   OC_UINT4m energy_state_id;
   Oxs_MeshValue<OC_REAL8m> energy;
+  Oxs_MeshValue<ThreeVector> dm_dt_t1, dm_dt_t2;
+  Oxs_MeshValue<ThreeVector> dm_dt_l1, dm_dt_l2;
   OC_REAL8m next_timestep;
 
   // Scratch space
@@ -93,7 +132,17 @@ private:
   Oxs_MeshValue<ThreeVector> new_dm_dt_t1, new_dm_dt_t2;
   Oxs_MeshValue<ThreeVector> new_dm_dt_l1, new_dm_dt_l2;
 
-  Oxs_MeshValue<ThreeVector> total_field1, total_field2;  // For sublattices
+  // Total field of the sublattices.  The energy pass normally
+  // accumulates H straight into the dm_dt_l array of the evaluation,
+  // which the dm/dt kernel then overwrites in place.  Separate arrays
+  // are only needed when the fused pipeline runs while the total
+  // field output is requested; see FieldRequest.
+  Oxs_MeshValue<ThreeVector> total_field1, total_field2;
+  Oxs_MeshValue<ThreeVector>*
+  FieldRequest(Oxs_MeshValue<ThreeVector>& total_field_,
+               Oxs_MeshValue<ThreeVector>& dm_dt_l_,OC_BOOL fused);
+  /// Returns the array the energy pass should fill with H, and
+  /// releases total_field_ when it is not that array.
 
   // =======================================================================
   // Support for stage-varying temperature
@@ -115,6 +164,23 @@ private:
   // The following also updates kB_T.
   void UpdateStageTemperature(const Oxs_SimState& stage);
 
+  // Built-in analytic temperature pulses, added on top of the
+  // (tempscript or 0 K) stage temperature and re-evaluated every step
+  // without calling into Tcl.  Cells whose temperature moves by no
+  // more than temperature_tol (K) since their last update are left
+  // alone, as are their alpha and stochastic field variances.
+  OC_BOOL has_temperature_pulses;
+  YY_2LatTemperatureProfile temperature_pulses;
+  OC_REAL8m temperature_tol;
+  Oxs_MeshValue<OC_REAL8m> temperature_base; // Stage temperature
+  vector<OC_INDEX> temperature_changed;
+  void UpdatePulseTemperature(const Oxs_SimState& state);
+  // Temperature log published to the states (T_update_count and
+  // T_changed), so that YY_2LatExchange6Ngbr re-solves m_e only in
+  // the changed cells.
+  OC_UINT4m temperature_update_count;
+  void SetTemperaturePointers(const Oxs_SimState& state);
+
   // =======================================================================
   // Random functions and supports (for stochastic field)
   // =======================================================================
@@ -143,6 +209,114 @@ private:
   Oxs_MeshValue<ThreeVector> hFluct_t1, hFluct_t2;  // transverse
   Oxs_MeshValue<ThreeVector> hFluct_l1, hFluct_l2;  // longitudinal
 
+  // Frozen (pinned) cells for each sublattice, from the regions of
+  // the fixed_spins1 and fixed_spins2 options.  Frozen cells keep
+  // their spin and Ms, and are skipped by the stochastic field, dm/dt
+  // and advance sweeps, so they neither cost time per step nor enter
+  // max dm/dt.  Sorted cell indices, rebuilt on mesh change.  The
+  // Oxs_Evolver fixed_spins list is kept separate: it only zeroes the
+  // transverse dm/dt, on both sublattices.
+  Oxs_OwnedPointer<Oxs_Atlas> frozen_atlas1, frozen_atlas2;
+  vector<OC_INDEX> frozen_region_ids1, frozen_region_ids2;
+  OC_UINT4m frozen_mesh_id;
+  vector<OC_INDEX> frozen_spins1, frozen_spins2;
+  void GetFrozenRegions(const char* key,
+                        Oxs_OwnedPointer<Oxs_Atlas>& atlas_,
+                        vector<OC_INDEX>& region_ids_);
+  void UpdateFrozenSpinLists(const Oxs_Mesh* mesh_);
+  const vector<OC_INDEX>* GetFrozenSpinList(const Oxs_SimState& state_) const;
+  /// Null if the sublattice of state_ has no frozen cells.
+
+  // Per-sublattice parameter set used by the dm/dt kernel
+  struct LatticeParams {
+    const Oxs_MeshValue<OC_REAL8m>* alpha_t;
+    const Oxs_MeshValue<OC_REAL8m>* alpha_l;
+    const Oxs_MeshValue<OC_REAL8m>* gamma;
+    const Oxs_MeshValue<ThreeVector>* hFluct_t;
+    const Oxs_MeshValue<ThreeVector>* hFluct_l;
+    LatticeParams()
+      : alpha_t(0), alpha_l(0), gamma(0), hFluct_t(0), hFluct_l(0) {}
+  };
+
+  // Statistics collected by the dm/dt kernel over a range of cells
+  struct DmDtStats {
+    OC_REAL8m max_dm_dt_sq;
+    OC_REAL8m dE_dt_sum;
+    OC_INDEX max_index;
+    DmDtStats() : max_dm_dt_sq(0.0), dE_dt_sum(0.0), max_index(0) {}
+    void Merge(const DmDtStats& other) {
+      dE_dt_sum += other.dE_dt_sum;
+      if(other.max_dm_dt_sq>max_dm_dt_sq
+         || (other.max_dm_dt_sq==max_dm_dt_sq
+             && other.max_index<max_index)) {
+        max_dm_dt_sq = other.max_dm_dt_sq;
+        max_index = other.max_index;
+      }
+    }
+  };
+
+  void Prepare_dm_dt(const Oxs_SimState& state_,
+                     Oxs_MeshValue<ThreeVector>& dm_dt_t_,
+                     Oxs_MeshValue<ThreeVector>& dm_dt_l_,
+                     LatticeParams& params_);
+  /// Sets up parameter arrays on first go, fills the stochastic field
+  /// for the sublattice if not already done for this iteration, sizes
+  /// the dm_dt exports, and fills params_.  Not thread safe.
+
+  void Calculate_dm_dt_Chunk
+  (const Oxs_SimState& state_,
+   const LatticeParams& params_,
+   const Oxs_MeshValue<ThreeVector>& mxH_,
+   const Oxs_MeshValue<ThreeVector>& total_field_,
+   Oxs_MeshValue<ThreeVector>& dm_dt_t_,
+   Oxs_MeshValue<ThreeVector>& dm_dt_l_,
+   const vector<OC_INDEX>* frozen_spins_,
+   OC_INDEX node_start,OC_INDEX node_stop,
+   DmDtStats& stats_) const;
+  /// LLB right-hand side over [node_start,node_stop).  Safe to call
+  /// concurrently on disjoint ranges.  Stats over the range are
+  /// accumulated into stats_.  Cells in frozen_spins_ (may be null)
+  /// get dm_dt = 0 and are left out of the stats.  total_field_ may be
+  /// the same array as dm_dt_l_; each cell's H is read before its
+  /// dm_dt is written.
+
+  void Finish_dm_dt
+  (const Oxs_SimState& state_,
+   const Oxs_MeshValue<ThreeVector>& dm_dt_t_,
+   OC_REAL8m pE_pt_,
+   const DmDtStats& stats_,
+   OC_REAL8m& max_dm_dt_,
+   OC_REAL8m& dE_dt_,
+   OC_REAL8m& min_timestep_) const;
+
+  void AdvanceChunk
+  (const Oxs_SimState& cstate1_,
+   const Oxs_SimState& cstate2_,
+   OC_REAL8m stepsize_,
+   Oxs_SimState& workstate_,
+   Oxs_SimState& workstate1_,
+   Oxs_SimState& workstate2_,
+   OC_INDEX node_start,OC_INDEX node_stop) const;
+  /// Euler update of spin and Ms for both sublattices and the total
+  /// lattice over [node_start,node_stop), from dm_dt_t1 etc.
+  /// Frozen cells are copied over unchanged.
+
+  void PlaceMeshArrays(const Oxs_Mesh* mesh_);
+  /// Sizes all per-cell work arrays owned by *this and first-touches
+  /// them strip by strip; see YY_2LatFirstTouch.
+  friend class _YY_2LatEulerThread;
+
+  // Huge page advice for the arrays sized in PlaceMeshArrays, from
+  // the huge_pages option.  Those arrays are allocated by OOMMF core,
+  // so "explicit" is handled the same as "transparent".
+  YY_2LatHugePageMode huge_pages;
+
+  // If true, Step computes dm_dt inside the chunk energy pass, block by
+  // block, while the local fields are still in cache.  See the
+  // fused_dm_dt option and _YY_2LatEulerFusedDmDt.
+  OC_BOOL use_fused_dm_dt;
+  friend class _YY_2LatEulerFusedDmDt;
+
   void Calculate_dm_dt
   (const Oxs_SimState& state_,
    const Oxs_MeshValue<ThreeVector>& mxH_,
@@ -157,7 +331,8 @@ private:
   /// Exports: pE_pt, dm_dt_t_, dm_dt_l_, max_dm_dt_, dE_dt_, min_timestep_
   /// Call this with state_ for each sublattice. It internally judges tye 
   /// type of the lattice and get references of the other sublattice if 
-  /// necessary.
+  /// necessary.  Equivalent to Prepare_dm_dt + Calculate_dm_dt_Chunk
+  /// over the whole mesh + Finish_dm_dt.
 
   // =======================================================================
   // Outputs
@@ -169,8 +344,23 @@ private:
   Oxs_VectorFieldOutput<YY_2LatEulerEvolve> dm_dt_t1_output, dm_dt_t2_output;
   Oxs_VectorFieldOutput<YY_2LatEulerEvolve> dm_dt_l1_output, dm_dt_l2_output;
   Oxs_VectorFieldOutput<YY_2LatEulerEvolve> mxH1_output, mxH2_output;
-  Oxs_VectorFieldOutput<YY_2LatEulerEvolve> spin1_output, spin2_output;
-  Oxs_VectorFieldOutput<YY_2LatEulerEvolve> magnetization1_output, magnetization2_output;
+
+  Oxs_ScalarOutput<YY_2LatEulerEvolve> footprint_output;
+  void UpdateFootprintOutput(const Oxs_SimState&);
+  /// Memory held in per-cell arrays by *this, in MB.
+
+  void FillDmDtOutput(Oxs_VectorFieldOutput<YY_2LatEulerEvolve>& output_,
+                      const Oxs_MeshValue<ThreeVector>& dm_dt_,
+                      const Oxs_SimState& state_);
+  /// Copies dm_dt_ into the output cache if the output is requested,
+  /// else releases the cache.
+
+  Oxs_MeshValue<ThreeVector>*
+  MxHRequest(Oxs_VectorFieldOutput<YY_2LatEulerEvolve>& mxH_output_);
+  /// The mxH output caches are held only while an output requests
+  /// them.  Returns the cache to fill, or releases it and returns
+  /// NULL.  The dm/dt kernels form mxH from spin and total field when
+  /// handed an empty mxH array.
 
 public:
   virtual const char* ClassName() const; // ClassName() is
@@ -238,6 +428,46 @@ public:
  * current_state), then timestep is calculated so that 
  * max_dm_dt * timestep = start_dm.
  *
+ * OC_BOOL auto_timestep;
+ * OC_REAL8m auto_timestep_margin;
+ * With auto_timestep enabled, the step is re-derived at the start of
+ * each stage from the stiffest local rates, at the stage temperature.
+ * Energy terms that implement YY_2LatStiffnessEnergy (see
+ * yy_2lat_util.h) report per cell a transverse stiffness kt and a
+ * longitudinal stiffness kl, in A/m per radian and per unit of reduced
+ * magnetization m = Ms/Ms0, from the coefficients of their last
+ * evaluation and no extra energy evaluation.  YY_2LatExchange6Ngbr
+ * gives the shortest wavelength (checkerboard) exchange mode, the
+ * antiphase inter-sublattice mode from J0 and mu, and the
+ * longitudinal stiffness 1/(m chi_l); YY_2LatUniaxialAnisotropy gives
+ * the anisotropy field.  Other terms, e.g. demag and Zeeman, are not
+ * included; their fields are bounded by Ms and the applied field.
+ * The rates are
+ *
+ *   transverse    |gamma| kt sqrt(1 + (alpha_t/m)^2)
+ *   longitudinal  |gamma| alpha_l kl
+ *
+ * (alpha_t/m alone without precession), and the step is
+ * auto_timestep_margin divided by the largest rate over both
+ * sublattices, ignoring empty and frozen cells.  So a margin of 0.2
+ * turns the stiffest spin by about 0.2 rad per step and relaxes the
+ * stiffest longitudinal mode by about 20% per step; explicit Euler is
+ * unstable for longitudinal relaxation above 2.  The result is kept
+ * in the stage_*_timestep members, and the user's fixed_timestep,
+ * min_timestep and max_timestep are left as set.  For T > 0 it
+ * replaces fixed_timestep for the stage, but does not exceed an
+ * explicitly given fixed_timestep; for T = 0 it lowers the max_timestep
+ * cap of the adaptive control, and never goes below min_timestep.  The
+ * dm_dt of the stage's first state is recomputed at the stage
+ * temperature, with the stochastic field redrawn for the new step,
+ * and Step uses the refreshed Max dm/dt, dE/dt, pE/pt and timestep
+ * lower bound in place of the derived data of that state (which are
+ * write-once).  The step in use is reported by
+ * the driver's "Last time step" output.  Near Tc, alpha_l and kl
+ * change with the state, so for
+ * long stages with large temperature swings (temperature_pulses) a
+ * smaller margin is advisable.
+ *
  * const OC_UINT4m energy_accum_count_limit ;
  * OC_UINT4m energy_accum_count;
  * The total energy field in Oxs_SimState is computed by accumulating
@@ -34,6 +34,7 @@
 #include "rectangularmesh.h"
 #include "energy.h"		// Needed to make MSVC++ 5 happy
 
+#include "yy_2lat_blocksum.h"
 #include "yy_2lat_util.h"
 #include "yy_2latexchange6ngbr.h"
 
@@ -44,6 +45,11 @@ OXS_EXT_REGISTER(YY_2LatExchange6Ngbr);
 
 /* End includes */
 
+// Atlases with more regions than this default to per-cell face
+// coefficients (coef_storage auto).  The dense tables then take
+// 3*8*256^2 bytes, about 1.5 MB.
+#define YY_2LAT_EXCHANGE_DENSE_MAX_REGIONS 256
+
 // Revision information, set via CVS keyword substitution
 static const Oxs_WarningMessageRevisionInfo revision_info
   (__FILE__,
@@ -60,8 +66,11 @@ YY_2LatExchange6Ngbr::YY_2LatExchange6Ngbr(
   : Oxs_ChunkEnergy(name,newdtr,argstr),
     coef_size(0), mesh_id(0),
     coef1(NULL), coef2(NULL), coef12(NULL),
+    use_face_coefs(0),
+    default_coef1(0.0), default_coef2(0.0), default_coef12(0.0),
     last_stage_number(-1),
-    tol(1e-4), tolsq(1e-4)
+    tol(1e-4), tolsq(1e-4),
+    m_e_newton_limit(50), m_e_T_count(0), chi_l_state_id(0)
 {
   // Process arguments
   OXS_GET_INIT_EXT_OBJECT("atlas",Oxs_Atlas,atlas);
@@ -150,9 +159,6 @@ YY_2LatExchange6Ngbr::YY_2LatExchange6Ngbr(
   vector<String> params1;
   vector<String> params2;
   vector<String> params12;
-  OC_REAL8m default_coef1 = 0.0;
-  OC_REAL8m default_coef2 = 0.0;
-  OC_REAL8m default_coef12 = 0.0;
   OC_BOOL has_A = HasInitValue("A1")
     || HasInitValue("A2") || HasInitValue("A12");
   OC_BOOL has_lex = HasInitValue("lex1")
@@ -199,6 +205,21 @@ YY_2LatExchange6Ngbr::YY_2LatExchange6Ngbr(
       throw Oxs_ExtError(this,buf);
   }
 
+  // Coefficient storage: dense region x region tables, or per-cell
+  // face coefficients for atlases with many regions.
+  String storage = GetStringInitValue("coef_storage","auto");
+  if(storage.compare("dense")==0) {
+    use_face_coefs = 0;
+  } else if(storage.compare("faces")==0) {
+    use_face_coefs = 1;
+  } else if(storage.compare("auto")==0) {
+    use_face_coefs = (coef_size>YY_2LAT_EXCHANGE_DENSE_MAX_REGIONS);
+  } else {
+    String msg = String("Invalid coef_storage value \"") + storage
+      + String("\"; should be auto, dense or faces.");
+    throw Oxs_ExtError(this,msg);
+  }
+
   // Allocate A matrix.  Because raw pointers are used, a memory leak
   // would occur if an uncaught exception occurred beyond this point.
   // So, we put the whole bit in a try-catch block.
@@ -206,14 +227,6 @@ YY_2LatExchange6Ngbr::YY_2LatExchange6Ngbr(
   // Lattice 1
   // =======================================================================
   try {
-    coef1 = new OC_REAL8m*[coef_size];
-    coef1[0] = NULL; // Safety, in case next alloc throws an exception
-    coef1[0] = new OC_REAL8m[coef_size*coef_size];
-    OC_INDEX ic;
-    for(ic=1;ic<coef_size;ic++) coef1[ic] = coef1[ic-1] + coef_size;
-
-    // Fill A matrix
-    for(ic=0;ic<coef_size*coef_size;ic++) coef1[0][ic] = default_coef1;
     for(OC_INT4m ip=0;static_cast<size_t>(ip)<params1.size();ip+=3) {
       OC_INT4m i1 = atlas->GetRegionId(params1[ip]);
       OC_INT4m i2 = atlas->GetRegionId(params1[ip+1]);
@@ -268,8 +281,23 @@ YY_2LatExchange6Ngbr::YY_2LatExchange6Ngbr(
                     typestr.c_str(),long(ip/3),item);
         throw Oxs_ExtError(this,buf);
       }
-      coef1[i1][i2]=coef1pair;
-      coef1[i2][i1]=coef1pair; // coef should be symmetric
+      pairs1[i1*coef_size+i2]=coef1pair;
+      pairs1[i2*coef_size+i1]=coef1pair; // coef should be symmetric
+    }
+
+    if(!use_face_coefs) {
+      coef1 = new OC_REAL8m*[coef_size];
+      coef1[0] = NULL; // Safety, in case next alloc throws an exception
+      coef1[0] = new OC_REAL8m[coef_size*coef_size];
+      OC_INDEX ic;
+      for(ic=1;ic<coef_size;ic++) coef1[ic] = coef1[ic-1] + coef_size;
+
+      // Fill A matrix
+      for(ic=0;ic<coef_size*coef_size;ic++) coef1[0][ic] = default_coef1;
+      map<OC_INDEX,OC_REAL8m>::const_iterator it;
+      for(it=pairs1.begin();it!=pairs1.end();++it) {
+        coef1[0][it->first] = it->second;
+      }
     }
     DeleteInitValue(typestr+"1");
 
@@ -287,14 +315,6 @@ YY_2LatExchange6Ngbr::YY_2LatExchange6Ngbr(
   // Lattice 2
   // =======================================================================
   try {
-    coef2 = new OC_REAL8m*[coef_size];
-    coef2[0] = NULL; // Safety, in case next alloc throws an exception
-    coef2[0] = new OC_REAL8m[coef_size*coef_size];
-    OC_INDEX ic;
-    for(ic=1;ic<coef_size;ic++) coef2[ic] = coef2[ic-1] + coef_size;
-
-    // Fill A matrix
-    for(ic=0;ic<coef_size*coef_size;ic++) coef2[0][ic] = default_coef2;
     for(OC_INT4m ip=0;static_cast<size_t>(ip)<params2.size();ip+=3) {
       OC_INT4m i1 = atlas->GetRegionId(params2[ip]);
       OC_INT4m i2 = atlas->GetRegionId(params2[ip+1]);
@@ -349,8 +369,23 @@ YY_2LatExchange6Ngbr::YY_2LatExchange6Ngbr(
                     typestr.c_str(),long(ip/3),item);
         throw Oxs_ExtError(this,buf);
       }
-      coef2[i1][i2]=coef2pair;
-      coef2[i2][i1]=coef2pair; // coef should be symmetric
+      pairs2[i1*coef_size+i2]=coef2pair;
+      pairs2[i2*coef_size+i1]=coef2pair; // coef should be symmetric
+    }
+
+    if(!use_face_coefs) {
+      coef2 = new OC_REAL8m*[coef_size];
+      coef2[0] = NULL; // Safety, in case next alloc throws an exception
+      coef2[0] = new OC_REAL8m[coef_size*coef_size];
+      OC_INDEX ic;
+      for(ic=1;ic<coef_size;ic++) coef2[ic] = coef2[ic-1] + coef_size;
+
+      // Fill A matrix
+      for(ic=0;ic<coef_size*coef_size;ic++) coef2[0][ic] = default_coef2;
+      map<OC_INDEX,OC_REAL8m>::const_iterator it;
+      for(it=pairs2.begin();it!=pairs2.end();++it) {
+        coef2[0][it->first] = it->second;
+      }
     }
     DeleteInitValue(typestr+"2");
 
@@ -368,14 +403,6 @@ YY_2LatExchange6Ngbr::YY_2LatExchange6Ngbr(
   // Between lattice 1 and 2
   // =======================================================================
   try {
-    coef12 = new OC_REAL8m*[coef_size];
-    coef12[0] = NULL; // Safety, in case next alloc throws an exception
-    coef12[0] = new OC_REAL8m[coef_size*coef_size];
-    OC_INDEX ic;
-    for(ic=1;ic<coef_size;ic++) coef12[ic] = coef12[ic-1] + coef_size;
-
-    // Fill A matrix
-    for(ic=0;ic<coef_size*coef_size;ic++) coef12[0][ic] = default_coef12;
     for(OC_INT4m ip=0;static_cast<size_t>(ip)<params12.size();ip+=3) {
       OC_INT4m i1 = atlas->GetRegionId(params12[ip]);
       OC_INT4m i2 = atlas->GetRegionId(params12[ip+1]);
@@ -430,8 +457,23 @@ YY_2LatExchange6Ngbr::YY_2LatExchange6Ngbr(
                     typestr.c_str(),long(ip/3),item);
         throw Oxs_ExtError(this,buf);
       }
-      coef12[i1][i2]=coef12pair;
-      coef12[i2][i1]=coef12pair; // coef should be symmetric
+      pairs12[i1*coef_size+i2]=coef12pair;
+      pairs12[i2*coef_size+i1]=coef12pair; // coef should be symmetric
+    }
+
+    if(!use_face_coefs) {
+      coef12 = new OC_REAL8m*[coef_size];
+      coef12[0] = NULL; // Safety, in case next alloc throws an exception
+      coef12[0] = new OC_REAL8m[coef_size*coef_size];
+      OC_INDEX ic;
+      for(ic=1;ic<coef_size;ic++) coef12[ic] = coef12[ic-1] + coef_size;
+
+      // Fill A matrix
+      for(ic=0;ic<coef_size*coef_size;ic++) coef12[0][ic] = default_coef12;
+      map<OC_INDEX,OC_REAL8m>::const_iterator it;
+      for(it=pairs12.begin();it!=pairs12.end();++it) {
+        coef12[0][it->first] = it->second;
+      }
     }
     DeleteInitValue(typestr+"12");
 
@@ -471,44 +513,249 @@ YY_2LatExchange6Ngbr::~YY_2LatExchange6Ngbr()
   }
 }
 
+OC_REAL8m YY_2LatExchange6Ngbr::PairCoef
+(const map<OC_INDEX,OC_REAL8m>& pairs,
+ OC_REAL8m default_coef,
+ OC_INT4m r1,OC_INT4m r2) const
+{
+  map<OC_INDEX,OC_REAL8m>::const_iterator it
+    = pairs.find(static_cast<OC_INDEX>(r1)*coef_size+r2);
+  if(it==pairs.end()) return default_coef;
+  return it->second;
+}
+
+void YY_2LatExchange6Ngbr::FillFaceCoefs(const Oxs_Mesh* genmesh) const
+{
+  const Oxs_CommonRectangularMesh* mesh
+    = dynamic_cast<const Oxs_CommonRectangularMesh*>(genmesh);
+  if(mesh==NULL) {
+    String msg =
+      String("Import mesh (\"")
+      + String(genmesh->InstanceName())
+      + String("\") to YY_2LatExchange6Ngbr::FillFaceCoefs()"
+             " routine of object \"") + String(InstanceName())
+      + String("\" is not a rectangular mesh object.");
+    throw Oxs_ExtError(msg.c_str());
+  }
+  int xperiodic=0, yperiodic=0, zperiodic=0;
+  const Oxs_PeriodicRectangularMesh* pmesh
+    = dynamic_cast<const Oxs_PeriodicRectangularMesh*>(mesh);
+  if(pmesh!=NULL) {
+    xperiodic = pmesh->IsPeriodicX();
+    yperiodic = pmesh->IsPeriodicY();
+    zperiodic = pmesh->IsPeriodicZ();
+  }
+  const OC_INDEX xdim = mesh->DimX();
+  const OC_INDEX ydim = mesh->DimY();
+  const OC_INDEX zdim = mesh->DimZ();
+  const OC_INDEX xydim = xdim*ydim;
+  const OC_INDEX xyzdim = xydim*zdim;
+
+  face1.AdjustSize(mesh);
+  face2.AdjustSize(mesh);
+  OC_INDEX i = 0;
+  for(OC_INDEX z=0;z<zdim;++z) {
+    for(OC_INDEX y=0;y<ydim;++y) {
+      for(OC_INDEX x=0;x<xdim;++x,++i) {
+        const OC_INT4m ri = region_id[i];
+        OC_REAL8m a1[3] = { 0., 0., 0. };
+        OC_REAL8m a2[3] = { 0., 0., 0. };
+        OC_INDEX jn[3] = { -1, -1, -1 };
+        if(x<xdim-1 || xperiodic) jn[0] = (x<xdim-1 ? i+1 : i+1-xdim);
+        if(y<ydim-1 || yperiodic) jn[1] = (y<ydim-1 ? i+xdim : i+xdim-xydim);
+        if(z<zdim-1 || zperiodic) {
+          jn[2] = (z<zdim-1 ? i+xydim : i+xydim-xyzdim);
+        }
+        for(int k=0;k<3;++k) {
+          if(jn[k]<0) continue;
+          const OC_INT4m rj = region_id[jn[k]];
+          a1[k] = PairCoef(pairs1,default_coef1,ri,rj);
+          a2[k] = PairCoef(pairs2,default_coef2,ri,rj);
+        }
+        face1[i].Set(a1[0],a1[1],a1[2]);
+        face2[i].Set(a2[0],a2[1],a2[2]);
+      }
+    }
+  }
+}
+
 OC_BOOL YY_2LatExchange6Ngbr::Init()
 {
   mesh_id = 0;
   region_id.Release();
+  face1.Release(); face2.Release();
   J01.Release(); J02.Release();
   J012.Release(); J021.Release();
   mu1.Release(); mu2.Release();
   Tc1.Release(); Tc2.Release();
   m_e1.Release(); m_e2.Release();
   chi_l1.Release(); chi_l2.Release();
+  chi_l_state_id = 0;
   G1.Release(); G2.Release();
   Lambdai11.Release(); Lambdai12.Release();
   Lambdai21.Release(); Lambdai22.Release();
   return Oxs_Energy::Init();
 }
 
-void YY_2LatExchange6Ngbr::CalcEnergyA
-(const Oxs_SimState& state,
- Oxs_ComputeEnergyDataThreaded& ocedt,
- Oxs_ComputeEnergyDataThreadedAux& ocedtaux,
- OC_INDEX node_start,
- OC_INDEX node_stop,
- int threadnumber
- ) const
-{
-  // Depending on the lattice type, specify the coefficients to be used.
-  // Sucscript A corresponds to this lattice, B is the other.
+struct YY_2LatExchange6Ngbr::StencilA {
   const Oxs_MeshValue<ThreeVector> *spinA, *spinB;
-  OC_REAL8m** coefA;
-  OC_REAL8m** coefB;
   const Oxs_MeshValue<OC_REAL8m> *MsA, *MsB;
-  const Oxs_MeshValue<OC_REAL8m> *MsA_inverse, *MsB_inverse;
+  const Oxs_MeshValue<OC_REAL8m> *MsA_inverse;
   const Oxs_MeshValue<OC_REAL8m> *Ms0A_inverse, *Ms0B_inverse;
   const Oxs_MeshValue<OC_REAL8m> *J0A, *J0AB;
-  const Oxs_MeshValue<OC_REAL8m> *muA, *muB;
+  const Oxs_MeshValue<OC_REAL8m> *muA;
   const Oxs_MeshValue<OC_REAL8m> *m_eA, *m_eB;
-  const Oxs_MeshValue<OC_REAL8m> *chi_lA, *chi_lB;
-  const Oxs_MeshValue<OC_REAL8m> *GA, *GB;
+  const Oxs_MeshValue<OC_REAL8m> *chi_lA;
+  const Oxs_MeshValue<OC_REAL8m> *GB;
+  const Oxs_MeshValue<OC_REAL8m> *T, *Tc;
+  OC_REAL8m** coefA;  // Dense tables, or
+  const Oxs_MeshValue<ThreeVector>* faceA; // per-cell +x,+y,+z faces
+  const Oxs_MeshValue<OC_INT4m>* region_id;
+  Oxs_ComputeEnergyDataThreaded* ocedt;
+  OC_REAL8m wgtx, wgty, wgtz;
+  OC_REAL8m hcoef_t;
+};
+
+template<int INTERIOR>
+void YY_2LatExchange6Ngbr::CalcCellA
+(const StencilA& st,
+ OC_INDEX i,
+ OC_INDEX jzm,OC_INDEX jym,OC_INDEX jxm,
+ OC_INDEX jxp,OC_INDEX jyp,OC_INDEX jzp,
+ YY_2LatBlockSum& energy_sum,
+ OC_REAL8m& thread_maxdot) const
+{
+  const Oxs_MeshValue<ThreeVector>& spinA = *st.spinA;
+  const Oxs_MeshValue<OC_REAL8m>& MsA = *st.MsA;
+  const Oxs_MeshValue<OC_REAL8m>& MsA_inverse = *st.MsA_inverse;
+  const Oxs_MeshValue<OC_REAL8m>& Ms0A_inverse = *st.Ms0A_inverse;
+  const Oxs_MeshValue<OC_INT4m>& rid = *st.region_id;
+  Oxs_ComputeEnergyDataThreaded& ocedt = *st.ocedt;
+
+  ThreeVector baseA = spinA[i];
+  ThreeVector baseB = (*st.spinB)[i];
+  OC_REAL8m MsiA = MsA[i];
+  OC_REAL8m MsiiA = MsA_inverse[i];
+  if(0.0 == MsiiA) {
+    if(ocedt.energy) (*ocedt.energy)[i] = 0.0;
+    if(ocedt.H)      (*ocedt.H)[i].Set(0.,0.,0.);
+    if(ocedt.mxH)    (*ocedt.mxH)[i].Set(0.,0.,0.);
+    return;
+  }
+  // Face coefficients: the -x face of i is the +x face of its -x
+  // neighbor, etc.
+  const Oxs_MeshValue<ThreeVector>* faceA = st.faceA;
+  OC_REAL8m* ArowA = (faceA ? NULL : st.coefA[rid[i]]);
+  OC_REAL8m miA = MsA[i]*Ms0A_inverse[i];
+  ThreeVector sum(0.,0.,0.);
+  ThreeVector sum_l(0.,0.,0.);
+
+  {
+    // Exchange with the other sublattice
+    OC_REAL8m LambdaiAA = (1.0+(*st.GB)[i])/(*st.chi_lA)[i];
+    OC_REAL8m LambdaiAB = fabs((*st.m_eB)[i])
+      *fabs((*st.J0AB)[i])/((*st.m_eA)[i]*(*st.muA)[i]*MU0);
+    ThreeVector PB = baseA^baseB;
+    PB ^= baseA;
+    PB *= (*st.MsB)[i]*(*st.Ms0B_inverse)[i]; // PB = -nA x (nA x mB)
+    OC_REAL8m tauB = abs(baseB*baseA);  // Dot product
+    tauB *= (*st.MsB)[i]*(*st.Ms0B_inverse)[i]; // |tauB| = mB dot nA
+
+    if((*st.T)[i]!=0.0) {
+      OC_REAL8m beta = 1.0/(KB*(*st.T)[i]);
+      OC_REAL8m A_AA = beta*fabs((*st.J0A)[i]);
+      OC_REAL8m A_AB = beta*fabs((*st.J0AB)[i]);
+      OC_REAL8m B, dB;
+      LangevinPair(A_AA*miA+A_AB*tauB,B,dB); // One exp() for both
+      if( (*st.T)[i]<(*st.Tc)[i] || 1-B/miA>0 ) {
+        // This condition prevents unstable bursts of spin polarizations
+        // when m ~ 0.
+        sum_l -= (1-B/miA)/(MU0*(*st.muA)[i]*beta*dB)*baseA;
+      }
+    }
+
+    sum += (*st.J0AB)[i]/(*st.muA)[i]*PB;
+    sum *= -0.5*MsiA;  // This will be divided by MsiA at the end.
+  }
+
+  // Backward neighbors also feed the max spin angle check.
+  if(INTERIOR || jzm>=0) {
+    OC_INDEX j = jzm;
+    OC_REAL8m ApairA = (faceA ? (*faceA)[j].z : ArowA[rid[j]]);
+    if(ApairA!=0 && MsA_inverse[j]!=0.0) {
+      ThreeVector diffA = (MsA[j]*Ms0A_inverse[j]*spinA[j] - miA*baseA);
+      OC_REAL8m dot = diffA.MagSq();
+      sum += ApairA*st.wgtz*diffA;
+      if(dot>thread_maxdot) thread_maxdot = dot;
+    }
+  }
+  if(INTERIOR || jym>=0) {
+    OC_INDEX j = jym;
+    OC_REAL8m ApairA = (faceA ? (*faceA)[j].y : ArowA[rid[j]]);
+    if(ApairA!=0.0 && MsA_inverse[j]!=0.0) {
+      ThreeVector diffA = (MsA[j]*Ms0A_inverse[j]*spinA[j] - miA*baseA);
+      OC_REAL8m dot = diffA.MagSq();
+      sum += ApairA*st.wgty*diffA;
+      if(dot>thread_maxdot) thread_maxdot = dot;
+    }
+  }
+  if(INTERIOR || jxm>=0) {
+    OC_INDEX j = jxm;
+    OC_REAL8m ApairA = (faceA ? (*faceA)[j].x : ArowA[rid[j]]);
+    if(ApairA!=0.0 && MsA_inverse[j]!=0.0) {
+      ThreeVector diffA = (MsA[j]*Ms0A_inverse[j]*spinA[j] - miA*baseA);
+      OC_REAL8m dot = diffA.MagSq();
+      sum += ApairA*st.wgtx*diffA;
+      if(dot>thread_maxdot) thread_maxdot = dot;
+    }
+  }
+  if(INTERIOR || jxp>=0) {
+    OC_INDEX j = jxp;
+    OC_REAL8m ApairA = (faceA ? (*faceA)[i].x : ArowA[rid[j]]);
+    if(MsA_inverse[j]!=0.0) {
+      sum += ApairA*st.wgtx*( MsA[j]*Ms0A_inverse[j]*spinA[j] - miA*baseA );
+    }
+  }
+  if(INTERIOR || jyp>=0) {
+    OC_INDEX j = jyp;
+    OC_REAL8m ApairA = (faceA ? (*faceA)[i].y : ArowA[rid[j]]);
+    if(MsA_inverse[j]!=0.0) {
+      sum += ApairA*st.wgty*( MsA[j]*Ms0A_inverse[j]*spinA[j] - miA*baseA );
+    }
+  }
+  if(INTERIOR || jzp>=0) {
+    OC_INDEX j = jzp;
+    OC_REAL8m ApairA = (faceA ? (*faceA)[i].z : ArowA[rid[j]]);
+    if(MsA_inverse[j]!=0.0) {
+      sum += ApairA*st.wgtz*( MsA[j]*Ms0A_inverse[j]*spinA[j] - miA*baseA );
+    }
+  }
+
+  OC_REAL8m ei = baseA.x*sum.x + baseA.y*sum.y + baseA.z*sum.z;
+  OC_REAL8m hmult = st.hcoef_t*MsiiA;
+  sum.x *= hmult;  sum.y *= hmult;   sum.z *= hmult;
+  sum += sum_l;
+  OC_REAL8m tx = baseA.y*sum.z - baseA.z*sum.y;
+  OC_REAL8m ty = baseA.z*sum.x - baseA.x*sum.z;
+  OC_REAL8m tz = baseA.x*sum.y - baseA.y*sum.x;
+
+  energy_sum += ei;
+  if(ocedt.energy)       (*ocedt.energy)[i] = ei;
+  if(ocedt.energy_accum) (*ocedt.energy_accum)[i] += ei;
+  if(ocedt.H)       (*ocedt.H)[i] = sum;
+  if(ocedt.H_accum) (*ocedt.H_accum)[i] += sum;
+  if(ocedt.mxH)       (*ocedt.mxH)[i] = ThreeVector(tx,ty,tz);
+  if(ocedt.mxH_accum) (*ocedt.mxH_accum)[i] += ThreeVector(tx,ty,tz);
+}
+
+void YY_2LatExchange6Ngbr::SetupStencilA
+(const Oxs_SimState& state,
+ const Oxs_CommonRectangularMesh* mesh,
+ Oxs_ComputeEnergyDataThreaded& ocedt,
+ StencilA& st) const
+{
+  // Depending on the lattice type, specify the coefficients to be used.
+  // Sucscript A corresponds to this lattice, B is the other.
   switch(state.lattice_type) {
   case Oxs_SimState::TOTAL:
     throw Oxs_ExtError(this, "Programming error: CalcEnergyA was called"
@@ -516,42 +763,48 @@ void YY_2LatExchange6Ngbr::CalcEnergyA
         " TOTAL.");
     break;
   case Oxs_SimState::LATTICE1:
-    spinA = &(state.spin);
-    spinB = &(state.lattice2->spin);
-    MsA = state.Ms;
-    MsB = state.lattice2->Ms;
-    MsA_inverse = state.Ms_inverse;
-    MsB_inverse = state.lattice2->Ms_inverse;
-    Ms0A_inverse = state.Ms0_inverse;
-    Ms0B_inverse = state.lattice2->Ms0_inverse;
-    coefA = coef1; coefB = coef2;
-    muA = &mu1; muB = &mu2;
-    J0A = &J01;
-    J0AB = &J012;
-    m_eA = &m_e1; m_eB = &m_e2;
-    chi_lA = &chi_l1; chi_lB = &chi_l2;
-    GA = &G1; GB = &G2;
+    st.spinB = &(state.lattice2->spin);
+    st.MsB = state.lattice2->Ms;
+    st.Ms0B_inverse = state.lattice2->Ms0_inverse;
+    st.coefA = coef1;
+    st.faceA = (use_face_coefs ? &face1 : NULL);
+    st.muA = &mu1;
+    st.J0A = &J01;
+    st.J0AB = &J012;
+    st.m_eA = &m_e1; st.m_eB = &m_e2;
+    st.chi_lA = &chi_l1;
+    st.GB = &G2;
     break;
   case Oxs_SimState::LATTICE2:
-    spinA = &(state.spin);
-    spinB = &(state.lattice1->spin);
-    MsA = state.Ms;
-    MsB = state.lattice1->Ms;
-    MsA_inverse = state.Ms_inverse;
-    MsB_inverse = state.lattice1->Ms_inverse;
-    Ms0A_inverse = state.Ms0_inverse;
-    Ms0B_inverse = state.lattice1->Ms0_inverse;
-    coefA = coef2;
-    coefB = coef1;
-    muA = &mu2; muB = &mu1;
-    J0A = &J02;
-    J0AB = &J021;
-    m_eA = &m_e2; m_eB = &m_e1;
-    chi_lA = &chi_l2; chi_lB = &chi_l1;
-    GA = &G2; GB = &G1;
+    st.spinB = &(state.lattice1->spin);
+    st.MsB = state.lattice1->Ms;
+    st.Ms0B_inverse = state.lattice1->Ms0_inverse;
+    st.coefA = coef2;
+    st.faceA = (use_face_coefs ? &face2 : NULL);
+    st.muA = &mu2;
+    st.J0A = &J02;
+    st.J0AB = &J021;
+    st.m_eA = &m_e2; st.m_eB = &m_e1;
+    st.chi_lA = &chi_l2;
+    st.GB = &G1;
     break;
   }
+  st.spinA = &(state.spin);
+  st.MsA = state.Ms;
+  st.MsA_inverse = state.Ms_inverse;
+  st.Ms0A_inverse = state.Ms0_inverse;
+  st.T = state.T;  st.Tc = state.Tc;
+  st.region_id = &region_id;
+  st.ocedt = &ocedt;
+  st.wgtx = -1.0/(mesh->EdgeLengthX()*mesh->EdgeLengthX());
+  st.wgty = -1.0/(mesh->EdgeLengthY()*mesh->EdgeLengthY());
+  st.wgtz = -1.0/(mesh->EdgeLengthZ()*mesh->EdgeLengthZ());
+  st.hcoef_t = -2/MU0;
+}
 
+const Oxs_CommonRectangularMesh*
+YY_2LatExchange6Ngbr::StencilMesh(const Oxs_SimState& state) const
+{
   // Downcast mesh
   const Oxs_CommonRectangularMesh* mesh
     = dynamic_cast<const Oxs_CommonRectangularMesh*>(state.mesh);
@@ -564,7 +817,20 @@ void YY_2LatExchange6Ngbr::CalcEnergyA
       + String("\" is not a rectangular mesh object.");
     throw Oxs_ExtError(msg.c_str());
   }
+  return mesh;
+}
 
+void YY_2LatExchange6Ngbr::SweepA
+(const Oxs_CommonRectangularMesh* mesh,
+ const StencilA& st1,
+ const StencilA* st2,
+ OC_INDEX node_start,
+ OC_INDEX node_stop,
+ YY_2LatBlockSum& energy_sum1,
+ YY_2LatBlockSum& energy_sum2,
+ OC_REAL8m& thread_maxdot1,
+ OC_REAL8m& thread_maxdot2) const
+{
   // If periodic, collect data for distance determination
   // Periodic boundaries?
   int xperiodic=0, yperiodic=0, zperiodic=0;
@@ -582,150 +848,61 @@ void YY_2LatExchange6Ngbr::CalcEnergyA
   OC_INDEX xydim = xdim*ydim;
   OC_INDEX xyzdim = xdim*ydim*zdim;
 
-  OC_REAL8m wgtx = -1.0/(mesh->EdgeLengthX()*mesh->EdgeLengthX());
-  OC_REAL8m wgty = -1.0/(mesh->EdgeLengthY()*mesh->EdgeLengthY());
-  OC_REAL8m wgtz = -1.0/(mesh->EdgeLengthZ()*mesh->EdgeLengthZ());
-
-  OC_REAL8m hcoef_t = -2/MU0;
-
-  Nb_Xpfloat energy_sum = 0;
-  OC_REAL8m thread_maxdot = maxdot[threadnumber];
-  // Note: For maxangle calculation, it suffices to check
-  // spin[j]-spin[i] for j>i.
+  // Note: For maxangle calculation each pair need only be checked
+  // once.  CalcCellA checks the backward (-x,-y,-z) neighbors of each
+  // cell, so every pair is seen once, from its higher-index cell.
 
   OC_INDEX x,y,z;
   mesh->GetCoords(node_start,x,y,z);
 
+  // Wrap logic is resolved once per x-row.  Cells that have all six
+  // neighbors at unit (x) and fixed (y,z) strides, i.e., interior
+  // cells of interior rows, or of every row in directions that are
+  // periodic, take the unchecked CalcCellA<1> path.  Only row ends and
+  // rows on non-periodic y/z faces take the checked path.  With st2
+  // set, each cell is evaluated for both sublattices back to back, so
+  // the neighbor indices and the cell's spins are shared.
   OC_INDEX i = node_start;
   while(i<node_stop) {
     OC_INDEX xstop = xdim;
     if(xdim-x>node_stop-i) xstop = x + (node_stop-i);
-    while(x<xstop) {
-      ThreeVector baseA = (*spinA)[i];
-      ThreeVector baseB = (*spinB)[i];
-      OC_REAL8m MsiA = (*MsA)[i];
-      OC_REAL8m MsiiA = (*MsA_inverse)[i];
-      if(0.0 == MsiiA) {
-        if(ocedt.energy) (*ocedt.energy)[i] = 0.0;
-        if(ocedt.H)      (*ocedt.H)[i].Set(0.,0.,0.);
-        if(ocedt.mxH)    (*ocedt.mxH)[i].Set(0.,0.,0.);
-        ++i;   ++x;
-        continue;
-      }
-      OC_REAL8m* ArowA = coefA[region_id[i]];
-      OC_REAL8m* ArowB = coefB[region_id[i]];
-      OC_REAL8m* ArowAB = coef12[region_id[i]];
-      OC_REAL8m miA = (*MsA)[i]*(*Ms0A_inverse)[i];
-      ThreeVector sum(0.,0.,0.);
-      ThreeVector sum_l(0.,0.,0.);
-
-      {
-        // Exchange with the other sublattice
-        OC_REAL8m LambdaiAA = (1.0+(*GB)[i])/(*chi_lA)[i];
-        OC_REAL8m LambdaiAB = fabs((*m_eB)[i])
-          *fabs((*J0AB)[i])/((*m_eA)[i]*(*muA)[i]*MU0);
-        ThreeVector PB = baseA^baseB;
-        PB ^= baseA;
-        PB *= (*MsB)[i]*(*Ms0B_inverse)[i]; // PB = -nA x (nA x mB)
-        OC_REAL8m tauB = abs(baseB*baseA);  // Dot product
-        tauB *= (*MsB)[i]*(*Ms0B_inverse)[i]; // |tauB| = mB dot nA
-
-        if((*state.T)[i]!=0.0) {
-          OC_REAL8m beta = 1.0/(KB*(*state.T)[i]);
-          OC_REAL8m A_AA = beta*fabs((*J0A)[i]);
-          OC_REAL8m A_AB = beta*fabs((*J0AB)[i]);
-          OC_REAL8m B = Langevin(A_AA*miA+A_AB*tauB);
-          OC_REAL8m dB = LangevinDeriv(A_AA*miA+A_AB*tauB);
-          if( (*state.T)[i]<(*state.Tc)[i] || 1-B/miA>0 ) {
-            // This condition prevents unstable bursts of spin polarizations
-            // when m ~ 0.
-            sum_l -= (1-B/miA)/(MU0*(*muA)[i]*beta*dB)*baseA;
-          }
-        }
 
-        sum += (*J0AB)[i]/(*muA)[i]*PB;
-        sum *= -0.5*MsiA;  // This will be divided by MsiA at the end.
-      }
+    const OC_INDEX dzm = (z>0 ? -xydim : xyzdim-xydim);
+    const OC_INDEX dym = (y>0 ? -xdim : xydim-xdim);
+    const OC_INDEX dyp = (y<ydim-1 ? xdim : xdim-xydim);
+    const OC_INDEX dzp = (z<zdim-1 ? xydim : xydim-xyzdim);
+    const OC_BOOL hzm = (z>0 || zperiodic);
+    const OC_BOOL hym = (y>0 || yperiodic);
+    const OC_BOOL hyp = (y<ydim-1 || yperiodic);
+    const OC_BOOL hzp = (z<zdim-1 || zperiodic);
+    const OC_BOOL full_row = (hzm && hym && hyp && hzp);
+    const OC_INDEX xin = (xstop<xdim-1 ? xstop : xdim-1);
 
-      if(z>0 || zperiodic) {
-        OC_INDEX j = i-xydim;
-        if(z==0) j += xyzdim;
-        OC_REAL8m ApairA = ArowA[region_id[j]];
-        if(ApairA!=0 && (*MsA_inverse)[j]!=0.0) {
-          ThreeVector diffA = ((*MsA)[j]*(*Ms0A_inverse)[j]*(*spinA)[j] 
-              - miA*baseA);
-          OC_REAL8m dot = diffA.MagSq();
-          sum += ApairA*wgtz*diffA;
-          if(dot>thread_maxdot) thread_maxdot = dot;
-        }
-      }
-      if(y>0 || yperiodic) {
-        OC_INDEX j = i-xdim;
-        if(y==0) j += xydim;
-        OC_REAL8m ApairA = ArowA[region_id[j]];
-        if(ApairA!=0.0 && (*MsA_inverse)[j]!=0.0) {
-          ThreeVector diffA = ((*MsA)[j]*(*Ms0A_inverse)[j]*(*spinA)[j] 
-              - miA*baseA);
-          OC_REAL8m dot = diffA.MagSq();
-          sum += ApairA*wgty*diffA;
-          if(dot>thread_maxdot) thread_maxdot = dot;
-        }
-      }
-      if(x>0 || xperiodic) {
-        OC_INDEX j = i-1;
-        if(x==0) j += xdim;
-        OC_REAL8m ApairA = ArowA[region_id[j]];
-        if(ApairA!=0.0 && (*MsA_inverse)[j]!=0.0) {
-          ThreeVector diffA = ((*MsA)[j]*(*Ms0A_inverse)[j]*(*spinA)[j] 
-              - miA*baseA);
-          OC_REAL8m dot = diffA.MagSq();
-          sum += ApairA*wgtx*diffA;
-          if(dot>thread_maxdot) thread_maxdot = dot;
-        }
-      }
-      if(x<xdim-1 || xperiodic) {
-        OC_INDEX j = i+1;
-        if(x==xdim-1) j -= xdim;
-        OC_REAL8m ApairA = ArowA[region_id[j]];
-        if((*MsA_inverse)[j]!=0.0) {
-          sum += ApairA*wgtx*( (*MsA)[j]*(*Ms0A_inverse)[j]*(*spinA)[j] 
-              - miA*baseA );
-        }
-      }
-      if(y<ydim-1 || yperiodic) {
-        OC_INDEX j = i+xdim;
-        if(y==ydim-1) j -= xydim;
-        OC_REAL8m ApairA = ArowA[region_id[j]];
-        if((*MsA_inverse)[j]!=0.0) {
-          sum += ApairA*wgty*( (*MsA)[j]*(*Ms0A_inverse)[j]*(*spinA)[j] 
-              - miA*baseA );
+    while(x<xstop) {
+      if(full_row && x>0 && x<xin) {
+        for(;x<xin;++x,++i) {
+          CalcCellA<1>(st1,i,i+dzm,i+dym,i-1,i+1,i+dyp,i+dzp,
+                       energy_sum1,thread_maxdot1);
+          if(st2) {
+            CalcCellA<1>(*st2,i,i+dzm,i+dym,i-1,i+1,i+dyp,i+dzp,
+                         energy_sum2,thread_maxdot2);
+          }
         }
+        continue;
       }
-      if(z<zdim-1 || zperiodic) {
-        OC_INDEX j = i+xydim;
-        if(z==zdim-1) j -= xyzdim;
-        OC_REAL8m ApairA = ArowA[region_id[j]];
-        if((*MsA_inverse)[j]!=0.0) {
-          sum += ApairA*wgtz*( (*MsA)[j]*(*Ms0A_inverse)[j]*(*spinA)[j] 
-              - miA*baseA );
-        }
+      OC_INDEX jxm = -1, jxp = -1;
+      if(x>0 || xperiodic)      jxm = (x>0 ? i-1 : i-1+xdim);
+      if(x<xdim-1 || xperiodic) jxp = (x<xdim-1 ? i+1 : i+1-xdim);
+      const OC_INDEX jzm = (hzm ? i+dzm : -1);
+      const OC_INDEX jym = (hym ? i+dym : -1);
+      const OC_INDEX jyp = (hyp ? i+dyp : -1);
+      const OC_INDEX jzp = (hzp ? i+dzp : -1);
+      CalcCellA<0>(st1,i,jzm,jym,jxm,jxp,jyp,jzp,
+                   energy_sum1,thread_maxdot1);
+      if(st2) {
+        CalcCellA<0>(*st2,i,jzm,jym,jxm,jxp,jyp,jzp,
+                     energy_sum2,thread_maxdot2);
       }
-
-      OC_REAL8m ei = baseA.x*sum.x + baseA.y*sum.y + baseA.z*sum.z;
-      OC_REAL8m hmult = hcoef_t*MsiiA;
-      sum.x *= hmult;  sum.y *= hmult;   sum.z *= hmult;
-      sum += sum_l;
-      OC_REAL8m tx = baseA.y*sum.z - baseA.z*sum.y;
-      OC_REAL8m ty = baseA.z*sum.x - baseA.x*sum.z;
-      OC_REAL8m tz = baseA.x*sum.y - baseA.y*sum.x;
-
-      energy_sum += ei;
-      if(ocedt.energy)       (*ocedt.energy)[i] = ei;
-      if(ocedt.energy_accum) (*ocedt.energy_accum)[i] += ei;
-      if(ocedt.H)       (*ocedt.H)[i] = sum;
-      if(ocedt.H_accum) (*ocedt.H_accum)[i] += sum;
-      if(ocedt.mxH)       (*ocedt.mxH)[i] = ThreeVector(tx,ty,tz);
-      if(ocedt.mxH_accum) (*ocedt.mxH_accum)[i] += ThreeVector(tx,ty,tz);
       ++i;   ++x;
     }
     x=0;
@@ -734,6 +911,27 @@ void YY_2LatExchange6Ngbr::CalcEnergyA
       ++z;
     }
   }
+}
+
+void YY_2LatExchange6Ngbr::CalcEnergyA
+(const Oxs_SimState& state,
+ Oxs_ComputeEnergyDataThreaded& ocedt,
+ Oxs_ComputeEnergyDataThreadedAux& ocedtaux,
+ OC_INDEX node_start,
+ OC_INDEX node_stop,
+ int threadnumber
+ ) const
+{
+  const Oxs_CommonRectangularMesh* mesh = StencilMesh(state);
+  StencilA st;
+  SetupStencilA(state,mesh,ocedt,st);
+
+  YY_2LatBlockSum energy_sum, unused_sum;
+  vector<OC_REAL8m>& maxdot = MaxDot(state);
+  OC_REAL8m thread_maxdot = maxdot[threadnumber];
+  OC_REAL8m unused_maxdot = 0.0;
+  SweepA(mesh,st,NULL,node_start,node_stop,
+         energy_sum,unused_sum,thread_maxdot,unused_maxdot);
 
   ocedtaux.energy_total_accum += energy_sum.GetValue() * mesh->Volume(0);
   /// All cells have same volume in an Oxs_RectangularMesh.
@@ -741,6 +939,45 @@ void YY_2LatExchange6Ngbr::CalcEnergyA
   maxdot[threadnumber] = thread_maxdot;
 }
 
+void YY_2LatExchange6Ngbr::CalcEnergyPairA
+(const Oxs_SimState& state1,
+ const Oxs_SimState& state2,
+ Oxs_ComputeEnergyDataThreaded& ocedt1,
+ Oxs_ComputeEnergyDataThreaded& ocedt2,
+ Oxs_ComputeEnergyDataThreadedAux& ocedtaux1,
+ Oxs_ComputeEnergyDataThreadedAux& ocedtaux2,
+ OC_INDEX node_start,
+ OC_INDEX node_stop,
+ int threadnumber
+ ) const
+{
+  const Oxs_CommonRectangularMesh* mesh = StencilMesh(state1);
+  StencilA st1, st2;
+  SetupStencilA(state1,mesh,ocedt1,st1);
+  SetupStencilA(state2,mesh,ocedt2,st2);
+
+  YY_2LatBlockSum energy_sum1, energy_sum2;
+  vector<OC_REAL8m>& maxdotA = MaxDot(state1);
+  vector<OC_REAL8m>& maxdotB = MaxDot(state2);
+  OC_REAL8m thread_maxdot1 = maxdotA[threadnumber];
+  OC_REAL8m thread_maxdot2 = maxdotB[threadnumber];
+  SweepA(mesh,st1,&st2,node_start,node_stop,
+         energy_sum1,energy_sum2,thread_maxdot1,thread_maxdot2);
+
+  ocedtaux1.energy_total_accum += energy_sum1.GetValue() * mesh->Volume(0);
+  ocedtaux2.energy_total_accum += energy_sum2.GetValue() * mesh->Volume(0);
+  /// All cells have same volume in an Oxs_RectangularMesh.
+
+  maxdotA[threadnumber] = thread_maxdot1;
+  maxdotB[threadnumber] = thread_maxdot2;
+}
+
+vector<OC_REAL8m>&
+YY_2LatExchange6Ngbr::MaxDot(const Oxs_SimState& state) const
+{
+  if(state.lattice_type == Oxs_SimState::LATTICE2) return maxdot2;
+  return maxdot1;
+}
 
 void YY_2LatExchange6Ngbr::ComputeEnergyChunkInitialize
 (const Oxs_SimState& state, // One of the sublattice states
@@ -756,14 +993,17 @@ void YY_2LatExchange6Ngbr::ComputeEnergyChunkInitialize
     const OC_INDEX size = mesh->Size();
     Tc1.AdjustSize(mesh);
     Tc2.AdjustSize(mesh);
-    J01_init->FillMeshValue(mesh,J01);
-    J02_init->FillMeshValue(mesh,J02);
-    J012_init->FillMeshValue(mesh,J012);
-    J021_init->FillMeshValue(mesh,J021);
-    mu1_init->FillMeshValue(mesh,mu1);
-    mu2_init->FillMeshValue(mesh,mu2);
+    YY_2LatFillMeshValue(J01_init.GetPtr(),mesh,J01);
+    YY_2LatFillMeshValue(J02_init.GetPtr(),mesh,J02);
+    YY_2LatFillMeshValue(J012_init.GetPtr(),mesh,J012);
+    YY_2LatFillMeshValue(J021_init.GetPtr(),mesh,J021);
+    YY_2LatFillMeshValue(mu1_init.GetPtr(),mesh,mu1);
+    YY_2LatFillMeshValue(mu2_init.GetPtr(),mesh,mu2);
     m_e1.AdjustSize(mesh);
     m_e2.AdjustSize(mesh);
+    m_e1 = 0.0; // No warm start for the first m_e solve
+    m_e2 = 0.0;
+    m_e_T.AdjustSize(mesh);
     chi_l1.AdjustSize(mesh);
     chi_l2.AdjustSize(mesh);
     G1.AdjustSize(mesh);
@@ -800,15 +1040,44 @@ void YY_2LatExchange6Ngbr::ComputeEnergyChunkInitialize
     Update_m_e(*(state.total_lattice), 1e-4);
   }
 
+  // Sublattice 1 state of this evaluation; carries T and its log
+  const Oxs_SimState& tstate = *(state.total_lattice->lattice1);
   if(state.stage_number != last_stage_number) { // New stage
     last_stage_number = state.stage_number;
     Update_m_e(*(state.total_lattice), 1e-4);
+  } else if(tstate.T_update_count
+            && *(tstate.T_update_count) != m_e_T_count) {
+    // Temperature may also change inside a stage (evolver
+    // temperature_pulses).  Re-solve only the cells whose T moved.
+    // Those are listed by the evolver if this is the only update since
+    // the last solve; otherwise (missed updates, or a full rewrite of
+    // T) they are found by comparison with m_e_T.
+    const vector<OC_INDEX>& changed = *(tstate.T_changed);
+    if(*(tstate.T_update_count) == m_e_T_count+1 && !changed.empty()) {
+      Update_m_e(*(state.total_lattice), 1e-4, &changed);
+    } else {
+      const Oxs_MeshValue<OC_REAL8m>& T = *(tstate.T);
+      const OC_INDEX size = state.mesh->Size();
+      m_e_cells.clear();
+      for(OC_INDEX i=0;i<size;++i) {
+        if(T[i] != m_e_T[i]) m_e_cells.push_back(i);
+      }
+      if(!m_e_cells.empty()) {
+        Update_m_e(*(state.total_lattice), 1e-4, &m_e_cells);
+      }
+    }
+  }
+  m_e_T_count = (tstate.T_update_count ? *(tstate.T_update_count) : 0);
+
+  // chi_l depends on instantaneous magnetization so calculate it at
+  // each step.  It covers both sublattices, so the Initialize call for
+  // the other sublattice of the same state skips it.
+  if(chi_l_state_id != state.total_lattice->Id()) {
+    Update_chi_l(*(state.total_lattice));
+    chi_l_state_id = state.total_lattice->Id();
   }
 
-  // chi_l depends on instantaneous magnetization 
-  // so calculate it at each step
-  Update_chi_l(*(state.total_lattice));
-
+  vector<OC_REAL8m>& maxdot = MaxDot(state);
   if(maxdot.size() != (vector<OC_REAL8m>::size_type)number_of_threads) {
     maxdot.resize(number_of_threads);
   }
@@ -825,6 +1094,7 @@ void YY_2LatExchange6Ngbr::ComputeEnergyChunkFinalize
  int number_of_threads) const
 {
   // Set max angle data
+  const vector<OC_REAL8m>& maxdot = MaxDot(state);
   OC_REAL8m total_maxdot = 0.0;
   for(int i=0;i<number_of_threads;++i) {
     if(maxdot[i]>total_maxdot) total_maxdot = maxdot[i];
@@ -917,25 +1187,16 @@ void YY_2LatExchange6Ngbr::ComputeEnergyChunkFinalize
 }
 
 
-void YY_2LatExchange6Ngbr::ComputeEnergyChunk
+OC_BOOL YY_2LatExchange6Ngbr::PrepareChunk
 (const Oxs_SimState& state,
- Oxs_ComputeEnergyDataThreaded& ocedt,
- Oxs_ComputeEnergyDataThreadedAux& ocedtaux,
- OC_INDEX node_start,
- OC_INDEX node_stop,
  int threadnumber
  ) const
-{
-#ifndef NDEBUG
-  if(node_stop>state.mesh->Size() || node_start>node_stop) {
-    throw Oxs_ExtError(this,"Programming error:"
-                       " Invalid node_start/node_stop values");
-  }
-#endif
-
+{ // Region (and face coefficient) setup, run by the main thread when
+  // the mesh or atlas changes.  Returns 0 if there is nothing to do or
+  // setup failed in another thread.
   const OC_INDEX size = state.mesh->Size();
   if(size<1) {
-    return;
+    return 0;
   }
 
   if(mesh_id !=  state.mesh->Id() || !atlaskey.SameState()) {
@@ -952,7 +1213,7 @@ void YY_2LatExchange6Ngbr::ComputeEnergyChunk
         thread_control.Notify();
       }
       thread_control.Unlock();
-      return; // What else?
+      return 0; // What else?
     }
     if(threadnumber != 0) {
       if(mesh_id != state.mesh->Id() || !atlaskey.SameState()) {
@@ -984,7 +1245,7 @@ void YY_2LatExchange6Ngbr::ComputeEnergyChunk
         }
         thread_control.Unlock();
         if(condcheckerror || Oxs_ThreadError::IsError()) {
-          return; // What else?
+          return 0; // What else?
         }
       } else {
         if(thread_control.count>0) {
@@ -1015,6 +1276,7 @@ void YY_2LatExchange6Ngbr::ComputeEnergyChunk
             throw Oxs_ExtError(msg.c_str());
           }
         }
+        if(use_face_coefs) FillFaceCoefs(state.mesh);
         atlaskey.Set(atlas.GetPtr());
         mesh_id = state.mesh->Id();
       } catch(Oxs_ExtError& err) {
@@ -1068,6 +1330,26 @@ void YY_2LatExchange6Ngbr::ComputeEnergyChunk
       thread_control.Unlock();
     }
   }
+  return 1;
+}
+
+void YY_2LatExchange6Ngbr::ComputeEnergyChunk
+(const Oxs_SimState& state,
+ Oxs_ComputeEnergyDataThreaded& ocedt,
+ Oxs_ComputeEnergyDataThreadedAux& ocedtaux,
+ OC_INDEX node_start,
+ OC_INDEX node_stop,
+ int threadnumber
+ ) const
+{
+#ifndef NDEBUG
+  if(node_stop>state.mesh->Size() || node_start>node_stop) {
+    throw Oxs_ExtError(this,"Programming error:"
+                       " Invalid node_start/node_stop values");
+  }
+#endif
+
+  if(!PrepareChunk(state,threadnumber)) return;
   if(excoeftype == LEX_TYPE) {
     //CalcEnergyLex(state,ocedt,ocedtaux,node_start,node_stop,threadnumber);
   } else {
@@ -1075,29 +1357,255 @@ void YY_2LatExchange6Ngbr::ComputeEnergyChunk
   }
 }
 
+void YY_2LatExchange6Ngbr::ComputeEnergyPairChunk
+(const Oxs_SimState& state1,
+ const Oxs_SimState& state2,
+ Oxs_ComputeEnergyDataThreaded& ocedt1,
+ Oxs_ComputeEnergyDataThreaded& ocedt2,
+ Oxs_ComputeEnergyDataThreadedAux& ocedtaux1,
+ Oxs_ComputeEnergyDataThreadedAux& ocedtaux2,
+ OC_INDEX node_start,
+ OC_INDEX node_stop,
+ int threadnumber
+ ) const
+{
+#ifndef NDEBUG
+  if(node_stop>state1.mesh->Size() || node_start>node_stop) {
+    throw Oxs_ExtError(this,"Programming error:"
+                       " Invalid node_start/node_stop values");
+  }
+#endif
+  // The sublattice states share the mesh, so one PrepareChunk covers
+  // both.
+  if(!PrepareChunk(state1,threadnumber)) return;
+  if(excoeftype == LEX_TYPE) {
+    //CalcEnergyLex(...);
+  } else {
+    CalcEnergyPairA(state1,state2,ocedt1,ocedt2,ocedtaux1,ocedtaux2,
+                    node_start,node_stop,threadnumber);
+  }
+}
+
+void YY_2LatExchange6Ngbr::AccumStiffness
+(const Oxs_SimState& state, // Sublattice state
+ Oxs_MeshValue<OC_REAL8m>& kt,
+ Oxs_MeshValue<OC_REAL8m>& kl) const
+{
+  const Oxs_CommonRectangularMesh* mesh = StencilMesh(state);
+  if(mesh_id != mesh->Id() || !chi_l1.CheckMesh(mesh)) {
+    return; // Not evaluated on this mesh yet
+  }
+  const OC_BOOL lat1 = (state.lattice_type != Oxs_SimState::LATTICE2);
+  const Oxs_SimState& stateB = *(lat1 ? state.lattice2 : state.lattice1);
+  OC_REAL8m** coefA = (lat1 ? coef1 : coef2);
+  const Oxs_MeshValue<ThreeVector>* faceA
+    = (use_face_coefs ? (lat1 ? &face1 : &face2) : NULL);
+  const Oxs_MeshValue<OC_REAL8m>& muA = (lat1 ? mu1 : mu2);
+  const Oxs_MeshValue<OC_REAL8m>& J0AB = (lat1 ? J012 : J021);
+  const Oxs_MeshValue<OC_REAL8m>& chi_lA = (lat1 ? chi_l1 : chi_l2);
+  const Oxs_MeshValue<OC_REAL8m>& MsA = *(state.Ms);
+  const Oxs_MeshValue<OC_REAL8m>& Ms0A_inverse = *(state.Ms0_inverse);
+  const Oxs_MeshValue<OC_REAL8m>& MsB = *(stateB.Ms);
+  const Oxs_MeshValue<OC_REAL8m>& Ms0B_inverse = *(stateB.Ms0_inverse);
+  const Oxs_MeshValue<OC_REAL8m>& T = *(state.total_lattice->lattice1->T);
+
+  int xperiodic=0, yperiodic=0, zperiodic=0;
+  const Oxs_PeriodicRectangularMesh* pmesh
+    = dynamic_cast<const Oxs_PeriodicRectangularMesh*>(mesh);
+  if(pmesh!=NULL) {
+    xperiodic = pmesh->IsPeriodicX();
+    yperiodic = pmesh->IsPeriodicY();
+    zperiodic = pmesh->IsPeriodicZ();
+  }
+  const OC_INDEX xdim = mesh->DimX();
+  const OC_INDEX ydim = mesh->DimY();
+  const OC_INDEX zdim = mesh->DimZ();
+  const OC_INDEX xydim = xdim*ydim;
+  const OC_REAL8m wgt[3] = {
+    1.0/(mesh->EdgeLengthX()*mesh->EdgeLengthX()),
+    1.0/(mesh->EdgeLengthY()*mesh->EdgeLengthY()),
+    1.0/(mesh->EdgeLengthZ()*mesh->EdgeLengthZ())
+  };
+
+  // Exchange: with cell i and its neighbors j turning in antiphase, the
+  // field of i changes by 2/(MU0*Ms_i) sum_j A_ij/d^2 (m_i+m_j) per
+  // radian.  Each +x, +y, +z pair is visited once and credits both
+  // cells.
+  OC_INDEX i = 0;
+  for(OC_INDEX z=0;z<zdim;++z) {
+    for(OC_INDEX y=0;y<ydim;++y) {
+      for(OC_INDEX x=0;x<xdim;++x,++i) {
+        if(MsA[i]==0.0) continue;
+        const OC_REAL8m mi = MsA[i]*Ms0A_inverse[i];
+        for(int dir=0;dir<3;++dir) {
+          OC_INDEX j;
+          if(dir==0) {
+            if(x+1<xdim)       j = i+1;
+            else if(xperiodic) j = i+1-xdim;
+            else continue;
+          } else if(dir==1) {
+            if(y+1<ydim)       j = i+xdim;
+            else if(yperiodic) j = i+xdim-xydim;
+            else continue;
+          } else {
+            if(z+1<zdim)       j = i+xydim;
+            else if(zperiodic) j = i+xydim-xydim*zdim;
+            else continue;
+          }
+          if(j==i || MsA[j]==0.0) continue;
+          OC_REAL8m A;
+          if(faceA) {
+            const ThreeVector& f = (*faceA)[i];
+            A = (dir==0 ? f.x : (dir==1 ? f.y : f.z));
+          } else {
+            A = coefA[region_id[i]][region_id[j]];
+          }
+          const OC_REAL8m mj = MsA[j]*Ms0A_inverse[j];
+          const OC_REAL8m k = (2.0/MU0)*fabs(A)*wgt[dir]*(mi+mj);
+          kt[i] += k/MsA[i];
+          kt[j] += k/MsA[j];
+        }
+      }
+    }
+  }
+
+  const OC_INDEX size = mesh->Size();
+  for(i=0;i<size;++i) {
+    if(MsA[i]==0.0 || muA[i]==0.0) continue;
+    // Inter-sublattice: the field J0AB/(MU0*muA) times the part of m_B
+    // transverse to m_A, which turns at twice the rate in antiphase.
+    const OC_REAL8m mB = MsB[i]*Ms0B_inverse[i];
+    kt[i] += 2*fabs(J0AB[i])*mB/(MU0*muA[i]);
+    // Longitudinal: near m_e the field changes by 1/(m*chi_l) per unit
+    // of m.  No longitudinal field at T = 0.
+    const OC_REAL8m mi = MsA[i]*Ms0A_inverse[i];
+    if(T[i]!=0.0 && chi_lA[i]!=0.0) {
+      kl[i] += 1.0/fabs(mi*chi_lA[i]);
+    }
+  }
+}
+
+OC_BOOL YY_2LatExchange6Ngbr::M_eNewtonStep(
+    OC_REAL8m A11,OC_REAL8m A12,
+    OC_REAL8m A21,OC_REAL8m A22,
+    OC_REAL8m& x1,OC_REAL8m& x2) const
+{
+  OC_REAL8m L1, L2, dL1, dL2;
+  LangevinPair(A11*x1+A12*x2,L1,dL1);
+  LangevinPair(A21*x1+A22*x2,L2,dL2);
+  const OC_REAL8m y1 = L1-x1;
+  const OC_REAL8m y2 = L2-x2;
+  // Jacobian
+  const OC_REAL8m J11 = A11*dL1-1;
+  const OC_REAL8m J12 = A12*dL1;
+  const OC_REAL8m J21 = A21*dL2;
+  const OC_REAL8m J22 = A22*dL2-1;
+  const OC_REAL8m det = J11*J22-J12*J21;
+  if(det == 0.0) {
+    // No more change. Calculate parameters with current x1, x2.
+    return 1;
+  }
+  const OC_REAL8m deti = 1.0/det;
+  const OC_REAL8m dx1 = -deti*(J22*y1-J12*y2);
+  const OC_REAL8m dx2 = -deti*(-J21*y1+J11*y2);
+  x1 += dx1;
+  x2 += dx2;
+  return (dx1*dx1<=tolsq && dx2*dx2<=tolsq);
+}
+
 void YY_2LatExchange6Ngbr::Update_m_e(
     const Oxs_SimState& state,  // Total lattice state
-    OC_REAL8m tol_in = 1e-4) const
+    OC_REAL8m tol_in,
+    const vector<OC_INDEX>* cells) const
 {
   // Solve for the equilibrium spin polarization m_e using 2 variable
   // Newton method.
-  const OC_REAL8m size = state.mesh->Size();
+  //   All cells are solved together: each sweep applies one Newton
+  // step to every cell still in the active list, then drops the
+  // converged ones, so there is no data-dependent inner loop.  Cells
+  // that were ordered (both m_e > tol) at the previous solve start
+  // from that m_e; for the few Kelvin steps of a typical temperature
+  // ramp this is within a couple of steps of the new root.  Other
+  // cells start from 0.8.  Sweeps are capped at m_e_newton_limit; a
+  // warm-started cell that has not converged by then is retried from
+  // 0.8, in case the previous root was a poor guess.
+  //   If cells is non-null, only the listed cells are solved (and have
+  // their Tc updated); the rest keep their current values.
+  const OC_INDEX size = state.mesh->Size();
+  const OC_INDEX count
+    = (cells ? static_cast<OC_INDEX>(cells->size()) : size);
   tol = fabs(tol_in);
   tolsq = tol_in*tol_in;
+  chi_l_state_id = 0; // T moved, so chi_l is stale even for this state
 
   Oxs_MeshValue<OC_REAL8m>& Ms1 = *(state.lattice1->Ms);
   Oxs_MeshValue<OC_REAL8m>& Ms2 = *(state.lattice2->Ms);
   Oxs_MeshValue<OC_REAL8m>& Ms01_inverse = *(state.lattice1->Ms0_inverse);
   Oxs_MeshValue<OC_REAL8m>& Ms02_inverse = *(state.lattice2->Ms0_inverse);
+  const Oxs_MeshValue<OC_REAL8m>& T = *(state.lattice1->T);
+
+  // Coefficients and iterates for the active set, by list position k
+  vector<OC_REAL8m>& A = m_e_A;
+  vector<OC_REAL8m>& x1 = m_e_x1;
+  vector<OC_REAL8m>& x2 = m_e_x2;
+  vector<OC_INDEX>& active = m_e_active;
+  vector<OC_INDEX>& retry = m_e_retry;
+  A.resize(4*count);
+  x1.resize(count);  x2.resize(count);
+  active.clear();
+  active.reserve(count);
+
+  OC_INDEX k;
+  for(k=0; k<count; k++) {
+    const OC_INDEX i = (cells ? (*cells)[k] : k);
+    const OC_REAL8m kB_T = KB*T[i];
+    if(kB_T == 0) continue;
+    const OC_REAL8m beta = 1.0/kB_T;
+    A[4*k]   = beta*J01[i];
+    A[4*k+1] = beta*fabs(J012[i]);
+    A[4*k+2] = beta*fabs(J021[i]);
+    A[4*k+3] = beta*J02[i];
+    if(m_e1[i]>tol && m_e2[i]>tol) {
+      x1[k] = m_e1[i]; x2[k] = m_e2[i];
+    } else {
+      x1[k] = 0.8; x2[k] = 0.8;
+    }
+    active.push_back(k);
+  }
 
-  OC_REAL8m A11, A12, A21, A22;
-  OC_REAL8m x10, x20, y10, y20;
-  OC_REAL8m x1, x2, y1, y2;
-  OC_REAL8m dx1, dx2, dy1, dy2;
-  OC_REAL8m dL1, dL2;
-  OC_REAL8m J11, J12, J21, J22, det, deti;
-  for(OC_INDEX i=0; i<size; i++) {
-    const OC_REAL8m kB_T = KB*(*(state.lattice1->T))[i];
+  OC_INDEX unconverged_count = 0;
+  for(int pass=0;pass<2 && !active.empty();++pass) {
+    for(OC_INT4m sweep=0;
+        sweep<m_e_newton_limit && !active.empty();++sweep) {
+      size_t keep = 0;
+      for(size_t n=0;n<active.size();++n) {
+        const OC_INDEX j = active[n];
+        const OC_REAL8m* Aj = &(A[4*j]);
+        if(!M_eNewtonStep(Aj[0],Aj[1],Aj[2],Aj[3],x1[j],x2[j])) {
+          active[keep++] = j;
+        }
+      }
+      active.resize(keep);
+    }
+    // Retry warm-started cells from a cold start; give up on the rest.
+    retry.clear();
+    for(size_t n=0;n<active.size();++n) {
+      const OC_INDEX j = active[n];
+      const OC_INDEX i = (cells ? (*cells)[j] : j);
+      if(pass==0 && m_e1[i]>tol && m_e2[i]>tol) {
+        x1[j] = 0.8; x2[j] = 0.8;
+        retry.push_back(j);
+      } else {
+        ++unconverged_count;
+      }
+    }
+    active.swap(retry);
+  }
+
+  for(k=0; k<count; k++) {
+    const OC_INDEX i = (cells ? (*cells)[k] : k);
+    m_e_T[i] = T[i];
+    const OC_REAL8m kB_T = KB*T[i];
     if(kB_T == 0) {
       m_e1[i]=1.0;
       m_e2[i]=1.0;
@@ -1106,39 +1614,8 @@ void YY_2LatExchange6Ngbr::Update_m_e(
       Tc2[i] = (J02[i]+fabs(J021[i]))/(3*KB);
       continue;
     }
-    const OC_REAL8m beta = 1.0/kB_T;
-    A11 = beta*J01[i];
-    A12 = beta*fabs(J012[i]);
-    A21 = beta*fabs(J021[i]);
-    A22 = beta*J02[i];
-
-    x1 = 0.8; x2 = 0.8;
-    y1 = Langevin(A11*x1+A12*x2)-x1;
-    y2 = Langevin(A21*x1+A22*x2)-x2;
-    do {
-      x10 = x1; x20 = x2; y10 = y1; y20 = y2;
-      dL1 = LangevinDeriv(A11*x1+A12*x2);
-      dL2 = LangevinDeriv(A21*x1+A22*x2);
-      // Jacobian
-      J11 = A11*dL1-1;
-      J12 = A12*dL1;
-      J21 = A21*dL2;
-      J22 = A22*dL2-1;
-      det = J11*J22-J12*J21;
-      if(det == 0.0) {
-        // No more change. Calculate parameters with current x1, x2.
-        break;
-      }
-      deti = 1.0/det;
-      dx1 = -deti*(J22*y1-J12*y2);
-      dx2 = -deti*(-J21*y1+J11*y2);
-      x1 = x10 + dx1;
-      x2 = x20 + dx2;
-      y1 = Langevin(A11*x1+A12*x2)-x1;
-      y2 = Langevin(A21*x1+A22*x2)-x2;
-    } while( dx1*dx1>tolsq || dx2*dx2>tolsq );
-    m_e1[i] = x1>tol ? x1 : 0.0;
-    m_e2[i] = x2>tol ? x2 : 0.0;
+    m_e1[i] = x1[k]>tol ? x1[k] : 0.0;
+    m_e2[i] = x2[k]>tol ? x2[k] : 0.0;
 
     OC_REAL8m m1 = Ms1[i]*Ms01_inverse[i];
     OC_REAL8m m2 = Ms2[i]*Ms02_inverse[i];
@@ -1154,6 +1631,28 @@ void YY_2LatExchange6Ngbr::Update_m_e(
       Tc2[i] = 2*a/( 3*KB*b*( sqrt(1+4*a/(b*b))-1 ) );
     }
   }
+
+  if(!cells) {
+    // Full solves run once per stage; don't hold mesh-sized scratch
+    // in between.
+    vector<OC_REAL8m>().swap(m_e_A);
+    vector<OC_REAL8m>().swap(m_e_x1);
+    vector<OC_REAL8m>().swap(m_e_x2);
+    vector<OC_INDEX>().swap(m_e_active);
+    vector<OC_INDEX>().swap(m_e_retry);
+  }
+
+  if(unconverged_count>0) {
+    static Oxs_WarningMessage nonconvergence(3);
+    char buf[1024];
+    Oc_Snprintf(buf,sizeof(buf),
+                "Equilibrium magnetization m_e did not converge to"
+                " tolerance %g in %d Newton iterations in %ld cells.",
+                static_cast<double>(tol),
+                static_cast<int>(m_e_newton_limit),
+                static_cast<long>(unconverged_count));
+    nonconvergence.Send(revision_info,OC_STRINGIFY(__LINE__),buf);
+  }
 }
 
 OC_REAL8m YY_2LatExchange6Ngbr::Langevin(OC_REAL8m x) const
@@ -1172,6 +1671,35 @@ OC_REAL8m YY_2LatExchange6Ngbr::LangevinDeriv(OC_REAL8m x) const
   return -1.0/(temp*temp)+1.0/(x*x);
 }
 
+void YY_2LatExchange6Ngbr::LangevinPair(OC_REAL8m x,
+                                        OC_REAL8m& L,OC_REAL8m& dL) const
+{
+  // L(x) = coth(x)-1/x and L'(x) = 1/x^2-(coth(x)^2-1), from a single
+  // exp() evaluation.  Same large-x limits as Langevin and
+  // LangevinDeriv.  Near x = 0 both forms cancel badly (L' is off by
+  // tens of percent at x ~ 1e-5), so small arguments, which occur for
+  // m near 0 close to Tc, use the Taylor series instead; the truncation
+  // error is below 1e-15 for |x| < 0.1.
+  if(fabs(x)<0.1) {
+    const OC_REAL8m x2 = x*x;
+    L = x*(1./3. + x2*(-1./45. + x2*(2./945.
+                                     + x2*(-1./4725. + x2*(2./93555.)))));
+    dL = 1./3. + x2*(-1./15. + x2*(2./189.
+                                   + x2*(-1./675. + x2*(2./10395.))));
+    return;
+  }
+  OC_REAL8m temp = exp(2*x)+1;
+  if(!Nb_IsFinite(temp)) { // Large input
+    L = (x>0 ? 1.0 : -1.0);
+    dL = 1.0/(x*x);
+    return;
+  }
+  OC_REAL8m coth = temp/(temp-2);
+  OC_REAL8m x_inverse = 1.0/x;
+  L = coth - x_inverse;
+  dL = x_inverse*x_inverse - (coth*coth-1.0);
+}
+
 void YY_2LatExchange6Ngbr::Update_chi_l(const Oxs_SimState& state) const
 {
   const OC_REAL8m size = state.mesh->Size();
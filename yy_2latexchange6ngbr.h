@@ -23,6 +23,8 @@
 #ifndef _YY_2LATEXCHANGE6NGBR
 #define _YY_2LATEXCHANGE6NGBR
 
+#include <map>
+
 #include "atlas.h"
 #include "key.h"
 #include "chunkenergy.h"
@@ -33,11 +35,17 @@
 #include "threevector.h"
 #include "rectangularmesh.h"
 
+#include "yy_2lat_util.h"
+
 /* End includes */
 
+class YY_2LatBlockSum; // Forward references
+
 #define DEFAULT_M_E_TOL 1e-4
 
-class YY_2LatExchange6Ngbr : public Oxs_ChunkEnergy {
+class YY_2LatExchange6Ngbr
+  : public Oxs_ChunkEnergy, public YY_2LatPairChunkEnergy,
+    public YY_2LatStiffnessEnergy {
 private:
   enum ExchangeCoefType {
     A_UNKNOWN, A_TYPE, LEX_TYPE
@@ -47,20 +55,75 @@ private:
   OC_REAL8m** coef1;
   OC_REAL8m** coef2;
   OC_REAL8m** coef12;
+
+  // With many atlas regions (e.g., Voronoi grains) the dense
+  // coef_size x coef_size tables above are not allocated.  Instead the
+  // listed pairs are kept in maps, keyed by i1*coef_size+i2, and the
+  // stencil reads per-cell coefficients of the +x, +y and +z faces,
+  // face1 and face2, built from the maps once per mesh.  Memory then
+  // scales with cells rather than regions squared.
+  OC_BOOL use_face_coefs;
+  OC_REAL8m default_coef1, default_coef2, default_coef12;
+  map<OC_INDEX,OC_REAL8m> pairs1, pairs2, pairs12;
+  mutable Oxs_MeshValue<ThreeVector> face1, face2;
+  OC_REAL8m PairCoef(const map<OC_INDEX,OC_REAL8m>& pairs,
+                     OC_REAL8m default_coef,
+                     OC_INT4m r1,OC_INT4m r2) const;
+  void FillFaceCoefs(const Oxs_Mesh* mesh) const;
+  /// Fills face1 and face2 from region_id.  Faces without a neighbor
+  /// (non-periodic mesh boundary) get 0.
   mutable Oxs_Key<Oxs_Atlas> atlaskey;  
   Oxs_OwnedPointer<Oxs_Atlas> atlas;
   mutable Oxs_ThreadControl thread_control;
   mutable OC_UINT4m mesh_id;
   mutable Oxs_MeshValue<OC_INT4m> region_id;
 
-  // Support for threaded maxang calculations
-  mutable vector<OC_REAL8m> maxdot;
+  // Support for threaded maxang calculations.  One set per sublattice,
+  // since the paired sweep fills both before either is finalized.
+  mutable vector<OC_REAL8m> maxdot1, maxdot2;
+  vector<OC_REAL8m>& MaxDot(const Oxs_SimState& state) const;
 
   void CalcEnergyA(const Oxs_SimState& state,
                    Oxs_ComputeEnergyDataThreaded& ocedt,
                    Oxs_ComputeEnergyDataThreadedAux& ocedtaux,
                    OC_INDEX node_start,OC_INDEX node_stop,
                    int threadnumber) const;
+  void CalcEnergyPairA(const Oxs_SimState& state1,
+                       const Oxs_SimState& state2,
+                       Oxs_ComputeEnergyDataThreaded& ocedt1,
+                       Oxs_ComputeEnergyDataThreaded& ocedt2,
+                       Oxs_ComputeEnergyDataThreadedAux& ocedtaux1,
+                       Oxs_ComputeEnergyDataThreadedAux& ocedtaux2,
+                       OC_INDEX node_start,OC_INDEX node_stop,
+                       int threadnumber) const;
+  /// Both sublattices in one sweep; same results as two CalcEnergyA
+  /// calls.
+  OC_BOOL PrepareChunk(const Oxs_SimState& state,int threadnumber) const;
+  /// Region mapping setup shared by the chunk entry points.  Returns 0
+  /// if the chunk should be skipped.
+
+  struct StencilA; // Per-call constants of CalcEnergyA; see .cc
+  void SetupStencilA(const Oxs_SimState& state,
+                     const Oxs_CommonRectangularMesh* mesh,
+                     Oxs_ComputeEnergyDataThreaded& ocedt,
+                     StencilA& st) const;
+  const Oxs_CommonRectangularMesh*
+  StencilMesh(const Oxs_SimState& state) const;
+  void SweepA(const Oxs_CommonRectangularMesh* mesh,
+              const StencilA& st1,const StencilA* st2,
+              OC_INDEX node_start,OC_INDEX node_stop,
+              YY_2LatBlockSum& energy_sum1,YY_2LatBlockSum& energy_sum2,
+              OC_REAL8m& thread_maxdot1,OC_REAL8m& thread_maxdot2) const;
+  /// Cells node_start to node_stop for st1, and for st2 if non-null.
+  template<int INTERIOR>
+  void CalcCellA(const StencilA& st,OC_INDEX i,
+                 OC_INDEX jzm,OC_INDEX jym,OC_INDEX jxm,
+                 OC_INDEX jxp,OC_INDEX jyp,OC_INDEX jzp,
+                 YY_2LatBlockSum& energy_sum,
+                 OC_REAL8m& thread_maxdot) const;
+  /// One cell of CalcEnergyA.  A neighbor index <0 means no neighbor.
+  /// With INTERIOR!=0 all six neighbors are present and the checks
+  /// compile away.
   void CalcEnergyLex(const Oxs_SimState& state,
                      Oxs_ComputeEnergyDataThreaded& ocedt,
                      Oxs_ComputeEnergyDataThreadedAux& ocedtaux,
@@ -87,15 +150,34 @@ private:
   // Langevin function and its derivative
   OC_REAL8m Langevin(OC_REAL8m x) const;
   OC_REAL8m LangevinDeriv(OC_REAL8m x) const;
+  void LangevinPair(OC_REAL8m x,OC_REAL8m& L,OC_REAL8m& dL) const;
+  /// Both of the above from a single exp() evaluation.
   mutable OC_REAL8m tol, tolsq; // Calculation tolerance
-  void Update_m_e(const Oxs_SimState& state, OC_REAL8m tol) const;
+  const OC_INT4m m_e_newton_limit; // Newton sweep cap in Update_m_e
+  OC_BOOL M_eNewtonStep(OC_REAL8m A11,OC_REAL8m A12,
+                        OC_REAL8m A21,OC_REAL8m A22,
+                        OC_REAL8m& x1,OC_REAL8m& x2) const;
+  /// One Newton step for the coupled m_e equations of a single cell.
+  /// Returns true if the step was below tolerance (or the Jacobian is
+  /// singular), i.e., x1, x2 are converged.
+  void Update_m_e(const Oxs_SimState& state, OC_REAL8m tol,
+                  const vector<OC_INDEX>* cells = 0) const;
   void Update_m_e(const Oxs_SimState& state) const {
     return Update_m_e(state, DEFAULT_M_E_TOL);
   }
+  /// If cells is non-null, only those cells are re-solved.
+  mutable Oxs_MeshValue<OC_REAL8m> m_e_T; // T at each cell's last solve
+  mutable vector<OC_INDEX> m_e_cells;
+  mutable OC_UINT4m m_e_T_count; // T_update_count at the last solve
+  // Newton scratch of Update_m_e, indexed by position in the solve
+  // list, so a partial solve only touches as many entries as cells.
+  mutable vector<OC_REAL8m> m_e_A, m_e_x1, m_e_x2;
+  mutable vector<OC_INDEX> m_e_active, m_e_retry;
   mutable Oxs_MeshValue<OC_REAL8m> G1, G2;
   mutable Oxs_MeshValue<OC_REAL8m> Lambdai11, Lambdai12, Lambdai21, Lambdai22;
 
   void Update_chi_l(const Oxs_SimState& state) const;
+  mutable OC_UINT4m chi_l_state_id; // Total lattice state of chi_l
 
   // Supplied outputs, in addition to those provided by Oxs_Energy.
   Oxs_ScalarOutput<YY_2LatExchange6Ngbr> maxspinangle_output;
@@ -155,6 +237,23 @@ public:
 		    const char* argstr);  // MIF input block parameters
   virtual ~YY_2LatExchange6Ngbr();
   virtual OC_BOOL Init();
+
+  virtual void ComputeEnergyPairChunk(
+      const Oxs_SimState& state1,
+      const Oxs_SimState& state2,
+      Oxs_ComputeEnergyDataThreaded& ocedt1,
+      Oxs_ComputeEnergyDataThreaded& ocedt2,
+      Oxs_ComputeEnergyDataThreadedAux& ocedtaux1,
+      Oxs_ComputeEnergyDataThreadedAux& ocedtaux2,
+      OC_INDEX node_start,OC_INDEX node_stop,
+      int threadnumber) const;
+  /// Both sublattices in one sweep (YY_2LatPairChunkEnergy).
+
+  virtual void AccumStiffness(const Oxs_SimState& state,
+                              Oxs_MeshValue<OC_REAL8m>& kt,
+                              Oxs_MeshValue<OC_REAL8m>& kl) const;
+  /// Exchange, inter-sublattice and longitudinal (chi_l) stiffness
+  /// (YY_2LatStiffnessEnergy).
 };
 
 
@@ -0,0 +1,675 @@
+/** FILE: yy_2latgnebevolve.cc                 -*-Mode: c++-*-
+ *
+ * Geodesic nudged elastic band (GNEB) for energy barriers between two
+ * magnetization states of a two lattice system.
+ *
+ * Copyright (C) 2015 Yu Yahagi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <math.h>
+#include <float.h>
+
+#include "nb.h"
+#include "director.h"
+#include "simstate.h"
+#include "key.h"
+#include "energy.h"    // Needed to make MSVC++ 5 happy
+#include "meshvalue.h"
+#include "scalarfield.h"
+#include "vectorfield.h"
+
+#include "yy_2lat_blocksum.h"
+#include "yy_2lat_util.h"
+#include "yy_2lattimedriver.h"
+#include "yy_2latgnebevolve.h"
+
+// Oxs_Ext registration support
+OXS_EXT_REGISTER(YY_2LatGNEBEvolve);
+
+/* End includes */
+
+// Gyromagnetic ratio used to report the band force as "Max dm/dt".
+static const OC_REAL8m GNEB_GAMMA = 2.211e5;
+
+// Constructor
+YY_2LatGNEBEvolve::YY_2LatGNEBEvolve(
+    const char* name,     // Child instance id
+    Oxs_Director* newdtr, // App director
+    const char* argstr)   // MIF input block parameters
+    : YY_2LatTimeEvolver(name,newdtr,argstr),
+    image_count(0), spring_constant(0.), climb_after(0),
+    max_rotation(0.), step_scale(0.),
+    path_mesh_id(0), path_iteration(0), climbing_image(-1),
+    max_image(0), max_force(0.), path_length(0.), forces_valid(0)
+{
+  // Process arguments
+  image_count = GetIntInitValue("images",12);
+  if(image_count<3) {
+    throw Oxs_Ext::Error(this,"Invalid initialization detected:"
+       " images must be at least 3 (two end points and one"
+       " interior image).");
+  }
+  spring_constant = GetRealInitValue("spring_constant",1e4);
+  if(spring_constant<0.) {
+    throw Oxs_Ext::Error(this,"Invalid initialization detected:"
+       " spring_constant must be non-negative.");
+  }
+  climb_after = GetIntInitValue("climb_after",100);
+  max_rotation = GetRealInitValue("max_rotation",2.0);
+  if(max_rotation<=0. || max_rotation>90.) {
+    throw Oxs_Ext::Error(this,"Invalid initialization detected:"
+       " max_rotation must be in (0,90] degrees.");
+  }
+  max_rotation *= PI/180.; // Convert from deg to rad
+
+  OXS_GET_INIT_EXT_OBJECT("final_m1",Oxs_VectorField,final_m1_init);
+  OXS_GET_INIT_EXT_OBJECT("final_m2",Oxs_VectorField,final_m2_init);
+
+  if(HasInitValue("temperature")) {
+    OXS_GET_INIT_EXT_OBJECT("temperature",Oxs_ScalarField,temperature_init);
+  } else {
+    temperature_init.SetAsOwner(dynamic_cast<Oxs_ScalarField *>
+                          (MakeNew("Oxs_UniformScalarField",director,
+                                   "value 0.0")));
+  }
+
+  // Image states (total and both sublattices).
+  director->ReserveSimulationStateRequest(3);
+
+  // Setup outputs
+  max_dm_dt_output.Setup(this,InstanceName(),"Max dm/dt","deg/ns",0,
+     &YY_2LatGNEBEvolve::UpdateDerivedOutputs);
+  energy_barrier_output.Setup(this,InstanceName(),"Energy barrier","J",0,
+     &YY_2LatGNEBEvolve::UpdateDerivedOutputs);
+  max_image_output.Setup(this,InstanceName(),"Max image","",0,
+     &YY_2LatGNEBEvolve::UpdateDerivedOutputs);
+  path_length_output.Setup(this,InstanceName(),"Path length","rad",0,
+     &YY_2LatGNEBEvolve::UpdateDerivedOutputs);
+
+  VerifyAllInitArgsUsed();
+}   // end Constructor
+
+OC_BOOL YY_2LatGNEBEvolve::Init()
+{
+  // Register outputs
+  max_dm_dt_output.Register(director,-5);
+  energy_barrier_output.Register(director,-5);
+  max_image_output.Register(director,-5);
+  path_length_output.Register(director,-5);
+
+  ReleasePath();
+  temperature.Release();
+  energy.Release();
+  H1.Release();
+  H2.Release();
+  tangent1.Release();
+  tangent2.Release();
+  image_Ms.Release();
+  image_Ms_inverse.Release();
+
+  return YY_2LatTimeEvolver::Init();  // Initialize parent class.
+  // Do this after child output registration so that
+  // UpdateDerivedOutputs gets called before the parent
+  // total_energy_output update function.
+}
+
+YY_2LatGNEBEvolve::~YY_2LatGNEBEvolve()
+{
+  ReleasePath();
+}
+
+void YY_2LatGNEBEvolve::ReleasePath()
+{
+  for(size_t k=0;k<path.size();++k) delete path[k];
+  path.clear();
+  distance.clear();
+  path_mesh_id = 0;
+  path_iteration = 0;
+  climbing_image = -1;
+  max_image = 0;
+  max_force = 0.;
+  path_length = 0.;
+  step_scale = 0.;
+  forces_valid = 0;
+}
+
+// Spin a turned towards b by fraction t of the angle between them.
+static ThreeVector YY_2LatGNEBSlerp(const ThreeVector& a,
+                                    const ThreeVector& b,
+                                    OC_REAL8m t)
+{
+  ThreeVector axis = a ^ b;
+  OC_REAL8m sinth = sqrt(axis.MagSq());
+  OC_REAL8m costh = a*b;
+  if(sinth<1e-12) {
+    if(costh>0.) return a; // Parallel
+    // Antiparallel: any great circle will do.  Rotate about an axis
+    // perpendicular to a.
+    axis = (fabs(a.x)<0.9 ? ThreeVector(1,0,0) : ThreeVector(0,1,0)) ^ a;
+    axis.MakeUnit();
+  } else {
+    axis *= 1.0/sinth;
+  }
+  OC_REAL8m angle = atan2(sinth,costh)*t;
+  // Rodrigues rotation of a about axis; a is perpendicular to axis.
+  ThreeVector result = cos(angle)*a;
+  result += sin(angle)*(axis ^ a);
+  result.MakeUnit();
+  return result;
+}
+
+void YY_2LatGNEBEvolve::BuildPath(const Oxs_SimState& cstate1_,
+                                  const Oxs_SimState& cstate2_)
+{
+  ReleasePath();
+  const Oxs_Mesh* mesh = cstate1_.mesh;
+  const OC_INDEX size = mesh->Size();
+
+  Oxs_MeshValue<ThreeVector> final1, final2;
+  YY_2LatFillMeshValue(final_m1_init.GetPtr(),mesh,final1);
+  YY_2LatFillMeshValue(final_m2_init.GetPtr(),mesh,final2);
+  OC_INDEX i;
+  for(i=0;i<size;++i) {
+    final1[i].MakeUnit();
+    final2[i].MakeUnit();
+  }
+  // Fixed spins stay in their initial direction along the whole band.
+  UpdateFixedSpinList(mesh);
+  const vector<OC_INDEX>* fixed = GetFixedSpinList();
+  if(fixed!=NULL) {
+    for(size_t j=0;j<fixed->size();++j) {
+      final1[(*fixed)[j]] = cstate1_.spin[(*fixed)[j]];
+      final2[(*fixed)[j]] = cstate2_.spin[(*fixed)[j]];
+    }
+  }
+
+  path.resize(image_count,0);
+  for(OC_INDEX k=0;k<image_count;++k) {
+    Image* image = new Image;
+    path[k] = image;
+    image->spin1.AdjustSize(mesh);
+    image->spin2.AdjustSize(mesh);
+    image->force1.AdjustSize(mesh);
+    image->force2.AdjustSize(mesh);
+    image->velocity1.AdjustSize(mesh);
+    image->velocity2.AdjustSize(mesh);
+    const OC_REAL8m t = OC_REAL8m(k)/OC_REAL8m(image_count-1);
+    for(i=0;i<size;++i) {
+      image->spin1[i] = YY_2LatGNEBSlerp(cstate1_.spin[i],final1[i],t);
+      image->spin2[i] = YY_2LatGNEBSlerp(cstate2_.spin[i],final2[i],t);
+      image->force1[i].Set(0.,0.,0.);
+      image->force2[i].Set(0.,0.,0.);
+      image->velocity1[i].Set(0.,0.,0.);
+      image->velocity2[i].Set(0.,0.,0.);
+    }
+  }
+  // Exact end points
+  path[0]->spin1 = cstate1_.spin;
+  path[0]->spin2 = cstate2_.spin;
+  path[image_count-1]->spin1 = final1;
+  path[image_count-1]->spin2 = final2;
+
+  distance.resize(image_count-1,0.);
+  path_mesh_id = mesh->Id();
+}
+
+void YY_2LatGNEBEvolve::EvaluateImage(
+    const Oxs_SimState& cstate_,
+    const Oxs_SimState& cstate1_,
+    const Oxs_SimState& cstate2_,
+    Image& image_)
+{
+  const Oxs_Mesh* mesh = cstate_.mesh;
+  const OC_INDEX size = mesh->Size();
+  image_Ms.AdjustSize(mesh);
+  image_Ms_inverse.AdjustSize(mesh);
+
+  Oxs_Key<Oxs_SimState> tempkey, tempkey1, tempkey2;
+  director->GetNewSimulationState(tempkey);
+  director->GetNewSimulationState(tempkey1);
+  director->GetNewSimulationState(tempkey2);
+  Oxs_SimState& tstate = tempkey.GetWriteReference();
+  Oxs_SimState& tstate1 = tempkey1.GetWriteReference();
+  Oxs_SimState& tstate2 = tempkey2.GetWriteReference();
+  cstate_.CloneHeader(tstate);
+  cstate1_.CloneHeader(tstate1);
+  cstate2_.CloneHeader(tstate2);
+
+  // Sublattice Ms is that of the current state; only the total lattice,
+  // whose magnitude depends on the spin directions, needs its own.
+  tstate.Ms = &image_Ms;    tstate.Ms_inverse = &image_Ms_inverse;
+  tstate1.Ms = cstate1_.Ms; tstate1.Ms_inverse = cstate1_.Ms_inverse;
+  tstate2.Ms = cstate2_.Ms; tstate2.Ms_inverse = cstate2_.Ms_inverse;
+
+  tstate.lattice_type = Oxs_SimState::TOTAL;
+  tstate1.lattice_type = Oxs_SimState::LATTICE1;
+  tstate2.lattice_type = Oxs_SimState::LATTICE2;
+  tstate.total_lattice = NULL;
+  tstate.lattice1 = &tstate1;
+  tstate.lattice2 = &tstate2;
+  tstate1.total_lattice = &tstate;
+  tstate1.lattice1 = NULL;
+  tstate1.lattice2 = &tstate2;
+  tstate2.total_lattice = &tstate;
+  tstate2.lattice1 = &tstate1;
+  tstate2.lattice2 = NULL;
+  tstate1.T = cstate1_.T;
+  tstate2.T = cstate2_.T;
+  tstate1.Tc = cstate1_.Tc;
+  tstate2.Tc = cstate2_.Tc;
+  tstate1.m_e = cstate1_.m_e;
+  tstate2.m_e = cstate2_.m_e;
+  tstate1.chi_l = cstate1_.chi_l;
+  tstate2.chi_l = cstate2_.chi_l;
+
+  tstate1.spin = image_.spin1;
+  tstate2.spin = image_.spin2;
+  const Oxs_MeshValue<OC_REAL8m>& Ms1 = *(cstate1_.Ms);
+  const Oxs_MeshValue<OC_REAL8m>& Ms2 = *(cstate2_.Ms);
+  tstate.spin.AdjustSize(mesh);
+  OC_INDEX i;
+  for(i=0;i<size;++i) {
+    ThreeVector tempspin = Ms1[i]*image_.spin1[i];
+    tempspin += Ms2[i]*image_.spin2[i];
+    image_Ms[i] = sqrt(tempspin.MagSq());
+    tempspin.MakeUnit();
+    tstate.spin[i] = tempspin;
+    image_Ms_inverse[i] = (image_Ms[i]!=0.0 ? 1.0/image_Ms[i] : 0.0);
+  }
+
+  tempkey1.GetReadReference();  // Release write locks
+  tempkey2.GetReadReference();
+  const Oxs_SimState& tstate_read = tempkey.GetReadReference();
+  OC_REAL8m pE_pt, total_E;
+  GetEnergyDensity(tstate_read,energy,NULL,NULL,&H1,&H2,pE_pt,total_E);
+  image_.energy = total_E;
+  tempkey.Release();
+  tempkey1.Release();
+  tempkey2.Release();
+
+  // Transverse effective field.  Empty cells carry no force.
+  for(i=0;i<size;++i) {
+    const ThreeVector& m1 = image_.spin1[i];
+    const ThreeVector& m2 = image_.spin2[i];
+    if(Ms1[i]!=0.0) {
+      image_.force1[i] = H1[i] - (H1[i]*m1)*m1;
+    } else {
+      image_.force1[i].Set(0.,0.,0.);
+    }
+    if(Ms2[i]!=0.0) {
+      image_.force2[i] = H2[i] - (H2[i]*m2)*m2;
+    } else {
+      image_.force2[i].Set(0.,0.,0.);
+    }
+  }
+  const vector<OC_INDEX>* fixed = GetFixedSpinList();
+  if(fixed!=NULL) {
+    for(size_t j=0;j<fixed->size();++j) {
+      image_.force1[(*fixed)[j]].Set(0.,0.,0.);
+      image_.force2[(*fixed)[j]].Set(0.,0.,0.);
+    }
+  }
+}
+
+OC_REAL8m YY_2LatGNEBEvolve::GeodesicDistance(
+    const Oxs_MeshValue<ThreeVector>& a1,
+    const Oxs_MeshValue<ThreeVector>& a2,
+    const Oxs_MeshValue<ThreeVector>& b1,
+    const Oxs_MeshValue<ThreeVector>& b2)
+{
+  const OC_INDEX size = a1.Size();
+  YY_2LatBlockSum sum;
+  for(OC_INDEX i=0;i<size;++i) {
+    OC_REAL8m th1 = atan2(sqrt((a1[i]^b1[i]).MagSq()),a1[i]*b1[i]);
+    OC_REAL8m th2 = atan2(sqrt((a2[i]^b2[i]).MagSq()),a2[i]*b2[i]);
+    sum += th1*th1 + th2*th2;
+  }
+  return sqrt(sum.GetValue());
+}
+
+void YY_2LatGNEBEvolve::ComputeTangent(const Oxs_Mesh* mesh,OC_INDEX k)
+{
+  const Image& prev = *(path[k-1]);
+  const Image& curr = *(path[k]);
+  const Image& next = *(path[k+1]);
+  const OC_INDEX size = curr.spin1.Size();
+  tangent1.AdjustSize(mesh);
+  tangent2.AdjustSize(mesh);
+
+  // Weights of the forward and backward chords
+  OC_REAL8m wp, wm;
+  const OC_REAL8m dEp = next.energy - curr.energy;
+  const OC_REAL8m dEm = curr.energy - prev.energy;
+  if(dEp>0. && dEm>0.) {
+    wp = 1.0; wm = 0.0;
+  } else if(dEp<0. && dEm<0.) {
+    wp = 0.0; wm = 1.0;
+  } else {
+    const OC_REAL8m dEmax = OC_MAX(fabs(dEp),fabs(dEm));
+    const OC_REAL8m dEmin = OC_MIN(fabs(dEp),fabs(dEm));
+    if(next.energy>prev.energy) {
+      wp = dEmax; wm = dEmin;
+    } else {
+      wp = dEmin; wm = dEmax;
+    }
+    if(wp==0. && wm==0.) { wp = wm = 1.0; } // Flat band
+  }
+
+  YY_2LatBlockSum norm_sq;
+  for(OC_INDEX i=0;i<size;++i) {
+    const ThreeVector& m1 = curr.spin1[i];
+    const ThreeVector& m2 = curr.spin2[i];
+    ThreeVector t1 = wp*(next.spin1[i]-m1) + wm*(m1-prev.spin1[i]);
+    ThreeVector t2 = wp*(next.spin2[i]-m2) + wm*(m2-prev.spin2[i]);
+    t1 -= (t1*m1)*m1;
+    t2 -= (t2*m2)*m2;
+    tangent1[i] = t1;
+    tangent2[i] = t2;
+    norm_sq += t1.MagSq() + t2.MagSq();
+  }
+  const OC_REAL8m norm = sqrt(norm_sq.GetValue());
+  if(norm>0.) {
+    const OC_REAL8m inorm = 1.0/norm;
+    for(OC_INDEX i=0;i<size;++i) {
+      tangent1[i] *= inorm;
+      tangent2[i] *= inorm;
+    }
+  }
+}
+
+void YY_2LatGNEBEvolve::ComputeForces(const Oxs_SimState& state)
+{
+  const Oxs_SimState& state1 = *(state.lattice1);
+  const Oxs_SimState& state2 = *(state.lattice2);
+
+  // The exchange terms need the temperature.
+  if(!temperature.CheckMesh(state.mesh)) {
+    YY_2LatFillMeshValue(temperature_init.GetPtr(),state.mesh,temperature);
+  }
+  if(state1.T==NULL) {
+    state1.T = &temperature;
+    state2.T = &temperature;
+  }
+
+  const OC_BOOL new_path
+    = (path.empty() || path_mesh_id != state.mesh->Id());
+  if(new_path) {
+    BuildPath(state1,state2);
+  }
+  UpdateFixedSpinList(state.mesh);
+
+  // Energy and transverse field of each image.  The end points are
+  // fixed, so they are evaluated only once.
+  OC_INDEX k;
+  for(k=0;k<image_count;++k) {
+    if(!new_path && (k==0 || k==image_count-1)) continue;
+    EvaluateImage(state,state1,state2,*(path[k]));
+  }
+
+  path_length = 0.;
+  for(k=0;k+1<image_count;++k) {
+    distance[k] = GeodesicDistance(path[k]->spin1,path[k]->spin2,
+                                   path[k+1]->spin1,path[k+1]->spin2);
+    path_length += distance[k];
+  }
+
+  max_image = 1;
+  for(k=2;k+1<image_count;++k) {
+    if(path[k]->energy>path[max_image]->energy) max_image = k;
+  }
+  climbing_image = -1;
+  if(climb_after>=0 && path_iteration>=climb_after) {
+    climbing_image = max_image;
+  }
+
+  // GNEB forces: perpendicular part of the true force plus the spring
+  // force along the tangent, or the inverted parallel part for the
+  // climbing image.
+  const OC_INDEX size = state.mesh->Size();
+  OC_REAL8m max_force_sq = 0.;
+  for(k=1;k+1<image_count;++k) {
+    Image& image = *(path[k]);
+    ComputeTangent(state.mesh,k);
+    YY_2LatBlockSum fdott;
+    OC_INDEX i;
+    for(i=0;i<size;++i) {
+      fdott += image.force1[i]*tangent1[i] + image.force2[i]*tangent2[i];
+    }
+    OC_REAL8m along;
+    if(k==climbing_image) {
+      along = -2.0*fdott.GetValue();
+    } else {
+      along = spring_constant*(distance[k]-distance[k-1])
+        - fdott.GetValue();
+    }
+    for(i=0;i<size;++i) {
+      image.force1[i].Accum(along,tangent1[i]);
+      image.force2[i].Accum(along,tangent2[i]);
+      OC_REAL8m fsq = OC_MAX(image.force1[i].MagSq(),
+                             image.force2[i].MagSq());
+      if(fsq>max_force_sq) max_force_sq = fsq;
+    }
+  }
+  max_force = sqrt(max_force_sq);
+  if(step_scale<=0. && max_force>0.) {
+    step_scale = max_rotation/max_force;
+  }
+  forces_valid = 1;
+}
+
+void YY_2LatGNEBEvolve::Advance(Image& image_)
+{
+  const OC_INDEX size = image_.spin1.Size();
+  OC_INDEX i;
+
+  // Velocity projection: keep only the velocity component along the
+  // force, and none at all if it points against the force.
+  YY_2LatBlockSum vdotf, fdotf;
+  for(i=0;i<size;++i) {
+    vdotf += image_.velocity1[i]*image_.force1[i]
+      + image_.velocity2[i]*image_.force2[i];
+    fdotf += image_.force1[i].MagSq() + image_.force2[i].MagSq();
+  }
+  OC_REAL8m vscale = 0.;
+  if(vdotf.GetValue()>0. && fdotf.GetValue()>0.) {
+    vscale = vdotf.GetValue()/fdotf.GetValue();
+  }
+  vscale += step_scale;
+
+  const OC_REAL8m max_rot_sq = max_rotation*max_rotation;
+  Oxs_MeshValue<ThreeVector>* spin[2]
+    = { &image_.spin1, &image_.spin2 };
+  Oxs_MeshValue<ThreeVector>* force[2]
+    = { &image_.force1, &image_.force2 };
+  Oxs_MeshValue<ThreeVector>* velocity[2]
+    = { &image_.velocity1, &image_.velocity2 };
+  for(int l=0;l<2;++l) {
+    Oxs_MeshValue<ThreeVector>& s = *(spin[l]);
+    const Oxs_MeshValue<ThreeVector>& f = *(force[l]);
+    Oxs_MeshValue<ThreeVector>& v = *(velocity[l]);
+    for(i=0;i<size;++i) {
+      ThreeVector dm = vscale*f[i];
+      OC_REAL8m dmsq = dm.MagSq();
+      if(dmsq>max_rot_sq) {
+        dm *= max_rotation/sqrt(dmsq);
+      }
+      ThreeVector m = s[i] + dm;
+      m.MakeUnit();
+      s[i] = m;
+      // Carry the velocity over to the tangent space of the new spin.
+      dm -= (dm*m)*m;
+      v[i] = dm;
+    }
+  }
+}
+
+OC_BOOL
+YY_2LatGNEBEvolve::Step(const YY_2LatTimeDriver* driver,
+          Oxs_ConstKey<Oxs_SimState> current_state,
+          Oxs_ConstKey<Oxs_SimState> current_state1,
+          Oxs_ConstKey<Oxs_SimState> current_state2,
+          const Oxs_DriverStepInfo& /* step_info */,
+          Oxs_Key<Oxs_SimState>& next_state,
+          Oxs_Key<Oxs_SimState>& next_state1,
+          Oxs_Key<Oxs_SimState>& next_state2)
+{
+  const Oxs_SimState& cstate = current_state.GetReadReference();
+  const Oxs_SimState& cstate1 = current_state1.GetReadReference();
+  const Oxs_SimState& cstate2 = current_state2.GetReadReference();
+
+  if(path_mesh_id!=0 && cstate.mesh->Id() != path_mesh_id) {
+    throw Oxs_Ext::Error(this,
+        "YY_2LatGNEBEvolve::Step: Oxs_Mesh not fixed across steps.");
+  }
+
+  // Band forces.  Usually these are left over from UpdateDerivedOutputs
+  // on cstate.
+  if(!forces_valid) ComputeForces(cstate);
+
+  Oxs_SimState& workstate = next_state.GetWriteReference();
+  Oxs_SimState& workstate1 = next_state1.GetWriteReference();
+  Oxs_SimState& workstate2 = next_state2.GetWriteReference();
+  driver->FillState(cstate,workstate);
+  driver->FillState(cstate1,workstate1);
+  driver->FillState(cstate2,workstate2);
+
+  // Set pointers to the sublattice
+  workstate.lattice1 = &workstate1;
+  workstate.lattice2 = &workstate2;
+  workstate1.total_lattice = &workstate;
+  workstate1.lattice2 = &workstate2;
+  workstate2.total_lattice = &workstate;
+  workstate2.lattice1 = &workstate1;
+  workstate1.lattice_type = Oxs_SimState::LATTICE1;
+  workstate2.lattice_type = Oxs_SimState::LATTICE2;
+
+  if(cstate.Id() != workstate.previous_state_id) {
+    throw Oxs_Ext::Error(this,
+        "YY_2LatGNEBEvolve::Step: State continuity break detected.");
+  }
+
+  // The band does not move in time.
+  workstate.last_timestep = 0.;
+  workstate1.last_timestep = 0.;
+  workstate2.last_timestep = 0.;
+  workstate.stage_start_time = cstate.stage_start_time;
+  workstate.stage_elapsed_time = cstate.stage_elapsed_time;
+  workstate1.stage_start_time = cstate.stage_start_time;
+  workstate1.stage_elapsed_time = cstate.stage_elapsed_time;
+  workstate2.stage_start_time = cstate.stage_start_time;
+  workstate2.stage_elapsed_time = cstate.stage_elapsed_time;
+  workstate.iteration_count = cstate.iteration_count + 1;
+  workstate.stage_iteration_count = cstate.stage_iteration_count + 1;
+  workstate1.iteration_count = cstate1.iteration_count + 1;
+  workstate1.stage_iteration_count = cstate1.stage_iteration_count + 1;
+  workstate2.iteration_count = cstate2.iteration_count + 1;
+  workstate2.stage_iteration_count = cstate2.stage_iteration_count + 1;
+
+  // The next state is the highest energy image of the band as it was
+  // evaluated, so that its energy and the band force belong together.
+  const Image& top = *(path[max_image]);
+  const OC_INDEX size = cstate.mesh->Size();
+  const Oxs_MeshValue<OC_REAL8m>& Ms1 = *(workstate1.Ms);
+  const Oxs_MeshValue<OC_REAL8m>& Ms2 = *(workstate2.Ms);
+  Oxs_MeshValue<OC_REAL8m>& wMs = *(workstate.Ms);
+  Oxs_MeshValue<OC_REAL8m>& wMs_inverse = *(workstate.Ms_inverse);
+  workstate1.spin = top.spin1;
+  workstate2.spin = top.spin2;
+  workstate.spin.AdjustSize(cstate.mesh);
+  for(OC_INDEX i=0;i<size;++i) {
+    ThreeVector tempspin = Ms1[i]*top.spin1[i];
+    tempspin += Ms2[i]*top.spin2[i];
+    wMs[i] = sqrt(tempspin.MagSq());
+    tempspin.MakeUnit();
+    workstate.spin[i] = tempspin;
+    wMs_inverse[i] = (wMs[i]!=0.0 ? 1.0/wMs[i] : 0.0);
+  }
+  driver->FillStateSupplemental(workstate);
+  driver->FillStateSupplemental(workstate1);
+  driver->FillStateSupplemental(workstate2);
+
+  next_state1.GetReadReference();  // Release write locks
+  next_state2.GetReadReference();
+  const Oxs_SimState& nstate
+    = next_state.GetReadReference();  // Release write lock
+
+  if(!nstate.AddDerivedData("Max dm/dt",GNEB_GAMMA*max_force) ||
+     !nstate.AddDerivedData("Energy barrier",
+                            top.energy-path[0]->energy) ||
+     !nstate.AddDerivedData("Max image",OC_REAL8m(max_image)) ||
+     !nstate.AddDerivedData("Path length",path_length)) {
+    throw Oxs_Ext::Error(this,
+       "YY_2LatGNEBEvolve::Step:"
+       " Programming error; data cache already set.");
+  }
+
+  // Move the interior images.
+  for(OC_INDEX k=1;k+1<image_count;++k) Advance(*(path[k]));
+  ++path_iteration;
+  forces_valid = 0;
+
+  return 1;  // Good step
+}   // end Step
+
+void YY_2LatGNEBEvolve::UpdateDerivedOutputs(const Oxs_SimState& state)
+{ // This routine fills all the YY_2LatGNEBEvolve Oxs_ScalarOutput's
+  // from the band data recorded in state.  A state not produced by
+  // Step, i.e., the initial state or a new stage state, gets the data
+  // of the band in its current shape.
+  max_dm_dt_output.cache.state_id
+    = energy_barrier_output.cache.state_id
+    = max_image_output.cache.state_id
+    = path_length_output.cache.state_id
+    = 0;  // Mark change in progress
+
+  OC_REAL8m max_dm_dt, barrier, image, length;
+  if(!state.GetDerivedData("Max dm/dt",max_dm_dt) ||
+     !state.GetDerivedData("Energy barrier",barrier) ||
+     !state.GetDerivedData("Max image",image) ||
+     !state.GetDerivedData("Path length",length)) {
+    if(!forces_valid) ComputeForces(state);
+    max_dm_dt = GNEB_GAMMA*max_force;
+    barrier = path[max_image]->energy - path[0]->energy;
+    image = OC_REAL8m(max_image);
+    length = path_length;
+    OC_REAL8m dummy_value;
+    if(!state.GetDerivedData("Max dm/dt",dummy_value)) {
+      state.AddDerivedData("Max dm/dt",max_dm_dt);
+    }
+    if(!state.GetDerivedData("Energy barrier",dummy_value)) {
+      state.AddDerivedData("Energy barrier",barrier);
+    }
+    if(!state.GetDerivedData("Max image",dummy_value)) {
+      state.AddDerivedData("Max image",image);
+    }
+    if(!state.GetDerivedData("Path length",dummy_value)) {
+      state.AddDerivedData("Path length",length);
+    }
+  }
+
+  max_dm_dt_output.cache.value = max_dm_dt*(180e-9/PI);
+  /// Convert from radians/second to deg/ns
+  energy_barrier_output.cache.value = barrier;
+  max_image_output.cache.value = image;
+  path_length_output.cache.value = length;
+
+  max_dm_dt_output.cache.state_id
+    = energy_barrier_output.cache.state_id
+    = max_image_output.cache.state_id
+    = path_length_output.cache.state_id
+    = state.Id();
+}   // end UpdateDerivedOutputs
@@ -0,0 +1,198 @@
+/** FILE: yy_2latgnebevolve.h                 -*-Mode: c++-*-
+ *
+ * Geodesic nudged elastic band (GNEB) for energy barriers between two
+ * magnetization states of a two lattice system.
+ *
+ * Copyright (C) 2015 Yu Yahagi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _YY_2LATGNEBEVOLVE
+#define _YY_2LATGNEBEVOLVE
+
+#include <vector>
+
+#include "nb.h"
+
+#include "yy_2lattimeevolver.h"
+#include "key.h"
+#include "output.h"
+#include "scalarfield.h"
+#include "vectorfield.h"
+
+OC_USE_STD_NAMESPACE;
+
+/* End includes */
+
+class YY_2LatGNEBEvolve:public YY_2LatTimeEvolver {
+private:
+  // =======================================================================
+  // Band parameters.  See notes at the bottom.
+  // =======================================================================
+  OC_INDEX image_count;        // Including both end points, >= 3
+  OC_REAL8m spring_constant;   // A/m per radian of path length
+  OC_INDEX climb_after;        // Iterations before climbing; <0 never
+  OC_REAL8m max_rotation;      // radians per iteration and cell
+  OC_REAL8m step_scale;        // radians per A/m; 0 until first step
+
+  // Final state of the path.  The initial state is m01, m02 of the
+  // driver.
+  Oxs_OwnedPointer<Oxs_VectorField> final_m1_init, final_m2_init;
+
+  // Temperature is fixed, and only enters through the temperature
+  // dependence of the energy terms.
+  Oxs_OwnedPointer<Oxs_ScalarField> temperature_init;
+  Oxs_MeshValue<OC_REAL8m> temperature; // in Kelvin
+
+  // =======================================================================
+  // The band.  Images 0 and image_count-1 are the fixed end points.
+  // Each image holds unit spins for both sublattices; Ms is that of
+  // the driver state and is not relaxed.  force* is the GNEB force in
+  // field units (A/m), velocity* the optimizer velocity in radians.
+  // =======================================================================
+  struct Image {
+    Oxs_MeshValue<ThreeVector> spin1, spin2;
+    Oxs_MeshValue<ThreeVector> force1, force2;
+    Oxs_MeshValue<ThreeVector> velocity1, velocity2;
+    OC_REAL8m energy;
+    Image() : energy(0.) {}
+  };
+  vector<Image*> path;
+  OC_UINT4m path_mesh_id;     // Mesh the band was built on
+  OC_INDEX path_iteration;    // Iterations since the band was built
+  OC_INDEX climbing_image;    // -1 until climbing starts
+  OC_INDEX max_image;         // Highest energy interior image
+  OC_REAL8m max_force;        // Max |force| over interior images, A/m
+  OC_REAL8m path_length;      // Geodesic length of the band, radians
+  OC_BOOL forces_valid;       // force* match the current band
+
+  void ReleasePath();
+  void BuildPath(const Oxs_SimState& cstate1_,
+                 const Oxs_SimState& cstate2_);
+  /// Geodesic (great circle) interpolation from the current state to
+  /// the final state, cell by cell.
+
+  // Scratch space for the image energy evaluations
+  Oxs_MeshValue<OC_REAL8m> energy;
+  Oxs_MeshValue<ThreeVector> H1, H2;
+  Oxs_MeshValue<ThreeVector> tangent1, tangent2;
+  Oxs_MeshValue<OC_REAL8m> image_Ms, image_Ms_inverse;
+  vector<OC_REAL8m> distance; // Geodesic distance image k to k+1
+
+  void EvaluateImage(const Oxs_SimState& cstate_,
+                     const Oxs_SimState& cstate1_,
+                     const Oxs_SimState& cstate2_,
+                     Image& image_);
+  /// Energy and transverse effective field of image_, evaluated on a
+  /// temporary state trio built from the cstate_ headers with the spins
+  /// of image_.  The transverse field is left in image_.force*.
+
+  static OC_REAL8m GeodesicDistance(const Oxs_MeshValue<ThreeVector>& a1,
+                                    const Oxs_MeshValue<ThreeVector>& a2,
+                                    const Oxs_MeshValue<ThreeVector>& b1,
+                                    const Oxs_MeshValue<ThreeVector>& b2);
+  /// sqrt of the sum over cells and sublattices of the squared angle
+  /// between a and b.
+
+  void ComputeTangent(const Oxs_Mesh* mesh,OC_INDEX k);
+  /// Improved tangent at interior image k into tangent1/2, projected
+  /// onto the tangent space of the image and normalized over both
+  /// sublattices.
+
+  void ComputeForces(const Oxs_SimState& state);
+  /// Evaluates the band (building it first if needed) and fills the
+  /// GNEB force of each interior image, max_image, climbing_image,
+  /// max_force and path_length.  state provides the headers, Ms and
+  /// temperature for the image evaluations.
+
+  void Advance(Image& image_);
+  /// Velocity projection update of one interior image from its force.
+
+  // =======================================================================
+  // Outputs
+  // =======================================================================
+  void UpdateDerivedOutputs(const Oxs_SimState&);
+  Oxs_ScalarOutput<YY_2LatGNEBEvolve> max_dm_dt_output;
+  Oxs_ScalarOutput<YY_2LatGNEBEvolve> energy_barrier_output;
+  Oxs_ScalarOutput<YY_2LatGNEBEvolve> max_image_output;
+  Oxs_ScalarOutput<YY_2LatGNEBEvolve> path_length_output;
+
+  // Disable copy constructor and assignment operator by declaring
+  // them without defining them.
+  YY_2LatGNEBEvolve(const YY_2LatGNEBEvolve&);
+  YY_2LatGNEBEvolve& operator=(const YY_2LatGNEBEvolve&);
+
+public:
+  virtual const char* ClassName() const; // ClassName() is
+  /// automatically generated by the OXS_EXT_REGISTER macro.
+  virtual OC_BOOL Init();
+  YY_2LatGNEBEvolve(const char* name,     // Child instance id
+     Oxs_Director* newdtr, // App director
+     const char* argstr);  // MIF input block parameters
+  virtual ~YY_2LatGNEBEvolve();
+
+  virtual  OC_BOOL
+  Step(const YY_2LatTimeDriver* driver,
+       Oxs_ConstKey<Oxs_SimState> current_state,
+       Oxs_ConstKey<Oxs_SimState> current_state1,
+       Oxs_ConstKey<Oxs_SimState> current_state2,
+       const Oxs_DriverStepInfo& step_info,
+       Oxs_Key<Oxs_SimState>& next_state,
+       Oxs_Key<Oxs_SimState>& next_state1,
+       Oxs_Key<Oxs_SimState>& next_state2);
+  // One band iteration.  next_state holds the highest energy image.
+};
+
+/**
+ * Notes on the band
+ *
+ * The band is a chain of image_count images between the initial state
+ * (m01, m02 of the driver) and the final state (final_m1, final_m2).
+ * It is built on the first step by great circle interpolation of each
+ * cell, and kept across stages, so a first stage without climbing can
+ * be followed by a climbing stage.  A new band is built if the mesh
+ * changes.
+ *
+ * Distances are geodesic: the distance between two images is the root
+ * sum of squares over cells and sublattices of the angle between the
+ * spins.  The tangent at an interior image is the energy weighted
+ * ("improved") tangent of Henkelman and Jonsson, built from the chord
+ * to the neighbor images and projected onto the tangent space of the
+ * image.  The force on image k is, per cell,
+ *
+ *   f = H_perp - (H_perp.t)t + spring_constant*(L+ - L-)*t
+ *
+ * with H_perp the effective field transverse to the spin, t the
+ * tangent and L+, L- the distances to the neighbor images.  Working in
+ * field units makes the force independent of cell volume and Ms.
+ * After climb_after iterations the highest energy image climbs:
+ * f = H_perp - 2(H_perp.t)t, no spring.
+ *
+ * Images are moved by velocity projection: the velocity keeps only its
+ * component along the force, and is zeroed if it points against it.
+ * The force is turned into a rotation with step_scale, set on the
+ * first iteration so that the largest force turns its spin by
+ * max_rotation, and each cell's rotation per iteration is capped at
+ * max_rotation.  Spins are renormalized after each update.  Ms is held
+ * fixed, so the barrier is along the transverse degrees of freedom at
+ * the given temperature.
+ *
+ * "Max dm/dt" reports gamma*max|f| over the interior images, with
+ * gamma = 2.211e5 m/(A.s), so stopping_dm_dt of YY_2LatTimeDriver
+ * works as the convergence criterion.  Time does not advance.
+ */
+
+#endif // _YY_2LATGNEBEVOLVE
@@ -0,0 +1,1155 @@
+/** FILE: yy_2latrkevolve.cc                 -*-Mode: c++-*-
+ *
+ * Runge-Kutta evolver for the deterministic two-lattice
+ * Landau-Lifshitz-Bloch equation: adaptive Dormand-Prince 5(4), or
+ * the norm-preserving implicit midpoint rule.  It is based on
+ * YY_2LatEulerEvolve and the RKF54 step in Oxs_RungeKuttaEvolve.
+ *
+ * Copyright (C) 2015 Yu Yahagi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <math.h>
+#include <float.h>
+
+#include "nb.h"
+#include "director.h"
+#include "simstate.h"
+#include "key.h"
+#include "energy.h"    // Needed to make MSVC++ 5 happy
+#include "meshvalue.h"
+#include "rectangularmesh.h"
+#include "scalarfield.h"
+
+#include "yy_2lat_blocksum.h"
+#include "yy_2lat_util.h"
+#include "yy_2lattimedriver.h"
+#include "yy_2latrkevolve.h"
+
+// Oxs_Ext registration support
+OXS_EXT_REGISTER(YY_2LatRKEvolve);
+
+/* End includes */
+
+// Dormand-Prince 5(4) tableau.  Row 6 of DP_A holds the fifth order
+// weights, which are also the stage coefficients of the FSAL stage.
+// DP_E is the difference between the fifth and fourth order weights.
+static const OC_REAL8m DP_C[7] = {
+  0., 1./5., 3./10., 4./5., 8./9., 1., 1.
+};
+static const OC_REAL8m DP_A[7][6] = {
+  { 0. },
+  { 1./5. },
+  { 3./40., 9./40. },
+  { 44./45., -56./15., 32./9. },
+  { 19372./6561., -25360./2187., 64448./6561., -212./729. },
+  { 9017./3168., -355./33., 46732./5247., 49./176., -5103./18656. },
+  { 35./384., 0., 500./1113., 125./192., -2187./6784., 11./84. }
+};
+static const OC_REAL8m DP_E[7] = {
+  71./57600., 0., -71./16695., 71./1920., -17253./339200., 22./525.,
+  -1./40.
+};
+
+void YY_2LatRKEvolve::StagePool::AdjustSize(const Oxs_Mesh* mesh)
+{
+  for(int j=0;j<RK_STAGES;++j) {
+    dm_dt_t[j].AdjustSize(mesh);
+    dlnMs_dt[j].AdjustSize(mesh);
+  }
+}
+
+void YY_2LatRKEvolve::StagePool::Release()
+{
+  for(int j=0;j<RK_STAGES;++j) {
+    dm_dt_t[j].Release();
+    dlnMs_dt[j].Release();
+  }
+}
+
+// Constructor
+YY_2LatRKEvolve::YY_2LatRKEvolve(
+    const char* name,     // Child instance id
+    Oxs_Director* newdtr, // App director
+    const char* argstr)   // MIF input block parameters
+    : YY_2LatTimeEvolver(name,newdtr,argstr),
+    mesh_id(0), min_timestep(0.), max_timestep(1e-10),
+    step_method(RK_INVALID),
+    last_stage_number(0),
+    energy_state_id(0),next_timestep(0.),
+    pool_state_id(0)
+{
+  // Process arguments
+  min_timestep = GetRealInitValue("min_timestep",0.);
+  max_timestep = GetRealInitValue("max_timestep",1e-10);
+  if(max_timestep<=0.0 || max_timestep<min_timestep) {
+    char buf[4096];
+    Oc_Snprintf(buf,sizeof(buf),
+    "Invalid parameter value:"
+    " Specified max time step is %g (should be >0. and >= min time step)",
+    max_timestep);
+    throw Oxs_Ext::Error(this,buf);
+  }
+
+  allowed_error_rate = GetRealInitValue("error_rate",1.0);
+  if(allowed_error_rate>0.0) {
+    allowed_error_rate *= PI*1e9/180.; // Convert from deg/ns to rad/s
+  }
+  allowed_absolute_step_error
+    = GetRealInitValue("absolute_step_error",0.2);
+  if(allowed_absolute_step_error>0.0) {
+    allowed_absolute_step_error *= PI/180.; // Convert from deg to rad
+  }
+  allowed_relative_step_error
+    = GetRealInitValue("relative_step_error",0.01);
+
+  String method = GetStringInitValue("method","dp54");
+  if(method.compare("dp54")==0) {
+    step_method = RK_DP54;
+  } else if(method.compare("midpoint")==0) {
+    step_method = RK_MIDPOINT;
+  } else {
+    throw Oxs_Ext::Error(this,"Invalid initialization detected:"
+       " \"method\" value must be one of dp54 or midpoint.");
+  }
+  midpoint_tolerance = GetRealInitValue("midpoint_tolerance",1e-6);
+  midpoint_max_iterations = GetIntInitValue("midpoint_max_iterations",6);
+  if(midpoint_max_iterations<1) {
+    throw Oxs_Ext::Error(this,"Invalid initialization detected:"
+       " midpoint_max_iterations must be at least 1.");
+  }
+
+  step_headroom = GetRealInitValue("step_headroom",0.85);
+  if(step_headroom<=0. || step_headroom>1.) {
+    throw Oxs_Ext::Error(this,"Invalid initialization detected:"
+       " step_headroom value must be in (0,1].");
+  }
+
+  if(HasInitValue("alpha_t1")) {
+    OXS_GET_INIT_EXT_OBJECT("alpha_t1",Oxs_ScalarField,alpha_t1_init);
+  } else {
+    alpha_t1_init.SetAsOwner(dynamic_cast<Oxs_ScalarField *>
+                          (MakeNew("Oxs_UniformScalarField",director,
+                                   "value 0.5")));
+  }
+
+  if(HasInitValue("alpha_t2")) {
+    OXS_GET_INIT_EXT_OBJECT("alpha_t2",Oxs_ScalarField,alpha_t2_init);
+  } else {
+    alpha_t2_init.SetAsOwner(dynamic_cast<Oxs_ScalarField *>
+                          (MakeNew("Oxs_UniformScalarField",director,
+                                   "value 0.5")));
+  }
+
+  // User may specify either gamma_G (Gilbert) or
+  // gamma_LL (Landau-Lifshitz).  Code uses "gamma"
+  // which is LL form.
+  gamma1_style = GS_INVALID;
+  if(HasInitValue("gamma_G1") && HasInitValue("gamma_LL1")) {
+    throw Oxs_Ext::Error(this,"Invalid Specify block; "
+       "both gamma_G1 and gamma_LL1 specified.");
+  } else if(HasInitValue("gamma_G1")) {
+    OXS_GET_INIT_EXT_OBJECT("gamma_G1",Oxs_ScalarField,gamma1_init);
+    gamma1_style = GS_G;
+  } else if(HasInitValue("gamma_LL1")) {
+    OXS_GET_INIT_EXT_OBJECT("gamma_LL1",Oxs_ScalarField,gamma1_init);
+    gamma1_style = GS_LL;
+  } else {
+    gamma1_init.SetAsOwner(dynamic_cast<Oxs_ScalarField *>
+                          (MakeNew("Oxs_UniformScalarField",director,
+                                   "value 2.211e5")));
+  }
+
+  gamma2_style = GS_INVALID;
+  if(HasInitValue("gamma_G2") && HasInitValue("gamma_LL2")) {
+    throw Oxs_Ext::Error(this,"Invalid Specify block; "
+       "both gamma_G2 and gamma_LL2 specified.");
+  } else if(HasInitValue("gamma_G2")) {
+    OXS_GET_INIT_EXT_OBJECT("gamma_G2",Oxs_ScalarField,gamma2_init);
+    gamma2_style = GS_G;
+  } else if(HasInitValue("gamma_LL2")) {
+    OXS_GET_INIT_EXT_OBJECT("gamma_LL2",Oxs_ScalarField,gamma2_init);
+    gamma2_style = GS_LL;
+  } else {
+    gamma2_init.SetAsOwner(dynamic_cast<Oxs_ScalarField *>
+                          (MakeNew("Oxs_UniformScalarField",director,
+                                   "value 2.211e5")));
+  }
+
+  allow_signed_gamma = GetIntInitValue("allow_signed_gamma",0);
+  do_precess = GetIntInitValue("do_precess",1);
+
+  start_dm = GetRealInitValue("start_dm",0.01);
+  start_dm *= PI/180.; // Convert from deg to rad
+
+  if(HasInitValue("temperature")) {
+    OXS_GET_INIT_EXT_OBJECT("temperature",Oxs_ScalarField,temperature_init);
+  } else {
+    temperature_init.SetAsOwner(dynamic_cast<Oxs_ScalarField *>
+                          (MakeNew("Oxs_UniformScalarField",director,
+                                   "value 0.0")));
+  }
+
+  // Intermediate stage states (total and both sublattices).
+  director->ReserveSimulationStateRequest(3);
+
+  // Setup outputs
+  max_dm_dt_output.Setup(this,InstanceName(),"Max dm/dt","deg/ns",0,
+     &YY_2LatRKEvolve::UpdateDerivedOutputs);
+  dE_dt_output.Setup(this,InstanceName(),"dE/dt","J/s",0,
+     &YY_2LatRKEvolve::UpdateDerivedOutputs);
+  delta_E_output.Setup(this,InstanceName(),"Delta E","J",0,
+     &YY_2LatRKEvolve::UpdateDerivedOutputs);
+  dm_dt_t1_output.Setup(this,InstanceName(),"dm/dt (trans.)1","rad/s",1,
+     &YY_2LatRKEvolve::UpdateDerivedOutputs);
+  dm_dt_l1_output.Setup(this,InstanceName(),"dm/dt (long.)1","rad/s",1,
+     &YY_2LatRKEvolve::UpdateDerivedOutputs);
+  mxH1_output.Setup(this,InstanceName(),"mxH1","A/m",1,
+     &YY_2LatRKEvolve::UpdateDerivedOutputs);
+  dm_dt_t2_output.Setup(this,InstanceName(),"dm/dt (trans.)2","rad/s",1,
+     &YY_2LatRKEvolve::UpdateDerivedOutputs);
+  dm_dt_l2_output.Setup(this,InstanceName(),"dm/dt (long.)2","rad/s",1,
+     &YY_2LatRKEvolve::UpdateDerivedOutputs);
+  mxH2_output.Setup(this,InstanceName(),"mxH2","A/m",1,
+     &YY_2LatRKEvolve::UpdateDerivedOutputs);
+
+  VerifyAllInitArgsUsed();
+}   // end Constructor
+
+OC_BOOL YY_2LatRKEvolve::Init()
+{
+  // Register outputs
+  max_dm_dt_output.Register(director,-5);
+  dE_dt_output.Register(director,-5);
+  delta_E_output.Register(director,-5);
+  dm_dt_t1_output.Register(director,-5);
+  dm_dt_l1_output.Register(director,-5);
+  mxH1_output.Register(director,-5);
+  dm_dt_t2_output.Register(director,-5);
+  dm_dt_l2_output.Register(director,-5);
+  mxH2_output.Register(director,-5);
+
+  alpha_t10.Release(); alpha_t1.Release(); alpha_l1.Release();
+  alpha_t20.Release(); alpha_t2.Release(); alpha_l2.Release();
+  gamma1.Release(); gamma2.Release();
+  temperature.Release();
+  energy.Release();
+  new_energy.Release();
+  total_field1.Release();
+  total_field2.Release();
+  stage_mxH1.Release();
+  stage_mxH2.Release();
+  stage_Ms.Release();  stage_Ms_inverse.Release();
+  stage_Ms1.Release(); stage_Ms1_inverse.Release();
+  stage_Ms2.Release(); stage_Ms2_inverse.Release();
+  pool1.Release();
+  pool2.Release();
+  pool_state_id=0;
+
+  mesh_id = 0;
+  energy_state_id=0;   // Mark as invalid state
+  next_timestep=0.;    // Dummy value
+
+  return YY_2LatTimeEvolver::Init();  // Initialize parent class.
+  // Do this after child output registration so that
+  // UpdateDerivedOutputs gets called before the parent
+  // total_energy_output update function.
+}
+
+YY_2LatRKEvolve::~YY_2LatRKEvolve()
+{}
+
+// Call with the total_lattice state and it updates values for both
+// sublattices.
+void YY_2LatRKEvolve::UpdateMeshArrays(const Oxs_SimState& state)
+{
+  const Oxs_Mesh* mesh = state.mesh;
+  const OC_INDEX size = mesh->Size();
+  OC_INDEX i;
+
+  if(mesh_id != mesh->Id() || !gamma1.CheckMesh(mesh)) {
+    // First go or mesh change detected
+    mesh_id = 0; // Mark update in progress
+    YY_2LatFillMeshValue(alpha_t1_init.GetPtr(),mesh,alpha_t10);
+    YY_2LatFillMeshValue(alpha_t2_init.GetPtr(),mesh,alpha_t20);
+    YY_2LatFillMeshValue(gamma1_init.GetPtr(),mesh,gamma1);
+    YY_2LatFillMeshValue(gamma2_init.GetPtr(),mesh,gamma2);
+    if(!allow_signed_gamma) {
+      for(i=0;i<size;++i) {
+        gamma1[i] = fabs(gamma1[i]);
+        gamma2[i] = fabs(gamma2[i]);
+      }
+    }
+    if(gamma1_style == GS_G) { // Convert to LL form
+      for(i=0;i<size;++i) {
+        gamma1[i] /= (1+alpha_t10[i]*alpha_t10[i]);
+      }
+    }
+    if(gamma2_style == GS_G) { // Convert to LL form
+      for(i=0;i<size;++i) {
+        gamma2[i] /= (1+alpha_t20[i]*alpha_t20[i]);
+      }
+    }
+    alpha_t1.AdjustSize(mesh);
+    alpha_t2.AdjustSize(mesh);
+    alpha_l1.AdjustSize(mesh);
+    alpha_l2.AdjustSize(mesh);
+  }
+
+  // Temperature-dependent damping; see YY_2LatEulerEvolve.  Tc is only
+  // needed where T > 0, and it is only set by YY_2LatExchange6Ngbr.
+  const Oxs_MeshValue<OC_REAL8m>* Tc1 = state.lattice1->Tc;
+  const Oxs_MeshValue<OC_REAL8m>* Tc2 = state.lattice2->Tc;
+  for(i=0;i<size;i++) {
+    if(temperature[i] == 0.0) {
+      alpha_t1[i] = alpha_t10[i];  alpha_l1[i] = 0.0;
+      alpha_t2[i] = alpha_t20[i];  alpha_l2[i] = 0.0;
+      continue;
+    }
+    if(Tc1 == NULL || Tc2 == NULL) {
+      throw Oxs_ExtError(this,"YY_2LatRKEvolve: temperature > 0"
+          " requires the Curie temperature from YY_2LatExchange6Ngbr.");
+    }
+    if(temperature[i] > (*Tc1)[i]) {
+      alpha_t1[i] = 2./3.*alpha_t10[i];
+      alpha_l1[i] = alpha_t1[i];
+    } else {
+      alpha_l1[i] = alpha_t10[i]*2*temperature[i]/(3*(*Tc1)[i]);
+      alpha_t1[i] = alpha_t10[i]*(1-temperature[i]/(3*(*Tc1)[i]));
+    }
+    if(temperature[i] > (*Tc2)[i]) {
+      alpha_t2[i] = 2./3.*alpha_t20[i];
+      alpha_l2[i] = alpha_t2[i];
+    } else {
+      alpha_l2[i] = alpha_t20[i]*2*temperature[i]/(3*(*Tc2)[i]);
+      alpha_t2[i] = alpha_t20[i]*(1-temperature[i]/(3*(*Tc2)[i]));
+    }
+  }
+
+  mesh_id = mesh->Id();
+}
+
+void YY_2LatRKEvolve::Calculate_dm_dt(
+    const Oxs_SimState& state_,
+    const Oxs_MeshValue<ThreeVector>& mxH_,
+    const Oxs_MeshValue<ThreeVector>& total_field_,
+    Oxs_MeshValue<ThreeVector>& dm_dt_t_,
+    Oxs_MeshValue<OC_REAL8m>& dlnMs_dt_,
+    OC_REAL8m& max_dm_dt_,
+    OC_REAL8m& dE_dt_sum_)
+{
+  const Oxs_Mesh* mesh_ = state_.mesh;
+  const OC_INDEX size = mesh_->Size(); // Assume all imports are compatible
+  const Oxs_MeshValue<OC_REAL8m>& Ms_ = *(state_.Ms);
+  const Oxs_MeshValue<OC_REAL8m>& Ms_inverse_ = *(state_.Ms_inverse);
+  const Oxs_MeshValue<OC_REAL8m>& Ms0_ = *(state_.Ms0);
+  const Oxs_MeshValue<ThreeVector>& spin_ = state_.spin;
+  dm_dt_t_.AdjustSize(mesh_);
+  dlnMs_dt_.AdjustSize(mesh_);
+  OC_INDEX i;
+
+  const Oxs_MeshValue<OC_REAL8m>* palpha_t = NULL;
+  const Oxs_MeshValue<OC_REAL8m>* palpha_l = NULL;
+  const Oxs_MeshValue<OC_REAL8m>* pgamma = NULL;
+  switch(state_.lattice_type) {
+  case Oxs_SimState::LATTICE1:
+    palpha_t = &alpha_t1;  palpha_l = &alpha_l1;  pgamma = &gamma1;
+    break;
+  case Oxs_SimState::LATTICE2:
+    palpha_t = &alpha_t2;  palpha_l = &alpha_l2;  pgamma = &gamma2;
+    break;
+  default:
+    throw Oxs_ExtError(this, "PROGRAMMING ERROR: YY_2LatRKEvolve::"
+        "Calculate_dm_dt() is called with a wrong type of simulation"
+        " state.");
+  }
+  const Oxs_MeshValue<OC_REAL8m>& alpha_t = *palpha_t;
+  const Oxs_MeshValue<OC_REAL8m>& alpha_l = *palpha_l;
+  const Oxs_MeshValue<OC_REAL8m>& gamma = *pgamma;
+
+  ThreeVector scratch;
+  for(i=0;i<size;i++) {
+    if(Ms_[i]==0) {
+      dm_dt_t_[i].Set(0.0,0.0,0.0);
+      dlnMs_dt_[i] = 0.0;
+      continue;
+    }
+    OC_REAL8m cell_gamma = gamma[i];
+    OC_REAL8m cell_m_inverse = Ms0_[i]*Ms_inverse_[i];
+
+    // Precession
+    scratch = mxH_[i];
+    scratch *= -cell_gamma; // -|gamma|*(mxH)
+    if(do_precess) {
+      dm_dt_t_[i] = scratch;
+    } else {
+      dm_dt_t_[i].Set(0.0,0.0,0.0);
+    }
+
+    // Transverse damping, -|alpha_t*gamma|/m (mx(mxH))
+    scratch ^= spin_[i];
+    scratch *= -alpha_t[i]*cell_m_inverse;
+    dm_dt_t_[i] += scratch;
+
+    // Longitudinal relaxation, as a rate of change of ln(Ms)
+    OC_REAL8m temp = spin_[i]*total_field_[i];
+    dlnMs_dt_[i] = temp*cell_gamma*alpha_l[i]*cell_m_inverse;
+  }
+
+  // Zero dm_dt at fixed spin sites
+  UpdateFixedSpinList(mesh_);
+  const OC_INDEX fixed_count = GetFixedSpinCount();
+  for(OC_INDEX j=0;j<fixed_count;j++) {
+    OC_INDEX k = GetFixedSpin(j);
+    dm_dt_t_[k].Set(0.,0.,0.);
+    dlnMs_dt_[k] = 0.0;
+  }
+
+  // Collect statistics
+  OC_REAL8m max_dm_dt_sq = 0.0;
+  YY_2LatBlockSum dE_dt_sum;
+  for(i=0;i<size;i++) {
+    OC_REAL8m dm_dt_sq = dm_dt_t_[i].MagSq() + dlnMs_dt_[i]*dlnMs_dt_[i];
+    if(dm_dt_sq>0.0) {
+      dE_dt_sum += -1*MU0*fabs(gamma[i]*alpha_t[i])
+        *mxH_[i].MagSq() * Ms_[i] * mesh_->Volume(i);
+      if(dm_dt_sq>max_dm_dt_sq) max_dm_dt_sq = dm_dt_sq;
+    }
+  }
+  max_dm_dt_ = sqrt(max_dm_dt_sq);
+  dE_dt_sum_ = dE_dt_sum.GetValue();
+}
+
+void YY_2LatRKEvolve::ComputeStage(
+    const Oxs_SimState& state_,
+    Oxs_MeshValue<ThreeVector>& mxH1_,
+    Oxs_MeshValue<ThreeVector>& mxH2_,
+    int slot_,
+    OC_REAL8m& pE_pt_,
+    OC_REAL8m& max_dm_dt_,
+    OC_REAL8m& dE_dt_)
+{
+  GetEnergyDensity(state_,new_energy,&mxH1_,&mxH2_,
+                   &total_field1,&total_field2,pE_pt_);
+
+  OC_REAL8m max1,max2,dE1,dE2;
+  Calculate_dm_dt(*(state_.lattice1),mxH1_,total_field1,
+                  pool1.dm_dt_t[slot_],pool1.dlnMs_dt[slot_],max1,dE1);
+  Calculate_dm_dt(*(state_.lattice2),mxH2_,total_field2,
+                  pool2.dm_dt_t[slot_],pool2.dlnMs_dt[slot_],max2,dE2);
+  max_dm_dt_ = OC_MAX(max1,max2);
+  dE_dt_ = dE1 + dE2 + pE_pt_;
+}
+
+void YY_2LatRKEvolve::AdvanceSublattice(
+    const Oxs_SimState& cstate_,
+    OC_REAL8m stepsize_,
+    const StagePool& pool_,
+    const OC_REAL8m* coef_,
+    int coef_count_,
+    Oxs_SimState& wstate_) const
+{
+  const OC_INDEX size = cstate_.mesh->Size();
+  const Oxs_MeshValue<ThreeVector>& spin0 = cstate_.spin;
+  const Oxs_MeshValue<OC_REAL8m>& Ms_0 = *(cstate_.Ms);
+  const Oxs_MeshValue<OC_REAL8m>& Ms0 = *(cstate_.Ms0);
+  Oxs_MeshValue<OC_REAL8m>& wMs = *(wstate_.Ms);
+  Oxs_MeshValue<OC_REAL8m>& wMs_inverse = *(wstate_.Ms_inverse);
+  wstate_.spin.AdjustSize(cstate_.mesh);
+
+  for(OC_INDEX i=0;i<size;++i) {
+    ThreeVector dm(0.,0.,0.);
+    OC_REAL8m dlnMs = 0.0;
+    for(int j=0;j<coef_count_;++j) {
+      if(coef_[j]==0.0) continue;
+      dm += coef_[j]*pool_.dm_dt_t[j][i];
+      dlnMs += coef_[j]*pool_.dlnMs_dt[j][i];
+    }
+    dm *= stepsize_;
+    dlnMs *= stepsize_;
+
+    // Transverse movement
+    ThreeVector tempspin = spin0[i];
+    tempspin += dm;
+    tempspin.MakeUnit();
+    wstate_.spin[i] = tempspin;
+
+    // Longitudinal movement.  As in the Euler step, an overshoot
+    // through zero keeps Ms positive and flips the spin.
+    OC_REAL8m scale = 1.0 + dlnMs;
+    if(scale<0.0) {
+      wstate_.spin[i] *= -1;
+      scale = -scale;
+    }
+    wMs[i] = scale*Ms_0[i];
+    if(wMs[i] > Ms0[i]) {
+      // Ms cannot be >Ms0.
+      wMs[i] = Ms0[i];
+    }
+    if(wMs[i] != 0.0) {
+      wMs_inverse[i] = 1.0/wMs[i];
+    } else {
+      wMs_inverse[i] = 0.0;
+    }
+  }
+}
+
+void YY_2LatRKEvolve::FillTotalState(
+    const Oxs_SimState& wstate1_,
+    const Oxs_SimState& wstate2_,
+    Oxs_SimState& wstate_) const
+{
+  const OC_INDEX size = wstate1_.mesh->Size();
+  const Oxs_MeshValue<OC_REAL8m>& wMs1 = *(wstate1_.Ms);
+  const Oxs_MeshValue<OC_REAL8m>& wMs2 = *(wstate2_.Ms);
+  Oxs_MeshValue<OC_REAL8m>& wMs = *(wstate_.Ms);
+  Oxs_MeshValue<OC_REAL8m>& wMs_inverse = *(wstate_.Ms_inverse);
+  wstate_.spin.AdjustSize(wstate1_.mesh);
+  ThreeVector tempspin;
+  for(OC_INDEX i=0; i<size; i++) {
+    tempspin = wMs1[i]*wstate1_.spin[i];
+    tempspin += wMs2[i]*wstate2_.spin[i];
+    wMs[i] = sqrt(tempspin.MagSq());
+    tempspin.MakeUnit();
+    wstate_.spin[i] = tempspin;
+    if(wMs[i] != 0.0) {
+      wMs_inverse[i] = 1.0/wMs[i];
+    } else {
+      wMs_inverse[i] = 0.0;
+    }
+  }
+}
+
+void YY_2LatRKEvolve::SetupStageStates(
+    const Oxs_SimState& wstate_,
+    const Oxs_SimState& wstate1_,
+    const Oxs_SimState& wstate2_,
+    OC_REAL8m stage_offset_,
+    Oxs_SimState& tstate_,
+    Oxs_SimState& tstate1_,
+    Oxs_SimState& tstate2_)
+{
+  const Oxs_Mesh* mesh = wstate_.mesh;
+  stage_Ms.AdjustSize(mesh);  stage_Ms_inverse.AdjustSize(mesh);
+  stage_Ms1.AdjustSize(mesh); stage_Ms1_inverse.AdjustSize(mesh);
+  stage_Ms2.AdjustSize(mesh); stage_Ms2_inverse.AdjustSize(mesh);
+
+  wstate_.CloneHeader(tstate_);
+  wstate1_.CloneHeader(tstate1_);
+  wstate2_.CloneHeader(tstate2_);
+
+  tstate_.Ms = &stage_Ms;    tstate_.Ms_inverse = &stage_Ms_inverse;
+  tstate1_.Ms = &stage_Ms1;  tstate1_.Ms_inverse = &stage_Ms1_inverse;
+  tstate2_.Ms = &stage_Ms2;  tstate2_.Ms_inverse = &stage_Ms2_inverse;
+
+  tstate_.last_timestep -= stage_offset_;
+  tstate_.stage_elapsed_time -= stage_offset_;
+  tstate1_.last_timestep -= stage_offset_;
+  tstate1_.stage_elapsed_time -= stage_offset_;
+  tstate2_.last_timestep -= stage_offset_;
+  tstate2_.stage_elapsed_time -= stage_offset_;
+
+  tstate_.lattice_type = Oxs_SimState::TOTAL;
+  tstate1_.lattice_type = Oxs_SimState::LATTICE1;
+  tstate2_.lattice_type = Oxs_SimState::LATTICE2;
+  tstate_.total_lattice = NULL;
+  tstate_.lattice1 = &tstate1_;
+  tstate_.lattice2 = &tstate2_;
+  tstate1_.total_lattice = &tstate_;
+  tstate1_.lattice1 = NULL;
+  tstate1_.lattice2 = &tstate2_;
+  tstate2_.total_lattice = &tstate_;
+  tstate2_.lattice1 = &tstate1_;
+  tstate2_.lattice2 = NULL;
+  tstate1_.T = wstate1_.T;
+  tstate2_.T = wstate2_.T;
+  tstate1_.Tc = wstate1_.Tc;
+  tstate2_.Tc = wstate2_.Tc;
+  tstate1_.m_e = wstate1_.m_e;
+  tstate2_.m_e = wstate2_.m_e;
+  tstate1_.chi_l = wstate1_.chi_l;
+  tstate2_.chi_l = wstate2_.chi_l;
+}
+
+void YY_2LatRKEvolve::FillMidpointSublattice(
+    const Oxs_SimState& cstate_,
+    const Oxs_SimState& wstate_,
+    Oxs_SimState& tstate_) const
+{
+  const OC_INDEX size = cstate_.mesh->Size();
+  const Oxs_MeshValue<OC_REAL8m>& cMs = *(cstate_.Ms);
+  const Oxs_MeshValue<OC_REAL8m>& wMs = *(wstate_.Ms);
+  Oxs_MeshValue<OC_REAL8m>& tMs = *(tstate_.Ms);
+  Oxs_MeshValue<OC_REAL8m>& tMs_inverse = *(tstate_.Ms_inverse);
+  tstate_.spin.AdjustSize(cstate_.mesh);
+  for(OC_INDEX i=0;i<size;++i) {
+    ThreeVector tempspin = cstate_.spin[i];
+    tempspin += wstate_.spin[i];
+    tempspin.MakeUnit();
+    tstate_.spin[i] = tempspin;
+    tMs[i] = 0.5*(cMs[i] + wMs[i]);
+    if(tMs[i] != 0.0) {
+      tMs_inverse[i] = 1.0/tMs[i];
+    } else {
+      tMs_inverse[i] = 0.0;
+    }
+  }
+}
+
+OC_REAL8m YY_2LatRKEvolve::CayleyUpdate(
+    const Oxs_SimState& cstate_,
+    const Oxs_SimState& mstate_,
+    const StagePool& pool_,
+    int slot_,
+    OC_REAL8m stepsize_,
+    Oxs_SimState& wstate_) const
+{
+  const OC_INDEX size = cstate_.mesh->Size();
+  const Oxs_MeshValue<ThreeVector>& dm_dt_t = pool_.dm_dt_t[slot_];
+  const Oxs_MeshValue<OC_REAL8m>& dlnMs_dt = pool_.dlnMs_dt[slot_];
+  const Oxs_MeshValue<OC_REAL8m>& Ms_0 = *(cstate_.Ms);
+  const Oxs_MeshValue<OC_REAL8m>& Ms0 = *(cstate_.Ms0);
+  const Oxs_MeshValue<OC_REAL8m>& Ms0_inverse = *(cstate_.Ms0_inverse);
+  Oxs_MeshValue<OC_REAL8m>& wMs = *(wstate_.Ms);
+  Oxs_MeshValue<OC_REAL8m>& wMs_inverse = *(wstate_.Ms_inverse);
+  OC_REAL8m max_change_sq = 0.0;
+
+  for(OC_INDEX i=0;i<size;++i) {
+    // dm/dt = m x w at the midpoint, so w (less its component along
+    // m, which does not enter) is dm/dt x m.  The midpoint rule
+    //   m1 - m0 = (m0 + m1) x a,  a = h*w/2
+    // is solved exactly by a rotation of m0 about a.
+    ThreeVector a = dm_dt_t[i] ^ mstate_.spin[i];
+    a *= 0.5*stepsize_;
+    const ThreeVector& m0 = cstate_.spin[i];
+    OC_REAL8m asq = a.MagSq();
+    ThreeVector tempspin = (1.0-asq)*m0;
+    tempspin += 2.0*(m0^a);
+    tempspin += (2.0*(a*m0))*a;
+    tempspin *= 1.0/(1.0+asq);
+
+    // Longitudinal part, rate at the midpoint
+    OC_REAL8m scale = 1.0 + stepsize_*dlnMs_dt[i];
+    if(scale<0.0) {
+      tempspin *= -1;
+      scale = -scale;
+    }
+    OC_REAL8m newMs = scale*Ms_0[i];
+    if(newMs > Ms0[i]) newMs = Ms0[i];
+
+    ThreeVector diff = tempspin - wstate_.spin[i];
+    OC_REAL8m dMs = (newMs - wMs[i])*Ms0_inverse[i];
+    OC_REAL8m change_sq = diff.MagSq() + dMs*dMs;
+    if(change_sq>max_change_sq) max_change_sq = change_sq;
+
+    wstate_.spin[i] = tempspin;
+    wMs[i] = newMs;
+    if(newMs != 0.0) {
+      wMs_inverse[i] = 1.0/newMs;
+    } else {
+      wMs_inverse[i] = 0.0;
+    }
+  }
+  return sqrt(max_change_sq);
+}
+
+OC_BOOL YY_2LatRKEvolve::MidpointIterate(
+    const Oxs_SimState& cstate1_,
+    const Oxs_SimState& cstate2_,
+    Oxs_SimState& wstate_,
+    Oxs_SimState& wstate1_,
+    Oxs_SimState& wstate2_,
+    OC_REAL8m stepsize_,
+    int& iterations_)
+{
+  // Euler predictor from the derivative at the current state
+  static const OC_REAL8m euler_coef[1] = { 1.0 };
+  AdvanceSublattice(cstate1_,stepsize_,pool1,euler_coef,1,wstate1_);
+  AdvanceSublattice(cstate2_,stepsize_,pool2,euler_coef,1,wstate2_);
+
+  Oxs_Key<Oxs_SimState> tempkey, tempkey1, tempkey2;
+  OC_REAL8m stage_pE_pt, stage_max_dm_dt, stage_dE_dt;
+  stage_mxH1.AdjustSize(cstate1_.mesh);
+  stage_mxH2.AdjustSize(cstate1_.mesh);
+  OC_BOOL converged = 0;
+  for(iterations_=1;iterations_<=midpoint_max_iterations;++iterations_) {
+    director->GetNewSimulationState(tempkey);
+    director->GetNewSimulationState(tempkey1);
+    director->GetNewSimulationState(tempkey2);
+    Oxs_SimState& tstate = tempkey.GetWriteReference();
+    Oxs_SimState& tstate1 = tempkey1.GetWriteReference();
+    Oxs_SimState& tstate2 = tempkey2.GetWriteReference();
+    SetupStageStates(wstate_,wstate1_,wstate2_,0.5*stepsize_,
+                     tstate,tstate1,tstate2);
+    FillMidpointSublattice(cstate1_,wstate1_,tstate1);
+    FillMidpointSublattice(cstate2_,wstate2_,tstate2);
+    FillTotalState(tstate1,tstate2,tstate);
+    const Oxs_SimState& mstate1 = tempkey1.GetReadReference();
+    const Oxs_SimState& mstate2 = tempkey2.GetReadReference();
+    const Oxs_SimState& mstate = tempkey.GetReadReference();
+    ComputeStage(mstate,stage_mxH1,stage_mxH2,1,
+                 stage_pE_pt,stage_max_dm_dt,stage_dE_dt);
+    OC_REAL8m change
+      = CayleyUpdate(cstate1_,mstate1,pool1,1,stepsize_,wstate1_);
+    OC_REAL8m change2
+      = CayleyUpdate(cstate2_,mstate2,pool2,1,stepsize_,wstate2_);
+    if(change2>change) change = change2;
+    if(change<=midpoint_tolerance) {
+      converged = 1;
+      break;
+    }
+  }
+  if(iterations_>midpoint_max_iterations) {
+    iterations_ = midpoint_max_iterations;
+  }
+  tempkey.Release();
+  tempkey1.Release();
+  tempkey2.Release();
+
+  FillTotalState(wstate1_,wstate2_,wstate_);
+  return converged;
+}
+
+OC_REAL8m YY_2LatRKEvolve::StageError(const StagePool& pool_) const
+{
+  const OC_INDEX size = pool_.dm_dt_t[0].Size();
+  OC_REAL8m max_error_sq = 0.0;
+  for(OC_INDEX i=0;i<size;++i) {
+    ThreeVector err_t(0.,0.,0.);
+    OC_REAL8m err_l = 0.0;
+    for(int j=0;j<RK_STAGES;++j) {
+      if(DP_E[j]==0.0) continue;
+      err_t += DP_E[j]*pool_.dm_dt_t[j][i];
+      err_l += DP_E[j]*pool_.dlnMs_dt[j][i];
+    }
+    OC_REAL8m error_sq = err_t.MagSq() + err_l*err_l;
+    if(error_sq>max_error_sq) max_error_sq = error_sq;
+  }
+  return sqrt(max_error_sq);
+}
+
+OC_BOOL
+YY_2LatRKEvolve::Step(const YY_2LatTimeDriver* driver,
+          Oxs_ConstKey<Oxs_SimState> current_state,
+          Oxs_ConstKey<Oxs_SimState> current_state1,
+          Oxs_ConstKey<Oxs_SimState> current_state2,
+          const Oxs_DriverStepInfo& /* step_info */,
+          Oxs_Key<Oxs_SimState>& next_state,
+          Oxs_Key<Oxs_SimState>& next_state1,
+          Oxs_Key<Oxs_SimState>& next_state2)
+{
+  const OC_REAL8m max_step_increase = 5.0;
+  const OC_REAL8m max_step_decrease = 0.2;
+
+  OC_INDEX size,i; // Mesh size and indexing variable
+
+  const Oxs_SimState& cstate = current_state.GetReadReference();
+  const Oxs_SimState& cstate1 = current_state1.GetReadReference();
+  const Oxs_SimState& cstate2 = current_state2.GetReadReference();
+  Oxs_SimState& workstate = next_state.GetWriteReference();
+  Oxs_SimState& workstate1 = next_state1.GetWriteReference();
+  Oxs_SimState& workstate2 = next_state2.GetWriteReference();
+  driver->FillState(cstate,workstate);
+  driver->FillState(cstate1,workstate1);
+  driver->FillState(cstate2,workstate2);
+
+  // Set pointers to the sublattice
+  workstate.lattice1 = &workstate1;
+  workstate.lattice2 = &workstate2;
+  workstate1.total_lattice = &workstate;
+  workstate1.lattice2 = &workstate2;
+  workstate2.total_lattice = &workstate;
+  workstate2.lattice1 = &workstate1;
+  workstate1.lattice_type = Oxs_SimState::LATTICE1;
+  workstate2.lattice_type = Oxs_SimState::LATTICE2;
+
+  if(cstate.mesh->Id() != workstate.mesh->Id()) {
+    throw Oxs_Ext::Error(this,
+        "YY_2LatRKEvolve::Step: Oxs_Mesh not fixed across steps.");
+  }
+
+  if(cstate.Id() != workstate.previous_state_id) {
+    throw Oxs_Ext::Error(this,
+        "YY_2LatRKEvolve::Step: State continuity break detected.");
+  }
+
+  // Pull cached values out from cstate.  Pool slot 0 must hold the
+  // derivative at cstate.
+  if(energy_state_id != cstate.Id() || pool_state_id != cstate.Id()) {
+    // cached data out-of-date
+    UpdateDerivedOutputs(cstate);
+  }
+  OC_BOOL cache_good = 1;
+  OC_REAL8m max_dm_dt;
+  OC_REAL8m dE_dt, delta_E, pE_pt;
+
+  cache_good &= cstate.GetDerivedData("Max dm/dt",max_dm_dt);
+  cache_good &= cstate.GetDerivedData("dE/dt",dE_dt);
+  cache_good &= cstate.GetDerivedData("Delta E",delta_E);
+  cache_good &= cstate.GetDerivedData("pE/pt",pE_pt);
+  cache_good &= (energy_state_id == cstate.Id());
+  cache_good &= (pool_state_id == cstate.Id());
+
+  if(!cache_good) {
+    throw Oxs_Ext::Error(this,
+       "YY_2LatRKEvolve::Step: Invalid data cache.");
+  }
+
+  // First stage (FSAL).  Slot 0 holds the derivative at cstate, from
+  // the previous accepted step or from UpdateDerivedOutputs.
+  size = cstate.mesh->Size();
+  pool1.AdjustSize(cstate.mesh);
+  pool2.AdjustSize(cstate.mesh);
+
+  // Negotiate with driver over size of next step
+  OC_REAL8m stepsize = next_timestep;
+
+  if(stepsize<=0.0) {
+    if(start_dm < sqrt(DBL_MAX/4) * max_dm_dt) {
+      stepsize = start_dm / max_dm_dt;
+    } else {
+      stepsize = sqrt(DBL_MAX/4);
+    }
+  }
+  OC_BOOL forcestep=0;
+  // Insure step is not outside requested step bounds
+  if(stepsize<=min_timestep) {
+    // the step has to be forced here, to make sure we don't produce
+    // an infinite loop
+    stepsize = min_timestep;
+    forcestep = 1;
+  }
+  if(stepsize>max_timestep) stepsize = max_timestep;
+
+  workstate.last_timestep=stepsize;
+  workstate1.last_timestep=stepsize;
+  workstate2.last_timestep=stepsize;
+
+  if(cstate.stage_number != last_stage_number) {
+    // New stage
+    last_stage_number = cstate.stage_number;
+    workstate.stage_start_time = cstate.stage_start_time
+                                + cstate.stage_elapsed_time;
+    workstate.stage_elapsed_time = workstate.last_timestep;
+    workstate1.stage_start_time = cstate.stage_start_time
+                                + cstate.stage_elapsed_time;
+    workstate1.stage_elapsed_time = workstate1.last_timestep;
+    workstate2.stage_start_time = cstate.stage_start_time
+                                + cstate.stage_elapsed_time;
+    workstate2.stage_elapsed_time = workstate2.last_timestep;
+  } else {
+    workstate.stage_start_time = cstate.stage_start_time;
+    workstate.stage_elapsed_time = cstate.stage_elapsed_time
+                                  + workstate.last_timestep;
+    workstate1.stage_start_time = cstate.stage_start_time;
+    workstate1.stage_elapsed_time = cstate.stage_elapsed_time
+                                  + workstate1.last_timestep;
+    workstate2.stage_start_time = cstate.stage_start_time;
+    workstate2.stage_elapsed_time = cstate.stage_elapsed_time
+                                  + workstate2.last_timestep;
+  }
+  workstate.iteration_count = cstate.iteration_count + 1;
+  workstate.stage_iteration_count = cstate.stage_iteration_count + 1;
+  driver->FillStateSupplemental(workstate);
+  workstate1.iteration_count = cstate1.iteration_count + 1;
+  workstate1.stage_iteration_count = cstate1.stage_iteration_count + 1;
+  driver->FillStateSupplemental(workstate1);
+  workstate2.iteration_count = cstate2.iteration_count + 1;
+  workstate2.stage_iteration_count = cstate2.stage_iteration_count + 1;
+  driver->FillStateSupplemental(workstate2);
+
+  if(workstate.last_timestep>stepsize) {
+    // Driver wants to force this stepsize in order to end stage
+    // exactly at boundary.
+    forcestep=1;
+  }
+  stepsize = workstate.last_timestep;
+
+  OC_REAL8m ratio = 1.0; // Next step size relative to this one
+  if(step_method == RK_MIDPOINT) {
+    int iterations;
+    if(!MidpointIterate(cstate1,cstate2,workstate,workstate1,workstate2,
+                        stepsize,iterations) && !forcestep) {
+      // Reject step; the fixed-point iteration did not converge.
+      next_timestep = 0.5*stepsize;
+      return 0;
+    }
+    if(2*iterations<=midpoint_max_iterations) ratio = 1.25;
+  } else {
+    // Intermediate stages 1 through 5
+    Oxs_Key<Oxs_SimState> tempkey, tempkey1, tempkey2;
+    OC_REAL8m stage_pE_pt, stage_max_dm_dt, stage_dE_dt;
+    stage_mxH1.AdjustSize(cstate.mesh);
+    stage_mxH2.AdjustSize(cstate.mesh);
+    for(int s=1;s<RK_STAGES-1;++s) {
+      director->GetNewSimulationState(tempkey);
+      director->GetNewSimulationState(tempkey1);
+      director->GetNewSimulationState(tempkey2);
+      Oxs_SimState& tstate = tempkey.GetWriteReference();
+      Oxs_SimState& tstate1 = tempkey1.GetWriteReference();
+      Oxs_SimState& tstate2 = tempkey2.GetWriteReference();
+      SetupStageStates(workstate,workstate1,workstate2,
+                       (1.0-DP_C[s])*stepsize,tstate,tstate1,tstate2);
+      AdvanceSublattice(cstate1,stepsize,pool1,DP_A[s],s,tstate1);
+      AdvanceSublattice(cstate2,stepsize,pool2,DP_A[s],s,tstate2);
+      FillTotalState(tstate1,tstate2,tstate);
+      tempkey1.GetReadReference();  // Release write locks
+      tempkey2.GetReadReference();
+      const Oxs_SimState& tstate_read = tempkey.GetReadReference();
+      ComputeStage(tstate_read,stage_mxH1,stage_mxH2,s,
+                   stage_pE_pt,stage_max_dm_dt,stage_dE_dt);
+    }
+    tempkey.Release();
+    tempkey1.Release();
+    tempkey2.Release();
+
+    // Candidate next state, from the fifth order weights
+    AdvanceSublattice(cstate1,stepsize,pool1,DP_A[6],6,workstate1);
+    AdvanceSublattice(cstate2,stepsize,pool2,DP_A[6],6,workstate2);
+    FillTotalState(workstate1,workstate2,workstate);
+  }
+  const Oxs_SimState& nstate1
+    = next_state1.GetReadReference();  // Release write lock
+  const Oxs_SimState& nstate2
+    = next_state2.GetReadReference();  // Release write lock
+  const Oxs_SimState& nstate
+    = next_state.GetReadReference();  // Release write lock
+
+  // Derivative at the new state; for dp54 this is the last stage,
+  // and for both methods it is the first stage of the next step.
+  OC_REAL8m new_pE_pt, new_max_dm_dt, new_dE_dt;
+  mxH1_output.cache.state_id = mxH2_output.cache.state_id = 0;
+  Oxs_MeshValue<ThreeVector>& new_mxH1 = MxHTarget(mxH1_output,stage_mxH1);
+  Oxs_MeshValue<ThreeVector>& new_mxH2 = MxHTarget(mxH2_output,stage_mxH2);
+  ComputeStage(nstate,new_mxH1,new_mxH2,6,
+               new_pE_pt,new_max_dm_dt,new_dE_dt);
+  if(&new_mxH1 != &stage_mxH1) mxH1_output.cache.state_id=nstate.Id();
+  if(&new_mxH2 != &stage_mxH2) mxH2_output.cache.state_id=nstate.Id();
+
+  YY_2LatBlockSum dE_sum;
+  for(i=0;i<size;++i) {
+    dE_sum += (new_energy[i] - energy[i]) * nstate.mesh->Volume(i);
+  }
+  const OC_REAL8m dE = dE_sum.GetValue();
+
+  if(step_method == RK_DP54) {
+    // Error estimate, in radians (transverse) and relative Ms change
+    // (longitudinal), maximum across both sublattices.
+    OC_REAL8m max_error = OC_MAX(StageError(pool1),StageError(pool2));
+    max_error *= stepsize;
+
+    OC_REAL8m allowed_error = DBL_MAX;
+    if(allowed_error_rate>=0.) {
+      allowed_error = allowed_error_rate*stepsize;
+    }
+    if(allowed_absolute_step_error>=0.
+       && allowed_absolute_step_error<allowed_error) {
+      allowed_error = allowed_absolute_step_error;
+    }
+    if(allowed_relative_step_error>=0.
+       && allowed_relative_step_error*max_dm_dt*stepsize<allowed_error) {
+      allowed_error = allowed_relative_step_error*max_dm_dt*stepsize;
+    }
+
+    // Step size that would just meet the error restriction, relative
+    // to the current step.  The local error of the embedded pair
+    // scales as the fifth power of the step.
+    ratio = max_step_increase;
+    if(max_error>0.0 && allowed_error<DBL_MAX) {
+      ratio = step_headroom*pow(allowed_error/max_error,0.2);
+    }
+    if(ratio>max_step_increase) ratio = max_step_increase;
+    if(ratio<max_step_decrease) ratio = max_step_decrease;
+
+    if(!forcestep && max_error>allowed_error) {
+      // Reject step
+      next_timestep = ratio*stepsize;
+      return 0;
+    }
+  }
+
+  // Otherwise, accept step.
+  next_timestep = ratio*stepsize;
+
+  if(!nstate.AddDerivedData("Max dm/dt",new_max_dm_dt) ||
+     !nstate.AddDerivedData("dE/dt",new_dE_dt) ||
+     !nstate.AddDerivedData("Delta E",dE) ||
+     !nstate.AddDerivedData("pE/pt",new_pE_pt)) {
+    throw Oxs_Ext::Error(this,
+       "YY_2LatRKEvolve::Step:"
+       " Programming error; data cache already set.");
+  }
+
+  // Slot 6 becomes slot 0 of the next step, and is exported through
+  // the dm_dt output caches if requested.
+  pool1.dm_dt_t[0].Swap(pool1.dm_dt_t[6]);
+  pool1.dlnMs_dt[0].Swap(pool1.dlnMs_dt[6]);
+  pool2.dm_dt_t[0].Swap(pool2.dm_dt_t[6]);
+  pool2.dlnMs_dt[0].Swap(pool2.dlnMs_dt[6]);
+  pool_state_id = nstate.Id();
+  FillDmDtOutputs(nstate);
+
+  energy.Swap(new_energy);
+  energy_state_id = nstate.Id();
+
+  return 1;  // Good step
+}   // end Step
+
+void YY_2LatRKEvolve::UpdateDerivedOutputs(const Oxs_SimState& state)
+{ // This routine fills all the YY_2LatRKEvolve Oxs_ScalarOutput's to
+  // the appropriate value based on the import "state", and any of
+  // Oxs_VectorOutput's that have CacheRequest enabled are filled.
+  // It also makes sure all the expected WOO objects in state are
+  // filled.
+  max_dm_dt_output.cache.state_id
+    = dE_dt_output.cache.state_id
+    = delta_E_output.cache.state_id
+    = 0;  // Mark change in progress
+
+  // If temperature has not been set up, do so. It is required in exchange
+  // energy calculation.
+  if(!temperature.CheckMesh(state.mesh)) {
+    YY_2LatFillMeshValue(temperature_init.GetPtr(),state.mesh,temperature);
+  }
+  if(state.lattice1->T==NULL) {
+    state.lattice1->T = &temperature;
+    state.lattice2->T = &temperature;
+  }
+
+  OC_REAL8m dummy_value;
+  if(!state.GetDerivedData("Max dm/dt",max_dm_dt_output.cache.value) ||
+     !state.GetDerivedData("dE/dt",dE_dt_output.cache.value) ||
+     !state.GetDerivedData("Delta E",delta_E_output.cache.value) ||
+     !state.GetDerivedData("pE/pt",dummy_value) ||
+     energy_state_id != state.Id() ||
+     pool_state_id != state.Id() ||
+     (mxH1_output.GetCacheRequestCount()>0
+      && mxH1_output.cache.state_id != state.Id()) ||
+     (mxH2_output.GetCacheRequestCount()>0
+      && mxH2_output.cache.state_id != state.Id()) ) {
+
+    // Missing at least some data, so calculate from scratch.  The
+    // energy pass fills Tc, which the damping arrays depend on.
+    mxH1_output.cache.state_id = mxH2_output.cache.state_id = 0;
+    Oxs_MeshValue<ThreeVector>& mxH1 = MxHTarget(mxH1_output,stage_mxH1);
+    Oxs_MeshValue<ThreeVector>& mxH2 = MxHTarget(mxH2_output,stage_mxH2);
+    OC_REAL8m pE_pt;
+    GetEnergyDensity(state,energy,&mxH1,&mxH2,
+                     &total_field1,&total_field2,pE_pt);
+    energy_state_id=state.Id();
+    if(&mxH1 != &stage_mxH1) mxH1_output.cache.state_id=state.Id();
+    if(&mxH2 != &stage_mxH2) mxH2_output.cache.state_id=state.Id();
+    UpdateMeshArrays(state);
+
+    if(!state.GetDerivedData("pE/pt",dummy_value)) {
+      state.AddDerivedData("pE/pt",pE_pt);
+    }
+
+    // Calculate dm/dt, Max dm/dt and dE/dt into slot 0 of the pool
+    pool1.AdjustSize(state.mesh);
+    pool2.AdjustSize(state.mesh);
+    pool_state_id = 0;
+    OC_REAL8m max1,max2,dE1,dE2;
+    Calculate_dm_dt(*(state.lattice1),mxH1,total_field1,
+                    pool1.dm_dt_t[0],pool1.dlnMs_dt[0],max1,dE1);
+    Calculate_dm_dt(*(state.lattice2),mxH2,total_field2,
+                    pool2.dm_dt_t[0],pool2.dlnMs_dt[0],max2,dE2);
+    pool_state_id = state.Id();
+    max_dm_dt_output.cache.value = OC_MAX(max1,max2);
+    dE_dt_output.cache.value = dE1 + dE2 + pE_pt;
+
+    if(!state.GetDerivedData("Max dm/dt",dummy_value)) {
+      state.AddDerivedData("Max dm/dt",max_dm_dt_output.cache.value);
+    }
+    if(!state.GetDerivedData("dE/dt",dummy_value)) {
+      state.AddDerivedData("dE/dt",dE_dt_output.cache.value);
+    }
+
+    if(!state.GetDerivedData("Delta E",dummy_value)) {
+      if(state.previous_state_id!=0 && state.stage_iteration_count>0) {
+        throw Oxs_Ext::Error(this,
+           "YY_2LatRKEvolve::UpdateDerivedOutputs:"
+           " Can't derive Delta E from single state.");
+      }
+      state.AddDerivedData("Delta E",0.0);
+      dummy_value = 0.;
+    }
+    delta_E_output.cache.value=dummy_value;
+  }
+
+  max_dm_dt_output.cache.value*=(180e-9/PI);
+  /// Convert from radians/second to deg/ns
+
+  FillDmDtOutputs(state);
+
+  max_dm_dt_output.cache.state_id
+    = dE_dt_output.cache.state_id
+    = delta_E_output.cache.state_id
+    = state.Id();
+}   // end UpdateDerivedOutputs
+
+Oxs_MeshValue<ThreeVector>&
+YY_2LatRKEvolve::MxHTarget
+(Oxs_VectorFieldOutput<YY_2LatRKEvolve>& mxH_output_,
+ Oxs_MeshValue<ThreeVector>& scratch_)
+{
+  if(mxH_output_.GetCacheRequestCount()>0) {
+    return mxH_output_.cache.value;
+  }
+  mxH_output_.cache.value.Release();
+  return scratch_;
+}
+
+void YY_2LatRKEvolve::FillDmDtOutputs(const Oxs_SimState& state_)
+{ // Pool slot 0 must hold the derivative at state_.  The longitudinal
+  // outputs are dm/dt = d(ln Ms)/dt * m.
+  Oxs_VectorFieldOutput<YY_2LatRKEvolve>* const t_output[2]
+    = { &dm_dt_t1_output, &dm_dt_t2_output };
+  Oxs_VectorFieldOutput<YY_2LatRKEvolve>* const l_output[2]
+    = { &dm_dt_l1_output, &dm_dt_l2_output };
+  const StagePool* const pool[2] = { &pool1, &pool2 };
+  const Oxs_SimState* const lstate[2] = { state_.lattice1, state_.lattice2 };
+  const OC_INDEX size = state_.mesh->Size();
+  for(int ilat=0;ilat<2;++ilat) {
+    Oxs_VectorFieldOutput<YY_2LatRKEvolve>& tout = *(t_output[ilat]);
+    if(tout.GetCacheRequestCount()>0) {
+      if(tout.cache.state_id != state_.Id()) {
+        tout.cache.state_id = 0;
+        tout.cache.value = pool[ilat]->dm_dt_t[0];
+        tout.cache.state_id = state_.Id();
+      }
+    } else {
+      tout.cache.state_id = 0;
+      tout.cache.value.Release();
+    }
+    Oxs_VectorFieldOutput<YY_2LatRKEvolve>& lout = *(l_output[ilat]);
+    if(lout.GetCacheRequestCount()>0) {
+      if(lout.cache.state_id != state_.Id()) {
+        lout.cache.state_id = 0;
+        lout.cache.value.AdjustSize(state_.mesh);
+        const Oxs_MeshValue<OC_REAL8m>& dlnMs_dt = pool[ilat]->dlnMs_dt[0];
+        const Oxs_MeshValue<ThreeVector>& spin = lstate[ilat]->spin;
+        for(OC_INDEX i=0;i<size;++i) {
+          lout.cache.value[i] = dlnMs_dt[i]*spin[i];
+        }
+        lout.cache.state_id = state_.Id();
+      }
+    } else {
+      lout.cache.state_id = 0;
+      lout.cache.value.Release();
+    }
+  }
+}
@@ -0,0 +1,302 @@
+/** FILE: yy_2latrkevolve.h                 -*-Mode: c++-*-
+ *
+ * Runge-Kutta evolver for the deterministic two-lattice
+ * Landau-Lifshitz-Bloch equation: adaptive Dormand-Prince 5(4), or
+ * the norm-preserving implicit midpoint rule.  It is based on
+ * YY_2LatEulerEvolve and the RKF54 step in Oxs_RungeKuttaEvolve.
+ *
+ * Copyright (C) 2015 Yu Yahagi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _YY_2LATRKEVOLVE
+#define _YY_2LATRKEVOLVE
+
+#include "nb.h"
+
+#include "yy_2lattimeevolver.h"
+#include "key.h"
+#include "output.h"
+#include "scalarfield.h"
+
+/* End includes */
+
+class YY_2LatRKEvolve:public YY_2LatTimeEvolver {
+private:
+  mutable OC_UINT4m mesh_id;
+
+  // =======================================================================
+  // Stepsize control and error criteria.  See notes at the bottom.
+  // =======================================================================
+  OC_REAL8m min_timestep;   // Seconds
+  OC_REAL8m max_timestep;   // Seconds
+
+  OC_REAL8m allowed_error_rate;
+  OC_REAL8m allowed_absolute_step_error;
+  OC_REAL8m allowed_relative_step_error;
+  OC_REAL8m step_headroom;
+
+  OC_REAL8m start_dm;
+
+  // Step method.  RK_DP54 is the adaptive Dormand-Prince pair;
+  // RK_MIDPOINT is the implicit midpoint rule, see notes at the bottom.
+  enum StepMethod { RK_INVALID, RK_DP54, RK_MIDPOINT } step_method;
+  OC_REAL8m midpoint_tolerance;    // radians
+  OC_INT4m midpoint_max_iterations;
+
+  // Evolver control parameters
+  OC_BOOL do_precess;
+  OC_BOOL allow_signed_gamma;
+  enum GammaStyle { GS_INVALID, GS_LL, GS_G };
+  GammaStyle gamma1_style, gamma2_style;  // Landau-Lifshitz or Gilbert
+
+  // =======================================================================
+  // Spatially variable coefficients
+  // =======================================================================
+  Oxs_OwnedPointer<Oxs_ScalarField> gamma1_init, gamma2_init;
+  mutable Oxs_MeshValue<OC_REAL8m> gamma1, gamma2;        // LL gyromagnetic ratio
+  Oxs_OwnedPointer<Oxs_ScalarField> alpha_t1_init, alpha_t2_init;
+  mutable Oxs_MeshValue<OC_REAL8m> alpha_t1, alpha_t2;    // transverse
+  mutable Oxs_MeshValue<OC_REAL8m> alpha_l1, alpha_l2;    // longitudinal
+  mutable Oxs_MeshValue<OC_REAL8m> alpha_t10, alpha_t20;
+  // alpha_t10, _t20 are the values at T = 0 K.
+
+  // Temperature is fixed in time.  There is no stochastic field, so
+  // the dynamics are deterministic at any temperature.
+  Oxs_OwnedPointer<Oxs_ScalarField> temperature_init;
+  Oxs_MeshValue<OC_REAL8m> temperature; // in Kelvin
+  OC_INDEX last_stage_number;
+
+  void UpdateMeshArrays(const Oxs_SimState& state);
+  // Call with the total_lattice state and it updates values for both
+  // sublattices.  Needs Tc from the exchange term if temperature is
+  // not zero everywhere.
+
+  // =======================================================================
+  // Caches and scratch spaces
+  // =======================================================================
+  // Data cached from last state
+  OC_UINT4m energy_state_id;
+  Oxs_MeshValue<OC_REAL8m> energy;
+  OC_REAL8m next_timestep;
+
+  // Scratch space
+  Oxs_MeshValue<OC_REAL8m> new_energy;
+  Oxs_MeshValue<ThreeVector> total_field1, total_field2;  // For sublattices
+  Oxs_MeshValue<ThreeVector> stage_mxH1, stage_mxH2;
+
+  // Stage derivative pool.  Each sublattice keeps one slot per
+  // Dormand-Prince stage; the transverse part is stored as dm/dt of
+  // the unit spin and the longitudinal part as the relative rate
+  // d(ln Ms)/dt.  Slot 0 holds the derivative at the current state
+  // (FSAL), and slot 6 is the derivative at the candidate next state,
+  // which becomes slot 0 of the next step.  pool_state_id tags slot 0.
+  // The slots are sized on first use and reused across steps; Init()
+  // returns them.
+  enum { RK_STAGES = 7 };
+  struct StagePool {
+    Oxs_MeshValue<ThreeVector> dm_dt_t[RK_STAGES];
+    Oxs_MeshValue<OC_REAL8m>   dlnMs_dt[RK_STAGES];
+    void AdjustSize(const Oxs_Mesh* mesh);
+    void Release();
+  } pool1, pool2;
+  OC_UINT4m pool_state_id; // Id of the state whose derivative is in slot 0
+
+  // Ms storage for the intermediate stage states.  The driver only
+  // double buffers Ms for current and next state, so the evolver
+  // supplies its own arrays for the stage states it creates.
+  Oxs_MeshValue<OC_REAL8m> stage_Ms, stage_Ms_inverse;
+  Oxs_MeshValue<OC_REAL8m> stage_Ms1, stage_Ms1_inverse;
+  Oxs_MeshValue<OC_REAL8m> stage_Ms2, stage_Ms2_inverse;
+
+  void Calculate_dm_dt
+  (const Oxs_SimState& state_,
+   const Oxs_MeshValue<ThreeVector>& mxH_,
+   const Oxs_MeshValue<ThreeVector>& total_field_,
+   Oxs_MeshValue<ThreeVector>& dm_dt_t_,
+   Oxs_MeshValue<OC_REAL8m>& dlnMs_dt_,
+   OC_REAL8m& max_dm_dt_,
+   OC_REAL8m& dE_dt_sum_);
+  /// Deterministic LLB right-hand side for one sublattice.
+  /// Imports: state_, mxH_, total_field_
+  /// Exports: dm_dt_t_, dlnMs_dt_, max_dm_dt_ (over both components)
+  /// and dE_dt_sum_ (transverse terms only, not including pE/pt).
+
+  void AdvanceSublattice
+  (const Oxs_SimState& cstate_,
+   OC_REAL8m stepsize_,
+   const StagePool& pool_,
+   const OC_REAL8m* coef_,
+   int coef_count_,
+   Oxs_SimState& wstate_) const;
+  /// Fills spin and Ms of wstate_ with
+  ///   cstate_ + stepsize_ * sum_j coef_[j] * stage_j,
+  /// j = 0..coef_count_-1, using the same update rules as the Euler
+  /// step: transverse part renormalized onto the unit sphere, Ms
+  /// scaled by the longitudinal increment and clamped to [0,Ms0].
+
+  void FillTotalState(const Oxs_SimState& wstate1_,
+                      const Oxs_SimState& wstate2_,
+                      Oxs_SimState& wstate_) const;
+  /// Vector sum of the two sublattices into wstate_.
+
+  void SetupStageStates
+  (const Oxs_SimState& wstate_,
+   const Oxs_SimState& wstate1_,
+   const Oxs_SimState& wstate2_,
+   OC_REAL8m stage_offset_,
+   Oxs_SimState& tstate_,
+   Oxs_SimState& tstate1_,
+   Oxs_SimState& tstate2_);
+  /// Headers for an intermediate stage state, stage_offset_ seconds
+  /// before the candidate next state wstate_.  Ms points at the
+  /// stage_Ms* arrays.
+
+  void FillMidpointSublattice
+  (const Oxs_SimState& cstate_,
+   const Oxs_SimState& wstate_,
+   Oxs_SimState& tstate_) const;
+  /// Spin and Ms of tstate_ halfway between cstate_ and wstate_.
+
+  OC_REAL8m CayleyUpdate
+  (const Oxs_SimState& cstate_,
+   const Oxs_SimState& mstate_,
+   const StagePool& pool_,
+   int slot_,
+   OC_REAL8m stepsize_,
+   Oxs_SimState& wstate_) const;
+  /// One implicit midpoint update of wstate_ from cstate_, using the
+  /// derivative in pool slot slot_ evaluated at the midpoint state
+  /// mstate_.  The transverse part is an exact rotation (Cayley
+  /// transform), so |spin| is preserved.  Returns the largest change
+  /// in wstate_ relative to its previous content.
+
+  OC_BOOL MidpointIterate
+  (const Oxs_SimState& cstate1_,
+   const Oxs_SimState& cstate2_,
+   Oxs_SimState& wstate_,
+   Oxs_SimState& wstate1_,
+   Oxs_SimState& wstate2_,
+   OC_REAL8m stepsize_,
+   int& iterations_);
+  /// Fixed-point solve of the implicit midpoint rule for both
+  /// sublattices, starting from an Euler predictor.  Returns true
+  /// if the iteration converged to midpoint_tolerance.
+
+  OC_REAL8m StageError(const StagePool& pool_) const;
+  /// Max over cells of the embedded error estimate per unit time,
+  /// combining transverse (rad) and longitudinal (relative) parts.
+
+  void ComputeStage
+  (const Oxs_SimState& state_,
+   Oxs_MeshValue<ThreeVector>& mxH1_,
+   Oxs_MeshValue<ThreeVector>& mxH2_,
+   int slot_,
+   OC_REAL8m& pE_pt_,
+   OC_REAL8m& max_dm_dt_,
+   OC_REAL8m& dE_dt_);
+  /// Energy evaluation plus Calculate_dm_dt for both sublattices at
+  /// state_, writing into pool slot slot_.  Energy density goes into
+  /// new_energy.
+
+  // =======================================================================
+  // Outputs
+  // =======================================================================
+  void UpdateDerivedOutputs(const Oxs_SimState&);
+  Oxs_MeshValue<ThreeVector>&
+  MxHTarget(Oxs_VectorFieldOutput<YY_2LatRKEvolve>& mxH_output_,
+            Oxs_MeshValue<ThreeVector>& scratch_);
+  /// The mxH output caches are held only while an output requests
+  /// them.  Returns the cache to fill, or releases it and returns
+  /// scratch_.
+  void FillDmDtOutputs(const Oxs_SimState& state_);
+  /// Copies pool slot 0 into those dm/dt output caches that are
+  /// requested, and releases the others.
+  Oxs_ScalarOutput<YY_2LatRKEvolve> max_dm_dt_output;
+  Oxs_ScalarOutput<YY_2LatRKEvolve> dE_dt_output;
+  Oxs_ScalarOutput<YY_2LatRKEvolve> delta_E_output;
+  Oxs_VectorFieldOutput<YY_2LatRKEvolve> dm_dt_t1_output, dm_dt_t2_output;
+  Oxs_VectorFieldOutput<YY_2LatRKEvolve> dm_dt_l1_output, dm_dt_l2_output;
+  Oxs_VectorFieldOutput<YY_2LatRKEvolve> mxH1_output, mxH2_output;
+
+  // Disable copy constructor and assignment operator by declaring
+  // them without defining them.
+  YY_2LatRKEvolve(const YY_2LatRKEvolve&);
+  YY_2LatRKEvolve& operator=(const YY_2LatRKEvolve&);
+
+public:
+  virtual const char* ClassName() const; // ClassName() is
+  /// automatically generated by the OXS_EXT_REGISTER macro.
+  virtual OC_BOOL Init();
+  YY_2LatRKEvolve(const char* name,     // Child instance id
+     Oxs_Director* newdtr, // App director
+     const char* argstr);  // MIF input block parameters
+  virtual ~YY_2LatRKEvolve();
+
+  virtual  OC_BOOL
+  Step(const YY_2LatTimeDriver* driver,
+       Oxs_ConstKey<Oxs_SimState> current_state,
+       Oxs_ConstKey<Oxs_SimState> current_state1,
+       Oxs_ConstKey<Oxs_SimState> current_state2,
+       const Oxs_DriverStepInfo& step_info,
+       Oxs_Key<Oxs_SimState>& next_state,
+       Oxs_Key<Oxs_SimState>& next_state1,
+       Oxs_Key<Oxs_SimState>& next_state2);
+  // Returns true if step was successful, false if
+  // unable to step as requested.
+};
+
+/**
+ * Notes on timestep control and error criteria
+ *
+ * The step is the Dormand-Prince 5(4) pair with first-same-as-last
+ * (FSAL), so an accepted step costs six energy evaluations and a
+ * rejected step costs six as well (the derivative at the current
+ * state is reused).  The solution is advanced with the fifth order
+ * weights; the difference to the embedded fourth order solution is
+ * the local error estimate.
+ *
+ * The error is measured per cell as the norm of the transverse
+ * error (radians) and the longitudinal error (relative change of
+ * Ms), and the maximum is taken across all cells of both sublattices.
+ * The three control parameters have the same meaning as in
+ * YY_2LatEulerEvolve:
+ *
+ * allowed_error_rate           error/stepsize, MIF units deg/ns
+ * allowed_absolute_step_error  error, MIF units deg
+ * allowed_relative_step_error  error/(max_dm_dt*stepsize)
+ *
+ * The next step is sized from (allowed/error)^(1/5), scaled by
+ * step_headroom and limited to a factor in [1/5,5] of the previous
+ * step.  min_timestep and max_timestep bound the step; a step at
+ * min_timestep is always accepted.
+ *
+ * With method midpoint, each step solves the implicit midpoint rule
+ *   m1 = m0 + h * f((m0+m1)/2)
+ * by fixed-point iteration, one energy evaluation per iteration,
+ * plus one at the accepted state.  The transverse update is applied
+ * as a rotation of m0 about the midpoint precession axis, so the
+ * spin norm is preserved exactly and undamped precession neither
+ * gains nor loses energy.  The method is second order and has no
+ * embedded error estimate; the step is controlled by convergence of
+ * the iteration instead.  A step whose iteration does not reach
+ * midpoint_tolerance in midpoint_max_iterations is rejected and
+ * halved, and the step grows by 25% after steps that converged in
+ * at most half the allowed iterations.  Use max_timestep to bound
+ * the truncation error.
+ */
+
+#endif // _YY_2LATRKEVOLVE
@@ -19,6 +19,7 @@
  *
  */
 
+#include <math.h>
 #include <string>
 
 #include "nb.h"
@@ -42,7 +43,8 @@ YY_2LatTimeDriver::YY_2LatTimeDriver(
   const char* name,     // Child instance id
   Oxs_Director* newdtr, // App director
   const char* argstr)   // MIF input block parameters
-  : YY_2LatDriver(name,newdtr,argstr), max_dm_dt_obj_ptr(NULL)
+  : YY_2LatDriver(name,newdtr,argstr), max_dm_dt_obj_ptr(NULL),
+    ffs_restart(0)
 {
   // Process arguments
   OXS_GET_INIT_EXT_OBJECT("evolver",YY_2LatTimeEvolver,evolver_obj);
@@ -67,6 +69,16 @@ YY_2LatTimeDriver::YY_2LatTimeDriver(
   // If there is not, the following returns default value "oxs".
   String basename = GetStringInitValue("basename", "oxs");
 
+  if(HasInitValue("ffs")) {
+    YY_2LatFFSSpec ffs_spec;
+    String errmsg;
+    if(!YY_2LatParseFFSSpec(GetStringInitValue("ffs"),ffs_spec,errmsg)) {
+      String msg = String("Invalid ffs value: ") + errmsg;
+      throw Oxs_ExtError(this,msg.c_str());
+    }
+    ffs.Setup(ffs_spec);
+  }
+
   VerifyAllInitArgsUsed();
 
   last_timestep_output.Setup(
@@ -79,6 +91,21 @@ YY_2LatTimeDriver::YY_2LatTimeDriver(
   last_timestep_output.Register(director,0);
   simulation_time_output.Register(director,0);
 
+  if(ffs.Active()) {
+    ffs_lambda_output.Setup(
+           this,InstanceName(),"FFS order parameter","",0,
+           &YY_2LatTimeDriver::Fill__ffs_lambda_output);
+    ffs_rate_output.Setup(
+           this,InstanceName(),"FFS rate","1/s",0,
+           &YY_2LatTimeDriver::Fill__ffs_rate_output);
+    ffs_rate_error_output.Setup(
+           this,InstanceName(),"FFS rate error","1/s",0,
+           &YY_2LatTimeDriver::Fill__ffs_rate_error_output);
+    ffs_lambda_output.Register(director,0);
+    ffs_rate_output.Register(director,0);
+    ffs_rate_error_output.Register(director,0);
+  }
+
   // Reserve space for initial state (see GetInitialState() below)
   //director->ReserveSimulationStateRequest(3);
 }
@@ -174,6 +201,9 @@ YY_2LatTimeDriver::ChildIsStageDone(
 {
   OC_UINT4m stage_index = state.stage_number;
 
+  // Forward flux sampling runs until the rate is known.
+  if(ffs.Active()) return ffs.Done();
+
   // Stage time check
   OC_REAL8m stop_time=0.;
   if(stage_index >= stopping_time.size()) {
@@ -228,7 +258,7 @@ YY_2LatTimeDriver::ChildIsRunDone(
     const Oxs_SimState& /* state1 */,
     const Oxs_SimState& /* state2 */) const
 {
-  // No child-specific checks at this time...
+  if(ffs.Active()) return ffs.Done();
   return 0; // Run not done
 }
 
@@ -293,15 +323,95 @@ YY_2LatTimeDriver::Step(
   // is destroyed.
   Oxs_Key<YY_2LatTimeEvolver> temp_key = evolver_key;
   YY_2LatTimeEvolver& evolver = temp_key.GetWriteReference();
-  return evolver.Step(
-      this,
-      base_state,
-      base_state1,
-      base_state2,
-      stepinfo,
-      next_state,
-      next_state1,
-      next_state2);
+  if(!ffs.Active()) {
+    return evolver.Step(
+        this,
+        base_state,
+        base_state1,
+        base_state2,
+        stepinfo,
+        next_state,
+        next_state1,
+        next_state2);
+  }
+
+  const Oxs_SimState& cstate1 = base_state1.GetReadReference();
+  const Oxs_SimState& cstate2 = base_state2.GetReadReference();
+  if(!ffs.Started()) ffs.Start(cstate1,cstate2);
+  if(ffs_restart) {
+    FFSRestartState(base_state.GetReadReference(),cstate1,cstate2,
+                    next_state,next_state1,next_state2);
+    ffs_restart = 0;
+    return 1;
+  }
+  if(!evolver.Step(this,base_state,base_state1,base_state2,stepinfo,
+                   next_state,next_state1,next_state2)) {
+    return 0;
+  }
+  const Oxs_SimState& nstate = next_state.GetReadReference();
+  ffs_restart = ffs.Observe(next_state1.GetReadReference(),
+                            next_state2.GetReadReference(),
+                            nstate.last_timestep);
+  return 1;
+}
+
+void YY_2LatTimeDriver::FFSRestartState(
+    const Oxs_SimState& cstate,
+    const Oxs_SimState& cstate1,
+    const Oxs_SimState& cstate2,
+    Oxs_Key<Oxs_SimState>& next_state,
+    Oxs_Key<Oxs_SimState>& next_state1,
+    Oxs_Key<Oxs_SimState>& next_state2) const
+{ // Next state of a forward flux sampling branch point: the restart
+  // configuration at the current time, with a zero time step.
+  Oxs_SimState& workstate = next_state.GetWriteReference();
+  Oxs_SimState& workstate1 = next_state1.GetWriteReference();
+  Oxs_SimState& workstate2 = next_state2.GetWriteReference();
+  FillState(cstate,workstate);
+  FillState(cstate1,workstate1);
+  FillState(cstate2,workstate2);
+
+  workstate.lattice1 = &workstate1;
+  workstate.lattice2 = &workstate2;
+  workstate1.total_lattice = &workstate;
+  workstate1.lattice2 = &workstate2;
+  workstate2.total_lattice = &workstate;
+  workstate2.lattice1 = &workstate1;
+  workstate1.lattice_type = Oxs_SimState::LATTICE1;
+  workstate2.lattice_type = Oxs_SimState::LATTICE2;
+
+  Oxs_SimState* wstates[3] = { &workstate, &workstate1, &workstate2 };
+  const Oxs_SimState* cstates[3] = { &cstate, &cstate1, &cstate2 };
+  for(int j=0;j<3;++j) {
+    wstates[j]->last_timestep = 0.;
+    wstates[j]->stage_start_time = cstates[j]->stage_start_time;
+    wstates[j]->stage_elapsed_time = cstates[j]->stage_elapsed_time;
+    wstates[j]->iteration_count = cstates[j]->iteration_count + 1;
+    wstates[j]->stage_iteration_count
+      = cstates[j]->stage_iteration_count + 1;
+  }
+
+  ffs.Restore(workstate1,workstate2);
+  const OC_INDEX size = workstate.mesh->Size();
+  const Oxs_MeshValue<OC_REAL8m>& Ms1 = *(workstate1.Ms);
+  const Oxs_MeshValue<OC_REAL8m>& Ms2 = *(workstate2.Ms);
+  Oxs_MeshValue<OC_REAL8m>& Ms = *(workstate.Ms);
+  Oxs_MeshValue<OC_REAL8m>& Ms_inverse = *(workstate.Ms_inverse);
+  ThreeVector tempspin;
+  for(OC_INDEX i=0;i<size;++i) {
+    tempspin = Ms1[i]*workstate1.spin[i];
+    tempspin += Ms2[i]*workstate2.spin[i];
+    Ms[i] = sqrt(tempspin.MagSq());
+    tempspin.MakeUnit();
+    workstate.spin[i] = tempspin;
+    Ms_inverse[i] = (Ms[i]!=0.0 ? 1.0/Ms[i] : 0.0);
+  }
+
+  next_state1.GetReadReference();  // Release write locks
+  next_state2.GetReadReference();
+  const Oxs_SimState& nstate = next_state.GetReadReference();
+  // The jump carries no energy change the evolver could derive.
+  nstate.AddDerivedData("Delta E",0.0);
 }
 
 OC_BOOL
@@ -340,6 +450,28 @@ void YY_2LatTimeDriver::Fill__##NAME##_output(const Oxs_SimState& state) \
 
 OSO_FUNC(last_timestep)
 
+void
+YY_2LatTimeDriver::Fill__ffs_lambda_output(const Oxs_SimState& state)
+{
+  ffs_lambda_output.cache.state_id = state.Id();
+  ffs_lambda_output.cache.value
+    = ffs.OrderParameter(*(state.lattice1),*(state.lattice2));
+}
+
+void
+YY_2LatTimeDriver::Fill__ffs_rate_output(const Oxs_SimState& state)
+{
+  ffs_rate_output.cache.state_id = state.Id();
+  ffs_rate_output.cache.value = ffs.Rate();
+}
+
+void
+YY_2LatTimeDriver::Fill__ffs_rate_error_output(const Oxs_SimState& state)
+{
+  ffs_rate_error_output.cache.state_id = state.Id();
+  ffs_rate_error_output.cache.value = ffs.RateError();
+}
+
 void
 YY_2LatTimeDriver::Fill__simulation_time_output(const Oxs_SimState& state)
 {
@@ -28,6 +28,7 @@
 #include "key.h"
 #include "yy_2latdriver.h"
 #include "yy_2lattimeevolver.h"
+#include "yy_2lat_ffs.h"
 
 OC_USE_STD_NAMESPACE;
 
@@ -52,8 +53,24 @@ void Fill__##name##_output(const Oxs_SimState&); \
 Oxs_ScalarOutput<YY_2LatTimeDriver> name##_output
   OSO_DECL(last_timestep);
   OSO_DECL(simulation_time);
+  OSO_DECL(ffs_lambda);
+  OSO_DECL(ffs_rate);
+  OSO_DECL(ffs_rate_error);
 #undef OSO_DECL
 
+  // Forward flux sampling (ffs option).  When a trajectory ends, the
+  // next step is not taken by the evolver; instead the sampler's
+  // restart configuration is loaded into the next state.
+  YY_2LatFFSSampler ffs;
+  OC_BOOL ffs_restart;
+  void FFSRestartState(
+      const Oxs_SimState& cstate,
+      const Oxs_SimState& cstate1,
+      const Oxs_SimState& cstate2,
+      Oxs_Key<Oxs_SimState>& next_state,
+      Oxs_Key<Oxs_SimState>& next_state1,
+      Oxs_Key<Oxs_SimState>& next_state2) const;
+
   // Done checks, called by parent YY_2LatDriver::IsStageDone and
   // YY_2LatDriver::IsRunDone functions.
   virtual OC_BOOL ChildIsStageDone(const Oxs_SimState& state) const
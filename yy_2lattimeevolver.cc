@@ -118,7 +118,8 @@ void YY_2LatTimeEvolver::GetEnergyDensity
  Oxs_MeshValue<ThreeVector>* H1_req,
  Oxs_MeshValue<ThreeVector>* H2_req,
  OC_REAL8m& pE_pt,
- OC_REAL8m& total_E)
+ OC_REAL8m& total_E,
+ YY_2LatChunkPostProcess* postproc)
 {
   // Update call count
   ++energy_calc_count;
@@ -181,7 +182,8 @@ void YY_2LatTimeEvolver::GetEnergyDensity
     steponlytime.Stop();
   }
 #endif // REPORT_TIME
-  YY_2LatComputeEnergies(state,oced1,oced2,director->GetEnergyObjects(),oceed);
+  YY_2LatComputeEnergies(state,oced1,oced2,director->GetEnergyObjects(),oceed,
+                         postproc);
 #if REPORT_TIME
   if(sot_running) {
     steponlytime.Start();
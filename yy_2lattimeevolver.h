@@ -28,6 +28,7 @@
 /* End includes */
 
 class YY_2LatTimeDriver; // Forward references
+class YY_2LatChunkPostProcess;
 //struct YY_2LatDriverStepInfo;
 struct Oxs_DriverStepInfo;
 
@@ -79,7 +80,11 @@ protected:
       Oxs_MeshValue<ThreeVector>* H1_req1,
       Oxs_MeshValue<ThreeVector>* H2_reqr2,
       OC_REAL8m& pE_pt,
-      OC_REAL8m& total_E);
+      OC_REAL8m& total_E,
+      YY_2LatChunkPostProcess* postproc = 0);
+  // If postproc is non-null, it is handed each cache block of the
+  // chunk energy pass as soon as H and mxH for both sublattices are
+  // complete there.  See YY_2LatComputeEnergies in yy_2lat_util.h.
 
   void GetEnergyDensity(
       const Oxs_SimState& state,
@@ -94,6 +99,12 @@ protected:
     GetEnergyDensity(state,energy,mxH1_req,mxH2_req,H1_req,H2_req,pE_pt,dummy_E);
   }
 
+  OC_BOOL TotalFieldRequested() const {
+    return total_field_output.GetCacheRequestCount()>0;
+  }
+  // True if the total field output will copy H out of the H1/H2
+  // arrays handed to the next GetEnergyDensity call.
+
 public:
   virtual ~YY_2LatTimeEvolver();
 
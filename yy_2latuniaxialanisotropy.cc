@@ -34,6 +34,7 @@
 #include "uniformscalarfield.h"
 #include "uniformvectorfield.h"
 #include "rectangularmesh.h"  // For QUAD-style integration
+#include "yy_2lat_blocksum.h"
 #include "yy_2latuniaxialanisotropy.h"
 #include "energy.h"		// Needed to make MSVC++ 5 happy
 
@@ -263,31 +264,42 @@ YY_2LatUniaxialAnisotropy::GetMultiplier
 }
 
 
-void YY_2LatUniaxialAnisotropy::RectIntegEnergy
+// Per-sublattice view of the RECT_INTEG data for one state, set up
+// once per chunk by SetupSweep.  Arrays whose field is uniform are
+// null, and the uniform value is used instead.
+struct YY_2LatUniaxialAnisotropy::SweepData {
+  OC_BOOL k1_type;                // Else Ha_TYPE
+  const Oxs_Mesh* mesh;
+  OC_REAL8m volume;               // Cell volume, or 0 if not uniform
+  const ThreeVector* spin;
+  const OC_REAL8m* Ms;
+  const OC_REAL8m* Ms_inverse;
+  const OC_REAL8m* Ms0_inverse;
+  const OC_REAL8m* coef;          // K1 or Ha, depending on k1_type
+  OC_REAL8m uniform_coef;
+  OC_BOOL uniform_easy_axis;      // Valid iff coef is null
+  const ThreeVector* axis;
+  ThreeVector uniform_axis;
+  OC_REAL8m scaling, dscaling;
+  OC_REAL8m* energy;
+  OC_REAL8m* energy_accum;
+  ThreeVector* H;
+  ThreeVector* H_accum;
+  ThreeVector* mxH;
+  ThreeVector* mxH_accum;
+  OC_BOOL pair_aligned;           // All arrays 16-byte aligned
+  YY_2LatBlockSum energy_sum;
+  YY_2LatBlockSum pE_pt_sum;
+  void (*kernel)(SweepData&,OC_INDEX,OC_INDEX);
+};
+
+void YY_2LatUniaxialAnisotropy::SetupSweep
 (const Oxs_SimState& state,
  Oxs_ComputeEnergyDataThreaded& ocedt,
- Oxs_ComputeEnergyDataThreadedAux& ocedtaux,
- OC_INDEX node_start,OC_INDEX node_stop
- ) const
+ SweepData& sd) const
 {
-  const Oxs_Mesh* mesh = state.mesh;
-  const Oxs_MeshValue<OC_REAL8m>& Ms         = *(state.Ms);
-  const Oxs_MeshValue<OC_REAL8m>& Ms_inverse = *(state.Ms_inverse);
-  const Oxs_MeshValue<ThreeVector>& spin = state.spin;
-
-  Nb_Xpfloat energy_sum = 0;
-  Nb_Xpfloat pE_pt_sum = 0;
-
-  // Depending on the lattice type, specify the coefficients to be used.
-  const Oxs_MeshValue<OC_REAL8m> *K1;
-  const Oxs_MeshValue<OC_REAL8m> *Ha;
-  const Oxs_MeshValue<ThreeVector> *axis;
-  OC_BOOL K1_is_uniform;
-  OC_BOOL Ha_is_uniform;
-  OC_BOOL axis_is_uniform;
-  OC_REAL8m uniform_K1_value;
-  OC_REAL8m uniform_Ha_value;
-  const ThreeVector *uniform_axis_value;
+  const Oxs_MeshValue<OC_REAL8m>* coef = 0;
+  const Oxs_MeshValue<ThreeVector>* axis = 0;
   switch(state.lattice_type) {
   case Oxs_SimState::TOTAL:
     throw Oxs_ExtError(this, "Programming error: YY_2LatUniaxialAnisotropy"
@@ -295,200 +307,285 @@ void YY_2LatUniaxialAnisotropy::RectIntegEnergy
         " state with lattice_type = TOTAL.");
     break;
   case Oxs_SimState::LATTICE1:
-    K1 = &K11;
-    Ha = &Ha1;
-    axis = &axis1;
-    K1_is_uniform = K11_is_uniform;
-    Ha_is_uniform = Ha1_is_uniform;
-    axis_is_uniform = axis1_is_uniform;
-    uniform_K1_value = uniform_K11_value;
-    uniform_Ha_value = uniform_Ha1_value;
-    uniform_axis_value = &uniform_axis1_value;
+    if(aniscoeftype == K1_TYPE) {
+      sd.uniform_coef = uniform_K11_value;
+      if(!K11_is_uniform) coef = &K11;
+    } else {
+      sd.uniform_coef = uniform_Ha1_value;
+      if(!Ha1_is_uniform) coef = &Ha1;
+    }
+    sd.uniform_axis = uniform_axis1_value;
+    if(!axis1_is_uniform) axis = &axis1;
     break;
   case Oxs_SimState::LATTICE2:
-    K1 = &K12;
-    Ha = &Ha2;
-    axis = &axis2;
-    K1_is_uniform = K12_is_uniform;
-    Ha_is_uniform = Ha2_is_uniform;
-    axis_is_uniform = axis2_is_uniform;
-    uniform_K1_value = uniform_K12_value;
-    uniform_Ha_value = uniform_Ha2_value;
-    uniform_axis_value = &uniform_axis2_value;
+    if(aniscoeftype == K1_TYPE) {
+      sd.uniform_coef = uniform_K12_value;
+      if(!K12_is_uniform) coef = &K12;
+    } else {
+      sd.uniform_coef = uniform_Ha2_value;
+      if(!Ha2_is_uniform) coef = &Ha2;
+    }
+    sd.uniform_axis = uniform_axis2_value;
+    if(!axis2_is_uniform) axis = &axis2;
     break;
   }
 
-  OC_REAL8m k = uniform_K1_value;
-  OC_REAL8m field_mult = uniform_Ha_value;
-  ThreeVector unifaxis = *uniform_axis_value;
+  sd.k1_type = (aniscoeftype == K1_TYPE);
+  sd.mesh = state.mesh;
+  sd.volume = 0.0;
+  if(dynamic_cast<const Oxs_CommonRectangularMesh*>(state.mesh)) {
+    sd.volume = state.mesh->Volume(0);
+  }
+  sd.spin        = &(state.spin[0]);
+  sd.Ms          = &((*state.Ms)[0]);
+  sd.Ms_inverse  = &((*state.Ms_inverse)[0]);
+  sd.Ms0_inverse = &((*state.Ms0_inverse)[0]);
+  sd.coef = (coef ? &((*coef)[0]) : 0);
+  // K1 (or Ha) times m^3 keeps the sign of K1 (or Ha), so for uniform
+  // coefficients the easy axis/easy plane choice is the same in every
+  // cell.  Zero-coefficient cells come out zero either way.
+  sd.uniform_easy_axis = (sd.uniform_coef>0.0);
+  sd.axis = (axis ? &((*axis)[0]) : 0);
+  sd.scaling  = mult;  // Copy from class mutables.  These are
+  sd.dscaling = dmult; // set from main thread once per state.
+  sd.energy       = (ocedt.energy ? &((*ocedt.energy)[0]) : 0);
+  sd.energy_accum = (ocedt.energy_accum ? &((*ocedt.energy_accum)[0]) : 0);
+  sd.H            = (ocedt.H ? &((*ocedt.H)[0]) : 0);
+  sd.H_accum      = (ocedt.H_accum ? &((*ocedt.H_accum)[0]) : 0);
+  sd.mxH          = (ocedt.mxH ? &((*ocedt.mxH)[0]) : 0);
+  sd.mxH_accum    = (ocedt.mxH_accum ? &((*ocedt.mxH_accum)[0]) : 0);
 
-  OC_REAL8m scaling  = mult;  // Copy from class mutables.  These are
-  OC_REAL8m dscaling = dmult; // set from main thread once per state.
+  const void* const ptrs[] = {
+    sd.spin, sd.Ms, sd.Ms_inverse, sd.Ms0_inverse, sd.coef, sd.axis,
+    sd.energy, sd.energy_accum, sd.H, sd.H_accum, sd.mxH, sd.mxH_accum
+  };
+  sd.pair_aligned = 1;
+  for(size_t ip=0;ip<sizeof(ptrs)/sizeof(ptrs[0]);++ip) {
+    if(OC_UINDEX(ptrs[ip])%16 != 0) sd.pair_aligned = 0;
+  }
 
-  for(OC_INDEX i=node_start;i<node_stop;++i) {
+  sd.energy_sum.Reset();
+  sd.pE_pt_sum.Reset();
 
-    OC_REAL8m mi = (*state.Ms)[i]*(*state.Ms0_inverse)[i];
-    // Assume K1 proportional to m^3;
-    if(aniscoeftype == K1_TYPE) {
-      if(!K1_is_uniform) k = (*K1)[i];
-      k *= mi*mi*mi;
-      field_mult = (2.0/MU0)*k*Ms_inverse[i];
-    } else {
-      if(!Ha_is_uniform) field_mult = (*Ha)[i];
-      field_mult *= mi*mi*mi;
-      k = 0.5*MU0*field_mult*Ms[i];
-    }
-    if(k==0.0 || field_mult == 0.0) { // Includes Ms==0.0 case
-      if(ocedt.energy) (*ocedt.energy)[i] = 0.0;
-      if(ocedt.H)      (*ocedt.H)[i].Set(0.,0.,0.);
-      if(ocedt.mxH)    (*ocedt.mxH)[i].Set(0.,0.,0.);
-      continue;
-    }
+  if(sd.coef) {
+    sd.kernel = (sd.axis ? &SweepKernel<0,0> : &SweepKernel<0,1>);
+  } else {
+    sd.kernel = (sd.axis ? &SweepKernel<1,0> : &SweepKernel<1,1>);
+  }
+}
+
+// Single cell form of SweepKernel.  Used for the unaligned head and
+// odd tail of a range, and for everything on non-SSE builds.
+template<int COEF_UNIFORM,int AXIS_UNIFORM>
+void YY_2LatUniaxialAnisotropy::SweepCell(SweepData& sd,OC_INDEX i)
+{
+  const ThreeVector& m = sd.spin[i];
+  const ThreeVector& axisi = (AXIS_UNIFORM ? sd.uniform_axis : sd.axis[i]);
+  const OC_REAL8m coefi = (COEF_UNIFORM ? sd.uniform_coef : sd.coef[i]);
 
-    const ThreeVector& axisi = (axis_is_uniform ? unifaxis : (*axis)[i]);
-    if(k<=0) {
-      // Easy plane (hard axis)
-      // NOTE: This division is based on the value of k as specified by
-      //       K1[i], irrespective of the scaling multiplier.  This is
-      //       because we don't want the energy formula for a cell to
-      //       hop back and forth between the two (easy vs. hard)
-      //       representations over the lifetime of the simulation.
-      const OC_REAL8m dot = spin[i].x*axisi.x
-        + spin[i].y*axisi.y + spin[i].z*axisi.z;
-      const ThreeVector H = (scaling*field_mult*dot)*axisi;
+  // Assume K1 proportional to m^3;
+  const OC_REAL8m mi = sd.Ms[i]*sd.Ms0_inverse[i];
+  OC_REAL8m k, field_mult;
+  if(sd.k1_type) {
+    k = coefi*(mi*mi*mi);
+    field_mult = (2.0/MU0)*k*sd.Ms_inverse[i];
+  } else {
+    field_mult = coefi*(mi*mi*mi);
+    k = 0.5*MU0*field_mult*sd.Ms[i];
+  }
+  if(k==0.0 || field_mult == 0.0) { // Includes Ms==0.0 case
+    if(sd.energy) sd.energy[i] = 0.0;
+    if(sd.H)      sd.H[i].Set(0.,0.,0.);
+    if(sd.mxH)    sd.mxH[i].Set(0.,0.,0.);
+    return;
+  }
 
-      const OC_REAL8m tx = spin[i].y*H.z - spin[i].z*H.y; // mxH
-      const OC_REAL8m ty = spin[i].z*H.x - spin[i].x*H.z;
-      const OC_REAL8m tz = spin[i].x*H.y - spin[i].y*H.x;
+  // Easy axis energy is reported as k*(axis x spin)^2 rather than
+  // -k*(dot*dot-1), which loses precision when spin is nearly
+  // parallel to axis.  Easy plane (k<=0) energy is -k*dot*dot.  The
+  // choice is based on the sign of k as specified by K1[i],
+  // irrespective of the scaling multiplier, so that a cell does not hop
+  // between the two representations over the course of a simulation.
+  const OC_REAL8m dot = m.x*axisi.x + m.y*axisi.y + m.z*axisi.z;
+  const OC_REAL8m Hscale = sd.scaling*field_mult*dot;
 
-      const OC_REAL8m mkdotsq = -k*dot*dot;
-      const OC_REAL8m ei = scaling*mkdotsq;
-      const OC_REAL8m vol = mesh->Volume(i);
-      energy_sum += ei * vol;
-      pE_pt_sum += dscaling*mkdotsq * vol;
+  const OC_REAL8m tx = m.y*axisi.z - m.z*axisi.y;
+  const OC_REAL8m ty = m.z*axisi.x - m.x*axisi.z;
+  const OC_REAL8m tz = m.x*axisi.y - m.y*axisi.x;
 
-      if(ocedt.energy)       (*ocedt.energy)[i] = ei;
-      if(ocedt.energy_accum) (*ocedt.energy_accum)[i] += ei;
-      if(ocedt.H)       (*ocedt.H)[i] = H;
-      if(ocedt.H_accum) (*ocedt.H_accum)[i] += H;
-      if(ocedt.mxH)       (*ocedt.mxH)[i] = ThreeVector(tx,ty,tz);
-      if(ocedt.mxH_accum) (*ocedt.mxH_accum)[i] += ThreeVector(tx,ty,tz);
+  const OC_REAL8m eraw = (k>0 ? k*(tx*tx+ty*ty+tz*tz) : -k*dot*dot);
+  const OC_REAL8m ei = sd.scaling*eraw;
 
-    } else {
-      // Easy axis case.  For improved accuracy, we want to report
-      // energy as -k*(dot*dot-1), where dot = axis * spin.  But
-      // dot*dot-1 suffers from bad loss of precision if spin is
-      // nearly parallel to axis.  The are a couple of ways around
-      // this.  Recall that both spin and axis are unit vectors.
-      // Then from the cross product:
-      //            (axis x spin)^2 = 1 - dot*dot
-      // The cross product requires 6 mults and 3 adds, and
-      // the norm squared takes 3 mult and 2 adds
-      //            => 9 mults + 5 adds.
-      // Another option is to use
-      //            (axis - spin)^2 = 2*(1-dot) 
-      //     so  1 - dot*dot = t*(2-t)
-      //                where t = 0.5*(axis-spin)^2.
-      // The op count here is 
-      //            => 5 mults + 6 adds.
-      // Another advantage to the second approach is you get 'dot', as
-      // opposed to dot*dot, which saves a sqrt if dot is needed.  The
-      // downside is that if axis and spin are anti-parallel, then you
-      // want to use (axis+spin)^2 rather than (axis-spin)^2.  I did
-      // some single-spin test runs and the performance of the two
-      // methods was about the same.  Below we use the cross-product
-      // formulation. -mjd, 28-Jan-2001
-      const OC_REAL8m dot = spin[i].x*axisi.x
-        + spin[i].y*axisi.y + spin[i].z*axisi.z;
-      const OC_REAL8m Hscale = scaling*field_mult*dot;
+  const OC_REAL8m vol = (sd.volume>0.0 ? sd.volume : sd.mesh->Volume(i));
+  sd.energy_sum += ei * vol;
+  sd.pE_pt_sum += sd.dscaling*eraw * vol;
+
+  const ThreeVector H = Hscale*axisi;
+  ThreeVector mxH(Hscale*tx,Hscale*ty,Hscale*tz);
+  if(k<=0) { // Easy plane torque is taken as m x H
+    mxH.Set(m.y*H.z - m.z*H.y, m.z*H.x - m.x*H.z, m.x*H.y - m.y*H.x);
+  }
+  if(sd.energy)       sd.energy[i] = ei;
+  if(sd.energy_accum) sd.energy_accum[i] += ei;
+  if(sd.H)            sd.H[i] = H;
+  if(sd.H_accum)      sd.H_accum[i] += H;
+  if(sd.mxH)          sd.mxH[i] = mxH;
+  if(sd.mxH_accum)    sd.mxH_accum[i] += mxH;
+}
+
+// RECT_INTEG kernel for cells [node_start,node_stop) of one
+// sublattice.  Whether the anisotropy coefficient and axis are uniform
+// is fixed per chunk by the template parameters, so the cell loop has
+// no uniformity branches.  On SSE builds cells are handled in aligned
+// pairs, one Oc_Duet lane per cell.
+template<int COEF_UNIFORM,int AXIS_UNIFORM>
+void YY_2LatUniaxialAnisotropy::SweepKernel
+(SweepData& sd,
+ OC_INDEX node_start,OC_INDEX node_stop)
+{
+  OC_INDEX i = node_start;
+#if OC_USE_SSE
+  if(sd.pair_aligned) {
+    if(i%2 != 0 && i<node_stop) {
+      SweepCell<COEF_UNIFORM,AXIS_UNIFORM>(sd,i);
+      ++i;
+    }
+    const Oc_Duet scaling(sd.scaling);
+    const Oc_Duet dscaling(sd.dscaling);
+    const Oc_Duet zero(0.0);
+    Oc_Duet ax(sd.uniform_axis.x);
+    Oc_Duet ay(sd.uniform_axis.y);
+    Oc_Duet az(sd.uniform_axis.z);
+    Oc_Duet coef(sd.uniform_coef);
+    for(;i+1<node_stop;i+=2) {
+      Oc_Duet Ms;  Ms.LoadAligned(sd.Ms[i]);
+      Oc_Duet Ms0_inverse;  Ms0_inverse.LoadAligned(sd.Ms0_inverse[i]);
+      if(!COEF_UNIFORM) coef.LoadAligned(sd.coef[i]);
+      if(!AXIS_UNIFORM) Oxs_ThreeVectorPairLoadAligned(&(sd.axis[i]),ax,ay,az);
+
+      const Oc_Duet mi = Ms*Ms0_inverse;
+      Oc_Duet k, field_mult;
+      if(sd.k1_type) {
+        Oc_Duet Ms_inverse;  Ms_inverse.LoadAligned(sd.Ms_inverse[i]);
+        k = coef*(mi*mi*mi);
+        field_mult = Oc_Duet(2.0/MU0)*k*Ms_inverse;
+      } else {
+        field_mult = coef*(mi*mi*mi);
+        k = Oc_Duet(0.5*MU0)*field_mult*Ms;
+      }
+      // Cells with k or field_mult zero (including Ms==0) come out
+      // zero through the formulas below, so need no special case.
 
-      const OC_REAL8m tx = spin[i].y*axisi.z - spin[i].z*axisi.y;
-      const OC_REAL8m ty = spin[i].z*axisi.x - spin[i].x*axisi.z;
-      const OC_REAL8m tz = spin[i].x*axisi.y - spin[i].y*axisi.x;
+      Oc_Duet mx,my,mz;
+      Oxs_ThreeVectorPairLoadAligned(&(sd.spin[i]),mx,my,mz);
+      const Oc_Duet dot = mx*ax + my*ay + mz*az;
+      const Oc_Duet Hscale = scaling*field_mult*dot;
 
-      const OC_REAL8m ktsq = k*(tx*tx+ty*ty+tz*tz);
-      const OC_REAL8m ei = scaling*ktsq;
+      const Oc_Duet tx = my*az - mz*ay;
+      const Oc_Duet ty = mz*ax - mx*az;
+      const Oc_Duet tz = mx*ay - my*ax;
 
-      const OC_REAL8m vol = mesh->Volume(i);
-      energy_sum += ei * vol;
-      pE_pt_sum += dscaling*ktsq * vol;
+      Oc_Duet eraw;
+      if(COEF_UNIFORM) {
+        if(sd.uniform_easy_axis) eraw = k*(tx*tx+ty*ty+tz*tz);
+        else                     eraw = (zero-k)*dot*dot;
+      } else {
+        const Oc_Duet ktsq = k*(tx*tx+ty*ty+tz*tz);
+        const Oc_Duet mkdotsq = (zero-k)*dot*dot;
+        eraw.Set(k.GetA()>0 ? ktsq.GetA() : mkdotsq.GetA(),
+                 k.GetB()>0 ? ktsq.GetB() : mkdotsq.GetB());
+      }
+      const Oc_Duet ei = scaling*eraw;
+      const Oc_Duet pE = dscaling*eraw;
 
-      if(ocedt.energy)       (*ocedt.energy)[i] = ei;
-      if(ocedt.energy_accum) (*ocedt.energy_accum)[i] += ei;
-      if(ocedt.H)       (*ocedt.H)[i] = Hscale*axisi;
-      if(ocedt.H_accum) (*ocedt.H_accum)[i] += Hscale*axisi;
-      if(ocedt.mxH)       (*ocedt.mxH)[i]
-                            = ThreeVector(Hscale*tx,Hscale*ty,Hscale*tz);
-      if(ocedt.mxH_accum) (*ocedt.mxH_accum)[i]
-                           += ThreeVector(Hscale*tx,Hscale*ty,Hscale*tz);
+      OC_REAL8m volA = sd.volume, volB = sd.volume;
+      if(sd.volume<=0.0) {
+        volA = sd.mesh->Volume(i);
+        volB = sd.mesh->Volume(i+1);
+      }
+      sd.energy_sum += ei.GetA() * volA;
+      sd.energy_sum += ei.GetB() * volB;
+      sd.pE_pt_sum += pE.GetA() * volA;
+      sd.pE_pt_sum += pE.GetB() * volB;
+
+      const Oc_Duet Hx = Hscale*ax;
+      const Oc_Duet Hy = Hscale*ay;
+      const Oc_Duet Hz = Hscale*az;
+      const Oc_Duet Tx = Hscale*tx;
+      const Oc_Duet Ty = Hscale*ty;
+      const Oc_Duet Tz = Hscale*tz;
+      if(sd.energy) ei.StoreAligned(sd.energy[i]);
+      if(sd.energy_accum) {
+        Oc_Duet acc;  acc.LoadAligned(sd.energy_accum[i]);
+        acc += ei;
+        acc.StoreAligned(sd.energy_accum[i]);
+      }
+      if(sd.H) Oxs_ThreeVectorPairStoreAligned(Hx,Hy,Hz,&(sd.H[i]));
+      if(sd.H_accum) {
+        Oc_Duet accx,accy,accz;
+        Oxs_ThreeVectorPairLoadAligned(&(sd.H_accum[i]),accx,accy,accz);
+        accx += Hx;  accy += Hy;  accz += Hz;
+        Oxs_ThreeVectorPairStoreAligned(accx,accy,accz,&(sd.H_accum[i]));
+      }
+      if(sd.mxH) Oxs_ThreeVectorPairStoreAligned(Tx,Ty,Tz,&(sd.mxH[i]));
+      if(sd.mxH_accum) {
+        Oc_Duet accx,accy,accz;
+        Oxs_ThreeVectorPairLoadAligned(&(sd.mxH_accum[i]),accx,accy,accz);
+        accx += Tx;  accy += Ty;  accz += Tz;
+        Oxs_ThreeVectorPairStoreAligned(accx,accy,accz,&(sd.mxH_accum[i]));
+      }
     }
   }
-  ocedtaux.energy_total_accum += energy_sum.GetValue();
-  ocedtaux.pE_pt_accum += pE_pt_sum.GetValue();
+#endif // OC_USE_SSE
+  for(;i<node_stop;++i) SweepCell<COEF_UNIFORM,AXIS_UNIFORM>(sd,i);
 }
 
-void YY_2LatUniaxialAnisotropy::ComputeEnergyChunk
+void YY_2LatUniaxialAnisotropy::RectIntegEnergy
 (const Oxs_SimState& state,
  Oxs_ComputeEnergyDataThreaded& ocedt,
  Oxs_ComputeEnergyDataThreadedAux& ocedtaux,
- OC_INDEX node_start,OC_INDEX node_stop,
- int threadnumber
+ OC_INDEX node_start,OC_INDEX node_stop
  ) const
 {
-  if(node_stop>state.mesh->Size() || node_start>node_stop) {
-    throw Oxs_ExtError(this,"Programming error:"
-                       " Invalid node_start/node_stop values");
-  }
+  SweepData sd;
+  SetupSweep(state,ocedt,sd);
+  sd.kernel(sd,node_start,node_stop);
+  ocedtaux.energy_total_accum += sd.energy_sum.GetValue();
+  ocedtaux.pE_pt_accum += sd.pE_pt_sum.GetValue();
+}
 
-  // Depending on the lattice type, specify the coefficients to be used.
-  Oxs_MeshValue<OC_REAL8m> *K1;
-  Oxs_MeshValue<OC_REAL8m> *Ha;
-  Oxs_MeshValue<ThreeVector> *axis;
-  const Oxs_OwnedPointer<Oxs_ScalarField> *K1_init;
-  const Oxs_OwnedPointer<Oxs_ScalarField> *Ha_init;
-  const Oxs_OwnedPointer<Oxs_VectorField> *axis_init;
-  OC_BOOL K1_is_uniform;
-  OC_BOOL Ha_is_uniform;
-  OC_BOOL axis_is_uniform;
-  OC_REAL8m uniform_K1_value;
-  OC_REAL8m uniform_Ha_value;
-  const ThreeVector *uniform_axis_value;
-  switch(state.lattice_type) {
-  case Oxs_SimState::TOTAL:
-    throw Oxs_ExtError(this, "Programming error: YY_2LatUniaxialAnisotropy"
-        "::ComputeEnergyChunk was called with a wrong type of simulation"
-        " state with lattice_type = TOTAL.");
-    break;
-  case Oxs_SimState::LATTICE1:
-    K1 = &K11;
-    Ha = &Ha1;
-    axis = &axis1;
-    K1_init = &K11_init;
-    Ha_init = &Ha1_init;
-    axis_init = &axis1_init;
-    K1_is_uniform = K11_is_uniform;
-    Ha_is_uniform = Ha1_is_uniform;
-    axis_is_uniform = axis1_is_uniform;
-    uniform_K1_value = uniform_K11_value;
-    uniform_Ha_value = uniform_Ha1_value;
-    uniform_axis_value = &uniform_axis1_value;
-    break;
-  case Oxs_SimState::LATTICE2:
-    K1 = &K12;
-    Ha = &Ha2;
-    axis = &axis2;
-    K1_init = &K12_init;
-    Ha_init = &Ha2_init;
-    axis_init = &axis2_init;
-    K1_is_uniform = K12_is_uniform;
-    Ha_is_uniform = Ha2_is_uniform;
-    axis_is_uniform = axis2_is_uniform;
-    uniform_K1_value = uniform_K12_value;
-    uniform_Ha_value = uniform_Ha2_value;
-    uniform_axis_value = &uniform_axis2_value;
-    break;
+void YY_2LatUniaxialAnisotropy::RectIntegEnergyPair
+(const Oxs_SimState& state1,
+ const Oxs_SimState& state2,
+ Oxs_ComputeEnergyDataThreaded& ocedt1,
+ Oxs_ComputeEnergyDataThreaded& ocedt2,
+ Oxs_ComputeEnergyDataThreadedAux& ocedtaux1,
+ Oxs_ComputeEnergyDataThreadedAux& ocedtaux2,
+ OC_INDEX node_start,OC_INDEX node_stop
+ ) const
+{ // Both sublattices in one sweep.  The range is walked in short
+  // sub-blocks, each run for sublattice 1 and then sublattice 2, so
+  // the two sets of arrays are streamed side by side in a single pass.
+  const OC_INDEX SUBBLOCK = 256; // Even, to keep pair alignment
+  SweepData sd1, sd2;
+  SetupSweep(state1,ocedt1,sd1);
+  SetupSweep(state2,ocedt2,sd2);
+  for(OC_INDEX istart=node_start;istart<node_stop;istart+=SUBBLOCK) {
+    const OC_INDEX istop = (node_stop-istart>SUBBLOCK
+                            ? istart+SUBBLOCK : node_stop);
+    sd1.kernel(sd1,istart,istop);
+    sd2.kernel(sd2,istart,istop);
   }
+  ocedtaux1.energy_total_accum += sd1.energy_sum.GetValue();
+  ocedtaux1.pE_pt_accum += sd1.pE_pt_sum.GetValue();
+  ocedtaux2.energy_total_accum += sd2.energy_sum.GetValue();
+  ocedtaux2.pE_pt_accum += sd2.pE_pt_sum.GetValue();
+}
 
+OC_BOOL YY_2LatUniaxialAnisotropy::PrepareChunk
+(const Oxs_SimState& state,
+ int threadnumber) const
+{
   if(mesh_id !=  state.mesh->Id()) {
     // This is either the first pass through, or else mesh
     // has changed.  Initialize/update data fields.
@@ -504,7 +601,7 @@ void YY_2LatUniaxialAnisotropy::ComputeEnergyChunk
         thread_control.Notify();
       }
       thread_control.Unlock();
-      return; // What else?
+      return 0; // What else?
     }
     if(threadnumber != 0) {
       if(mesh_id != state.mesh->Id()) {
@@ -536,7 +633,7 @@ void YY_2LatUniaxialAnisotropy::ComputeEnergyChunk
         }
         thread_control.Unlock();
         if(condcheckerror || Oxs_ThreadError::IsError()) {
-          return; // What else?
+          return 0; // What else?
         }
       } else {
         if(thread_control.count>0) {
@@ -554,22 +651,27 @@ void YY_2LatUniaxialAnisotropy::ComputeEnergyChunk
     } else {
       // Main thread (threadnumber == 0)
       try {
+        // mesh_id is shared by the two sublattices, so fill both.
         if(aniscoeftype == K1_TYPE) {
-          if(!K1_is_uniform) (*K1_init)->FillMeshValue(state.mesh,*K1);
+          if(!K11_is_uniform) K11_init->FillMeshValue(state.mesh,K11);
+          if(!K12_is_uniform) K12_init->FillMeshValue(state.mesh,K12);
         } else if(aniscoeftype == Ha_TYPE) {
-          if(!Ha_is_uniform) (*Ha_init)->FillMeshValue(state.mesh,*Ha);
+          if(!Ha1_is_uniform) Ha1_init->FillMeshValue(state.mesh,Ha1);
+          if(!Ha2_is_uniform) Ha2_init->FillMeshValue(state.mesh,Ha2);
         }
-        if(!axis_is_uniform) {
-          (*axis_init)->FillMeshValue(state.mesh,*axis);
+        for(int lat=1;lat<=2;++lat) {
+          if(lat==1 ? axis1_is_uniform : axis2_is_uniform) continue;
+          Oxs_MeshValue<ThreeVector>& axis = (lat==1 ? axis1 : axis2);
+          (lat==1 ? axis1_init : axis2_init)->FillMeshValue(state.mesh,axis);
           const OC_INDEX size = state.mesh->Size();
           for(OC_INDEX i=0;i<size;i++) {
             // Check that axis is a unit vector:
             const OC_REAL8m eps = 1e-14;
-            if((*axis)[i].MagSq()<eps*eps) {
+            if(axis[i].MagSq()<eps*eps) {
               throw Oxs_ExtError(this,"Invalid initialization detected:"
                                  " Zero length anisotropy axis");
             } else {
-              (*axis)[i].MakeUnit();
+              axis[i].MakeUnit();
             }
           }
         }
@@ -639,7 +741,7 @@ void YY_2LatUniaxialAnisotropy::ComputeEnergyChunk
         mult_thread_control.Notify();
       }
       mult_thread_control.Unlock();
-      return; // What else?
+      return 0; // What else?
     }
     if(threadnumber != 0) {
       if(mult_state_id !=  state.Id()) {
@@ -671,7 +773,7 @@ void YY_2LatUniaxialAnisotropy::ComputeEnergyChunk
         }
         mult_thread_control.Unlock();
         if(condcheckerror || Oxs_ThreadError::IsError()) {
-          return; // What else?
+          return 0; // What else?
         }
       } else {
         if(mult_thread_control.count>0) {
@@ -742,6 +844,23 @@ void YY_2LatUniaxialAnisotropy::ComputeEnergyChunk
       mult_thread_control.Unlock();
     }
   }
+  return 1;
+}
+
+void YY_2LatUniaxialAnisotropy::ComputeEnergyChunk
+(const Oxs_SimState& state,
+ Oxs_ComputeEnergyDataThreaded& ocedt,
+ Oxs_ComputeEnergyDataThreadedAux& ocedtaux,
+ OC_INDEX node_start,OC_INDEX node_stop,
+ int threadnumber
+ ) const
+{
+  if(node_stop>state.mesh->Size() || node_start>node_stop) {
+    throw Oxs_ExtError(this,"Programming error:"
+                       " Invalid node_start/node_stop values");
+  }
+
+  if(!PrepareChunk(state,threadnumber)) return;
 
   if(integration_method != QUAD_INTEG) {
     RectIntegEnergy(state,ocedt,ocedtaux,node_start,node_stop);
@@ -1174,7 +1293,7 @@ void YY_2LatUniaxialAnisotropy::ComputeEnergyChunk
   // available if zdim<3.
 
   // Copy from scratch to real buffers.
-  Nb_Xpfloat energy_sum = 0.0;
+  YY_2LatBlockSum energy_sum;
   if(ocedt.energy_accum) {
     for(OC_INDEX i=node_start;i<node_stop;i++) {
       (*ocedt.energy_accum)[i] += energy[i];
@@ -1215,3 +1334,68 @@ void YY_2LatUniaxialAnisotropy::ComputeEnergyChunk
     }
   }
 }
+
+void YY_2LatUniaxialAnisotropy::ComputeEnergyPairChunk
+(const Oxs_SimState& state1,
+ const Oxs_SimState& state2,
+ Oxs_ComputeEnergyDataThreaded& ocedt1,
+ Oxs_ComputeEnergyDataThreaded& ocedt2,
+ Oxs_ComputeEnergyDataThreadedAux& ocedtaux1,
+ Oxs_ComputeEnergyDataThreadedAux& ocedtaux2,
+ OC_INDEX node_start,OC_INDEX node_stop,
+ int threadnumber
+ ) const
+{
+  if(integration_method == QUAD_INTEG) {
+    // Edge corrections are per sublattice
+    ComputeEnergyChunk(state1,ocedt1,ocedtaux1,
+                       node_start,node_stop,threadnumber);
+    ComputeEnergyChunk(state2,ocedt2,ocedtaux2,
+                       node_start,node_stop,threadnumber);
+    return;
+  }
+  if(node_stop>state1.mesh->Size() || node_start>node_stop) {
+    throw Oxs_ExtError(this,"Programming error:"
+                       " Invalid node_start/node_stop values");
+  }
+  // The sublattice states share mesh, stage and time, so one
+  // PrepareChunk covers both.
+  if(!PrepareChunk(state1,threadnumber)) return;
+  RectIntegEnergyPair(state1,state2,ocedt1,ocedt2,ocedtaux1,ocedtaux2,
+                      node_start,node_stop);
+}
+
+void YY_2LatUniaxialAnisotropy::AccumStiffness
+(const Oxs_SimState& state, // Sublattice state
+ Oxs_MeshValue<OC_REAL8m>& kt,
+ Oxs_MeshValue<OC_REAL8m>& /* kl */) const
+{ // The field is field_mult*(m.axis)*axis, so turning the spin changes
+  // its transverse part by at most |field_mult| per radian.  Uses the
+  // multiplier of the last evaluated state.
+  if(mesh_id != state.mesh->Id()) return; // Not evaluated yet
+  const OC_BOOL lat1 = (state.lattice_type != Oxs_SimState::LATTICE2);
+  const OC_BOOL k1_type = (aniscoeftype == K1_TYPE);
+  const Oxs_MeshValue<OC_REAL8m>* coef = 0;
+  OC_REAL8m uniform_coef;
+  if(k1_type) {
+    uniform_coef = (lat1 ? uniform_K11_value : uniform_K12_value);
+    if(lat1 && !K11_is_uniform) coef = &K11;
+    if(!lat1 && !K12_is_uniform) coef = &K12;
+  } else {
+    uniform_coef = (lat1 ? uniform_Ha1_value : uniform_Ha2_value);
+    if(lat1 && !Ha1_is_uniform) coef = &Ha1;
+    if(!lat1 && !Ha2_is_uniform) coef = &Ha2;
+  }
+  const Oxs_MeshValue<OC_REAL8m>& Ms = *(state.Ms);
+  const Oxs_MeshValue<OC_REAL8m>& Ms_inverse = *(state.Ms_inverse);
+  const Oxs_MeshValue<OC_REAL8m>& Ms0_inverse = *(state.Ms0_inverse);
+  const OC_INDEX size = state.mesh->Size();
+  for(OC_INDEX i=0;i<size;++i) {
+    if(Ms[i]==0.0) continue;
+    const OC_REAL8m mi = Ms[i]*Ms0_inverse[i];
+    const OC_REAL8m coefi = (coef ? (*coef)[i] : uniform_coef);
+    OC_REAL8m field_mult = coefi*(mi*mi*mi);
+    if(k1_type) field_mult *= (2.0/MU0)*Ms_inverse[i];
+    kt[i] += fabs(mult*field_mult);
+  }
+}
@@ -36,9 +36,13 @@
 #include "scalarfield.h"
 #include "vectorfield.h"
 
+#include "yy_2lat_util.h"
+
 /* End includes */
 
-class YY_2LatUniaxialAnisotropy : public Oxs_ChunkEnergy {
+class YY_2LatUniaxialAnisotropy
+  : public Oxs_ChunkEnergy, public YY_2LatPairChunkEnergy,
+    public YY_2LatStiffnessEnergy {
 private:
   enum AnisotropyCoefType {
     ANIS_UNKNOWN, K1_TYPE, Ha_TYPE
@@ -74,11 +78,36 @@ private:
   /// is defined for error detection.
 
   // RectIntegEnergy is a helper function for ComputeEnergyChunk;
-  // it computes using "RECT_INTEG" method.
+  // it computes using "RECT_INTEG" method.  RectIntegEnergyPair does
+  // the same for both sublattices in one sweep.
   void RectIntegEnergy(const Oxs_SimState& state,
                        Oxs_ComputeEnergyDataThreaded& ocedt,
                        Oxs_ComputeEnergyDataThreadedAux& ocedtaux,
                        OC_INDEX node_start,OC_INDEX node_stop) const;
+  void RectIntegEnergyPair(const Oxs_SimState& state1,
+                           const Oxs_SimState& state2,
+                           Oxs_ComputeEnergyDataThreaded& ocedt1,
+                           Oxs_ComputeEnergyDataThreaded& ocedt2,
+                           Oxs_ComputeEnergyDataThreadedAux& ocedtaux1,
+                           Oxs_ComputeEnergyDataThreadedAux& ocedtaux2,
+                           OC_INDEX node_start,OC_INDEX node_stop) const;
+
+  // RECT_INTEG kernel machinery; see the .cc file.
+  struct SweepData;
+  void SetupSweep(const Oxs_SimState& state,
+                  Oxs_ComputeEnergyDataThreaded& ocedt,
+                  SweepData& sd) const;
+  template<int COEF_UNIFORM,int AXIS_UNIFORM>
+  static void SweepCell(SweepData& sd,OC_INDEX i);
+  template<int COEF_UNIFORM,int AXIS_UNIFORM>
+  static void SweepKernel(SweepData& sd,
+                          OC_INDEX node_start,OC_INDEX node_stop);
+
+  // Per-state setup shared by the chunk entry points: fills the
+  // coefficient arrays of both sublattices on a mesh change, and runs
+  // the multiplier script.  Returns 0 if another thread has flagged an
+  // error, in which case the caller should return at once.
+  OC_BOOL PrepareChunk(const Oxs_SimState& state,int threadnumber) const;
 
 
   OC_BOOL has_multscript;
@@ -125,6 +154,20 @@ public:
   virtual void StageRequestCount(unsigned int& min,
 				 unsigned int& max) const;
 
+  virtual void ComputeEnergyPairChunk(
+      const Oxs_SimState& state1,
+      const Oxs_SimState& state2,
+      Oxs_ComputeEnergyDataThreaded& ocedt1,
+      Oxs_ComputeEnergyDataThreaded& ocedt2,
+      Oxs_ComputeEnergyDataThreadedAux& ocedtaux1,
+      Oxs_ComputeEnergyDataThreadedAux& ocedtaux2,
+      OC_INDEX node_start,OC_INDEX node_stop,
+      int threadnumber) const;
+
+  virtual void AccumStiffness(const Oxs_SimState& state,
+                              Oxs_MeshValue<OC_REAL8m>& kt,
+                              Oxs_MeshValue<OC_REAL8m>& kl) const;
+  /// Transverse anisotropy stiffness (YY_2LatStiffnessEnergy).
 };
 
 
@@ -22,6 +22,7 @@
  */
 
 #include <math.h>
+#include <algorithm>
 
 #include "nb.h"
 #include "director.h"
@@ -33,7 +34,9 @@
 #include "rectangularmesh.h"
 #include "scalarfield.h"
 #include "oxswarn.h"
+#include "oxsthread.h"
 
+#include "yy_2lat_blocksum.h"
 #include "yy_llbeulerevolve.h"
 
 // Oxs_Ext registration support
@@ -49,6 +52,43 @@ static const Oxs_WarningMessageRevisionInfo revision_info
    "$Author:$",
    "Yu Yahagi (yuyahagi2@gmail.com)");
 
+// 32-bit integer hash (xor-shift-multiply, after C. Wellons'
+// "lowbias32") used to build the counter-based noise generator.
+static inline OC_UINT4m YY_LLBNoiseHash(OC_UINT4m x)
+{
+  x ^= x >> 16;
+  x *= 0x7feb352dU;
+  x ^= x >> 15;
+  x *= 0x846ca68bU;
+  x ^= x >> 16;
+  return x;
+}
+
+// Fills gaus[0..5] with six independent standard normals for cell i.
+// Box-Muller in its trigonometric form, so there is no rejection loop.
+// Uniforms are centered in (0,1), so log() never sees zero.  The low
+// word of i is the counter and each of the six draws has its own stream
+// key.  The high word of i, nonzero only past 2^32 cells, is folded
+// into the keys, so no product of i is formed that could wrap.
+static inline void YY_LLBNoiseCell(OC_UINT4m key,OC_INDEX i,
+                                   OC_REAL8m* gaus)
+{
+  const OC_REAL8m scale = 1.0/4294967296.0;
+  const OC_UINT4m counter = YY_LLBNoiseHash(static_cast<OC_UINT4m>(i));
+  OC_UINT4m stream
+    = key ^ YY_LLBNoiseHash(static_cast<OC_UINT4m>((i>>16)>>16));
+  for(int k=0;k<6;k+=2) {
+    OC_REAL8m u1 = (YY_LLBNoiseHash(counter+YY_LLBNoiseHash(stream++))+0.5)
+      *scale;
+    OC_REAL8m u2 = (YY_LLBNoiseHash(counter+YY_LLBNoiseHash(stream++))+0.5)
+      *scale;
+    OC_REAL8m r = sqrt(-2.0*log(u1));
+    OC_REAL8m theta = 2*PI*u2;
+    gaus[k]   = r*cos(theta);
+    gaus[k+1] = r*sin(theta);
+  }
+}
+
 void YY_LLBEulerEvolve::UpdateStageTemperature(const Oxs_SimState& state)
 {
   if(!has_tempscript) return;
@@ -89,6 +129,7 @@ YY_LLBEulerEvolve::YY_LLBEulerEvolve(
     : Oxs_TimeEvolver(name,newdtr,argstr),
     mesh_id(0), min_timestep(0.), max_timestep(1e-10),
     energy_accum_count_limit(25),
+    m_e_newton_limit(50),
     energy_state_id(0),next_timestep(0.),
     KBoltzmann(1.38062e-23),
     iteration_Tcalculated(0),
@@ -211,8 +252,6 @@ YY_LLBEulerEvolve::YY_LLBEulerEvolve(
     has_uniform_seed = 0;
   }
 
-  gaus2_isset = 0;    //no gaussian random numbers calculated yet
-
   // Setup outputs
   max_dm_dt_output.Setup(this,InstanceName(),"Max dm/dt","deg/ns",0,
      &YY_LLBEulerEvolve::UpdateDerivedOutputs);
@@ -288,6 +327,7 @@ OC_BOOL YY_LLBEulerEvolve::Init()
     // Default seed value is time dependent
     Oc_Srand();
   }
+  noise_seed = static_cast<OC_UINT4m>(4294967295.0*Oc_UnifRand());
 
   return Oxs_TimeEvolver::Init();  // Initialize parent class.
   // Do this after child output registration so that
@@ -298,33 +338,15 @@ OC_BOOL YY_LLBEulerEvolve::Init()
 YY_LLBEulerEvolve::~YY_LLBEulerEvolve()
 {}
 
-void YY_LLBEulerEvolve::Calculate_dm_dt(
+OC_BOOL YY_LLBEulerEvolve::Prepare_dm_dt(
     const Oxs_SimState& state_,
-    const Oxs_MeshValue<ThreeVector>& mxH_,
-    const Oxs_MeshValue<ThreeVector>& total_field_,
-    OC_REAL8m pE_pt_,
     Oxs_MeshValue<ThreeVector>& dm_dt_t_,
     Oxs_MeshValue<ThreeVector>& dm_dt_l_,
-    OC_REAL8m& max_dm_dt_,
-    OC_REAL8m& dE_dt_,
-    OC_REAL8m& min_timestep_)
+    OC_UINT4m& noise_key_)
 {
-  // Imports: state_, mxH_, pE_pt
-  // Exports: dm_dt_t_, dm_dt_l_, max_dm_dt_, dE_dt_
   const Oxs_Mesh* mesh_ = state_.mesh;
   const OC_INDEX size = mesh_->Size(); // Assume all imports are compatible
-  const Oxs_MeshValue<OC_REAL8m>& Ms_ = *(state_.Ms);
-  const Oxs_MeshValue<OC_REAL8m>& Ms_inverse_ = *(state_.Ms_inverse);
-  const Oxs_MeshValue<OC_REAL8m>& Ms0_ = *(state_.Ms0);
-  const Oxs_MeshValue<OC_REAL8m>& Ms0_inverse_ = *(state_.Ms0_inverse);
-  const Oxs_MeshValue<ThreeVector>& spin_ = state_.spin;
   OC_UINT4m iteration_now = state_.iteration_count;
-  ThreeVector scratch_t;
-  ThreeVector scratch_l;
-  ThreeVector dm_fluct_t;
-  ThreeVector dm_fluct_l;
-  OC_REAL8m hFluctSigma_t;
-  OC_REAL8m hFluctSigma_l;
   dm_dt_t_.AdjustSize(mesh_);
   dm_dt_l_.AdjustSize(mesh_);
   OC_INDEX i;
@@ -352,8 +374,10 @@ void YY_LLBEulerEvolve::Calculate_dm_dt(
       }
     }
 
-    // Prepare temperature-dependent mesh value arrays
+    // Prepare temperature-dependent mesh value arrays.  m_e is zeroed
+    // so the first m_e solve starts cold.
     m_e.AdjustSize(mesh_);
+    for(i=0;i<size;++i) m_e[i] = 0.0;
     chi_l.AdjustSize(mesh_);
     alpha_t.AdjustSize(mesh_);
     alpha_l.AdjustSize(mesh_);
@@ -385,143 +409,270 @@ void YY_LLBEulerEvolve::Calculate_dm_dt(
     state_.chi_l = &chi_l;
   }
 
+  UpdateFixedSpinList(mesh_);
+
   if (use_stochastic && iteration_now > iteration_Tcalculated) {
     // i.e. if thermal field is not calculated for this step
-    for(i=0;i<size;i++){
-      if(Ms_[i] != 0){
-        // Only sqrt(delta_t) is multiplied for stochastic functions
-        // opposed to dm_dt * delta_t for deterministic functions.
-        // This is the standard deviation of the gaussian distribution
-        // used to represent the thermal perturbations
-        hFluctSigma_t = sqrt(hFluctVarConst_t[i] / fixed_timestep);
-        hFluctSigma_l = sqrt(hFluctVarConst_l[i] / fixed_timestep);
-
-        hFluct_t[i].x = hFluctSigma_t*Gaussian_Random(0.0, 1.0);
-        hFluct_t[i].y = hFluctSigma_t*Gaussian_Random(0.0, 1.0);
-        hFluct_t[i].z = hFluctSigma_t*Gaussian_Random(0.0, 1.0);
-        hFluct_l[i].x = hFluctSigma_l*Gaussian_Random(0.0, 1.0);
-        hFluct_l[i].y = hFluctSigma_l*Gaussian_Random(0.0, 1.0);
-        hFluct_l[i].z = hFluctSigma_l*Gaussian_Random(0.0, 1.0);
-      }
+    noise_key_ = YY_LLBNoiseHash(noise_seed
+                                 ^ YY_LLBNoiseHash(iteration_now));
+    // hFluct will be definetely calculated for this iteration
+    iteration_Tcalculated = iteration_now;
+    return 1;
+  }
+  return 0;
+}
+
+void YY_LLBEulerEvolve::FillHFluctChunk(
+    const Oxs_SimState& state_,
+    OC_UINT4m noise_key_,
+    OC_INDEX node_start,OC_INDEX node_stop)
+{
+  const Oxs_MeshValue<OC_REAL8m>& Ms_ = *(state_.Ms);
+  OC_REAL8m gaus[6];
+  for(OC_INDEX i=node_start;i<node_stop;i++){
+    if(Ms_[i] != 0){
+      // Only sqrt(delta_t) is multiplied for stochastic functions
+      // opposed to dm_dt * delta_t for deterministic functions.
+      // This is the standard deviation of the gaussian distribution
+      // used to represent the thermal perturbations
+      OC_REAL8m hFluctSigma_t = sqrt(hFluctVarConst_t[i] / fixed_timestep);
+      OC_REAL8m hFluctSigma_l = sqrt(hFluctVarConst_l[i] / fixed_timestep);
+      YY_LLBNoiseCell(noise_key_,i,gaus);
+      hFluct_t[i].Set(hFluctSigma_t*gaus[0],
+                      hFluctSigma_t*gaus[1],
+                      hFluctSigma_t*gaus[2]);
+      hFluct_l[i].Set(hFluctSigma_l*gaus[3],
+                      hFluctSigma_l*gaus[4],
+                      hFluctSigma_l*gaus[5]);
     }
   }
+}
 
-  for(i=0;i<size;i++) {
-    if(Ms_[i]==0) {
-      dm_dt_t_[i].Set(0.0,0.0,0.0);
-      dm_dt_l_[i].Set(0.0,0.0,0.0);
-    } else {
-      OC_REAL8m cell_alpha_t = alpha_t[i];
-      OC_REAL8m cell_alpha_l = alpha_l[i];
-      OC_REAL8m cell_gamma = gamma[i];
-      OC_REAL8m cell_m = Ms_[i]*Ms0_inverse_[i];
-      OC_REAL8m cell_msq = cell_m*cell_m;
-      OC_REAL8m cell_m_inverse = Ms0_[i]*Ms_inverse_[i];
-
-      // deterministic part
-      scratch_t = mxH_[i];
-      scratch_t *= -cell_gamma; // -|gamma|*(mxH)
-
-      if(do_precess) {
-        dm_dt_t_[i]  = scratch_t;
-        dm_dt_l_[i].Set(0.0,0.0,0.0);
-      } else {
-        dm_dt_t_[i].Set(0.0,0.0,0.0);
-        dm_dt_l_[i].Set(0.0,0.0,0.0);
-      }
+#if OC_USE_SSE
+// True if each array starts on a 16-byte boundary, so that cells 2k
+// and 2k+1 load as one Oc_Duet lane pair.  Null entries are skipped.
+static inline OC_BOOL YY_LLBPairAligned(const void* const* ptrs,
+                                        size_t count)
+{
+  for(size_t ip=0;ip<count;++ip) {
+    if(ptrs[ip] && OC_UINDEX(ptrs[ip])%16 != 0) return 0;
+  }
+  return 1;
+}
+#endif // OC_USE_SSE
 
-      // Transverse damping term
-      if(use_stochastic) {
-        // Note: The stochastic field is NOT included in the first term of 
-        // the LLB equation. See PRB 85, 014433 (2012). The second form of 
-        // LLB is the above article is implemented here.
-        dm_fluct_t = spin_[i] ^ hFluct_t[i];  // cross product mxhFluct_t
-        dm_fluct_t *= -cell_gamma;
-        scratch_t += dm_fluct_t;  // -|gamma|*mx(H+hFluct_t)
-      }
-      scratch_t ^= spin_[i];
-      // -|gamma|((mx(H+hFluct_t))xm) = |gamma|(mx(mx(H+hFluct_t)))
-      scratch_t *= -cell_alpha_t*cell_m_inverse; // -|alpha*gamma|(mx(mx(H+hFluct_t)))
-      dm_dt_t_[i] += scratch_t;
-
-      // Longitudinal terms
-      OC_REAL8m temp = spin_[i]*total_field_[i];
-      ThreeVector tempfield;
-      //if(temperature[i] < Tc[i]) {
-      if(temperature[i] != 0.0) {
-        //temp += 0.5/chi_l[i]
-        //  *(1-cell_msq/(m_e[i]*m_e[i]));
-
-        OC_REAL8m beta = 1.0/(KBoltzmann*temperature[i]);
-        OC_REAL8m A = beta*fabs(J[i]);
-        OC_REAL8m B = Langevin(A*cell_m);
-        OC_REAL8m dB = LangevinDeriv(A*cell_m);
-        if( temperature[i]<Tc[i] || 1-B/cell_m>0 ) {
-          // This condition prevents unstable bursts of spin polarizations
-          // when m ~ 0.
-          tempfield -= (1-B/cell_m)/(MU0*mu[i]*beta*dB)*spin_[i];
-          temp = spin_[i]*tempfield;
-          temp *= cell_gamma*cell_alpha_l*cell_m_inverse;
-
-          scratch_l = temp*spin_[i];
-          dm_dt_l_[i] += scratch_l;
-        }
-      } /*else {
-        temp += -1.0/chi_l[i]
-          *(1+0.6*(Tc[i]/(temperature[i]-Tc[i]))*cell_msq);
-        temp *= cell_gamma*cell_alpha_l*cell_m_inverse;
-        scratch_l = temp*spin_[i];
-        dm_dt_l_[i] += scratch_l;
-      }*/
-
-      // Check for overshooting
-      scratch_l = dm_dt_l_[i]*fixed_timestep;
-      scratch_l += spin_[i];
-      if( scratch_l*spin_[i]<0.0 ) {
-        dm_dt_l_[i] = -1*spin_[i];
-        dm_dt_l_[i].x /= fixed_timestep;
-        dm_dt_l_[i].y /= fixed_timestep;
-        dm_dt_l_[i].z /= fixed_timestep;
+void YY_LLBEulerEvolve::dm_dt_TransverseCell(
+    const Oxs_SimState& state_,
+    const Oxs_MeshValue<ThreeVector>& mxH_,
+    Oxs_MeshValue<ThreeVector>& dm_dt_t_,
+    OC_INDEX i) const
+{
+  const ThreeVector& m = state_.spin[i];
+  const OC_REAL8m cell_gamma = gamma[i];
+  const OC_REAL8m cell_m_inverse = (*(state_.Ms0))[i]
+    *(*(state_.Ms_inverse))[i];
+
+  // deterministic part
+  ThreeVector scratch_t = mxH_[i];
+  scratch_t *= -cell_gamma; // -|gamma|*(mxH)
+  ThreeVector dm_t = (do_precess ? 1.0 : 0.0)*scratch_t;
+
+  // Transverse damping term
+  if(use_stochastic) {
+    // Note: The stochastic field is NOT included in the first term of 
+    // the LLB equation. See PRB 85, 014433 (2012). The second form of 
+    // LLB is the above article is implemented here.
+    ThreeVector dm_fluct_t = m ^ hFluct_t[i];  // cross product mxhFluct_t
+    dm_fluct_t *= -cell_gamma;
+    scratch_t += dm_fluct_t;  // -|gamma|*mx(H+hFluct_t)
+  }
+  scratch_t ^= m;
+  // -|gamma|((mx(H+hFluct_t))xm) = |gamma|(mx(mx(H+hFluct_t)))
+  scratch_t *= -alpha_t[i]*cell_m_inverse; // -|alpha*gamma|(mx(mx(H+hFluct_t)))
+  dm_t += scratch_t;
+  dm_dt_t_[i] = dm_t;
+}
+
+void YY_LLBEulerEvolve::dm_dt_LongitudinalCell(
+    const Oxs_SimState& state_,
+    Oxs_MeshValue<ThreeVector>& dm_dt_t_,
+    Oxs_MeshValue<ThreeVector>& dm_dt_l_,
+    OC_INDEX i) const
+{
+  const ThreeVector& m = state_.spin[i];
+  const OC_REAL8m cell_m = (*(state_.Ms))[i]*(*(state_.Ms0_inverse))[i];
+  const OC_REAL8m cell_m_inverse = (*(state_.Ms0))[i]
+    *(*(state_.Ms_inverse))[i];
+
+  // Only the component along m of the longitudinal field enters, so
+  // carry it as a scalar.
+  OC_REAL8m dm_l = 0.0;
+  if(temperature[i] != 0.0) {
+    OC_REAL8m beta = 1.0/(KBoltzmann*temperature[i]);
+    OC_REAL8m A = beta*fabs(J[i]);
+    OC_REAL8m B, dB;
+    LangevinPair(A*cell_m,B,dB);
+    if( temperature[i]<Tc[i] || 1-B*cell_m_inverse>0 ) {
+      // This condition prevents unstable bursts of spin polarizations
+      // when m ~ 0.
+      dm_l = -(1-B*cell_m_inverse)/(MU0*mu[i]*beta*dB);
+      dm_l *= gamma[i]*alpha_l[i]*cell_m_inverse;
+    }
+  }
+
+  // Check for overshooting
+  if( 1.0 + dm_l*fixed_timestep < 0.0 ) {
+    dm_l = -1.0/fixed_timestep;
+  }
+  ThreeVector dm_lvec = dm_l*m;
+
+  if(use_stochastic) {
+    // Longitudinal stochastic field parallel to spin
+    ThreeVector fluct_l = hFluct_l[i]*cell_m_inverse;
+    dm_lvec += fluct_l;
+    dm_dt_t_[i] += fluct_l;
+  }
+  dm_dt_l_[i] = dm_lvec;
+}
+
+void YY_LLBEulerEvolve::dm_dt_Cell(
+    const Oxs_SimState& state_,
+    const Oxs_MeshValue<ThreeVector>& mxH_,
+    Oxs_MeshValue<ThreeVector>& dm_dt_t_,
+    Oxs_MeshValue<ThreeVector>& dm_dt_l_,
+    OC_INDEX i) const
+{
+  if((*(state_.Ms))[i]==0) {
+    dm_dt_t_[i].Set(0.0,0.0,0.0);
+    dm_dt_l_[i].Set(0.0,0.0,0.0);
+    return;
+  }
+  dm_dt_TransverseCell(state_,mxH_,dm_dt_t_,i);
+  dm_dt_LongitudinalCell(state_,dm_dt_t_,dm_dt_l_,i);
+}
+
+void YY_LLBEulerEvolve::Calculate_dm_dt_Chunk(
+    const Oxs_SimState& state_,
+    const Oxs_MeshValue<ThreeVector>& mxH_,
+    const Oxs_MeshValue<ThreeVector>& /* total_field_ */,
+    Oxs_MeshValue<ThreeVector>& dm_dt_t_,
+    Oxs_MeshValue<ThreeVector>& dm_dt_l_,
+    const vector<OC_INDEX>* fixed_spins_,
+    OC_INDEX node_start,OC_INDEX node_stop,
+    DmDtStats& stats_) const
+{
+  const Oxs_Mesh* mesh_ = state_.mesh;
+  const Oxs_MeshValue<OC_REAL8m>& Ms_ = *(state_.Ms);
+  OC_INDEX i = node_start;
+
+#if OC_USE_SSE
+  // The transverse terms run on cell pairs, one Oc_Duet lane per cell,
+  // with the same operations in the same order as the scalar form.  A
+  // pair with an Ms==0 cell goes through the scalar form.  The
+  // longitudinal terms need L(x) per cell and stay scalar.
+  const void* const ptrs[] = {
+    &(state_.spin[0]), &(mxH_[0]), &(dm_dt_t_[0]),
+    &(gamma[0]), &(alpha_t[0]),
+    &((*(state_.Ms0))[0]), &((*(state_.Ms_inverse))[0]),
+    (use_stochastic ? &(hFluct_t[0]) : 0)
+  };
+  if(node_stop-node_start>1
+     && YY_LLBPairAligned(ptrs,sizeof(ptrs)/sizeof(ptrs[0]))) {
+    const Oxs_MeshValue<OC_REAL8m>& Ms0_ = *(state_.Ms0);
+    const Oxs_MeshValue<OC_REAL8m>& Ms_inverse_ = *(state_.Ms_inverse);
+    if(i%2 != 0) {
+      dm_dt_Cell(state_,mxH_,dm_dt_t_,dm_dt_l_,i);
+      ++i;
+    }
+    const Oc_Duet zero(0.0);
+    const Oc_Duet precess(do_precess ? 1.0 : 0.0);
+    for(;i+1<node_stop;i+=2) {
+      if(Ms_[i]==0 || Ms_[i+1]==0) {
+        dm_dt_Cell(state_,mxH_,dm_dt_t_,dm_dt_l_,i);
+        dm_dt_Cell(state_,mxH_,dm_dt_t_,dm_dt_l_,i+1);
+        continue;
       }
+      Oc_Duet mx,my,mz;
+      Oxs_ThreeVectorPairLoadAligned(&(state_.spin[i]),mx,my,mz);
+      Oc_Duet g;  g.LoadAligned(gamma[i]);
+      const Oc_Duet mg = zero - g;
+
+      // deterministic part, -|gamma|*(mxH)
+      Oc_Duet sx,sy,sz;
+      Oxs_ThreeVectorPairLoadAligned(&(mxH_[i]),sx,sy,sz);
+      sx *= mg;  sy *= mg;  sz *= mg;
+      Oc_Duet dx = precess*sx;
+      Oc_Duet dy = precess*sy;
+      Oc_Duet dz = precess*sz;
 
+      // Transverse damping term
       if(use_stochastic) {
-        // Longitudinal stochastic field parallel to spin
-        dm_dt_l_[i] += hFluct_l[i]*cell_m_inverse;
-        dm_dt_t_[i] += hFluct_l[i]*cell_m_inverse;
+        Oc_Duet hx,hy,hz;
+        Oxs_ThreeVectorPairLoadAligned(&(hFluct_t[i]),hx,hy,hz);
+        sx += (my*hz - mz*hy)*mg;
+        sy += (mz*hx - mx*hz)*mg;
+        sz += (mx*hy - my*hx)*mg;
       }
+      Oc_Duet Ms0;  Ms0.LoadAligned(Ms0_[i]);
+      Oc_Duet Msi;  Msi.LoadAligned(Ms_inverse_[i]);
+      Oc_Duet a;    a.LoadAligned(alpha_t[i]);
+      const Oc_Duet damp = (zero - a)*(Ms0*Msi);
+      dx += (sy*mz - sz*my)*damp;
+      dy += (sz*mx - sx*mz)*damp;
+      dz += (sx*my - sy*mx)*damp;
+      Oxs_ThreeVectorPairStoreAligned(dx,dy,dz,&(dm_dt_t_[i]));
+
+      dm_dt_LongitudinalCell(state_,dm_dt_t_,dm_dt_l_,i);
+      dm_dt_LongitudinalCell(state_,dm_dt_t_,dm_dt_l_,i+1);
     }
   }
-
-  // now hFluct_t is definetely calculated for this iteration
-  iteration_Tcalculated = iteration_now;
-
-  // Zero dm_dt at fixed spin sites
-  UpdateFixedSpinList(mesh_);
-  const OC_INDEX fixed_count = GetFixedSpinCount();
-  for(OC_INDEX j=0;j<fixed_count;j++) {
-    dm_dt_t_[GetFixedSpin(j)].Set(0.,0.,0.);
+#endif // OC_USE_SSE
+
+  for(;i<node_stop;i++) dm_dt_Cell(state_,mxH_,dm_dt_t_,dm_dt_l_,i);
+
+  // Zero dm_dt at fixed spin sites.  The list is sorted, so jump
+  // straight to the first entry inside this range.
+  if(fixed_spins_ != NULL) {
+    vector<OC_INDEX>::const_iterator fit
+      = lower_bound(fixed_spins_->begin(),fixed_spins_->end(),node_start);
+    while(fit != fixed_spins_->end() && *fit < node_stop) {
+      dm_dt_t_[*fit].Set(0.,0.,0.);
+      ++fit;
+    }
   }
 
   // Collect statistics
-  OC_REAL8m max_dm_dt_sq=0.0;
-  OC_REAL8m dE_dt_sum=0.0;
-  OC_INDEX max_index=0;
-  for(i=0;i<size;i++) {
+  YY_2LatBlockSum dE_dt_sum;
+  for(i=node_start;i<node_stop;i++) {
     ThreeVector tempvec = dm_dt_t_[i];
     tempvec += dm_dt_l_[i];
     OC_REAL8m dm_dt_sq = tempvec.MagSq();
     if(dm_dt_sq>0.0) {
       dE_dt_sum += -1*MU0*fabs(gamma[i]*alpha_t[i])
         *mxH_[i].MagSq() * Ms_[i] * mesh_->Volume(i);
-      if(dm_dt_sq>max_dm_dt_sq) {
-        max_dm_dt_sq=dm_dt_sq;
-        max_index = i;
+      if(dm_dt_sq>stats_.max_dm_dt_sq) {
+        stats_.max_dm_dt_sq=dm_dt_sq;
+        stats_.max_index = i;
       }
     }
   }
+  stats_.dE_dt_sum += dE_dt_sum.GetValue();
+}
 
-  max_dm_dt_ = sqrt(max_dm_dt_sq);
-  dE_dt_ = dE_dt_sum; // Transverse terms
+void YY_LLBEulerEvolve::Finish_dm_dt(
+    const Oxs_SimState& state_,
+    const Oxs_MeshValue<ThreeVector>& dm_dt_t_,
+    OC_REAL8m pE_pt_,
+    const DmDtStats& stats_,
+    OC_REAL8m& max_dm_dt_,
+    OC_REAL8m& dE_dt_,
+    OC_REAL8m& min_timestep_) const
+{
+  const Oxs_MeshValue<ThreeVector>& spin_ = state_.spin;
+  const OC_INDEX max_index = stats_.max_index;
+
+  max_dm_dt_ = sqrt(stats_.max_dm_dt_sq);
+  dE_dt_ = stats_.dE_dt_sum; // Transverse terms
   dE_dt_ += pE_pt_;
   // TODO: What about the longitudinal terms?
   /// The first term is (partial E/partial M)*dM/dt, the
@@ -549,8 +700,215 @@ void YY_LLBEulerEvolve::Calculate_dm_dt(
   min_timestep_ = min_ratio * OC_REAL8_EPSILON;
   }
   else {min_timestep_ = fixed_timestep;}
+}
 
-  return;
+void YY_LLBEulerEvolve::AdvanceMsCell(
+    const Oxs_SimState& cstate_,
+    Oxs_SimState& workstate_,
+    OC_INDEX i,
+    OC_REAL8m lmagsq,OC_REAL8m ldot) const
+{
+  const Oxs_MeshValue<OC_REAL8m>& Ms0 = *(cstate_.Ms0);
+  Oxs_MeshValue<OC_REAL8m>& wMs = *(workstate_.Ms);
+  Oxs_MeshValue<OC_REAL8m>& wMs_inverse = *(workstate_.Ms_inverse);
+
+  // Update Ms in the next state.
+  // Both of wMs and wMs_inverse should be updated at the same time.
+  OC_REAL8m Ms_new = sqrt(lmagsq)*(*(cstate_.Ms))[i];
+  if(ldot<0.0) {
+    // If spin overshoots to the opposite direction with stochastic kick,
+    // keep Ms positive and flip spin direction.
+    workstate_.spin[i] *= -1;
+  }
+  if(Ms_new > Ms0[i]) {
+    // Ms cannot be >Ms0.
+    Ms_new = Ms0[i];
+  }
+  wMs[i] = Ms_new;
+  if(Ms_new != 0.0) {
+    wMs_inverse[i] = 1.0/Ms_new;
+  } else {
+    wMs_inverse[i] = 0.0;
+  }
+}
+
+void YY_LLBEulerEvolve::AdvanceCell(
+    const Oxs_SimState& cstate_,
+    const Oxs_MeshValue<ThreeVector>& dm_dt_t_,
+    const Oxs_MeshValue<ThreeVector>& dm_dt_l_,
+    OC_REAL8m stepsize_,
+    Oxs_SimState& workstate_,
+    OC_INDEX i) const
+{
+  const ThreeVector& m0 = cstate_.spin[i];
+
+  // Transverse movement
+  ThreeVector tempspin = dm_dt_t_[i];
+  tempspin *= stepsize_;
+
+  // For improved accuracy, adjust step vector so that
+  // to first order m0 + adjusted_step = v/|v| where
+  // v = m0 + step.
+  OC_REAL8m adj = 0.5 * tempspin.MagSq();
+  tempspin -= adj*m0;
+  tempspin *= 1.0/(1.0+adj);
+  tempspin += m0;
+  tempspin.MakeUnit();
+  workstate_.spin[i] = tempspin;
+
+  // Longitudinal movement
+  tempspin = dm_dt_l_[i]*stepsize_;
+  tempspin += m0;
+  AdvanceMsCell(cstate_,workstate_,i,tempspin.MagSq(),tempspin*m0);
+}
+
+void YY_LLBEulerEvolve::AdvanceChunk(
+    const Oxs_SimState& cstate_,
+    const Oxs_MeshValue<ThreeVector>& dm_dt_t_,
+    const Oxs_MeshValue<ThreeVector>& dm_dt_l_,
+    OC_REAL8m stepsize_,
+    Oxs_SimState& workstate_,
+    OC_INDEX node_start,OC_INDEX node_stop) const
+{
+  OC_INDEX i = node_start;
+
+#if OC_USE_SSE
+  // Spin moves run on cell pairs, one Oc_Duet lane per cell.  The Ms
+  // update has per-cell branches and stays scalar.
+  const void* const ptrs[] = {
+    &(cstate_.spin[0]), &(workstate_.spin[0]),
+    &(dm_dt_t_[0]), &(dm_dt_l_[0])
+  };
+  if(node_stop-node_start>1
+     && YY_LLBPairAligned(ptrs,sizeof(ptrs)/sizeof(ptrs[0]))) {
+    if(i%2 != 0) {
+      AdvanceCell(cstate_,dm_dt_t_,dm_dt_l_,stepsize_,workstate_,i);
+      ++i;
+    }
+    const Oc_Duet step(stepsize_);
+    const Oc_Duet half(0.5);
+    const Oc_Duet one(1.0);
+    for(;i+1<node_stop;i+=2) {
+      Oc_Duet m0x,m0y,m0z;
+      Oxs_ThreeVectorPairLoadAligned(&(cstate_.spin[i]),m0x,m0y,m0z);
+
+      // Transverse movement, with the first order normalization
+      // adjustment as in AdvanceCell
+      Oc_Duet tx,ty,tz;
+      Oxs_ThreeVectorPairLoadAligned(&(dm_dt_t_[i]),tx,ty,tz);
+      tx *= step;  ty *= step;  tz *= step;
+      const Oc_Duet adj = half*(tx*tx + ty*ty + tz*tz);
+      const Oc_Duet adjscale = one/(one+adj);
+      tx = (tx - adj*m0x)*adjscale + m0x;
+      ty = (ty - adj*m0y)*adjscale + m0y;
+      tz = (tz - adj*m0z)*adjscale + m0z;
+      const Oc_Duet invmag = one/Oc_Sqrt(tx*tx + ty*ty + tz*tz);
+      tx *= invmag;  ty *= invmag;  tz *= invmag;
+      Oxs_ThreeVectorPairStoreAligned(tx,ty,tz,&(workstate_.spin[i]));
+
+      // Longitudinal movement
+      Oc_Duet lx,ly,lz;
+      Oxs_ThreeVectorPairLoadAligned(&(dm_dt_l_[i]),lx,ly,lz);
+      lx = lx*step + m0x;
+      ly = ly*step + m0y;
+      lz = lz*step + m0z;
+      const Oc_Duet lmagsq = lx*lx + ly*ly + lz*lz;
+      const Oc_Duet ldot = lx*m0x + ly*m0y + lz*m0z;
+      AdvanceMsCell(cstate_,workstate_,i,lmagsq.GetA(),ldot.GetA());
+      AdvanceMsCell(cstate_,workstate_,i+1,lmagsq.GetB(),ldot.GetB());
+    }
+  }
+#endif // OC_USE_SSE
+
+  for(;i<node_stop;++i) {
+    AdvanceCell(cstate_,dm_dt_t_,dm_dt_l_,stepsize_,workstate_,i);
+  }
+}
+
+// Thread object for the per-cell sweeps.  Each thread works on its own
+// strip of the mesh value arrays, as laid out by Oxs_StripedArray, so
+// it touches only memory local to that thread.
+class _YY_LLBEulerThread : public Oxs_ThreadRunObj {
+public:
+  enum { INVALID, DM_DT, ADVANCE } task;
+  YY_LLBEulerEvolve* evolver;
+
+  // DM_DT imports/exports
+  const Oxs_SimState* state;
+  const Oxs_MeshValue<ThreeVector>* mxH;
+  const Oxs_MeshValue<ThreeVector>* total_field;
+  Oxs_MeshValue<ThreeVector>* dm_dt_t;
+  Oxs_MeshValue<ThreeVector>* dm_dt_l;
+  const vector<OC_INDEX>* fixed_spins;
+  OC_BOOL fill_noise;
+  OC_UINT4m noise_key;
+  vector<YY_LLBEulerEvolve::DmDtStats>* stats; // One per thread
+
+  // ADVANCE imports/exports (also uses state, dm_dt_t, dm_dt_l)
+  Oxs_SimState* workstate;
+  OC_REAL8m stepsize;
+
+  _YY_LLBEulerThread()
+    : task(INVALID), evolver(0), state(0), mxH(0), total_field(0),
+      dm_dt_t(0), dm_dt_l(0), fixed_spins(0), fill_noise(0),
+      noise_key(0), stats(0), workstate(0), stepsize(0.) {}
+
+  void Cmd(int threadnumber, void* /* data */) {
+    OC_INDEX istart,istop;
+    state->spin.GetArrayBlock()->GetStripPosition(threadnumber,
+                                                  istart,istop);
+    if(task == DM_DT) {
+      if(fill_noise) evolver->FillHFluctChunk(*state,noise_key,istart,istop);
+      evolver->Calculate_dm_dt_Chunk(*state,*mxH,*total_field,
+                                     *dm_dt_t,*dm_dt_l,fixed_spins,
+                                     istart,istop,(*stats)[threadnumber]);
+    } else if(task == ADVANCE) {
+      evolver->AdvanceChunk(*state,*dm_dt_t,*dm_dt_l,stepsize,
+                            *workstate,istart,istop);
+    }
+  }
+};
+
+void YY_LLBEulerEvolve::Calculate_dm_dt(
+    const Oxs_SimState& state_,
+    const Oxs_MeshValue<ThreeVector>& mxH_,
+    const Oxs_MeshValue<ThreeVector>& total_field_,
+    OC_REAL8m pE_pt_,
+    Oxs_MeshValue<ThreeVector>& dm_dt_t_,
+    Oxs_MeshValue<ThreeVector>& dm_dt_l_,
+    OC_REAL8m& max_dm_dt_,
+    OC_REAL8m& dE_dt_,
+    OC_REAL8m& min_timestep_)
+{
+  // Imports: state_, mxH_, pE_pt
+  // Exports: dm_dt_t_, dm_dt_l_, max_dm_dt_, dE_dt_
+  const int thread_count = Oc_GetMaxThreadCount();
+  vector<DmDtStats> stats(thread_count);
+
+  static Oxs_ThreadTree threadtree;
+  vector<_YY_LLBEulerThread> dm_dt_thread(thread_count);
+  dm_dt_thread[0].task = _YY_LLBEulerThread::DM_DT;
+  dm_dt_thread[0].evolver = this;
+  dm_dt_thread[0].state = &state_;
+  dm_dt_thread[0].mxH = &mxH_;
+  dm_dt_thread[0].total_field = &total_field_;
+  dm_dt_thread[0].dm_dt_t = &dm_dt_t_;
+  dm_dt_thread[0].dm_dt_l = &dm_dt_l_;
+  dm_dt_thread[0].stats = &stats;
+  dm_dt_thread[0].fill_noise
+    = Prepare_dm_dt(state_,dm_dt_t_,dm_dt_l_,dm_dt_thread[0].noise_key);
+  dm_dt_thread[0].fixed_spins = GetFixedSpinList();
+  for(int ithread=1;ithread<thread_count;++ithread) {
+    dm_dt_thread[ithread] = dm_dt_thread[0];
+    threadtree.Launch(dm_dt_thread[ithread],0);
+  }
+  threadtree.LaunchRoot(dm_dt_thread[0],0);
+
+  for(int ithread=1;ithread<thread_count;++ithread) {
+    stats[0].Merge(stats[ithread]);
+  }
+  Finish_dm_dt(state_,dm_dt_t_,pE_pt_,stats[0],
+               max_dm_dt_,dE_dt_,min_timestep_);
 } // end Calculate_dm_dt
 
 OC_BOOL
@@ -576,10 +934,7 @@ YY_LLBEulerEvolve::Step(const Oxs_TimeDriver* driver,
     workstate.Ms = Ms_ptr_A;
     workstate.Ms_inverse = Ms_inverse_ptr_A;
   }
-  for(OC_INDEX i=0; i<cstate.mesh->Size(); i++) {
-    (*workstate.Ms)[i] = (*cstate.Ms)[i];
-    (*workstate.Ms_inverse)[i] = (*cstate.Ms_inverse)[i];
-  }
+  // The contents of *workstate.Ms are filled by AdvanceChunk below.
 
   if(cstate.mesh->Id() != workstate.mesh->Id()) {
     throw Oxs_Ext::Error(this,
@@ -686,46 +1041,24 @@ YY_LLBEulerEvolve::Step(const Oxs_TimeDriver* driver,
   // Put new spin configuration in next_state
   workstate.spin.AdjustSize(workstate.mesh); // Safety
   size = workstate.spin.Size();
-  Oxs_MeshValue<OC_REAL8m>& wMs = *(workstate.Ms);
-  Oxs_MeshValue<OC_REAL8m>& wMs_inverse = *(workstate.Ms_inverse);
-  ThreeVector tempspin;
-  for(i=0;i<size;++i) {
-    // Transverse movement
-    tempspin = dm_dt_t[i];
-    tempspin *= stepsize;
-
-    // For improved accuracy, adjust step vector so that
-    // to first order m0 + adjusted_step = v/|v| where
-    // v = m0 + step.
-    OC_REAL8m adj = 0.5 * tempspin.MagSq();
-    tempspin -= adj*cstate.spin[i];
-    tempspin *= 1.0/(1.0+adj);
-    tempspin += cstate.spin[i];
-    tempspin.MakeUnit();
-    workstate.spin[i] = tempspin;
-
-    // Longitudinal movement
-    tempspin = dm_dt_l[i]*stepsize;
-    tempspin += cstate.spin[i];
-
-    // Update Ms in the next state.
-    // Both of wMs and wMs_inverse should be updated at the same time.
-    OC_REAL8m Ms_temp = wMs[i];
-    wMs[i] = sqrt(tempspin.MagSq())*Ms_temp;
-    if(tempspin*cstate.spin[i]<0.0) {  // Dot product
-      // If spin overshoots to the opposite direction with stochastic kick,
-      // keep Ms positive and flip spin direction.
-      workstate.spin[i] *= -1;
-    }
-    if(wMs[i] > (*cstate.Ms0)[i]) {
-      // Ms cannot be >Ms0.
-      wMs[i] = (*cstate.Ms0)[i];
-    }
-    if(wMs[i] != 0.0) {
-      wMs_inverse[i] = 1.0/wMs[i];
-    } else {
-      wMs_inverse[i] = 0.0;
+  {
+    const int thread_count = Oc_GetMaxThreadCount();
+    static Oxs_ThreadTree threadtree;
+    vector<_YY_LLBEulerThread> advance_thread(thread_count);
+    advance_thread[0].task = _YY_LLBEulerThread::ADVANCE;
+    advance_thread[0].evolver = this;
+    advance_thread[0].state = &cstate;
+    advance_thread[0].dm_dt_t
+      = const_cast<Oxs_MeshValue<ThreeVector>*>(&dm_dt_t);
+    advance_thread[0].dm_dt_l
+      = const_cast<Oxs_MeshValue<ThreeVector>*>(&dm_dt_l);
+    advance_thread[0].workstate = &workstate;
+    advance_thread[0].stepsize = stepsize;
+    for(int ithread=1;ithread<thread_count;++ithread) {
+      advance_thread[ithread] = advance_thread[0];
+      threadtree.Launch(advance_thread[ithread],0);
     }
+    threadtree.LaunchRoot(advance_thread[0],0);
   }
   const Oxs_SimState& nstate
     = next_state.GetReadReference();  // Release write lock
@@ -739,17 +1072,19 @@ YY_LLBEulerEvolve::Step(const Oxs_TimeDriver* driver,
   mxH_output.cache.state_id=nstate.Id();
   const Oxs_MeshValue<ThreeVector>& mxH = mxH_output.cache.value;
 
-  OC_REAL8m dE=0.0;
+  YY_2LatBlockSum dE_sum;
+  YY_2LatBlockSum total_E_sum;
   OC_REAL8m var_dE=0.0;
-  OC_REAL8m total_E=0.0;
   for(i=0;i<size;++i) {
     OC_REAL8m vol = nstate.mesh->Volume(i);
     OC_REAL8m e = energy[i];
-    total_E += e * vol;
+    total_E_sum += e * vol;
     OC_REAL8m new_e = new_energy[i];
-    dE += (new_e - e) * vol;
-    var_dE += (new_e*new_e + e*e)*vol*vol;
+    dE_sum += (new_e - e) * vol;
+    var_dE += (new_e*new_e + e*e)*vol*vol; // Only an error scale
   }
+  const OC_REAL8m dE = dE_sum.GetValue();
+  const OC_REAL8m total_E = total_E_sum.GetValue();
   var_dE *= 256*OC_REAL8_EPSILON*OC_REAL8_EPSILON/3.; // Variance, assuming
   /// error in each energy[i] term is independent, uniformly
   /// distributed, 0-mean, with range +/- 16*OC_REAL8_EPSILON*energy[i].
@@ -926,7 +1261,17 @@ void YY_LLBEulerEvolve::Update_m_e_chi_l(OC_REAL8m tol_in = 1e-4) const
 {
   // Solve for the equilibrium spin polarization m_e using the Newton's
   // method. Returns 0 when A <= 0 or A >= 1/3.
+  //   f(x) = L(x) - A*x is concave for x>0, so Newton iterates started
+  // at or to the right of the nonzero root decrease monotonically onto
+  // it.  The previous m_e (from the last temperature update) is used
+  // as the starting point when it lies on that side, which typically
+  // cuts the solve to a couple of iterations; otherwise start from
+  // x = 1/A, which is always to the right of the root.  The number of
+  // iterations is capped at m_e_newton_limit; by monotonicity the last
+  // iterate is then still a usable (slight over-)estimate of m_e.
   const OC_REAL8m size = J.Size();
+  const OC_REAL8m tol = fabs(tol_in);
+  OC_INDEX unconverged_count = 0;
 
   for(OC_INDEX i=0; i<size; i++) {
     OC_REAL8m A = kB_T[i]/J[i];
@@ -935,24 +1280,46 @@ void YY_LLBEulerEvolve::Update_m_e_chi_l(OC_REAL8m tol_in = 1e-4) const
       chi_l[i] = MU0*mu[i]/J[i];
     } else {
       // Solve for equilibrium spin polarization m_e using Newton's method
-      const OC_REAL8m tol = fabs(tol_in);
       OC_REAL8m x = 1.0/A;
-      OC_REAL8m y = Langevin(x)-A*x;
-      OC_REAL8m dy = LangevinDeriv(x)-A;
-      while(fabs(y)>tol) {
+      OC_REAL8m L, dL;
+      if(m_e[i]>0.0 && m_e[i]<1.0) {
+        OC_REAL8m xw = m_e[i]/A;
+        LangevinPair(xw,L,dL);
+        if(L-A*xw <= 0.0) x = xw;  // Warm start is right of the root
+      }
+      LangevinPair(x,L,dL);
+      OC_REAL8m y = L-A*x;
+      OC_REAL8m dy = dL-A;
+      OC_INT4m count = 0;
+      while(fabs(y)>tol && dy<0.0 && count<m_e_newton_limit) {
         x -= y/dy;
-        y = Langevin(x)-A*x;
-        dy = LangevinDeriv(x)-A;
+        LangevinPair(x,L,dL);
+        y = L-A*x;
+        dy = dL-A;
+        ++count;
       }
+      if(fabs(y)>tol) ++unconverged_count;
       m_e[i] = A*x;
 
       // Calculate longitudinal susceptibility chi_l
-      OC_REAL8m dL = LangevinDeriv(J[i]*m_e[i]/(kB_T[i]));
+      OC_REAL8m dLe = LangevinDeriv(J[i]*m_e[i]/(kB_T[i]));
       OC_REAL8m beta = 1/(kB_T[i]);
 
-      chi_l[i] = MU0*mu[i]*beta*dL/(1-beta*J[i]*dL);
+      chi_l[i] = MU0*mu[i]*beta*dLe/(1-beta*J[i]*dLe);
     }
   }
+
+  if(unconverged_count>0) {
+    static Oxs_WarningMessage nonconvergence(3);
+    char buf[1024];
+    Oc_Snprintf(buf,sizeof(buf),
+                "Equilibrium magnetization m_e did not converge to"
+                " tolerance %g in %d Newton iterations in %ld cells.",
+                static_cast<double>(tol),
+                static_cast<int>(m_e_newton_limit),
+                static_cast<long>(unconverged_count));
+    nonconvergence.Send(revision_info,OC_STRINGIFY(__LINE__),buf);
+  }
 }
 
 OC_REAL8m YY_LLBEulerEvolve::Langevin(OC_REAL8m x) const
@@ -971,6 +1338,28 @@ OC_REAL8m YY_LLBEulerEvolve::LangevinDeriv(OC_REAL8m x) const
   return -1.0/(temp*temp)+1.0/(x*x);
 }
 
+void YY_LLBEulerEvolve::LangevinPair(OC_REAL8m x,
+                                     OC_REAL8m& L,OC_REAL8m& dL) const
+{
+  // L(x) = coth(x)-1/x and L'(x) = 1/x^2-(coth(x)^2-1), from a single
+  // exp() evaluation.  Same limits as Langevin and LangevinDeriv.
+  if(fabs(x)<OC_REAL4_EPSILON) {
+    L = Langevin(x);
+    dL = 1./3.;
+    return;
+  }
+  OC_REAL8m temp = exp(2*x)+1;
+  if(!Nb_IsFinite(temp)) { // Large input
+    L = (x>0 ? 1.0 : -1.0);
+    dL = 1.0/(x*x);
+    return;
+  }
+  OC_REAL8m coth = temp/(temp-2);
+  OC_REAL8m x_inverse = 1.0/x;
+  L = coth - x_inverse;
+  dL = x_inverse*x_inverse - (coth*coth-1.0);
+}
+
 void YY_LLBEulerEvolve::UpdateDerivedOutputs(const Oxs_SimState& state)
 { // This routine fills all the YY_LLBEulerEvolve Oxs_ScalarOutput's to
   // the appropriate value based on the import "state", and any of
@@ -1062,31 +1451,6 @@ void YY_LLBEulerEvolve::UpdateDerivedOutputs(const Oxs_SimState& state)
     = state.Id();
 }   // end UpdateDerivedOutputs
 
-OC_REAL8m YY_LLBEulerEvolve::Gaussian_Random(const OC_REAL8m muGaus,
-    const OC_REAL8m sigmaGaus)
-{
-  // Box-Muller algorithm, see W.H. Press' "Numerical recipes" chapter7.2 
-  // for details.
-  OC_REAL8m R, gaus1, FAC;
-
-  if (!gaus2_isset) {
-    R = 1.;
-    while (R >= 1.){
-      gaus1 = 2. * Oc_UnifRand() - 1.;
-      gaus2 = 2. * Oc_UnifRand() - 1.;
-      R  = gaus1*gaus1 + gaus2*gaus2;
-    }
-    gaus2_isset = 1;
-    FAC = sqrt(-2. * log(R) / R);
-    gaus1 = gaus1 * FAC * sigmaGaus + muGaus;
-    gaus2 = gaus2 * FAC * sigmaGaus + muGaus;
-    return gaus1;
-  }
-
-  gaus2_isset = false;
-  return gaus2;
-}
-
 OC_BOOL YY_LLBEulerEvolve::IsSupportedEnergy(const Oxs_Energy* obj) const
 {
   static const OC_UINT4m size = 
@@ -36,6 +36,8 @@
 
 #define DEFAULT_M_E_TOL 1e-4
 
+class _YY_LLBEulerThread; // Helper class for threaded sweeps
+
 class YY_LLBEulerEvolve:public Oxs_TimeEvolver {
 private:
   mutable OC_UINT4m mesh_id;
@@ -95,6 +97,9 @@ private:
   // Langevin function and its derivative
   OC_REAL8m Langevin(OC_REAL8m x) const;
   OC_REAL8m LangevinDeriv(OC_REAL8m x) const;
+  void LangevinPair(OC_REAL8m x,OC_REAL8m& L,OC_REAL8m& dL) const;
+  /// Both of the above from a single exp() evaluation.
+  const OC_INT4m m_e_newton_limit; // Iteration cap for the m_e solve
   void Update_m_e_chi_l(OC_REAL8m tol) const;
   void Update_m_e_chi_l() const {
     return Update_m_e_chi_l(DEFAULT_M_E_TOL);
@@ -143,18 +148,16 @@ private:
   // =======================================================================
   // Random functions and supports (for stochastic field)
   // =======================================================================
-  OC_REAL8m Gaussian_Random(const OC_REAL8m muGaus,
-      const OC_REAL8m  sigmaGaus);
-  OC_BOOL gaus2_isset;    
-  OC_REAL8m gaus2;        
-  // returns a gaussian distributed random number 
-  // with average muGaus und standard deviation sigmaGaus.
-  // The algorithm here computes two values but returns only one at a time.
-  // The second value (and a flag) is stored in gaus2 and is returned 
-  // second time the method is called.
+  // The stochastic field is drawn from a counter-based generator: the
+  // normals for cell i at a given iteration depend only on noise_seed,
+  // the iteration count and i.  So any range of cells can be filled
+  // independently, by any thread, and results do not depend on the
+  // thread count.
+  void FillHFluctChunk(const Oxs_SimState& state_,OC_UINT4m noise_key_,
+                       OC_INDEX node_start,OC_INDEX node_stop);
+  OC_UINT4m noise_seed; // Drawn from Oc_UnifRand() in Init()
 
   // seed to initialize the generator with, can be any integer
-  // (beware: -|n| is used in this method)
   OC_INT4m uniform_seed;  
   OC_BOOL has_uniform_seed;
 
@@ -169,6 +172,93 @@ private:
   Oxs_MeshValue<ThreeVector> hFluct_t;  // transverse
   Oxs_MeshValue<ThreeVector> hFluct_l;  // longitudinal
 
+  // Statistics collected by the dm/dt kernel over a range of cells
+  struct DmDtStats {
+    OC_REAL8m max_dm_dt_sq;
+    OC_REAL8m dE_dt_sum;
+    OC_INDEX max_index;
+    DmDtStats() : max_dm_dt_sq(0.0), dE_dt_sum(0.0), max_index(0) {}
+    void Merge(const DmDtStats& other) {
+      dE_dt_sum += other.dE_dt_sum;
+      if(other.max_dm_dt_sq>max_dm_dt_sq
+         || (other.max_dm_dt_sq==max_dm_dt_sq
+             && other.max_index<max_index)) {
+        max_dm_dt_sq = other.max_dm_dt_sq;
+        max_index = other.max_index;
+      }
+    }
+  };
+
+  OC_BOOL Prepare_dm_dt(const Oxs_SimState& state_,
+                        Oxs_MeshValue<ThreeVector>& dm_dt_t_,
+                        Oxs_MeshValue<ThreeVector>& dm_dt_l_,
+                        OC_UINT4m& noise_key_);
+  /// Sets up parameter arrays on first go and sizes the dm_dt exports.
+  /// Returns true if the stochastic field needs to be refilled for
+  /// this iteration, in which case noise_key_ is set.  Not thread safe.
+
+  void Calculate_dm_dt_Chunk
+  (const Oxs_SimState& state_,
+   const Oxs_MeshValue<ThreeVector>& mxH_,
+   const Oxs_MeshValue<ThreeVector>& total_field_,
+   Oxs_MeshValue<ThreeVector>& dm_dt_t_,
+   Oxs_MeshValue<ThreeVector>& dm_dt_l_,
+   const vector<OC_INDEX>* fixed_spins_,
+   OC_INDEX node_start,OC_INDEX node_stop,
+   DmDtStats& stats_) const;
+  /// LLB right-hand side over [node_start,node_stop).  Safe to call
+  /// concurrently on disjoint ranges.
+
+  void dm_dt_Cell(const Oxs_SimState& state_,
+                  const Oxs_MeshValue<ThreeVector>& mxH_,
+                  Oxs_MeshValue<ThreeVector>& dm_dt_t_,
+                  Oxs_MeshValue<ThreeVector>& dm_dt_l_,
+                  OC_INDEX i) const;
+  void dm_dt_TransverseCell(const Oxs_SimState& state_,
+                            const Oxs_MeshValue<ThreeVector>& mxH_,
+                            Oxs_MeshValue<ThreeVector>& dm_dt_t_,
+                            OC_INDEX i) const;
+  void dm_dt_LongitudinalCell(const Oxs_SimState& state_,
+                              Oxs_MeshValue<ThreeVector>& dm_dt_t_,
+                              Oxs_MeshValue<ThreeVector>& dm_dt_l_,
+                              OC_INDEX i) const;
+  /// Scalar per-cell forms of Calculate_dm_dt_Chunk.  The transverse
+  /// part sets dm_dt_t_[i], and is also done on cell pairs with
+  /// Oc_Duet on SSE builds.  The longitudinal part sets dm_dt_l_[i] and
+  /// adds the longitudinal noise to dm_dt_t_[i].  Both assume Ms!=0.
+
+  void Finish_dm_dt
+  (const Oxs_SimState& state_,
+   const Oxs_MeshValue<ThreeVector>& dm_dt_t_,
+   OC_REAL8m pE_pt_,
+   const DmDtStats& stats_,
+   OC_REAL8m& max_dm_dt_,
+   OC_REAL8m& dE_dt_,
+   OC_REAL8m& min_timestep_) const;
+
+  void AdvanceChunk
+  (const Oxs_SimState& cstate_,
+   const Oxs_MeshValue<ThreeVector>& dm_dt_t_,
+   const Oxs_MeshValue<ThreeVector>& dm_dt_l_,
+   OC_REAL8m stepsize_,
+   Oxs_SimState& workstate_,
+   OC_INDEX node_start,OC_INDEX node_stop) const;
+  /// Euler update of spin and Ms over [node_start,node_stop).
+
+  void AdvanceCell
+  (const Oxs_SimState& cstate_,
+   const Oxs_MeshValue<ThreeVector>& dm_dt_t_,
+   const Oxs_MeshValue<ThreeVector>& dm_dt_l_,
+   OC_REAL8m stepsize_,
+   Oxs_SimState& workstate_,
+   OC_INDEX i) const;
+  void AdvanceMsCell(const Oxs_SimState& cstate_,Oxs_SimState& workstate_,
+                     OC_INDEX i,OC_REAL8m lmagsq,OC_REAL8m ldot) const;
+  /// Scalar per-cell forms of AdvanceChunk.  AdvanceMsCell takes
+  /// |m0+dm_l*dt|^2 and (m0+dm_l*dt).m0 and sets the new Ms.
+
+  friend class _YY_LLBEulerThread;
+
   void Calculate_dm_dt
   (const Oxs_SimState& state_,
    const Oxs_MeshValue<ThreeVector>& mxH_,
@@ -181,6 +271,8 @@ private:
    OC_REAL8m& min_timestep_);
   /// Imports: state_, mxH_, pE_pt
   /// Exports: dm_dt_t_, dm_dt_l_, max_dm_dt_, dE_dt_
+  /// Equivalent to Prepare_dm_dt + Calculate_dm_dt_Chunk over the
+  /// whole mesh + Finish_dm_dt, with the middle part run threaded.
 
   // =======================================================================
   // Outputs
@@ -19,6 +19,7 @@
 #include "rectangularmesh.h"
 #include "energy.h"		// Needed to make MSVC++ 5 happy
 
+#include "yy_2lat_blocksum.h"
 #include "yy_llbexchange6ngbr.h"
 
 OC_USE_STRING;
@@ -286,7 +287,7 @@ void YY_LLBExchange6Ngbr::CalcEnergyA
 
   OC_REAL8m hcoef = -2/MU0;
 
-  Nb_Xpfloat energy_sum = 0;
+  YY_2LatBlockSum energy_sum;
   OC_REAL8m thread_maxdot = maxdot[threadnumber];
   // Note: For maxangle calculation, it suffices to check
   // spin[j]-spin[i] for j>i.
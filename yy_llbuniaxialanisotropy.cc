@@ -21,6 +21,7 @@
 #include "rectangularmesh.h"  // For QUAD-style integration
 #include "energy.h"		// Needed to make MSVC++ 5 happy
 
+#include "yy_2lat_blocksum.h"
 #include "yy_llbuniaxialanisotropy.h"
 
 OC_USE_STRING;
@@ -225,8 +226,8 @@ void YY_LLBUniaxialAnisotropy::RectIntegEnergy
   const Oxs_MeshValue<OC_REAL8m>& Ms_inverse = *(state.Ms_inverse);
   const Oxs_MeshValue<ThreeVector>& spin = state.spin;
 
-  Nb_Xpfloat energy_sum = 0;
-  Nb_Xpfloat pE_pt_sum = 0;
+  YY_2LatBlockSum energy_sum;
+  YY_2LatBlockSum pE_pt_sum;
 
   OC_REAL8m k = uniform_K1_value;
   OC_REAL8m field_mult = uniform_Ha_value;
@@ -1036,7 +1037,7 @@ void YY_LLBUniaxialAnisotropy::ComputeEnergyChunk
   // available if zdim<3.
 
   // Copy from scratch to real buffers.
-  Nb_Xpfloat energy_sum = 0.0;
+  YY_2LatBlockSum energy_sum;
   if(ocedt.energy_accum) {
     for(OC_INDEX i=node_start;i<node_stop;i++) {
       (*ocedt.energy_accum)[i] += energy[i];